@@ -0,0 +1,438 @@
+/*
+ * FLIR One Pro LT Linux Driver - thermal + visible bundles
+ *
+ * Each record is assembled once as an iovec over the frame's own buffers
+ * and handed to every destination from the camera thread: files and
+ * FIFOs take it with one writev, socket clients with one sendmsg, the
+ * shared memory ring with one copy into the next slot. Nothing blocks:
+ * a full pipe or socket drops the record for that reader, and the ring
+ * simply overwrites the oldest slot.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include "bundle.h"
+#include "camera.h"
+#include "handoff.h"
+#include "sink.h"
+
+#define BUNDLE_MAX          4
+#define BUNDLE_CLIENTS      8
+
+/* Pipe and socket buffers to ask for: several records each */
+#define BUNDLE_PIPE_SIZE    (1 << 20)
+#define BUNDLE_SOCK_BUF     (1 << 20)
+
+/* A record that was partly written must be finished to keep the framing */
+#define BUNDLE_FINISH_MS    1000
+
+/* Shared memory: about a second of records; larger ones are dropped */
+#define BUNDLE_RING_SLOTS   8
+#define BUNDLE_SLOT_SIZE    (512 * 1024)
+
+#define BUNDLE_HEAD_SIZE    ((sizeof(struct bundle_header) + BUNDLE_SECTIONS * sizeof(struct bundle_section) + \
+                              BUNDLE_ALIGN - 1) & ~(size_t)(BUNDLE_ALIGN - 1))
+
+#define THERMAL_BYTES       (THERMAL_WIDTH * THERMAL_HEIGHT * 2)
+
+enum bundle_kind { BK_FILE, BK_UNIX, BK_SHM };
+
+struct bundle_out {
+    int kind;
+    char path[272];
+    int fd;                 /* file or FIFO, listening socket, shm object */
+    int pipe_size;          /* > 0 for pipes: records that do not fit are dropped */
+    int clients[BUNDLE_CLIENTS];
+    int nclients;
+    struct bundle_ring *ring;
+    size_t ring_size;
+    struct demand *demand;
+    int demand_id;
+    const char *tag;
+    unsigned long records;
+    unsigned long dropped;
+};
+
+struct bundle_set {
+    char tag[32];
+    int camera;
+    struct bundle_out out[BUNDLE_MAX];
+    int nout;
+};
+
+/* After a live upgrade: the fd, then the socket clients */
+struct bundle_handoff {
+    int32_t pipe_size;
+};
+
+static char specs[BUNDLE_MAX][256];
+static int nspecs = 0;
+
+int bundle_add(const char *spec) {
+    if (!spec[0] || strcmp(spec, "unix:") == 0 || strcmp(spec, "shm:") == 0) {
+        fprintf(stderr, "Invalid bundle %s (PATH, unix:PATH or shm:NAME)\n", spec);
+        return -1;
+    }
+    if (strncmp(spec, "shm:", 4) == 0 && strchr(spec + 4, '/')) {
+        fprintf(stderr, "Invalid bundle %s (no / in a shm name)\n", spec);
+        return -1;
+    }
+    if (nspecs >= BUNDLE_MAX) {
+        fprintf(stderr, "Too many bundles (max %d)\n", BUNDLE_MAX);
+        return -1;
+    }
+    if (strcmp(spec, "-") == 0 && sink_claim_stdout() < 0) return -1;
+    snprintf(specs[nspecs++], sizeof(specs[0]), "%s", spec);
+    return 0;
+}
+
+int bundle_count(void) {
+    return nspecs;
+}
+
+/* -- Destinations ------------------------------------------------------------ */
+
+static int open_unix(struct bundle_out *o, const char *path) {
+    struct sockaddr_un addr = { 0 };
+    struct stat st;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Bundle socket path too long: %s\n", path);
+        return -1;
+    }
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    /* A socket left behind by an earlier run, not any other file */
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+
+    o->fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (o->fd < 0 || bind(o->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(o->fd, BUNDLE_CLIENTS) < 0) {
+        fprintf(stderr, "Cannot listen on bundle socket %s: %s\n", path, strerror(errno));
+        if (o->fd >= 0) close(o->fd);
+        o->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+static int map_ring(struct bundle_out *o) {
+    o->ring_size = BUNDLE_RING_HEADER + (size_t)BUNDLE_RING_SLOTS * BUNDLE_SLOT_SIZE;
+    o->ring = mmap(NULL, o->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, o->fd, 0);
+    if (o->ring == MAP_FAILED) {
+        fprintf(stderr, "Cannot map bundle ring %s: %s\n", o->path, strerror(errno));
+        o->ring = NULL;
+        close(o->fd);
+        o->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+static int open_shm(struct bundle_out *o, const char *name) {
+    char shm_name[260];
+    snprintf(shm_name, sizeof(shm_name), "/%s", name);
+
+    o->fd = shm_open(shm_name, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (o->fd < 0 || ftruncate(o->fd, BUNDLE_RING_HEADER + (size_t)BUNDLE_RING_SLOTS * BUNDLE_SLOT_SIZE) < 0) {
+        fprintf(stderr, "Cannot create bundle ring %s: %s\n", shm_name, strerror(errno));
+        if (o->fd >= 0) close(o->fd);
+        o->fd = -1;
+        return -1;
+    }
+    if (map_ring(o) < 0) return -1;
+    o->ring->slots = BUNDLE_RING_SLOTS;
+    o->ring->slot_size = BUNDLE_SLOT_SIZE;
+    /* The magic last: a reader that sees it sees the geometry */
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(o->ring->magic, BUNDLE_RING_MAGIC, 4);
+    return 0;
+}
+
+/* Take new clients, let go of departed ones. Returns the client count. */
+static int poll_clients(void *arg) {
+    struct bundle_out *o = arg;
+    int fd;
+
+    while ((fd = accept4(o->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        if (o->nclients >= BUNDLE_CLIENTS) {
+            fprintf(stderr, "%sBundle %s: too many clients\n", o->tag, o->path);
+            close(fd);
+            continue;
+        }
+        int size = BUNDLE_SOCK_BUF;
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+        o->clients[o->nclients++] = fd;
+    }
+
+    for (int i = 0; i < o->nclients; i++) {
+        struct pollfd pfd = { o->clients[i], 0, 0 };
+        if (poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLHUP | POLLERR))) {
+            close(o->clients[i]);
+            o->clients[i--] = o->clients[--o->nclients];
+        }
+    }
+    return o->nclients;
+}
+
+/* One record, whole or not at all. Returns 0 written, 1 dropped, -1 the
+ * destination is broken. */
+static int write_file(struct bundle_out *o, struct iovec *iov, int n, size_t total) {
+    /* A pipe holds pages, not bytes, and a write may start a fresh page:
+     * with records of 10 kB and up, half the pipe is enough slack */
+    int r = sink_writev(o->fd, iov, n, total, o->pipe_size / 2, BUNDLE_FINISH_MS);
+    if (r < 0) {
+        fprintf(stderr, "%sBundle %s: %s\n", o->tag, o->path,
+                errno == EPIPE ? "reader closed" : errno == EAGAIN ? "reader stalled mid-record" : strerror(errno));
+    }
+    return r;
+}
+
+/* Each client gets the record or, if its socket is full, loses it */
+static int write_clients(struct bundle_out *o, struct iovec *iov, int n) {
+    struct msghdr msg = { 0 };
+    int sent = 0, dropped = 0;
+
+    msg.msg_iov = iov;
+    msg.msg_iovlen = n;
+    for (int i = 0; i < o->nclients; i++) {
+        if (sendmsg(o->clients[i], &msg, MSG_DONTWAIT | MSG_NOSIGNAL) >= 0) {
+            sent++;
+        } else if (errno == EAGAIN || errno == EMSGSIZE || errno == ENOBUFS) {
+            dropped++;
+        } else {
+            close(o->clients[i]);
+            o->clients[i--] = o->clients[--o->nclients];
+        }
+    }
+    if (o->demand_id >= 0) demand_set(o->demand, o->demand_id, o->nclients);
+    return sent ? 0 : dropped ? 1 : 2;
+}
+
+/* Seqlock per slot: odd while the record is copied in */
+static int write_ring(struct bundle_out *o, const struct iovec *iov, int n, size_t total) {
+    struct bundle_ring *ring = o->ring;
+    if (total > ring->slot_size - BUNDLE_SLOT_HEADER) return 1;
+
+    uint64_t seq = ring->head;
+    uint8_t *slot = (uint8_t *)ring + BUNDLE_RING_HEADER + (seq % ring->slots) * ring->slot_size;
+    uint64_t *word = (uint64_t *)slot;
+
+    __atomic_store_n(word, 2 * seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    uint8_t *p = slot + BUNDLE_SLOT_HEADER;
+    for (int i = 0; i < n; i++) {
+        memcpy(p, iov[i].iov_base, iov[i].iov_len);
+        p += iov[i].iov_len;
+    }
+    __atomic_store_n(word, 2 * seq + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->head, seq + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static void out_close(struct bundle_out *o) {
+    for (int i = 0; i < o->nclients; i++) close(o->clients[i]);
+    o->nclients = 0;
+    if (o->ring) munmap(o->ring, o->ring_size);
+    o->ring = NULL;
+    if (o->kind == BK_FILE) sink_close_path(o->fd);
+    else if (o->fd >= 0) close(o->fd);
+    o->fd = -1;
+}
+
+/* Carry on with what the old driver had open: same socket and clients,
+ * same ring (head and all), same file position */
+static int adopt_out(struct bundle_out *o, struct handoff_extra *x) {
+    struct bundle_handoff h;
+    int fds[1 + BUNDLE_CLIENTS];
+    char name[HANDOFF_NAME_LEN];
+
+    snprintf(name, sizeof(name), "bundle:%s", o->path);
+    int n = x ? handoff_take(x, name, &h, sizeof(h), fds, 1 + BUNDLE_CLIENTS) : -1;
+    if (n < 1) return -1;
+    o->fd = fds[0];
+    o->pipe_size = h.pipe_size;
+    o->nclients = n - 1;
+    memcpy(o->clients, fds + 1, sizeof(int) * o->nclients);
+    return o->kind == BK_SHM ? map_ring(o) : 0;
+}
+
+struct bundle_set *bundle_open(int camera_index, const char *tag, struct demand *d,
+                               struct handoff_extra *adopt) {
+    struct bundle_set *b = calloc(1, sizeof(*b));
+    if (!b) return NULL;
+    snprintf(b->tag, sizeof(b->tag), "%s", tag);
+    b->camera = camera_index;
+
+    for (int i = 0; i < nspecs; i++) {
+        struct bundle_out *o = &b->out[b->nout];
+        const char *spec = specs[i];
+        const char *p = strstr(spec, "{camera}");
+        memset(o, 0, sizeof(*o));
+        if (p) {
+            snprintf(o->path, sizeof(o->path), "%.*s%d%s", (int)(p - spec), spec, camera_index, p + 8);
+        } else if (camera_index == 0) {
+            snprintf(o->path, sizeof(o->path), "%s", spec);
+        } else {
+            continue;
+        }
+
+        o->tag = b->tag;
+        o->fd = -1;
+        o->demand_id = -1;
+        if (strncmp(o->path, "unix:", 5) == 0) o->kind = BK_UNIX;
+        else if (strncmp(o->path, "shm:", 4) == 0) o->kind = BK_SHM;
+        else o->kind = BK_FILE;
+
+        int r = adopt_out(o, adopt);
+        if (r < 0) {
+            if (o->kind == BK_UNIX) r = open_unix(o, o->path + 5);
+            else if (o->kind == BK_SHM) r = open_shm(o, o->path + 4);
+            else r = o->fd = sink_open_path(o->path, BUNDLE_PIPE_SIZE, &o->pipe_size);
+        }
+        if (r < 0) continue;
+
+        /* Socket clients are counted; a file or ring may always have a reader */
+        if (d) {
+            o->demand = d;
+            o->demand_id = o->kind == BK_UNIX ? demand_add_listener(d, o->fd, o->path, poll_clients, o)
+                                              : demand_add(d, o->path, DEMAND_UNKNOWN);
+        }
+        b->nout++;
+        printf("%sBundle %s%s\n", tag, o->path, o->pipe_size > 0 ? " (pipe)" : "");
+    }
+    if (b->nout == 0) {
+        free(b);
+        return NULL;
+    }
+    return b;
+}
+
+/* -------------------------------------------------------------------------- */
+
+static void put_section(struct bundle_section *s, int type, size_t offset, size_t size, int width, int height) {
+    s->type = type;
+    s->offset = offset;
+    s->size = size;
+    s->width = width;
+    s->height = height;
+}
+
+/* Padded to keep the next section aligned */
+static void append(struct iovec *iov, int *n, size_t *pos, const void *data, size_t size) {
+    static const uint8_t zeros[BUNDLE_ALIGN];
+
+    iov[*n].iov_base = (void *)data;
+    iov[(*n)++].iov_len = size;
+    *pos += size;
+    if (*pos % BUNDLE_ALIGN) {
+        size_t pad = BUNDLE_ALIGN - *pos % BUNDLE_ALIGN;
+        iov[*n].iov_base = (void *)zeros;
+        iov[(*n)++].iov_len = pad;
+        *pos += pad;
+    }
+}
+
+void bundle_frame(struct bundle_set *b, const struct bundle_parts *p) {
+    uint8_t head[BUNDLE_HEAD_SIZE] __attribute__((aligned(8))) = { 0 };
+    struct bundle_header *h = (struct bundle_header *)head;
+    struct bundle_section *sec = (struct bundle_section *)(h + 1);
+    struct iovec iov[7];
+    int n = 0;
+    size_t pos = BUNDLE_HEAD_SIZE;
+    size_t jpeg_size = p->jpeg ? p->jpeg_size : 0;
+    size_t status_size = p->status ? p->status_size : 0;
+
+    iov[n].iov_base = head;
+    iov[n++].iov_len = pos;
+    put_section(&sec[0], BUNDLE_THERMAL, pos, p->thermal ? THERMAL_BYTES : 0, THERMAL_WIDTH, THERMAL_HEIGHT);
+    if (p->thermal) append(iov, &n, &pos, p->thermal, THERMAL_BYTES);
+    put_section(&sec[1], BUNDLE_JPEG, pos, jpeg_size, VISIBLE_WIDTH, VISIBLE_HEIGHT);
+    if (jpeg_size) append(iov, &n, &pos, p->jpeg, jpeg_size);
+    put_section(&sec[2], BUNDLE_STATUS, pos, status_size, 0, 0);
+    if (status_size) append(iov, &n, &pos, p->status, status_size);
+
+    memcpy(h->magic, BUNDLE_MAGIC, 4);
+    h->size = pos;
+    h->header_size = sizeof(*h) + BUNDLE_SECTIONS * sizeof(*sec);
+    h->nsections = BUNDLE_SECTIONS;
+    h->camera = b->camera;
+    h->sequence = p->sequence;
+    h->time_ns = p->time_ns;
+    h->quality = p->quality;
+    h->ffc_state = p->ffc_state;
+
+    for (int i = 0; i < b->nout; i++) {
+        struct bundle_out *o = &b->out[i];
+        struct iovec v[7];
+        int r;
+        if (o->fd < 0) continue;
+
+        switch (o->kind) {
+        case BK_UNIX:
+            poll_clients(o);
+            r = write_clients(o, iov, n);
+            break;
+        case BK_SHM:
+            r = write_ring(o, iov, n, pos);
+            break;
+        default:
+            /* writev() advances through its own copy */
+            memcpy(v, iov, n * sizeof(*iov));
+            r = write_file(o, v, n, pos);
+            if (r < 0) {
+                out_close(o);
+                if (o->demand_id >= 0) demand_set(o->demand, o->demand_id, 0);
+            }
+            break;
+        }
+        if (r == 0) o->records++;
+        else if (r == 1) o->dropped++;
+    }
+}
+
+int bundle_hand_off(struct bundle_set *b, struct handoff_extra *x) {
+    for (int i = 0; b && i < b->nout; i++) {
+        struct bundle_out *o = &b->out[i];
+        struct bundle_handoff h = { o->pipe_size };
+        int fds[1 + BUNDLE_CLIENTS];
+        char name[HANDOFF_NAME_LEN];
+        if (o->fd < 0) continue;
+
+        fds[0] = o->fd;
+        memcpy(fds + 1, o->clients, sizeof(int) * o->nclients);
+        snprintf(name, sizeof(name), "bundle:%s", o->path);
+        if (handoff_put(x, name, &h, sizeof(h), fds, 1 + o->nclients) < 0) return -1;
+    }
+    return 0;
+}
+
+void bundle_close(struct bundle_set *b, int remove) {
+    if (!b) return;
+    for (int i = 0; i < b->nout; i++) {
+        struct bundle_out *o = &b->out[i];
+        printf("%sBundle %s: %lu records, %lu dropped\n", b->tag, o->path, o->records, o->dropped);
+        out_close(o);
+        if (!remove) continue;
+        if (o->kind == BK_UNIX) unlink(o->path + 5);
+        if (o->kind == BK_SHM) {
+            char shm_name[260];
+            snprintf(shm_name, sizeof(shm_name), "/%s", o->path + 4);
+            shm_unlink(shm_name);
+        }
+    }
+    free(b);
+}
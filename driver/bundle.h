@@ -0,0 +1,119 @@
+/*
+ * FLIR One Pro LT Linux Driver - thermal + visible bundles
+ *
+ * --bundle DEST emits one record per camera packet holding its metadata,
+ * the raw thermal plane and the visible JPEG together, so a fusion
+ * consumer reads both halves of a packet at once and never has to pair up
+ * two streams that lose frames independently. DEST is one of
+ *
+ *   PATH         a file, FIFO or "-" for stdout: records back to back
+ *   unix:PATH    a SOCK_SEQPACKET socket; every recv() is one record
+ *   shm:NAME     a ring of the latest records in /dev/shm/NAME
+ *
+ * "{camera}" in DEST becomes the camera index; a DEST without it belongs
+ * to camera 0. Records that a reader has no room for are dropped whole.
+ *
+ * A record is a struct bundle_header, a table of nsections struct
+ * bundle_section, then the sections at the offsets the table gives, from
+ * the start of the record. Sections a packet lacks have size 0: thermal
+ * when there was none or --ffc-policy dropped it, likewise the JPEG. All
+ * fields are little-endian.
+ */
+
+#ifndef FLIRONE_BUNDLE_H
+#define FLIRONE_BUNDLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "demand.h"
+
+#define BUNDLE_MAGIC        "FLB1"
+
+/* Section types */
+#define BUNDLE_THERMAL      1   /* width x height gray16 */
+#define BUNDLE_JPEG         2   /* baseline JPEG, through EOI */
+#define BUNDLE_STATUS       3   /* the camera's JSON status block */
+
+#define BUNDLE_SECTIONS     3
+
+/* Sections start at multiples of this from the start of the record */
+#define BUNDLE_ALIGN        16
+
+struct bundle_header {
+    char magic[4];              /* BUNDLE_MAGIC */
+    uint32_t size;              /* whole record */
+    uint16_t header_size;       /* this header and the section table */
+    uint16_t nsections;
+    uint32_t camera;            /* camera index */
+    uint64_t sequence;          /* camera packet number */
+    uint64_t time_ns;           /* capture time, CLOCK_MONOTONIC */
+    uint32_t quality;           /* FLIRONE_QUALITY_* */
+    int32_t ffc_state;          /* FLIRONE_FFC_* */
+};
+
+struct bundle_section {
+    uint32_t type;              /* BUNDLE_THERMAL, ... */
+    uint32_t offset;
+    uint32_t size;
+    uint16_t width, height;     /* 0 for STATUS */
+};
+
+/*
+ * Shared memory: a struct bundle_ring, then slots of slot_size bytes
+ * starting at BUNDLE_RING_HEADER. Record n goes to slot n % slots, after
+ * its 16-byte sequence word. The word is 2n + 1 while the record is
+ * written and 2n + 2 once it is complete, and head becomes n + 1. A
+ * reader takes slot (head - 1) % slots, reads the word, copies the
+ * record, and keeps the copy if the word is still the same even value.
+ */
+#define BUNDLE_RING_MAGIC   "FLBR"
+#define BUNDLE_RING_HEADER  64
+#define BUNDLE_SLOT_HEADER  16
+
+struct bundle_ring {
+    char magic[4];              /* BUNDLE_RING_MAGIC */
+    uint32_t slots;
+    uint32_t slot_size;         /* sequence word included */
+    uint32_t reserved;
+    uint64_t head;              /* records written */
+};
+
+/* Parse --bundle DEST. Returns 0 or -1. */
+int bundle_add(const char *spec);
+
+int bundle_count(void);
+
+struct bundle_set;
+struct handoff_extra;
+
+/* Per camera: open the destinations. One found in adopt (after a
+ * takeover, else NULL) keeps its fds, clients and ring. NULL if the
+ * camera has none. */
+struct bundle_set *bundle_open(int camera_index, const char *tag, struct demand *d,
+                               struct handoff_extra *adopt);
+
+/* One camera packet; thermal, jpeg or status may be NULL */
+struct bundle_parts {
+    uint64_t sequence;
+    uint64_t time_ns;
+    uint32_t quality;
+    int ffc_state;
+    const uint16_t *thermal;
+    const uint8_t *jpeg;
+    size_t jpeg_size;
+    const uint8_t *status;
+    size_t status_size;
+};
+
+void bundle_frame(struct bundle_set *b, const struct bundle_parts *p);
+
+/* Live upgrade: add the destinations and their clients to x. Returns 0
+ * or -1. */
+int bundle_hand_off(struct bundle_set *b, struct handoff_extra *x);
+
+/* With remove set the sockets and rings are unlinked; not after a
+ * handoff, when the successor still serves them */
+void bundle_close(struct bundle_set *b, int remove);
+
+#endif
@@ -0,0 +1,236 @@
+/*
+ * FLIR One Pro LT Linux Driver - factory calibration
+ *
+ * CameraFiles.zip holds a handful of small text and XML files. Rather than
+ * depend on the exact layout, every member is unpacked and searched for the
+ * constant names, which are the same ones exiftool reports for FLIR images.
+ * Members are found through the central directory, as a zip written as a
+ * stream only records their sizes after the data.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <zlib.h>
+
+#include "calib.h"
+#include "json.h"
+
+/* Largest zip member we unpack */
+#define CALIB_MEMBER_MAX    (1024 * 1024)
+
+static unsigned int le16(const unsigned char *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned long le32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+/* Number following key, as in "PlanckR1": 1.2, PlanckR1=1.2 or <PlanckR1>1.2 */
+static int find_number(const char *text, size_t len, const char *key, double *out) {
+    size_t klen = strlen(key);
+    const char *p = text;
+    const char *end = text + len;
+
+    while ((p = memmem(p, end - p, key, klen)) != NULL) {
+        const char *v = p + klen;
+        /* The key must not be the prefix of a longer name */
+        if (v < end && isalnum((unsigned char)*v)) {
+            p = v;
+            continue;
+        }
+        while (v < end && v - (p + klen) < 8 && strchr("\"'>:= \t", *v)) v++;
+        char num[32];
+        size_t n = 0;
+        while (v < end && n < sizeof(num) - 1 && strchr("0123456789+-.eE", *v)) num[n++] = *v++;
+        num[n] = '\0';
+        char *e;
+        double d = strtod(num, &e);
+        if (n > 0 && *e == '\0') {
+            *out = d;
+            return 1;
+        }
+        p += klen;
+    }
+    return 0;
+}
+
+static void find_string(const char *text, size_t len, const char *key, char *out, size_t size) {
+    size_t klen = strlen(key);
+    const char *p = memmem(text, len, key, klen);
+    if (!p) return;
+
+    const char *v = p + klen;
+    const char *end = text + len;
+    while (v < end && v - (p + klen) < 8 && strchr("\"'>:= \t", *v)) v++;
+    size_t n = 0;
+    while (v < end && n < size - 1 && (isalnum((unsigned char)*v) || *v == '-' || *v == '_')) out[n++] = *v++;
+    if (n > 0) out[n] = '\0';
+}
+
+static void scan_text(struct calib *c, const char *text, size_t len) {
+    find_number(text, len, "PlanckR1", &c->r1);
+    find_number(text, len, "PlanckB", &c->b);
+    find_number(text, len, "PlanckF", &c->f);
+    find_number(text, len, "PlanckO", &c->o);
+    find_number(text, len, "PlanckR2", &c->r2);
+    find_number(text, len, "Emissivity", &c->emissivity);
+    find_number(text, len, "ReflectedApparentTemperature", &c->refl_temp);
+    if (!c->serial[0]) find_string(text, len, "CameraSerialNumber", c->serial, sizeof(c->serial));
+    if (!c->serial[0]) find_string(text, len, "SerialNumber", c->serial, sizeof(c->serial));
+}
+
+/* Raw deflate (zip method 8) into a malloc'd buffer */
+static unsigned char *inflate_member(const unsigned char *src, size_t src_len, size_t *out_len) {
+    unsigned char *out = malloc(CALIB_MEMBER_MAX);
+    if (!out) return NULL;
+
+    z_stream zs = {0};
+    if (inflateInit2(&zs, -15) != Z_OK) {
+        free(out);
+        return NULL;
+    }
+    zs.next_in = (unsigned char *)src;
+    zs.avail_in = src_len;
+    zs.next_out = out;
+    zs.avail_out = CALIB_MEMBER_MAX;
+    int r = inflate(&zs, Z_FINISH);
+    *out_len = zs.total_out;
+    inflateEnd(&zs);
+    if (r != Z_STREAM_END && r != Z_BUF_ERROR) {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+static void scan_member(struct calib *c, const unsigned char *data, size_t size, unsigned int method) {
+    if (method == 0) {
+        scan_text(c, (const char *)data, size);
+    } else if (method == 8) {
+        size_t n;
+        unsigned char *m = inflate_member(data, size, &n);
+        if (m) {
+            scan_text(c, (const char *)m, n);
+            free(m);
+        }
+    }
+}
+
+/* End of central directory record, searched back over a comment of up to 64K */
+static const unsigned char *find_eocd(const unsigned char *data, size_t len) {
+    if (len < 22) return NULL;
+    size_t stop = len > 22 + 0xFFFF ? len - 22 - 0xFFFF : 0;
+    for (size_t pos = len - 22 + 1; pos-- > stop;) {
+        if (memcmp(data + pos, "PK\5\6", 4) == 0) return data + pos;
+    }
+    return NULL;
+}
+
+/* Members as listed in the central directory, which has their sizes even
+ * when the local headers leave them to a trailing data descriptor */
+static int scan_central(struct calib *c, const unsigned char *data, size_t len) {
+    const unsigned char *eocd = find_eocd(data, len);
+    if (!eocd) return -1;
+    unsigned int count = le16(eocd + 10);
+    size_t pos = le32(eocd + 16);
+    size_t end = pos + le32(eocd + 12);
+    if (end > (size_t)(eocd - data)) return -1;
+
+    for (unsigned int i = 0; i < count && pos + 46 <= end && memcmp(data + pos, "PK\1\2", 4) == 0; i++) {
+        const unsigned char *e = data + pos;
+        unsigned int method = le16(e + 10);
+        size_t csize = le32(e + 20);
+        size_t local = le32(e + 42);
+        pos += 46 + le16(e + 28) + le16(e + 30) + le16(e + 32);
+
+        if (local + 30 > len || memcmp(data + local, "PK\3\4", 4) != 0) continue;
+        size_t start = local + 30 + le16(data + local + 26) + le16(data + local + 28);
+        if (start > len || csize > len - start) continue;
+        scan_member(c, data + start, csize, method);
+    }
+    return 0;
+}
+
+int calib_parse(struct calib *c, const unsigned char *data, size_t len) {
+    memset(c, 0, sizeof(*c));
+    c->r1 = c->b = NAN;
+    c->f = 1.0;
+    c->r2 = 1.0;
+    c->emissivity = 0.95;
+    c->refl_temp = 20.0;
+
+    if (len < 4 || memcmp(data, "PK\3\4", 4) != 0) {
+        /* A single uncompressed file */
+        scan_text(c, (const char *)data, len);
+    } else if (scan_central(c, data, len) < 0) {
+        /* No central directory (cut short): walk the local headers */
+        size_t pos = 0;
+        while (pos + 30 <= len && memcmp(data + pos, "PK\3\4", 4) == 0) {
+            const unsigned char *h = data + pos;
+            size_t csize = le32(h + 18);
+            size_t start = pos + 30 + le16(h + 26) + le16(h + 28);
+            if (start > len) break;
+            /* Sizes in a trailing data descriptor: take the rest, inflate stops on its own */
+            if ((le16(h + 6) & 0x08) || csize > len - start) csize = len - start;
+            scan_member(c, data + start, csize, le16(h + 8));
+            if (le16(h + 6) & 0x08) break;
+            pos = start + csize;
+        }
+    }
+
+    c->valid = !isnan(c->r1) && !isnan(c->b) && c->r1 > 0 && c->b > 0;
+    snprintf(c->source, sizeof(c->source), "camera");
+    return c->valid ? 0 : -1;
+}
+
+int calib_load(struct calib *c, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    char text[4096];
+    size_t n = fread(text, 1, sizeof(text) - 1, f);
+    fclose(f);
+    text[n] = '\0';
+
+    memset(c, 0, sizeof(*c));
+    c->r1 = json_get_number(text, "PlanckR1", NAN);
+    c->b = json_get_number(text, "PlanckB", NAN);
+    c->f = json_get_number(text, "PlanckF", 1.0);
+    c->o = json_get_number(text, "PlanckO", 0.0);
+    c->r2 = json_get_number(text, "PlanckR2", 1.0);
+    c->emissivity = json_get_number(text, "Emissivity", 0.95);
+    c->refl_temp = json_get_number(text, "ReflectedApparentTemperature", 20.0);
+    json_get(text, "Serial", c->serial, sizeof(c->serial));
+    c->valid = !isnan(c->r1) && !isnan(c->b);
+    return c->valid ? 0 : -1;
+}
+
+int calib_save(const struct calib *c, const char *path) {
+    /* Write aside and rename, so a reader never sees half a file */
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    if (!f) return -1;
+
+    fprintf(f, "{\n");
+    fprintf(f, "    \"PlanckR1\": %.10g,\n", c->r1);
+    fprintf(f, "    \"PlanckB\": %.10g,\n", c->b);
+    fprintf(f, "    \"PlanckF\": %.10g,\n", c->f);
+    fprintf(f, "    \"PlanckO\": %.10g,\n", c->o);
+    fprintf(f, "    \"PlanckR2\": %.10g,\n", c->r2);
+    fprintf(f, "    \"Emissivity\": %.10g,\n", c->emissivity);
+    fprintf(f, "    \"ReflectedApparentTemperature\": %.10g,\n", c->refl_temp);
+    fprintf(f, "    \"Serial\": \"%s\",\n", c->serial);
+    fprintf(f, "    \"Source\": \"camera\"\n");
+    fprintf(f, "}\n");
+
+    if (fclose(f) != 0 || rename(tmp, path) < 0) {
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,34 @@
+/*
+ * FLIR One Pro LT Linux Driver - factory calibration
+ *
+ * The camera keeps its Planck constants and identification in files on
+ * the device (CameraFiles.zip, read over FILEIO). They are parsed once and
+ * cached per serial as calibration/<serial>.json, in the same format as
+ * camera_config.json, so later starts only read a small file.
+ */
+
+#ifndef FLIRONE_CALIB_H
+#define FLIRONE_CALIB_H
+
+#include <stddef.h>
+
+#define CALIB_SERIAL_LEN    64
+
+struct calib {
+    double r1, b, f, o, r2;
+    double emissivity;
+    double refl_temp;
+    char serial[CALIB_SERIAL_LEN];  /* from the camera files, may be empty */
+    char source[16];                /* "camera", "cache" or "default" */
+    int valid;
+};
+
+/* Fill c from a downloaded camera file (zip or plain text). Returns 0 if
+ * at least PlanckR1 and PlanckB were found. */
+int calib_parse(struct calib *c, const unsigned char *data, size_t len);
+
+/* Read or write a cache / camera_config.json style file. Returns 0 or -1. */
+int calib_load(struct calib *c, const char *path);
+int calib_save(const struct calib *c, const char *path);
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ * FLIR One Pro LT Linux Driver - per-camera state
+ *
+ * One struct camera per device. Each camera runs its own read loop on its
+ * own thread, so nothing in here is shared between cameras.
+ */
+
+#ifndef FLIRONE_CAMERA_H
+#define FLIRONE_CAMERA_H
+
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <libusb-1.0/libusb.h>
+
+#include "calib.h"
+#include "demand.h"
+#include "devclock.h"
+#include "frame.h"
+#include "packet.h"
+#include "plugin.h"
+#include "pipeline.h"
+#include "status.h"
+
+/* EP 0x81 status transfer size */
+#define STATUS_XFER_SIZE    4096
+
+/* Up to a rack of cameras per process */
+#define MAX_CAMERAS     8
+#define CAMERA_ID_LEN   64
+
+/* Counters, written only by the camera's own thread */
+struct camera_metrics {
+    unsigned long transfers;
+    unsigned long bytes;
+    unsigned long usb_errors;
+    unsigned long frames;
+    unsigned long thermal_writes;
+    unsigned long visible_writes;
+    unsigned long visible_dropped;
+    unsigned long visible_invalid;  /* truncated or corrupt JPEGs */
+    unsigned long plugin_frames;
+    unsigned long plugin_skipped;   /* plugins still busy with the previous frame */
+    unsigned long frames_flagged;   /* FFC, uniform or settling */
+    unsigned long frames_held;      /* sink writes dropped or repeated for them */
+    uint64_t start_ms;              /* first read of the loop */
+};
+
+struct camera {
+    int index;
+    char id[CAMERA_ID_LEN];     /* USB serial, bus-port path, or fake:FILE */
+    char tag[CAMERA_ID_LEN + 4];/* log prefix, empty with a single camera */
+    char serial[CAMERA_ID_LEN]; /* USB serial, empty if unknown */
+
+    /* Input */
+    libusb_device_handle *dev;
+    int usb_fd;                 /* usbfs node, when we opened it ourselves */
+    int fd_fake;                /* --fake: camera packets from a file/FIFO */
+    struct timespec fake_next;
+    int fd_capture;             /* --capture: raw EP 0x85 dump */
+
+    /* Status channel: EP 0x81 read asynchronously, completed by the event
+     * handling inside the EP 0x85 bulk reads */
+    struct status status;
+    struct libusb_transfer *status_xfer;
+    unsigned char status_buf[STATUS_XFER_SIZE];
+    volatile int status_busy;
+    volatile int status_stopping;
+
+    /* Factory calibration, cached per serial */
+    struct calib calib;
+
+    /* Sinks */
+    const char *thermal_path;
+    const char *visible_path;
+    int fd_thermal;
+    int fd_visible;
+    char thermal_name[CAMERA_ID_LEN + 16];
+    char visible_name[CAMERA_ID_LEN + 16];
+
+    /* On-demand streaming */
+    struct demand demand;
+    int stream_paused;
+    uint64_t idle_since_ms;     /* 0 while someone is watching */
+    uint64_t resume_ms;         /* 0 unless waiting for the first frame */
+
+    /* Frame buffers: the next packet is assembled into cur (buf85 is its
+     * packet[]); completed frames are shared by reference */
+    struct frame_pool *frames;
+    struct frame *cur;
+    unsigned char *buf85;
+    int buf85pointer;
+    int frame_count;
+    int frame_ffc;              /* FLIRONE_FFC_* of the last complete frame */
+    unsigned int frame_quality; /* FLIRONE_QUALITY_* of the last complete frame */
+    uint64_t frame_arrival_ns;  /* host time the frame's first transfer arrived */
+    uint64_t frame_time_ns;     /* frame timestamp, device-clock corrected if enabled */
+    int snapshot_seen;          /* last SIGUSR1 request this camera served */
+
+    /* --device-clock: header tick counter mapped to host time */
+    struct devclock clock;
+
+    /* Last good frames for --ffc-policy hold, referenced */
+    struct frame *thermal_good;
+    struct frame *visible_good;
+
+    /* Read-only view handed to plugins */
+    struct plugin_frame pframe;
+
+    /* --pipeline stages and outputs, NULL without one */
+    struct pipe_instance *pipe;
+
+    /* --stream outputs, NULL without any */
+    struct stream_set *streams;
+
+    /* --rtp senders, NULL without any */
+    struct rtp_set *rtp;
+
+    /* --record file, NULL without one */
+    struct record_set *record;
+
+    /* --bundle outputs, NULL without any */
+    struct bundle_set *bundle;
+
+    /* After a takeover, the outputs above as the old driver left them,
+     * until they are opened */
+    struct handoff_extra *adopt;
+
+    /* Bulk transfer buffer: usbfs memory the kernel reads into directly
+     * when it has it (xfer_dma), else xfer_heap, copied out by the kernel */
+    unsigned char *xfer;
+    int xfer_dma;
+    unsigned char xfer_heap[BUFFER_SIZE];
+
+    struct camera_metrics m;
+    pthread_t thread;
+    int thread_running;
+};
+
+/* flirone.c */
+int open_v4l2_output(const char *device, int width, int height, int format);
+
+#endif
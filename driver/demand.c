@@ -0,0 +1,152 @@
+/*
+ * FLIR One Pro LT Linux Driver - consumer demand tracking
+ *
+ * v4l2loopback (0.12.6+) queues a private V4L2_EVENT_PRI_CLIENT_USAGE event
+ * with the device open count whenever a client opens or closes it. We
+ * subscribe on our output fd and wait for POLLPRI, so no polling is needed.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <linux/videodev2.h>
+
+#include "demand.h"
+
+/* From v4l2loopback.h, which is rarely installed */
+#ifndef V4L2_EVENT_PRI_CLIENT_USAGE
+#define V4L2_EVENT_PRI_CLIENT_USAGE  V4L2_EVENT_PRIVATE_START
+struct v4l2_event_client_usage {
+    __u32 count;
+};
+#endif
+
+void demand_init(struct demand *d) {
+    d->nsinks = 0;
+    pthread_mutex_init(&d->lock, NULL);
+}
+
+/* Called with the lock held */
+static void set_count(struct demand *d, int id, int count) {
+    d->sinks[id].count = count;
+    printf("%s: %d consumer(s)\n", d->sinks[id].name, count);
+}
+
+int demand_add_v4l2(struct demand *d, int fd, const char *name) {
+    int id = demand_add(d, name, DEMAND_UNKNOWN);
+    if (id < 0) return -1;
+
+    struct v4l2_event_subscription sub = {0};
+    sub.type = V4L2_EVENT_PRI_CLIENT_USAGE;
+    sub.flags = V4L2_EVENT_SUB_FL_SEND_INITIAL;
+    if (ioctl(fd, VIDIOC_SUBSCRIBE_EVENT, &sub) < 0) {
+        printf("%s: no client-usage events (%s), assuming always watched\n",
+               name, strerror(errno));
+        return id;
+    }
+
+    d->sinks[id].fd = fd;
+    demand_update(d);
+    return id;
+}
+
+int demand_add_listener(struct demand *d, int fd, const char *name, int (*poll_count)(void *arg), void *arg) {
+    int id = demand_add(d, name, 0);
+    if (id < 0) return -1;
+    d->sinks[id].fd = fd;
+    d->sinks[id].poll_count = poll_count;
+    d->sinks[id].arg = arg;
+    demand_set(d, id, poll_count(arg));
+    return id;
+}
+
+int demand_add(struct demand *d, const char *name, int initial) {
+    pthread_mutex_lock(&d->lock);
+    int id = d->nsinks < DEMAND_MAX_SINKS ? d->nsinks : -1;
+    if (id >= 0) {
+        d->sinks[id].name = name;
+        d->sinks[id].fd = -1;
+        d->sinks[id].count = initial;
+        d->sinks[id].poll_count = NULL;
+        d->nsinks++;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return id;
+}
+
+void demand_set(struct demand *d, int id, int count) {
+    pthread_mutex_lock(&d->lock);
+    if (id >= 0 && id < d->nsinks && d->sinks[id].count != count) set_count(d, id, count);
+    pthread_mutex_unlock(&d->lock);
+}
+
+int demand_count(struct demand *d, int id) {
+    pthread_mutex_lock(&d->lock);
+    int count = id >= 0 && id < d->nsinks ? d->sinks[id].count : DEMAND_UNKNOWN;
+    pthread_mutex_unlock(&d->lock);
+    return count;
+}
+
+int demand_update(struct demand *d) {
+    int changed = 0;
+
+    for (int i = 0; i < d->nsinks; i++) {
+        struct demand_sink *s = &d->sinks[i];
+        if (s->fd < 0) continue;
+
+        /* The owner's poll_count() (accept, reap clients) runs unlocked */
+        if (s->poll_count) {
+            int count = s->poll_count(s->arg);
+            pthread_mutex_lock(&d->lock);
+            if (count != s->count) {
+                set_count(d, i, count);
+                changed = 1;
+            }
+            pthread_mutex_unlock(&d->lock);
+            continue;
+        }
+
+        struct pollfd pfd = { s->fd, POLLPRI, 0 };
+        while (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLPRI)) {
+            struct v4l2_event ev;
+            if (ioctl(s->fd, VIDIOC_DQEVENT, &ev) < 0) break;
+            if (ev.type != V4L2_EVENT_PRI_CLIENT_USAGE) continue;
+
+            /* The count includes our own output open */
+            int count = ((struct v4l2_event_client_usage *)&ev.u)->count - 1;
+            if (count < 0) count = 0;
+            pthread_mutex_lock(&d->lock);
+            if (count != s->count) {
+                set_count(d, i, count);
+                changed = 1;
+            }
+            pthread_mutex_unlock(&d->lock);
+        }
+    }
+    return changed;
+}
+
+void demand_wait(struct demand *d, int timeout_ms) {
+    struct pollfd pfd[DEMAND_MAX_SINKS];
+    int n = 0;
+
+    for (int i = 0; i < d->nsinks; i++) {
+        if (d->sinks[i].fd < 0) continue;
+        pfd[n].fd = d->sinks[i].fd;
+        pfd[n].events = d->sinks[i].poll_count ? POLLIN : POLLPRI;
+        pfd[n].revents = 0;
+        n++;
+    }
+    poll(pfd, n, timeout_ms);
+}
+
+int demand_wanted(struct demand *d) {
+    int wanted = 0;
+
+    pthread_mutex_lock(&d->lock);
+    for (int i = 0; i < d->nsinks && !wanted; i++) wanted = d->sinks[i].count != 0;
+    pthread_mutex_unlock(&d->lock);
+    return wanted;
+}
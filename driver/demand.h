@@ -0,0 +1,62 @@
+/*
+ * FLIR One Pro LT Linux Driver - consumer demand tracking
+ *
+ * Each sink reports how many consumers are attached. The driver only
+ * pulls frames from EP 0x85 while at least one sink is wanted.
+ */
+
+#ifndef FLIRONE_DEMAND_H
+#define FLIRONE_DEMAND_H
+
+#include <pthread.h>
+
+#define DEMAND_MAX_SINKS    16
+
+/* Consumer count for sinks that cannot tell (plain files, old v4l2loopback) */
+#define DEMAND_UNKNOWN      -1
+
+struct demand_sink {
+    const char *name;
+    int fd;         /* v4l2 fd with a usage subscription, listening socket, or -1 */
+    int count;
+    int (*poll_count)(void *arg);   /* listening sockets: accept and count clients */
+    void *arg;
+};
+
+/* One per camera. Output threads set counts while the camera thread
+ * reads them, so counts are only touched under lock. */
+struct demand {
+    struct demand_sink sinks[DEMAND_MAX_SINKS];
+    int nsinks;
+    pthread_mutex_t lock;
+};
+
+void demand_init(struct demand *d);
+
+/* Track a v4l2loopback output through its client-usage events.
+ * Returns a sink id, or -1 if the table is full. */
+int demand_add_v4l2(struct demand *d, int fd, const char *name);
+
+/* Track a listening socket: demand_wait() wakes when a client connects,
+ * and demand_update() takes the consumer count from poll_count(arg), which
+ * should accept pending clients and let go of departed ones. */
+int demand_add_listener(struct demand *d, int fd, const char *name, int (*poll_count)(void *arg), void *arg);
+
+/* Track a sink whose owner reports counts with demand_set(). */
+int demand_add(struct demand *d, const char *name, int initial);
+
+void demand_set(struct demand *d, int id, int count);
+
+/* Consumer count of one sink */
+int demand_count(struct demand *d, int id);
+
+/* Drain pending v4l2 events without blocking. Returns 1 if anything changed. */
+int demand_update(struct demand *d);
+
+/* Sleep until a consumer count may have changed, or timeout_ms passes. */
+void demand_wait(struct demand *d, int timeout_ms);
+
+/* 1 if any sink has (or may have) a consumer */
+int demand_wanted(struct demand *d);
+
+#endif
@@ -0,0 +1,153 @@
+/*
+ * FLIR One Pro LT Linux Driver - device clock synchronisation
+ *
+ * Transit delay only ever makes a frame late, so after a least-squares fit
+ * with outliers removed the line is shifted down to the earliest arrivals:
+ * stamps then estimate when the frame left the camera, plus the fixed part
+ * of the USB latency.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "devclock.h"
+
+/* Never reject samples closer to the fit than this (USB microframe scale) */
+#define DEVCLOCK_MIN_THRESHOLD_NS   100000.0
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void restart(struct devclock *c, uint64_t arrival_ns) {
+    c->tick0 = c->ticks;
+    c->host0 = arrival_ns;
+    c->n = 0;
+    c->next = 0;
+    c->locked = 0;
+}
+
+/* Least squares over the samples with keep[i] set */
+static int fit_line(struct devclock *c, const char *keep, double *a, double *b) {
+    double mx = 0, my = 0;
+    int k = 0;
+    for (int i = 0; i < c->n; i++) {
+        if (!keep[i]) continue;
+        mx += c->x[i];
+        my += c->y[i];
+        k++;
+    }
+    if (k < 2) return -1;
+    mx /= k;
+    my /= k;
+
+    double sxx = 0, sxy = 0;
+    for (int i = 0; i < c->n; i++) {
+        if (!keep[i]) continue;
+        sxx += (c->x[i] - mx) * (c->x[i] - mx);
+        sxy += (c->x[i] - mx) * (c->y[i] - my);
+    }
+    if (sxx <= 0) return -1;
+    *b = sxy / sxx;
+    *a = my - *b * mx;
+    return 0;
+}
+
+static void refit(struct devclock *c, int newest) {
+    char keep[DEVCLOCK_WINDOW];
+    double r[DEVCLOCK_WINDOW], sorted[DEVCLOCK_WINDOW];
+    double a, b;
+
+    memset(keep, 1, sizeof(keep));
+    if (fit_line(c, keep, &a, &b) < 0) return;
+
+    /* Robust spread: median absolute deviation of the residuals */
+    for (int i = 0; i < c->n; i++) r[i] = c->y[i] - (a + b * c->x[i]);
+    memcpy(sorted, r, sizeof(double) * c->n);
+    qsort(sorted, c->n, sizeof(double), cmp_double);
+    double median = sorted[c->n / 2];
+    for (int i = 0; i < c->n; i++) sorted[i] = fabs(r[i] - median);
+    qsort(sorted, c->n, sizeof(double), cmp_double);
+    double sigma = 1.4826 * sorted[c->n / 2];
+    double threshold = fmax(3.0 * sigma, DEVCLOCK_MIN_THRESHOLD_NS);
+
+    for (int i = 0; i < c->n; i++) keep[i] = fabs(r[i] - median) <= threshold;
+    if (!keep[newest]) c->outliers++;
+    if (fit_line(c, keep, &a, &b) < 0) return;
+
+    /* Down to the lower envelope of the kept samples */
+    double lowest = 0;
+    int first = 1;
+    for (int i = 0; i < c->n; i++) {
+        if (!keep[i]) continue;
+        double res = c->y[i] - (a + b * c->x[i]);
+        if (first || res < lowest) lowest = res;
+        first = 0;
+    }
+
+    c->a = a + lowest;
+    c->b = b;
+    c->jitter_ns = sigma;
+    c->locked = 1;
+}
+
+void devclock_init(struct devclock *c, int offset, double hz) {
+    memset(c, 0, sizeof(*c));
+    c->offset = offset;
+    c->hz = hz;
+}
+
+uint64_t devclock_stamp(struct devclock *c, const unsigned char *header, uint64_t arrival_ns) {
+    if (c->offset < 0) return arrival_ns;
+
+    const unsigned char *p = header + c->offset;
+    uint32_t raw = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+
+    if (!c->started) {
+        c->started = 1;
+        c->last_raw = raw;
+        c->ticks = raw;
+        restart(c, arrival_ns);
+    } else {
+        /* Unsigned difference handles wrap; a stalled or backwards counter
+         * (camera reset, or not a clock at all) starts over */
+        uint32_t delta = raw - c->last_raw;
+        c->last_raw = raw;
+        c->ticks += delta;
+        if (delta == 0 || delta >= 0x80000000u) {
+            c->resyncs++;
+            restart(c, arrival_ns);
+        }
+    }
+
+    double x = (double)(c->ticks - c->tick0);
+    double y = (double)(int64_t)(arrival_ns - c->host0);
+
+    if (c->locked && fabs(y - (c->a + c->b * x)) > DEVCLOCK_RESYNC_NS) {
+        /* Frames lost for a while, or the counter jumped */
+        c->resyncs++;
+        restart(c, arrival_ns);
+        x = 0;
+        y = 0;
+    }
+
+    int slot = c->next;
+    c->x[slot] = x;
+    c->y[slot] = y;
+    c->next = (c->next + 1) % DEVCLOCK_WINDOW;
+    if (c->n < DEVCLOCK_WINDOW) c->n++;
+
+    if (c->n < DEVCLOCK_MIN_FIT) return arrival_ns;
+    refit(c, slot);
+    if (!c->locked) return arrival_ns;
+
+    double t = c->a + c->b * x;
+    return c->host0 + (int64_t)llround(t);
+}
+
+double devclock_drift_ppm(const struct devclock *c) {
+    if (!c->locked || c->hz <= 0 || c->b <= 0) return 0;
+    return (1e9 / (c->b * c->hz) - 1.0) * 1e6;
+}
@@ -0,0 +1,57 @@
+/*
+ * FLIR One Pro LT Linux Driver - device clock synchronisation
+ *
+ * USB arrival times jitter by whole bus-batching intervals. If the packet
+ * header carries a device tick counter, host arrival time is regressed on
+ * it over a sliding window, samples delayed in transit are rejected, and
+ * every frame is stamped from the fitted line instead. The fit absorbs both
+ * the offset and the drift between the two clocks.
+ */
+
+#ifndef FLIRONE_DEVCLOCK_H
+#define FLIRONE_DEVCLOCK_H
+
+#include <stdint.h>
+
+#define DEVCLOCK_WINDOW     128     /* samples in the fit (~15 s at 8.7 fps) */
+#define DEVCLOCK_MIN_FIT    8       /* samples before stamps are corrected */
+#define DEVCLOCK_RESYNC_NS  500000000LL /* prediction error that restarts the fit */
+
+struct devclock {
+    int offset;                 /* header byte offset of the LE32 tick, -1 = off */
+    double hz;                  /* nominal tick rate, 0 if unknown */
+
+    /* Ticks unwrapped to 64 bit */
+    uint32_t last_raw;
+    uint64_t ticks;
+    int started;
+
+    /* Sample window, relative to the first sample after a (re)start */
+    uint64_t tick0;
+    uint64_t host0;
+    double x[DEVCLOCK_WINDOW];
+    double y[DEVCLOCK_WINDOW];
+    int n;
+    int next;
+
+    /* host = host0 + a + b * (ticks - tick0) */
+    double a, b;
+    int locked;
+
+    /* Diagnostics */
+    double jitter_ns;           /* robust spread of the arrival times */
+    unsigned long outliers;
+    unsigned long resyncs;
+};
+
+void devclock_init(struct devclock *c, int offset, double hz);
+
+/* Feed one frame: header and the host CLOCK_MONOTONIC arrival time in ns.
+ * Returns the corrected host time, or arrival_ns until the fit is ready. */
+uint64_t devclock_stamp(struct devclock *c, const unsigned char *header, uint64_t arrival_ns);
+
+/* Device clock rate against its nominal rate in ppm, positive if it runs
+ * fast (0 without a nominal rate) */
+double devclock_drift_ppm(const struct devclock *c);
+
+#endif
@@ -0,0 +1,256 @@
+/*
+ * FLIR One Pro LT Linux Driver - FFV1 encoder for thermal frames
+ *
+ * Follows the bitstream of RFC 9043 as FFmpeg writes it: the range coder
+ * and its state tables, the symbol coding and the two-line sample ring,
+ * including how FFmpeg fills the borders, must match the decoder exactly.
+ * Samples are kept as int16_t like FFmpeg's, so values above 32767 wrap
+ * the same way on both sides.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ffv1.h"
+
+#define CONTEXT_SIZE    32
+
+/* Gradient buckets: quantised value v covers differences from bound[v - 1]
+ * up to bound[v] - 1, the last one up to 127 (RFC 9043, 4.1). Few and
+ * coarse, because contexts restart with every frame and 4800 samples do
+ * not train many: 172 contexts code the thermal plane about 9% smaller
+ * than 666 did. */
+static const int quant_bounds[] = { 2, 8, 32 };
+#define QUANT_RUNS      4                       /* values 0..3 */
+#define QUANT_LEVELS    (2 * QUANT_RUNS - 1)    /* -3..3 */
+#define CONTEXTS        ((QUANT_LEVELS * QUANT_LEVELS * QUANT_LEVELS + 1) / 2)
+
+struct range_coder {
+    uint8_t *start, *p;
+    int low, range;
+    int outstanding_count;
+    int outstanding_byte;
+    uint8_t zero_state[256];
+    uint8_t one_state[256];
+};
+
+struct ffv1 {
+    int width, height;
+    int16_t quant[3][256];
+    uint8_t state[CONTEXTS][CONTEXT_SIZE];
+    int16_t *ring;              /* two lines of width + 6 */
+    struct range_coder c;
+};
+
+/* -- Range coder ------------------------------------------------------------ */
+
+/* The default state transition table: FFmpeg's ff_build_rac_states() with
+ * factor 0.05 and max_p 248 */
+static void build_states(struct range_coder *c) {
+    const int64_t one = 1LL << 32;
+    const int factor = 0.05 * (1LL << 32), max_p = 256 - 8;
+    int64_t p = one / 2;
+    int last_p8 = 0, p8;
+
+    memset(c->zero_state, 0, sizeof(c->zero_state));
+    memset(c->one_state, 0, sizeof(c->one_state));
+    for (int i = 0; i < 128; i++) {
+        p8 = (256 * p + one / 2) >> 32;
+        if (p8 <= last_p8) p8 = last_p8 + 1;
+        if (last_p8 && last_p8 < 256 && p8 <= max_p) c->one_state[last_p8] = p8;
+        p += ((one - p) * factor + one / 2) >> 32;
+        last_p8 = p8;
+    }
+    for (int i = 256 - max_p; i <= max_p; i++) {
+        if (c->one_state[i]) continue;
+        p = (i * one + 128) >> 8;
+        p += ((one - p) * factor + one / 2) >> 32;
+        p8 = (256 * p + one / 2) >> 32;
+        if (p8 <= i) p8 = i + 1;
+        if (p8 > max_p) p8 = max_p;
+        c->one_state[i] = p8;
+    }
+    for (int i = 1; i < 255; i++) c->zero_state[i] = 256 - c->one_state[256 - i];
+}
+
+static void rc_init(struct range_coder *c, uint8_t *buf) {
+    c->start = c->p = buf;
+    c->low = 0;
+    c->range = 0xFF00;
+    c->outstanding_count = 0;
+    c->outstanding_byte = -1;
+}
+
+/* Carries propagate into the run of 0xFF bytes held back */
+static void rc_renorm(struct range_coder *c) {
+    while (c->range < 0x100) {
+        if (c->outstanding_byte < 0) {
+            c->outstanding_byte = c->low >> 8;
+        } else if (c->low <= 0xFF00) {
+            *c->p++ = c->outstanding_byte;
+            for (; c->outstanding_count; c->outstanding_count--) *c->p++ = 0xFF;
+            c->outstanding_byte = c->low >> 8;
+        } else if (c->low >= 0x10000) {
+            *c->p++ = c->outstanding_byte + 1;
+            for (; c->outstanding_count; c->outstanding_count--) *c->p++ = 0x00;
+            c->outstanding_byte = (c->low >> 8) - 0x100;
+        } else {
+            c->outstanding_count++;
+        }
+        c->low = (c->low & 0xFF) << 8;
+        c->range <<= 8;
+    }
+}
+
+static inline void put_rac(struct range_coder *c, uint8_t *state, int bit) {
+    int range1 = (c->range * *state) >> 8;
+
+    if (!bit) {
+        c->range -= range1;
+        *state = c->zero_state[*state];
+    } else {
+        c->low += c->range - range1;
+        c->range = range1;
+        *state = c->one_state[*state];
+    }
+    rc_renorm(c);
+}
+
+static size_t rc_terminate(struct range_coder *c) {
+    c->range = 0xFF;
+    c->low += 0xFF;
+    rc_renorm(c);
+    c->range = 0xFF;
+    rc_renorm(c);
+    return c->p - c->start;
+}
+
+/* Exponent in unary, mantissa, sign; states 1..10, 22..31 and 11..21 */
+static inline void put_symbol(struct range_coder *c, uint8_t *state, int v, int is_signed) {
+    if (!v) {
+        put_rac(c, state, 1);
+        return;
+    }
+    int a = v < 0 ? -v : v;
+    int e = 31 - __builtin_clz(a);
+
+    put_rac(c, state, 0);
+    for (int i = 0; i < e; i++) put_rac(c, state + 1 + (i < 9 ? i : 9), 1);
+    put_rac(c, state + 1 + (e < 9 ? e : 9), 0);
+    for (int i = e - 1; i >= 0; i--) put_rac(c, state + 22 + (i < 9 ? i : 9), (a >> i) & 1);
+    if (is_signed) put_rac(c, state + 11 + (e < 10 ? e : 10), v < 0);
+}
+
+/* -- Frame ------------------------------------------------------------------ */
+
+/* Each table as run lengths of its quantised values over 0..127. The
+ * decoder mirrors them to the negative differences. */
+static void put_quant_tables(struct range_coder *c) {
+    for (int t = 0; t < 5; t++) {
+        uint8_t state[CONTEXT_SIZE];
+        int last = 0;
+
+        memset(state, 128, sizeof(state));
+        for (int i = 0; t < 3 && i < QUANT_RUNS - 1; i++) {
+            put_symbol(c, state, quant_bounds[i] - last - 1, 0);
+            last = quant_bounds[i];
+        }
+        put_symbol(c, state, 128 - last - 1, 0);
+    }
+}
+
+static void put_header(struct range_coder *c) {
+    uint8_t state[CONTEXT_SIZE];
+
+    memset(state, 128, sizeof(state));
+    put_symbol(c, state, 1, 0);         /* version */
+    put_symbol(c, state, 1, 0);         /* range coder, default states */
+    put_symbol(c, state, 0, 0);         /* YCbCr */
+    put_symbol(c, state, 16, 0);        /* bits per sample */
+    put_rac(c, state, 0);               /* no chroma planes */
+    put_symbol(c, state, 0, 0);
+    put_symbol(c, state, 0, 0);
+    put_rac(c, state, 0);               /* no alpha */
+    put_quant_tables(c);
+}
+
+static inline int mid_pred(int a, int b, int c) {
+    if (a > b) {
+        int t = a;
+        a = b;
+        b = t;
+    }
+    return c <= a ? a : c >= b ? b : c;
+}
+
+static void encode_line(struct ffv1 *f, const int16_t *cur, const int16_t *last) {
+    struct range_coder *c = &f->c;
+
+    for (int x = 0; x < f->width; x++) {
+        int L = cur[x - 1], T = last[x], LT = last[x - 1], RT = last[x + 1];
+        int context = f->quant[0][(L - LT) & 0xFF] + f->quant[1][(LT - T) & 0xFF] + f->quant[2][(T - RT) & 0xFF];
+        int diff = cur[x] - mid_pred(L, L + T - LT, T);
+
+        if (context < 0) {
+            context = -context;
+            diff = -diff;
+        }
+        put_symbol(c, f->state[context], (int16_t)diff, 1);
+    }
+}
+
+struct ffv1 *ffv1_create(int width, int height) {
+    struct ffv1 *f = calloc(1, sizeof(*f));
+    if (!f) return NULL;
+    f->width = width;
+    f->height = height;
+    f->ring = malloc(2 * (width + 6) * sizeof(*f->ring));
+    if (!f->ring) {
+        free(f);
+        return NULL;
+    }
+
+    /* The tables as the decoder rebuilds them from put_quant_tables() */
+    for (int t = 0; t < 3; t++) {
+        int scale = t == 0 ? 1 : t == 1 ? QUANT_LEVELS : QUANT_LEVELS * QUANT_LEVELS;
+        int v = 0;
+        for (int i = 0; i < 128; i++) {
+            while (v < QUANT_RUNS - 1 && i >= quant_bounds[v]) v++;
+            f->quant[t][i] = scale * v;
+        }
+        for (int i = 1; i < 128; i++) f->quant[t][256 - i] = -f->quant[t][i];
+        f->quant[t][128] = -f->quant[t][127];
+    }
+    build_states(&f->c);
+    return f;
+}
+
+void ffv1_destroy(struct ffv1 *f) {
+    if (!f) return;
+    free(f->ring);
+    free(f);
+}
+
+size_t ffv1_encode(struct ffv1 *f, const uint16_t *src, uint8_t *dst) {
+    struct range_coder *c = &f->c;
+    int w = f->width;
+    uint8_t keystate = 128;
+
+    rc_init(c, dst);
+    put_rac(c, &keystate, 1);
+    put_header(c);
+
+    /* A keyframe starts from fresh contexts and a zeroed ring */
+    memset(f->state, 128, sizeof(f->state));
+    memset(f->ring, 0, 2 * (w + 6) * sizeof(*f->ring));
+    for (int y = 0; y < f->height; y++) {
+        int16_t *cur = f->ring + (w + 6) * ((f->height - y) % 2) + 3;
+        int16_t *last = f->ring + (w + 6) * ((f->height + 1 - y) % 2) + 3;
+
+        cur[-1] = last[0];
+        last[w] = last[w - 1];
+        for (int x = 0; x < w; x++) cur[x] = src[(size_t)y * w + x];
+        encode_line(f, cur, last);
+    }
+    return rc_terminate(c);
+}
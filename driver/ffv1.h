@@ -0,0 +1,33 @@
+/*
+ * FLIR One Pro LT Linux Driver - FFV1 encoder for thermal frames
+ *
+ * Lossless 16-bit grey FFV1 (version 1, range coder with the default
+ * state table, one slice), as FFmpeg decodes it. Every frame is a
+ * keyframe that carries the codec header itself, so no codec private data
+ * is needed and any frame can be decoded on its own. Samples are predicted
+ * from the median of left, top and left + top - top-left, and the residuals
+ * coded adaptively per context of neighbour gradients: the thermal plane,
+ * which changes smoothly with a few counts of noise, comes out at about a
+ * third of its raw size.
+ */
+
+#ifndef FLIRONE_FFV1_H
+#define FLIRONE_FFV1_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Largest frame encode() can produce for width x height */
+#define FFV1_MAX_SIZE(w, h)     ((size_t)(w) * (h) * 32 + 1024)
+
+struct ffv1;
+
+struct ffv1 *ffv1_create(int width, int height);
+
+void ffv1_destroy(struct ffv1 *f);
+
+/* One frame of width x height samples into dst (FFV1_MAX_SIZE bytes).
+ * Returns the encoded size. */
+size_t ffv1_encode(struct ffv1 *f, const uint16_t *src, uint8_t *dst);
+
+#endif
@@ -0,0 +1,256 @@
+/*
+ * FLIR One Pro LT Linux Driver - FILEIO channel (interface 1)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <zlib.h>
+
+#include "fileio.h"
+#include "json.h"
+
+/* Largest reply: header, JSON, one chunk */
+#define FILEIO_RX_SIZE      (FILEIO_HEADER_SIZE + 1024 + FILEIO_CHUNK)
+
+/* The stand-in hands out replies in bulk-packet sized pieces */
+#define SCRIPT_PACKET       512
+
+static const unsigned char fileio_magic[4] = { 0xCC, 0x01, 0x00, 0x00 };
+
+static void put_le32(unsigned char *p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static uint32_t get_le32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Header + JSON (NUL included) + optional data, in a malloc'd buffer */
+static unsigned char *encode(uint32_t seq, const char *json, const unsigned char *data, size_t data_len,
+                             size_t *out_len) {
+    size_t json_len = strlen(json) + 1;
+    size_t payload = json_len + data_len;
+    unsigned char *msg = malloc(FILEIO_HEADER_SIZE + payload);
+    if (!msg) return NULL;
+
+    memcpy(msg + FILEIO_HEADER_SIZE, json, json_len);
+    if (data_len > 0) memcpy(msg + FILEIO_HEADER_SIZE + json_len, data, data_len);
+
+    memcpy(msg, fileio_magic, 4);
+    put_le32(msg + 4, seq);
+    put_le32(msg + 8, payload);
+    put_le32(msg + 12, crc32(0, msg + FILEIO_HEADER_SIZE, payload));
+    *out_len = FILEIO_HEADER_SIZE + payload;
+    return msg;
+}
+
+/* Stand-in side: answer one request from the served directory */
+static void script_handle(struct fileio *f, const char *req) {
+    char type[32] = "", path[256] = "", reply[512];
+    unsigned char *chunk = NULL;
+    size_t chunk_len = 0;
+
+    json_get(req, "type", type, sizeof(type));
+    if (strcmp(type, "openFile") == 0 && json_get(req, "path", path, sizeof(path)) && !strstr(path, "..")) {
+        char full[512];
+        snprintf(full, sizeof(full), "%s/%s", f->script_dir, path);
+        if (f->script_fd >= 0) close(f->script_fd);
+        f->script_fd = open(full, O_RDONLY | O_CLOEXEC);
+        if (f->script_fd >= 0) {
+            snprintf(reply, sizeof(reply), "{\"type\":\"openFile\",\"status\":\"success\",\"data\":{\"streamIdentifier\":10}}");
+        } else {
+            snprintf(reply, sizeof(reply), "{\"type\":\"openFile\",\"status\":\"error\",\"data\":{\"message\":\"%s\"}}",
+                     strerror(errno));
+        }
+    } else if (strcmp(type, "readFile") == 0 && f->script_fd >= 0) {
+        size_t want = json_get_number(req, "size", FILEIO_CHUNK);
+        if (want > FILEIO_CHUNK) want = FILEIO_CHUNK;
+        chunk = malloc(want);
+        ssize_t r = chunk ? read(f->script_fd, chunk, want) : -1;
+        chunk_len = r > 0 ? r : 0;
+        snprintf(reply, sizeof(reply), "{\"type\":\"readFile\",\"status\":\"%s\",\"data\":{\"streamIdentifier\":10,\"size\":%zu}}",
+                 r < 0 ? "error" : "success", chunk_len);
+    } else if (strcmp(type, "closeFile") == 0) {
+        if (f->script_fd >= 0) close(f->script_fd);
+        f->script_fd = -1;
+        snprintf(reply, sizeof(reply), "{\"type\":\"closeFile\",\"status\":\"success\"}");
+    } else {
+        snprintf(reply, sizeof(reply), "{\"type\":\"%s\",\"status\":\"error\",\"data\":{\"message\":\"bad request\"}}", type);
+    }
+
+    size_t len;
+    unsigned char *msg = encode(f->seq, reply, chunk, chunk_len, &len);
+    free(chunk);
+    if (!msg) return;
+    free(f->script_out);
+    f->script_out = msg;
+    f->script_out_len = len;
+    f->script_out_pos = 0;
+}
+
+static int transport_send(struct fileio *f, const unsigned char *buf, size_t len) {
+    if (f->dev) {
+        int actual = 0;
+        int r = libusb_bulk_transfer(f->dev, 0x02, (unsigned char *)buf, len, &actual, FILEIO_TIMEOUT_MS);
+        if (r < 0 || (size_t)actual != len) {
+            fprintf(stderr, "FILEIO send failed: %s\n", libusb_error_name(r));
+            return -1;
+        }
+        return 0;
+    }
+    script_handle(f, (const char *)buf + FILEIO_HEADER_SIZE);
+    return 0;
+}
+
+static int transport_recv(struct fileio *f, unsigned char *buf, size_t size) {
+    if (f->dev) {
+        int actual = 0;
+        int r = libusb_bulk_transfer(f->dev, 0x83, buf, size, &actual, FILEIO_TIMEOUT_MS);
+        if (r < 0 && actual == 0) return -1;
+        return actual;
+    }
+    size_t left = f->script_out_len - f->script_out_pos;
+    if (left == 0) return -1;
+    if (left > size) left = size;
+    if (left > SCRIPT_PACKET) left = SCRIPT_PACKET;
+    memcpy(buf, f->script_out + f->script_out_pos, left);
+    f->script_out_pos += left;
+    return left;
+}
+
+static int request(struct fileio *f, const char *json) {
+    size_t len;
+    unsigned char *msg = encode(++f->seq, json, NULL, 0, &len);
+    if (!msg) return -1;
+    int r = transport_send(f, msg, len);
+    free(msg);
+    return r;
+}
+
+/* Next complete reply. *json points into f->rx, the data follows it. */
+static int reply(struct fileio *f, const char **json, const unsigned char **data, size_t *data_len) {
+    size_t need = FILEIO_HEADER_SIZE;
+
+    f->rx_len = 0;
+    while (f->rx_len < need) {
+        int r = transport_recv(f, f->rx + f->rx_len, FILEIO_RX_SIZE - f->rx_len);
+        if (r <= 0) {
+            fprintf(stderr, "FILEIO: no reply\n");
+            return -1;
+        }
+        /* Skip anything before a header (stale bytes from an earlier session) */
+        if (f->rx_len == 0 && r >= 4 && memcmp(f->rx, fileio_magic, 4) != 0) continue;
+        f->rx_len += r;
+
+        if (need == FILEIO_HEADER_SIZE && f->rx_len >= FILEIO_HEADER_SIZE) {
+            uint32_t payload = get_le32(f->rx + 8);
+            if (payload == 0 || payload > FILEIO_RX_SIZE - FILEIO_HEADER_SIZE) {
+                fprintf(stderr, "FILEIO: bad reply length %u\n", payload);
+                return -1;
+            }
+            need = FILEIO_HEADER_SIZE + payload;
+        }
+    }
+
+    unsigned char *payload = f->rx + FILEIO_HEADER_SIZE;
+    size_t payload_len = need - FILEIO_HEADER_SIZE;
+    if (crc32(0, payload, payload_len) != get_le32(f->rx + 12)) {
+        fprintf(stderr, "FILEIO: reply checksum mismatch\n");
+        return -1;
+    }
+    size_t json_len = strnlen((const char *)payload, payload_len);
+    if (json_len == payload_len) {
+        fprintf(stderr, "FILEIO: unterminated reply\n");
+        return -1;
+    }
+
+    char status[32];
+    *json = (const char *)payload;
+    if (json_get(*json, "status", status, sizeof(status)) && strcmp(status, "success") != 0) {
+        fprintf(stderr, "FILEIO: %s\n", *json);
+        return -1;
+    }
+    if (data) *data = payload + json_len + 1;
+    if (data_len) *data_len = payload_len - json_len - 1;
+    return 0;
+}
+
+int fileio_open_usb(struct fileio *f, libusb_device_handle *dev) {
+    memset(f, 0, sizeof(*f));
+    f->dev = dev;
+    f->script_fd = -1;
+    f->rx = malloc(FILEIO_RX_SIZE);
+    return f->rx ? 0 : -1;
+}
+
+int fileio_open_script(struct fileio *f, const char *dir) {
+    memset(f, 0, sizeof(*f));
+    f->script_dir = dir;
+    f->script_fd = -1;
+    f->rx = malloc(FILEIO_RX_SIZE);
+    return f->rx ? 0 : -1;
+}
+
+int fileio_read_file(struct fileio *f, const char *path, unsigned char **data, size_t *len) {
+    char req[512];
+    const char *json;
+    const unsigned char *chunk;
+    size_t chunk_len;
+
+    snprintf(req, sizeof(req), "{\"type\":\"openFile\",\"data\":{\"mode\":\"r\",\"path\":\"%s\"}}", path);
+    if (request(f, req) < 0 || reply(f, &json, NULL, NULL) < 0) return -1;
+    int stream = json_get_number(json, "streamIdentifier", -1);
+    if (stream < 0) {
+        fprintf(stderr, "FILEIO: no stream for %s\n", path);
+        return -1;
+    }
+
+    unsigned char *buf = NULL;
+    size_t have = 0;
+    int r = -1;
+    for (;;) {
+        snprintf(req, sizeof(req), "{\"type\":\"readFile\",\"data\":{\"streamIdentifier\":%d,\"size\":%d}}",
+                 stream, FILEIO_CHUNK);
+        if (request(f, req) < 0 || reply(f, &json, &chunk, &chunk_len) < 0) break;
+        if (chunk_len == 0) {
+            r = 0;      /* end of file */
+            break;
+        }
+        if (have + chunk_len > FILEIO_MAX_FILE) {
+            fprintf(stderr, "FILEIO: %s larger than %d bytes\n", path, FILEIO_MAX_FILE);
+            break;
+        }
+        unsigned char *grown = realloc(buf, have + chunk_len);
+        if (!grown) break;
+        buf = grown;
+        memcpy(buf + have, chunk, chunk_len);
+        have += chunk_len;
+    }
+
+    snprintf(req, sizeof(req), "{\"type\":\"closeFile\",\"data\":{\"streamIdentifier\":%d}}", stream);
+    if (request(f, req) == 0) reply(f, &json, NULL, NULL);
+
+    if (r < 0 || have == 0) {
+        free(buf);
+        return -1;
+    }
+    *data = buf;
+    *len = have;
+    return 0;
+}
+
+void fileio_close(struct fileio *f) {
+    if (f->script_fd >= 0) close(f->script_fd);
+    free(f->script_out);
+    free(f->rx);
+    f->rx = NULL;
+    f->script_out = NULL;
+    f->script_fd = -1;
+}
@@ -0,0 +1,54 @@
+/*
+ * FLIR One Pro LT Linux Driver - FILEIO channel (interface 1)
+ *
+ * Requests go out on EP 0x02, replies come back on EP 0x83. Every message
+ * is a 16-byte header followed by a NUL-terminated JSON object and, for
+ * file reads, the raw file bytes:
+ *
+ *   CC 01 00 00 | seq (LE32) | payload length (LE32) | CRC-32 of payload (LE32)
+ *
+ *   {"type":"openFile","data":{"mode":"r","path":"CameraFiles.zip"}}
+ *   {"type":"readFile","data":{"streamIdentifier":N,"size":65536}}
+ *   {"type":"closeFile","data":{"streamIdentifier":N}}
+ *
+ * A scripted stand-in serves the same protocol from a directory, so the
+ * download path can run without a camera (--fake with --fake-files DIR).
+ */
+
+#ifndef FLIRONE_FILEIO_H
+#define FLIRONE_FILEIO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <libusb-1.0/libusb.h>
+
+#define FILEIO_HEADER_SIZE  16
+#define FILEIO_CHUNK        65536
+#define FILEIO_MAX_FILE     (8 * 1024 * 1024)
+#define FILEIO_TIMEOUT_MS   1000
+
+struct fileio {
+    libusb_device_handle *dev;      /* camera, or NULL for the stand-in */
+    uint32_t seq;
+
+    /* Reply reassembly */
+    unsigned char *rx;
+    size_t rx_len;
+
+    /* Stand-in: directory served, open file, queued reply bytes */
+    const char *script_dir;
+    int script_fd;
+    unsigned char *script_out;
+    size_t script_out_len;
+    size_t script_out_pos;
+};
+
+int fileio_open_usb(struct fileio *f, libusb_device_handle *dev);
+int fileio_open_script(struct fileio *f, const char *dir);
+
+/* Download a whole camera file into a malloc'd buffer. Returns 0 or -1. */
+int fileio_read_file(struct fileio *f, const char *path, unsigned char **data, size_t *len);
+
+void fileio_close(struct fileio *f);
+
+#endif
@@ -1,57 +1,126 @@
 /*
  * FLIR One Pro LT Linux Driver
- * 
+ *
  * Clean implementation based on reverse engineering of the original flirone-v4l2.
  * Outputs raw thermal (16-bit) and visible (JPEG) data.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <signal.h>
 #include <time.h>
+#include <poll.h>
+#include <pthread.h>
 #include <libusb-1.0/libusb.h>
 #include <linux/videodev2.h>
 #include <sys/ioctl.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#include "calib.h"
+#include "camera.h"
+#include "demand.h"
+#include "devclock.h"
+#include "fileio.h"
+#include "frame.h"
+#include "jpeg.h"
+#include "rjpeg.h"
+#include "stream.h"
+#include "rtp.h"
+#include "record.h"
+#include "bundle.h"
+#include "loopback.h"
+#include "handoff.h"
+#include "packet.h"
+#include "pipeline.h"
+#include "plugin.h"
+#include "status.h"
+#include "sink.h"
+#include "workq.h"
 
 /* USB Device */
 #define VENDOR_ID   0x09CB
 #define PRODUCT_ID  0x1996
 #define USB_CONFIG  3
 
-/* Frame dimensions (Pro LT = Gen3 = 80x60) */
-#define THERMAL_WIDTH   80
-#define THERMAL_HEIGHT  60
-#define VISIBLE_WIDTH   640
-#define VISIBLE_HEIGHT  480
-
-/* Frame format */
-#define HEADER_SIZE     28
-#define MAGIC_0         0xEF
-#define MAGIC_1         0xBE
-#define LINE_STRIDE     82  /* 80 * 164 / 160 */
-#define LINE_OFFSET     32
-
-/* Buffer size - must be 1MB per original driver */
-#define BUFFER_SIZE     1048576
-
 /* V4L2 devices */
 #define VIDEO_THERMAL   "/dev/video10"
 #define VIDEO_VISIBLE   "/dev/video11"
 
+/* Fake device pacing (~8.7 fps like the real camera) */
+#define FAKE_FRAME_US   115000
+
+/* On-demand streaming: linger before stopping, bound on first-frame latency */
+#define DEMAND_IDLE_MS      3000
+#define DEMAND_RESUME_MS    1000
+
+/* Camera file holding the factory calibration */
+#define CAMERA_FILES    "CameraFiles.zip"
+
+/* Per-camera metrics log interval with several cameras */
+#define METRICS_INTERVAL_MS 10000
+
 /* Global state */
-static libusb_device_handle *dev = NULL;
-static int fd_thermal = -1;
-static int fd_visible = -1;
+static struct camera *cameras[MAX_CAMERAS];
+static int ncameras = 0;
 static volatile int running = 1;
+static int on_demand = 0;
+static int usb_ready = 0;
+static int usb_dma = 1;         /* --usb-copy turns zero-copy bulk reads off */
+
+/* --ffc-policy for the built-in outputs */
+static int policy_thermal = FFC_POLICY_PASS;
+static int policy_visible = FFC_POLICY_PASS;
+
+/* Calibration cache, and the directory served to fake cameras over FILEIO */
+static const char *calib_dir = "calibration";
+static const char *fake_files = NULL;
+
+/* --device-clock: header offset of a device tick counter, and its rate */
+static int clock_offset = -1;
+static double clock_hz = 0;
+
+/* --snapshot-dir: SIGUSR1 writes the next good frame of every camera there */
+static const char *snapshot_dir = NULL;
+static volatile sig_atomic_t snapshot_request = 0;
 
-/* Frame buffer - like original driver */
-static unsigned char buf85[BUFFER_SIZE];
-static int buf85pointer = 0;
-static int frame_count = 0;
+/* Live upgrade */
+static const char *handoff_path = NULL;
+static int fd_handoff = -1;
+static int handed_off = 0;
+
+/* Camera threads park here while the main thread hands them off */
+static pthread_mutex_t park_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t park_cond = PTHREAD_COND_INITIALIZER;
+static int park_request = 0;
+static int parked = 0;
+static int threads_running = 0;
+
+/* Monotonic clock in milliseconds */
+uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
 
 /* Signal handler */
 void signal_handler(int sig) {
@@ -59,9 +128,58 @@ void signal_handler(int sig) {
     running = 0;
 }
 
+void snapshot_handler(int sig) {
+    snapshot_request++;
+}
+
+struct camera *camera_new(const char *id) {
+    if (ncameras >= MAX_CAMERAS) {
+        fprintf(stderr, "Too many cameras (max %d)\n", MAX_CAMERAS);
+        return NULL;
+    }
+    struct camera *cam = calloc(1, sizeof(*cam));
+    if (!cam) return NULL;
+    
+    cam->index = ncameras;
+    snprintf(cam->id, sizeof(cam->id), "%s", id);
+    cam->usb_fd = -1;
+    cam->fd_fake = -1;
+    cam->fd_capture = -1;
+    cam->fd_thermal = -1;
+    cam->fd_visible = -1;
+    cam->xfer = cam->xfer_heap;
+    cam->frames = frame_pool_create();
+    if (!cam->frames) {
+        free(cam);
+        return NULL;
+    }
+    cam->cur = frame_get(cam->frames);
+    cam->buf85 = cam->cur->packet;
+    plugin_frame_init(&cam->pframe);
+    status_init(&cam->status, cam->id);
+    demand_init(&cam->demand);
+    cameras[ncameras++] = cam;
+    return cam;
+}
+
 /* Open V4L2 loopback device */
 int open_v4l2_output(const char *device, int width, int height, int format) {
-    int fd = open(device, O_RDWR);
+    char dev[32];
+    
+    /* label:NAME is the v4l2loopback device with that card label */
+    if (strncmp(device, LOOPBACK_PREFIX, strlen(LOOPBACK_PREFIX)) == 0) {
+        if (loopback_resolve(device + strlen(LOOPBACK_PREFIX), dev, sizeof(dev)) < 0) return -1;
+        device = dev;
+    }
+    
+    /* Outside /dev a missing or regular file is (re)created for raw frames */
+    struct stat st;
+    int fd;
+    if (strncmp(device, "/dev/", 5) != 0 && (stat(device, &st) < 0 ? errno == ENOENT : S_ISREG(st.st_mode))) {
+        fd = open(device, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    } else {
+        fd = open(device, O_RDWR);
+    }
     if (fd < 0) {
         fprintf(stderr, "Cannot open %s: %s\n", device, strerror(errno));
         return -1;
@@ -88,6 +206,11 @@ int open_v4l2_output(const char *device, int width, int height, int format) {
     }
     
     if (ioctl(fd, VIDIOC_S_FMT, &fmt) < 0) {
+        /* Plain files and FIFOs get the raw frames (fake-device testing) */
+        if (errno == ENOTTY) {
+            printf("Opened %s: not a V4L2 device, writing raw frames\n", device);
+            return fd;
+        }
         fprintf(stderr, "Cannot set format on %s: %s\n", device, strerror(errno));
         close(fd);
         return -1;
@@ -116,9 +239,122 @@ void save_default_config(void) {
     }
 }
 
-/* Initialize USB device */
+/* Bus-port path of a device, e.g. "1-2.3" (stable across re-plugs) */
+void usb_port_path(libusb_device *d, char *out, size_t len) {
+    uint8_t ports[8];
+    int n = libusb_get_port_numbers(d, ports, sizeof(ports));
+    int off = snprintf(out, len, "%u", libusb_get_bus_number(d));
+    for (int i = 0; i < n && off < (int)len; i++) {
+        off += snprintf(out + off, len - off, "%c%u", i == 0 ? '-' : '.', ports[i]);
+    }
+}
+
+/* Open one camera through its usbfs node so the fd can be handed off later.
+ * Falls back to a plain libusb_open() (no handoff) if the node is not usable. */
+libusb_device_handle *open_camera(libusb_device *d, int *usb_fd) {
+    libusb_device_handle *h = NULL;
+    char node[64];
+    
+    *usb_fd = -1;
+    snprintf(node, sizeof(node), "/dev/bus/usb/%03u/%03u",
+             libusb_get_bus_number(d), libusb_get_device_address(d));
+    int fd = open(node, O_RDWR | O_CLOEXEC);
+    if (fd >= 0 && libusb_wrap_sys_device(NULL, (intptr_t)fd, &h) == 0) {
+        *usb_fd = fd;
+        return h;
+    }
+    if (fd >= 0) close(fd);
+    if (libusb_open(d, &h) < 0) return NULL;
+    return h;
+}
+
+/* Index of the camera whose id matches the serial or port path, or -1 */
+int match_camera(const char *serial, const char *port) {
+    for (int i = 0; i < ncameras; i++) {
+        if (cameras[i]->dev || cameras[i]->fd_fake >= 0) continue;
+        if (strcmp(cameras[i]->id, serial) == 0 || strcmp(cameras[i]->id, port) == 0) return i;
+    }
+    return -1;
+}
+
+/* Enumerate FLIR devices and attach them to cameras. Without configured
+ * cameras the first device found becomes camera 0. Returns cameras still
+ * waiting for a device. */
+int attach_devices(int auto_first) {
+    libusb_device **list;
+    ssize_t n = libusb_get_device_list(NULL, &list);
+    if (n < 0) return -1;
+    
+    for (ssize_t i = 0; i < n; i++) {
+        struct libusb_device_descriptor desc;
+        if (libusb_get_device_descriptor(list[i], &desc) < 0) continue;
+        if (desc.idVendor != VENDOR_ID || desc.idProduct != PRODUCT_ID) continue;
+        
+        char port[32], serial[CAMERA_ID_LEN] = "";
+        usb_port_path(list[i], port, sizeof(port));
+        
+        int usb_fd;
+        libusb_device_handle *h = open_camera(list[i], &usb_fd);
+        if (!h) continue;
+        if (desc.iSerialNumber) {
+            libusb_get_string_descriptor_ascii(h, desc.iSerialNumber,
+                                               (unsigned char *)serial, sizeof(serial));
+        }
+        
+        int idx = match_camera(serial, port);
+        if (idx < 0 && auto_first && ncameras == 0) {
+            camera_new(serial[0] ? serial : port);
+            idx = 0;
+        }
+        if (idx < 0) {
+            /* Not ours (or already attached): leave it alone */
+            libusb_close(h);
+            if (usb_fd >= 0) close(usb_fd);
+            continue;
+        }
+        
+        cameras[idx]->dev = h;
+        cameras[idx]->usb_fd = usb_fd;
+        snprintf(cameras[idx]->serial, sizeof(cameras[idx]->serial), "%s", serial);
+        printf("Found FLIR One Pro LT: serial %s, port %s\n", serial[0] ? serial : "?", port);
+        if (auto_first) break;
+    }
+    libusb_free_device_list(list, 1);
+    
+    int missing = auto_first && ncameras == 0;
+    for (int i = 0; i < ncameras; i++) {
+        if (!cameras[i]->dev && cameras[i]->fd_fake < 0) missing++;
+    }
+    return missing;
+}
+
+/* Configure and claim an opened camera */
+int setup_camera(struct camera *cam) {
+    int r;
+    
+    r = libusb_set_configuration(cam->dev, USB_CONFIG);
+    if (r < 0 && r != LIBUSB_ERROR_BUSY) {
+        fprintf(stderr, "%sCannot set config: %s\n", cam->tag, libusb_error_name(r));
+    }
+    printf("%sSet USB configuration %d\n", cam->tag, USB_CONFIG);
+    
+    for (int i = 0; i < 3; i++) {
+        libusb_detach_kernel_driver(cam->dev, i);
+        r = libusb_claim_interface(cam->dev, i);
+        if (r < 0) {
+            fprintf(stderr, "%sCannot claim interface %d: %s\n", cam->tag, i, libusb_error_name(r));
+            return -1;
+        }
+    }
+    printf("%sClaimed interfaces 0, 1, 2\n", cam->tag);
+    
+    return 0;
+}
+
+/* Initialize USB devices */
 int init_usb(void) {
     int r;
+    int auto_first = (ncameras == 0);
     
     /* Ensure config exists */
     save_default_config();
@@ -128,286 +364,1293 @@ int init_usb(void) {
         fprintf(stderr, "Failed to init libusb: %s\n", libusb_error_name(r));
         return -1;
     }
+    usb_ready = 1;
     
-    libusb_init(NULL); // Assuming init success from before or handle error properly
-    
-    // Retry finding device for 5 seconds
+    // Retry finding devices for 5 seconds
+    int missing = 0;
     for (int i = 0; i < 50; i++) {
-        dev = libusb_open_device_with_vid_pid(NULL, VENDOR_ID, PRODUCT_ID);
-        if (dev) break;
+        missing = attach_devices(auto_first);
+        if (missing <= 0) break;
         if (i == 0) printf("Waiting for device...\n");
         usleep(100000); // 100ms
     }
     
-    if (!dev) {
+    if (auto_first && ncameras == 0) {
         fprintf(stderr, "FLIR One Pro LT not found. Is it connected?\n");
         return -1;
     }
-    printf("Found FLIR One Pro LT\n");
     
-
-    
-    r = libusb_set_configuration(dev, USB_CONFIG);
-    if (r < 0 && r != LIBUSB_ERROR_BUSY) {
-        fprintf(stderr, "Cannot set config: %s\n", libusb_error_name(r));
-    }
-    printf("Set USB configuration %d\n", USB_CONFIG);
-    
-    for (int i = 0; i < 3; i++) {
-        libusb_detach_kernel_driver(dev, i);
-        r = libusb_claim_interface(dev, i);
-        if (r < 0) {
-            fprintf(stderr, "Cannot claim interface %d: %s\n", i, libusb_error_name(r));
-            return -1;
+    /* Run with whatever was found; report the rest */
+    int found = 0;
+    for (int i = 0; i < ncameras; i++) {
+        struct camera *cam = cameras[i];
+        if (cam->fd_fake >= 0) {
+            found++;
+            continue;
+        }
+        if (!cam->dev) {
+            fprintf(stderr, "Camera %s not found\n", cam->id);
+            continue;
         }
+        if (setup_camera(cam) < 0) {
+            libusb_close(cam->dev);
+            cam->dev = NULL;
+            continue;
+        }
+        found++;
     }
-    printf("Claimed interfaces 0, 1, 2\n");
     
-    return 0;
+    return found > 0 ? 0 : -1;
 }
 
 /* Start video streaming */
-int start_streaming(void) {
+int start_streaming(struct camera *cam) {
     int r;
     unsigned char data[2] = {0, 0};
+    libusb_device_handle *dev = cam->dev;
     
-    printf("stop interface 2 FRAME\n");
+    printf("%sstop interface 2 FRAME\n", cam->tag);
     r = libusb_control_transfer(dev, 1, 0x0b, 0, 2, data, 0, 100);
     
-    printf("stop interface 1 FILEIO\n");
+    printf("%sstop interface 1 FILEIO\n", cam->tag);
     r = libusb_control_transfer(dev, 1, 0x0b, 0, 1, data, 0, 100);
     
-    printf("\nstart interface 1 FILEIO\n");
+    printf("\n%sstart interface 1 FILEIO\n", cam->tag);
     r = libusb_control_transfer(dev, 1, 0x0b, 1, 1, data, 0, 100);
     if (r < 0) {
-        fprintf(stderr, "Control error: %s\n", libusb_error_name(r));
+        fprintf(stderr, "%sControl error: %s\n", cam->tag, libusb_error_name(r));
         return -1;
     }
     
-    printf("\nAsk for video stream, start EP 0x85:\n");
+    printf("\n%sAsk for video stream, start EP 0x85:\n", cam->tag);
     r = libusb_control_transfer(dev, 1, 0x0b, 1, 2, data, 2, 200);
     if (r < 0) {
-        fprintf(stderr, "Control error: %s\n", libusb_error_name(r));
+        fprintf(stderr, "%sControl error: %s\n", cam->tag, libusb_error_name(r));
         return -1;
     }
     
-    printf("Video streaming started\n");
+    printf("%sVideo streaming started\n", cam->tag);
     return 0;
 }
 
-/* Process EP 0x85 data - matches original driver logic exactly */
-void vframe(int r, int actual_length, unsigned char *buf) {
-    /* Error handling */
+/* EP 0x81 completion: parse and resubmit. Runs inside whichever thread is
+ * handling libusb events, serialized with the other callbacks. */
+void LIBUSB_CALL status_callback(struct libusb_transfer *xfer) {
+    struct camera *cam = xfer->user_data;
+    
+    if (xfer->status == LIBUSB_TRANSFER_COMPLETED && xfer->actual_length > 0) {
+        status_feed(&cam->status, xfer->buffer, xfer->actual_length);
+    }
+    
+    if (xfer->status == LIBUSB_TRANSFER_CANCELLED || xfer->status == LIBUSB_TRANSFER_NO_DEVICE
+        || cam->status_stopping || libusb_submit_transfer(xfer) < 0) {
+        cam->status_busy = 0;
+    }
+}
+
+/* Keep one EP 0x81 transfer in flight instead of polling it */
+int status_start(struct camera *cam) {
+    if (!cam->dev || cam->status_busy) return 0;
+    
+    if (!cam->status_xfer) cam->status_xfer = libusb_alloc_transfer(0);
+    if (!cam->status_xfer) return -1;
+    libusb_fill_bulk_transfer(cam->status_xfer, cam->dev, 0x81, cam->status_buf, STATUS_XFER_SIZE,
+                              status_callback, cam, 0);
+    
+    cam->status_stopping = 0;
+    int r = libusb_submit_transfer(cam->status_xfer);
     if (r < 0) {
+        fprintf(stderr, "%sCannot read status channel: %s\n", cam->tag, libusb_error_name(r));
+        return -1;
+    }
+    cam->status_busy = 1;
+    return 0;
+}
+
+/* Cancel the status transfer and wait for its callback */
+void status_stop(struct camera *cam) {
+    if (!cam->status_xfer) return;
+    
+    cam->status_stopping = 1;
+    if (cam->status_busy) libusb_cancel_transfer(cam->status_xfer);
+    for (int i = 0; i < 20 && cam->status_busy; i++) {
+        struct timeval tv = { 0, 50000 };
+        libusb_handle_events_timeout(NULL, &tv);
+    }
+    if (!cam->status_busy) {
+        libusb_free_transfer(cam->status_xfer);
+        cam->status_xfer = NULL;
+    }
+}
+
+/* Stop EP 0x85 while nobody is watching. FILEIO stays up for a fast resume. */
+void pause_streaming(struct camera *cam) {
+    unsigned char data[2] = {0, 0};
+    
+    if (cam->fd_fake < 0) {
+        libusb_control_transfer(cam->dev, 1, 0x0b, 0, 2, data, 0, 100);
+    }
+    cam->stream_paused = 1;
+    cam->buf85pointer = 0;
+    printf("%sNo consumers, video stream paused\n", cam->tag);
+}
+
+/* Restart EP 0x85 for a new consumer; only interface 2 is toggled */
+void resume_streaming(struct camera *cam) {
+    unsigned char data[2] = {0, 0};
+    
+    if (cam->fd_fake < 0) {
+        int r = libusb_control_transfer(cam->dev, 1, 0x0b, 1, 2, data, 2, 200);
+        if (r < 0) {
+            fprintf(stderr, "%sResume error: %s\n", cam->tag, libusb_error_name(r));
+        }
+    }
+    cam->stream_paused = 0;
+    cam->idle_since_ms = 0;
+    cam->resume_ms = now_ms();
+    printf("%sConsumer attached, video stream resumed\n", cam->tag);
+}
+
+/* Start or stop the stream to follow the sinks' consumer counts */
+void update_demand(struct camera *cam) {
+    uint64_t now = now_ms();
+    
+    demand_update(&cam->demand);
+    int wanted = demand_wanted(&cam->demand);
+    
+    if (cam->stream_paused) {
+        if (wanted) resume_streaming(cam);
         return;
     }
     
-    /* Magic bytes check */
-    unsigned char magicbyte[4] = {0xEF, 0xBE, 0x00, 0x00};
+    if (wanted) {
+        cam->idle_since_ms = 0;
+    } else if (cam->idle_since_ms == 0) {
+        cam->idle_since_ms = now;
+    } else if (now - cam->idle_since_ms >= DEMAND_IDLE_MS) {
+        pause_streaming(cam);
+        return;
+    }
+    
+    /* The short resume path did not bring frames back: full restart */
+    if (cam->resume_ms && now - cam->resume_ms > DEMAND_RESUME_MS) {
+        fprintf(stderr, "%sNo frame %d ms after resume, restarting stream\n", cam->tag, DEMAND_RESUME_MS);
+        if (cam->fd_fake < 0) start_streaming(cam);
+        cam->resume_ms = now;
+    }
+}
+
+/* Hand the completed frame to the plugins; they hold a reference to it
+ * until the last one is done. */
+void submit_plugins(struct camera *cam, struct frame *frame) {
+    struct flirone_frame *f = &cam->pframe.view;
+    
+    f->camera_index = cam->index;
+    f->camera_id = cam->id;
+    f->sequence = cam->frame_count;
+    f->timestamp_ns = cam->frame_time_ns;
+    f->arrival_ns = cam->frame_arrival_ns;
+    f->header = frame->packet;
+    f->header_size = HEADER_SIZE;
+    f->thermal = frame->has_thermal ? frame->thermal : NULL;
+    f->thermal_width = THERMAL_WIDTH;
+    f->thermal_height = THERMAL_HEIGHT;
+    f->jpeg = frame->jpeg;
+    f->jpeg_size = frame->jpeg_size;
+    f->status = frame->status;
+    f->status_size = frame->status_size;
+    f->ffc_state = cam->frame_ffc;
+    f->quality = cam->frame_quality;
+    
+    cam->pframe.frame = frame_ref(frame);
+    if (plugins_submit(&cam->pframe) < 0) {
+        cam->m.plugin_skipped++;
+        return;
+    }
+    cam->m.plugin_frames++;
+}
+
+/* Keep a reference to the last good frame for --ffc-policy hold */
+void hold_frame(struct frame **slot, struct frame *frame) {
+    frame_unref(*slot);
+    *slot = frame_ref(frame);
+}
+
+/* Camera serial (or id for fake cameras) as a plain file name */
+void camera_key(struct camera *cam, char *key, size_t size) {
+    const char *id = cam->serial[0] ? cam->serial : cam->id;
+    size_t n = 0;
+    
+    for (; id[n] && n < size - 1; n++) {
+        key[n] = (isalnum((unsigned char)id[n]) || id[n] == '-' || id[n] == '.') ? id[n] : '_';
+    }
+    key[n] = '\0';
+}
+
+/* Visible JPEG as received, with the raw thermal and calibration in FLIR
+ * APP1 segments, to --snapshot-dir/<camera>-<frame>.jpg */
+void write_snapshot(struct camera *cam, const struct frame *frame) {
+    char key[CAMERA_ID_LEN], path[512];
+    
+    cam->snapshot_seen = snapshot_request;
+    camera_key(cam, key, sizeof(key));
+    snprintf(path, sizeof(path), "%s/%s-%06d.jpg", snapshot_dir, key, cam->frame_count);
+    
+    mkdir(snapshot_dir, 0755);
+    if (rjpeg_write(path, frame->jpeg, frame->jpeg_size, frame->thermal, THERMAL_WIDTH, THERMAL_HEIGHT,
+                    &cam->calib, cam->serial[0] ? cam->serial : cam->id) == 0) {
+        printf("%sSnapshot: %s\n", cam->tag, path);
+    }
+}
+
+/* Process EP 0x85 data. Transfers are reassembled into a camera packet
+ * the way the original driver did it; a complete packet is then sealed,
+ * timestamped, checked for FFC and passed to every output, plugin and
+ * pipeline stage, which the original did not have. */
+void vframe(struct camera *cam, int r, int actual_length, unsigned char *buf) {
+    unsigned char *buf85 = cam->buf85;
+    
+    /* Error handling */
+    if (r < 0) {
+        return;
+    }
     
     /* Reset buffer if new frame starts OR buffer overflow */
-    if ((memcmp(buf, magicbyte, 4) == 0) || ((buf85pointer + actual_length) >= BUFFER_SIZE)) {
-        buf85pointer = 0;
+    if (packet_is_start(buf) || ((cam->buf85pointer + actual_length) >= BUFFER_SIZE)) {
+        cam->buf85pointer = 0;
+        cam->frame_arrival_ns = now_ns();
     }
     
     /* Append chunk to buffer */
-    memcpy(buf85 + buf85pointer, buf, actual_length);
-    buf85pointer += actual_length;
+    memcpy(buf85 + cam->buf85pointer, buf, actual_length);
+    cam->buf85pointer += actual_length;
     
     /* Check if buffer starts with magic bytes */
-    if (memcmp(buf85, magicbyte, 4) != 0) {
-        buf85pointer = 0;
+    if (!packet_is_start(buf85)) {
+        cam->buf85pointer = 0;
         return;
     }
     
     /* Need header to parse sizes */
-    if (buf85pointer < 28) return;
+    if (cam->buf85pointer < HEADER_SIZE) return;
     
-    /* Parse header (little-endian) */
-    uint32_t FrameSize = buf85[8] | (buf85[9] << 8) | (buf85[10] << 16) | (buf85[11] << 24);
-    uint32_t ThermalSize = buf85[12] | (buf85[13] << 8) | (buf85[14] << 16) | (buf85[15] << 24);
-    uint32_t JpgSize = buf85[16] | (buf85[17] << 8) | (buf85[18] << 16) | (buf85[19] << 24);
+    struct packet_sizes sizes;
+    packet_sizes(buf85, &sizes);
+    uint32_t FrameSize = sizes.frame;
+    uint32_t ThermalSize = sizes.thermal;
+    uint32_t JpgSize = sizes.jpeg;
     
     /* Wait for complete frame */
-    if ((FrameSize + 28) > (uint32_t)buf85pointer) {
+    if ((FrameSize + 28) > (uint32_t)cam->buf85pointer) {
         return;
     }
     
     /* Got complete frame! */
-    frame_count++;
-    printf("Frame %d: thermal=%u jpeg=%u\n", frame_count, ThermalSize, JpgSize);
+    cam->frame_count++;
+    cam->m.frames++;
+    
+    /* Timestamp: completion time, or the device tick mapped to host time */
+    if (cam->clock.offset >= 0) {
+        int was_locked = cam->clock.locked;
+        cam->frame_time_ns = devclock_stamp(&cam->clock, buf85, cam->frame_arrival_ns);
+        if (cam->clock.locked && !was_locked) {
+            printf("%sDevice clock locked: jitter %.0f us\n", cam->tag, cam->clock.jitter_ns / 1000);
+        }
+    } else {
+        cam->frame_time_ns = now_ns();
+    }
+    
+    /* The status block after the JPEG reports the shutter state at capture */
+    if (FrameSize > ThermalSize + JpgSize) {
+        status_frame(&cam->status, &buf85[28 + ThermalSize + JpgSize], FrameSize - ThermalSize - JpgSize);
+    }
+    cam->frame_ffc = status_ffc(&cam->status);
+    if (cam->resume_ms) {
+        printf("%sFirst frame %llu ms after resume\n", cam->tag,
+               (unsigned long long)(now_ms() - cam->resume_ms));
+        cam->resume_ms = 0;
+    }
+    printf("%sFrame %d: thermal=%u jpeg=%u%s\n", cam->tag, cam->frame_count, ThermalSize, JpgSize,
+           cam->frame_ffc == FLIRONE_FFC_RUNNING ? " (FFC)" : "");
     
     /* Reset pointer for next frame */
-    buf85pointer = 0;
+    cam->buf85pointer = 0;
+    
+    /* From here on the frame is read-only. The next packet goes into a
+     * fresh one; without a free frame nothing may keep a reference. */
+    struct frame *frame = cam->cur;
+    frame_seal(frame, &sizes);
+    struct frame *next = frame_get(cam->frames);
+    if (!next) fprintf(stderr, "%sFrame pool exhausted, frame not shared\n", cam->tag);
+    
+    /* A JPEG that failed validation goes nowhere, as if there were none */
+    if (frame->jpeg_status != JPEG_OK) {
+        cam->m.visible_invalid++;
+        printf("%sWarning: Dropped visible frame (%s JPEG)\n", cam->tag, jpeg_status_name(frame->jpeg_status));
+    }
+    
+    /* Plugins still on the previous frame miss this one */
+    int plugins = plugin_count() > 0;
+    if (plugins && (plugin_frame_busy(&cam->pframe) || !next)) {
+        cam->m.plugin_skipped++;
+        plugins = 0;
+    }
+    
+    int snapshot = snapshot_dir && cam->snapshot_seen != snapshot_request;
+    
+    /* The frames the outputs take each part from, after --ffc-policy */
+    struct frame *thermal_from = NULL;
+    struct frame *visible_from = NULL;
+    const uint16_t *stream_thermal = NULL;
     
     /* Extract and write thermal data (16-bit raw) */
-    if (ThermalSize > 0 && fd_thermal >= 0) {
-        int x, y, v;
-        unsigned short pix[THERMAL_WIDTH * THERMAL_HEIGHT];
-        
-        /* Extract 16-bit raw values */
-        for (y = 0; y < THERMAL_HEIGHT; y++) {
-            for (x = 0; x < THERMAL_WIDTH; x++) {
-                int idx = 2 * (y * LINE_STRIDE + x) + LINE_OFFSET;
-                
-                /* Range check to be safe */
-                if (idx + 1 >= BUFFER_SIZE) continue;
-                
-                if (x < 80) {
-                    v = buf85[idx] + 256 * buf85[idx + 1];
-                } else {
-                    v = buf85[idx + 4] + 256 * buf85[idx + 1 + 4];
-                }
-                pix[y * THERMAL_WIDTH + x] = v;
+    if (ThermalSize > 0 && (cam->fd_thermal >= 0 || plugins || cam->pipe || cam->streams || cam->rtp ||
+                            cam->record || cam->bundle || snapshot)) {
+        uint16_t *pix = frame->thermal;
+        size_t pix_size = sizeof(frame->thermal);
+        
+        packet_thermal(buf85, pix);
+        frame->has_thermal = 1;
+        
+        cam->frame_quality = status_quality(&cam->status, cam->frame_ffc, pix, THERMAL_WIDTH * THERMAL_HEIGHT);
+        
+        /* Flagged frames: skip, or repeat the last good one (--ffc-policy) */
+        thermal_from = frame;
+        if (policy_thermal != FFC_POLICY_PASS) {
+            if (!cam->frame_quality) {
+                if (policy_thermal == FFC_POLICY_HOLD && next) hold_frame(&cam->thermal_good, frame);
+            } else {
+                cam->m.frames_held++;
+                thermal_from = policy_thermal == FFC_POLICY_HOLD ? cam->thermal_good : NULL;
             }
         }
         
+        stream_thermal = thermal_from ? thermal_from->thermal : NULL;
+        
         /* Write 16-bit raw thermal data directly */
-        write(fd_thermal, pix, sizeof(pix));
+        if (cam->fd_thermal >= 0 && stream_thermal && write(cam->fd_thermal, stream_thermal, pix_size) == pix_size) {
+            cam->m.thermal_writes++;
+        }
+    } else {
+        cam->frame_quality = status_quality(&cam->status, cam->frame_ffc, NULL, 0);
     }
+    if (cam->frame_quality) cam->m.frames_flagged++;
     
-    /* Write visible JPEG */
-    if (JpgSize > 0 && fd_visible >= 0) {
-        unsigned char *jpg_data = &buf85[28 + ThermalSize];
+    /* Write visible JPEG. Flagged frames may be skipped or replaced by the
+     * last good one, per --ffc-policy. */
+    visible_from = frame->jpeg ? frame : NULL;
+    if (visible_from && (cam->fd_visible >= 0 || cam->streams || cam->rtp || cam->record || cam->bundle) &&
+        policy_visible != FFC_POLICY_PASS) {
+        if (!cam->frame_quality) {
+            if (policy_visible == FFC_POLICY_HOLD && next) hold_frame(&cam->visible_good, frame);
+        } else {
+            cam->m.frames_held++;
+            visible_from = policy_visible == FFC_POLICY_HOLD ? cam->visible_good : NULL;
+        }
+    }
+    const unsigned char *jpg_data = visible_from ? visible_from->jpeg : NULL;
+    uint32_t jpg_size = visible_from ? visible_from->jpeg_size : 0;
+    if (jpg_size > 0 && cam->fd_visible >= 0) {
+        /* Write the validated JPEG, PLUS PADDING */
+        /* Padding fixes 'overread' errors in OpenCV/FFmpeg decoders; the frame
+         * carries FRAME_JPEG_PAD zeros after the JPEG for this */
+        /* Atomic write strategy: Send everything in one go or drop it. */
+        size_t total_size = jpg_size + FRAME_JPEG_PAD;
+        ssize_t r = write(cam->fd_visible, jpg_data, total_size);
         
-        /* Verify JPEG SOI (FF D8) */
-        if (jpg_data[0] != 0xFF || jpg_data[1] != 0xD8) {
-             printf("Warning: Malformed JPEG header\n");
+        if (r < 0) {
+             if (errno != EAGAIN && errno != EINTR) {
+                  perror("write visible failed");
+             }
+             cam->m.visible_dropped++;
+        } else if (r != total_size) {
+             /* Partial write occurred - this destroys the frame structure for v4l2loopback */
+             /* We must DROP this frame rather than sending the rest later */
+             printf("%sWarning: Dropped frame (Atomic write failed: %zd/%zd bytes)\n", cam->tag, r, total_size);
+             cam->m.visible_dropped++;
+        } else {
+             cam->m.visible_writes++;
         }
+    }
+    
+    if (cam->streams) {
+        stream_frame(cam->streams, stream_thermal, jpg_data, jpg_size, cam->frame_time_ns);
+    }
+    if (cam->record) {
+        record_frame(cam->record, stream_thermal, jpg_data, jpg_size, cam->frame_time_ns);
+    }
+    if (cam->bundle) {
+        struct bundle_parts parts = {
+            cam->frame_count, cam->frame_time_ns, cam->frame_quality, cam->frame_ffc,
+            stream_thermal, jpg_data, jpg_size, frame->status, frame->status_size
+        };
+        bundle_frame(cam->bundle, &parts);
+    }
+    if (cam->rtp && next) {
+        rtp_frame(cam->rtp, stream_thermal ? thermal_from : NULL, visible_from, cam->frame_time_ns);
+    }
+    
+    /* Radiometric snapshot: waits for a frame with both parts and no flags */
+    if (snapshot && ThermalSize > 0 && frame->jpeg && !cam->frame_quality) {
+        write_snapshot(cam, frame);
+    }
+    
+    /* Configured stages, synchronously: they read the frame in place */
+    if (cam->pipe) {
+        pipeline_run(cam->pipe, frame->has_thermal ? frame->thermal : NULL, frame->jpeg, frame->jpeg_size,
+                     cam->frame_quality);
+    }
+    
+    if (plugins) submit_plugins(cam, frame);
+    
+    if (next) {
+        frame_unref(frame);
+        cam->cur = next;
+        cam->buf85 = next->packet;
+    }
+}
 
-        /* Verify JPEG EOI (FF D9) */
-        /* Some frames have trailing padding (e.g., D9 00 or 00 00), so we scan the last few bytes */
-        int found_eoi = 0;
-        for (int i = 0; i < 16; i++) {
-            if (JpgSize - 2 - i >= 0) {
-                if (jpg_data[JpgSize - 2 - i] == 0xFF && jpg_data[JpgSize - 1 - i] == 0xD9) {
-                    found_eoi = 1;
-                    break;
-                }
-            }
+/* Read one camera packet from the fake device stream. The stream is
+ * re-framed from the packet headers so every chunk starts on the magic,
+ * just like the bulk transfers from the real camera. */
+int fake_read(struct camera *cam, unsigned char *buf, int size, int *actual) {
+    struct timespec *next = &cam->fake_next;
+    int have = 0;
+    ssize_t r;
+    
+    *actual = 0;
+    
+    /* Header, resyncing byte by byte on garbage */
+    while (have < HEADER_SIZE) {
+        r = read(cam->fd_fake, buf + have, HEADER_SIZE - have);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) return LIBUSB_ERROR_IO;
+        if (r == 0) {
+            /* End of stream: loop regular files, wait for FIFO writers */
+            if (lseek(cam->fd_fake, 0, SEEK_SET) < 0) usleep(10000);
+            return LIBUSB_ERROR_TIMEOUT;
+        }
+        have += r;
+        if (have >= 2 && (buf[0] != MAGIC_0 || buf[1] != MAGIC_1)) {
+            memmove(buf, buf + 1, --have);
+        }
+    }
+    
+    struct packet_sizes sizes;
+    packet_sizes(buf, &sizes);
+    uint32_t FrameSize = sizes.frame;
+    if (FrameSize > (uint32_t)(size - HEADER_SIZE)) {
+        return LIBUSB_ERROR_OVERFLOW;
+    }
+    
+    while (have < HEADER_SIZE + (int)FrameSize) {
+        r = read(cam->fd_fake, buf + have, HEADER_SIZE + FrameSize - have);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return LIBUSB_ERROR_IO;
+        have += r;
+    }
+    *actual = have;
+    
+    /* Pace to the camera frame rate */
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (next->tv_sec == 0 || now.tv_sec > next->tv_sec + 1) *next = now;
+    next->tv_nsec += FAKE_FRAME_US * 1000L;
+    if (next->tv_nsec >= 1000000000L) {
+        next->tv_sec++;
+        next->tv_nsec -= 1000000000L;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, next, NULL);
+    
+    return 0;
+}
+
+/* Hand all cameras over to a successor. Called by the main thread with
+ * every camera thread parked. Returns 0 if we should exit. */
+int hand_off(int conn) {
+    static struct handoff_extra x;
+    
+    for (int c = 0; c < ncameras; c++) {
+        struct camera *cam = cameras[c];
+        struct handoff_state st = {0};
+        int fds[HANDOFF_FD_COUNT] = {
+            cam->fd_fake >= 0 ? cam->fd_fake : cam->usb_fd,
+            cam->fd_thermal, cam->fd_visible, cam->fd_capture
+        };
+        
+        if (fds[HANDOFF_FD_USB] < 0) {
+            fprintf(stderr, "%sCamera was not opened through usbfs, cannot hand off\n", cam->tag);
+            return -1;
         }
         
-        if (!found_eoi) {
-             printf("Warning: Malformed JPEG footer (No EOI). Last bytes: %02X %02X\n", 
-                    jpg_data[JpgSize - 2], jpg_data[JpgSize - 1]);
+        st.magic = HANDOFF_MAGIC;
+        st.version = HANDOFF_VERSION;
+        st.camera_index = c;
+        st.camera_count = ncameras;
+        snprintf(st.id, sizeof(st.id), "%s", cam->id);
+        st.flags = cam->fd_fake >= 0 ? HANDOFF_FLAG_FAKE : 0;
+        if (cam->stream_paused) st.flags |= HANDOFF_FLAG_PAUSED;
+        for (int i = 0; i < HANDOFF_FD_COUNT; i++) {
+            if (fds[i] >= 0) st.fd_mask |= 1u << i;
         }
+        st.frame_count = cam->frame_count;
+        st.buf_len = cam->buf85pointer;
         
-        /* Write full JPEG buffer size as reported by header, PLUS PADDING */
-        /* Padding fixes 'overread' errors in OpenCV/FFmpeg decoders */
-        /* Atomic write strategy: Send everything in one go or drop it. */
-        size_t pad_size = 8192; // 8KB is sufficient for safety
-        size_t total_size = JpgSize + pad_size;
-        unsigned char *padded_jpg = malloc(total_size);
+        /* The other outputs go by name, so nothing is reopened or truncated */
+        x.len = 0;
+        x.nfds = 0;
+        if (pipeline_hand_off(cam->pipe, &x) < 0 || stream_hand_off(cam->streams, &x) < 0 ||
+            rtp_hand_off(cam->rtp, &x) < 0 || bundle_hand_off(cam->bundle, &x) < 0 ||
+            (c == 0 && loopback_hand_off(&x) < 0)) {
+            return -1;
+        }
         
-        if (padded_jpg) {
-            memcpy(padded_jpg, jpg_data, JpgSize);
-            memset(padded_jpg + JpgSize, 0, pad_size);
-            
-            /* Atomic Write: Attempt to send entire frame at once */
-            ssize_t r = write(fd_visible, padded_jpg, total_size);
-            
+        printf("%sHanding off to successor at frame %d\n", cam->tag, cam->frame_count);
+        if (handoff_send(conn, &st, fds, cam->buf85, &x) < 0) return -1;
+    }
+    return handoff_wait_ack(conn);
+}
+
+/* Take over all cameras from a running driver instead of opening them */
+int take_over(const char *path) {
+    struct handoff_state st;
+    int fds[HANDOFF_FD_COUNT];
+    unsigned int count = 1;
+    int r;
+    
+    int conn = handoff_connect(path);
+    if (conn < 0) return -1;
+    
+    for (unsigned int c = 0; c < count; c++) {
+        struct camera *cam = NULL;
+        
+        /* Receive straight into a fresh camera's frame buffer */
+        if (ncameras < MAX_CAMERAS) cam = camera_new("");
+        if (cam) cam->adopt = malloc(sizeof(*cam->adopt));
+        if (!cam || !cam->adopt || handoff_receive(conn, &st, fds, cam->buf85, BUFFER_SIZE, cam->adopt) < 0) {
+            goto fail;
+        }
+        
+        count = st.camera_count;
+        snprintf(cam->id, sizeof(cam->id), "%s", st.id);
+        /* The loopback devices the old driver created are ours to remove */
+        if (c == 0) loopback_adopt(cam->adopt);
+        if (st.flags & HANDOFF_FLAG_FAKE) {
+            cam->fd_fake = fds[HANDOFF_FD_USB];
+        } else {
+            cam->usb_fd = fds[HANDOFF_FD_USB];
+            r = usb_ready ? 0 : libusb_init(NULL);
+            if (r == 0) {
+                usb_ready = 1;
+                r = libusb_wrap_sys_device(NULL, (intptr_t)cam->usb_fd, &cam->dev);
+            }
             if (r < 0) {
-                 if (errno != EAGAIN && errno != EINTR) {
-                      perror("write visible failed");
-                 }
-            } else if (r != total_size) {
-                 /* Partial write occurred - this destroys the frame structure for v4l2loopback */
-                 /* We must DROP this frame rather than sending the rest later */
-                 printf("Warning: Dropped frame (Atomic write failed: %zd/%zd bytes)\n", r, total_size);
+                /* No ack: the old driver keeps streaming */
+                fprintf(stderr, "Cannot wrap handed-off USB fd: %s\n", libusb_error_name(r));
+                cam->fd_thermal = fds[HANDOFF_FD_THERMAL];
+                cam->fd_visible = fds[HANDOFF_FD_VISIBLE];
+                cam->fd_capture = fds[HANDOFF_FD_CAPTURE];
+                goto fail;
+            }
+            /* Claims belong to the shared usbfs file; this just syncs libusb */
+            for (int i = 0; i < 3; i++) {
+                libusb_claim_interface(cam->dev, i);
             }
-            
-            free(padded_jpg);
-        } else {
-            /* Fallback */
-            write(fd_visible, jpg_data, JpgSize);
         }
+        cam->fd_thermal = fds[HANDOFF_FD_THERMAL];
+        cam->fd_visible = fds[HANDOFF_FD_VISIBLE];
+        cam->fd_capture = fds[HANDOFF_FD_CAPTURE];
+        cam->buf85pointer = st.buf_len;
+        cam->frame_count = st.frame_count;
+        cam->stream_paused = (st.flags & HANDOFF_FLAG_PAUSED) != 0;
+    }
+    
+    handoff_ack(conn);
+    printf("Took over %d camera(s)\n", ncameras);
+    return 0;
+
+fail:
+    /* Not ours yet: cleanup() must not stop the old driver's streams */
+    handed_off = 1;
+    close(conn);
+    return -1;
+}
+
+/* Block a camera thread while the main thread hands the cameras off */
+void park_camera(void) {
+    pthread_mutex_lock(&park_lock);
+    parked++;
+    pthread_cond_broadcast(&park_cond);
+    while (park_request) {
+        pthread_cond_wait(&park_cond, &park_lock);
     }
+    parked--;
+    pthread_mutex_unlock(&park_lock);
 }
 
 /* Main read loop */
-void run_loop(void) {
-    unsigned char buf[BUFFER_SIZE];
+void run_loop(struct camera *cam) {
+    unsigned char *buf = cam->xfer;
     int actual;
     int r;
     
-    printf("Reading from camera...\n");
+    printf("%sReading from camera...\n", cam->tag);
+    cam->m.start_ms = now_ms();
     
     while (running) {
+        /* A successor is waiting: stop between transfers */
+        if (park_request) {
+            park_camera();
+            continue;
+        }
+        
+        if (on_demand) {
+            update_demand(cam);
+            if (cam->stream_paused) {
+                /* Nothing to read: sleep until a consumer shows up */
+                demand_wait(&cam->demand, 100);
+                if (cam->fd_fake < 0) {
+                    r = libusb_bulk_transfer(cam->dev, 0x83, buf, BUFFER_SIZE, &actual, 10);
+                    if (r == LIBUSB_ERROR_NO_DEVICE) {
+                        fprintf(stderr, "%sDevice disconnected\n", cam->tag);
+                        break;
+                    }
+                }
+                continue;
+            }
+        }
+        
+        if (cam->fd_fake >= 0) {
+            r = fake_read(cam, buf, BUFFER_SIZE, &actual);
+            if (actual > 0) {
+                cam->m.transfers++;
+                cam->m.bytes += actual;
+                vframe(cam, r, actual, buf);
+            }
+            continue;
+        }
+        
         /* Poll EP 0x85 (frame data) - 100ms timeout */
-        r = libusb_bulk_transfer(dev, 0x85, buf, sizeof(buf), &actual, 100);
+        r = libusb_bulk_transfer(cam->dev, 0x85, buf, BUFFER_SIZE, &actual, 100);
+        if (r < 0 && r != LIBUSB_ERROR_TIMEOUT) cam->m.usb_errors++;
         if (actual > 0) {
-            vframe(r, actual, buf);
+            cam->m.transfers++;
+            cam->m.bytes += actual;
+            if (cam->fd_capture >= 0 && write(cam->fd_capture, buf, actual) != actual) {
+                perror("capture write failed");
+            }
+            vframe(cam, r, actual, buf);
         }
         
-        /* Poll EP 0x81 (status) */
-        r = libusb_bulk_transfer(dev, 0x81, buf, sizeof(buf), &actual, 10);
-        
         /* Poll EP 0x83 (file I/O) - detects disconnect */
-        r = libusb_bulk_transfer(dev, 0x83, buf, sizeof(buf), &actual, 10);
+        r = libusb_bulk_transfer(cam->dev, 0x83, buf, BUFFER_SIZE, &actual, 10);
         if (r == LIBUSB_ERROR_NO_DEVICE) {
-            fprintf(stderr, "Device disconnected\n");
+            fprintf(stderr, "%sDevice disconnected\n", cam->tag);
             break;
         }
     }
 }
 
+/* Factory constants: the per-serial cache, else a FILEIO download of the
+ * camera files (cached for next time), else camera_config.json. Runs on the
+ * camera thread before the status channel starts, so the EP 0x83 reads
+ * have interface 1 to themselves. */
+void load_calibration(struct camera *cam) {
+    char key[CAMERA_ID_LEN], path[512];
+    
+    camera_key(cam, key, sizeof(key));
+    snprintf(path, sizeof(path), "%s/%s.json", calib_dir, key);
+    
+    uint64_t t0 = now_us();
+    if (calib_load(&cam->calib, path) == 0) {
+        snprintf(cam->calib.source, sizeof(cam->calib.source), "cache");
+        printf("%sCalibration: %s (%lu us)\n", cam->tag, path, (unsigned long)(now_us() - t0));
+        return;
+    }
+    
+    struct fileio f;
+    int have_fileio = -1;
+    if (cam->dev) have_fileio = fileio_open_usb(&f, cam->dev);
+    else if (fake_files) have_fileio = fileio_open_script(&f, fake_files);
+    
+    if (have_fileio == 0) {
+        unsigned char *data;
+        size_t len;
+        if (fileio_read_file(&f, CAMERA_FILES, &data, &len) == 0) {
+            if (calib_parse(&cam->calib, data, len) == 0) {
+                printf("%sCalibration: %s from camera (%zu bytes, %lu ms), R1=%g B=%g F=%g O=%g\n",
+                       cam->tag, CAMERA_FILES, len, (unsigned long)((now_us() - t0) / 1000),
+                       cam->calib.r1, cam->calib.b, cam->calib.f, cam->calib.o);
+                mkdir(calib_dir, 0755);
+                if (calib_save(&cam->calib, path) < 0) {
+                    fprintf(stderr, "%sCannot write %s: %s\n", cam->tag, path, strerror(errno));
+                }
+            } else {
+                fprintf(stderr, "%sNo Planck constants in %s\n", cam->tag, CAMERA_FILES);
+            }
+            free(data);
+        }
+        fileio_close(&f);
+        if (cam->calib.valid) return;
+    }
+    
+    if (calib_load(&cam->calib, "camera_config.json") == 0) {
+        snprintf(cam->calib.source, sizeof(cam->calib.source), "default");
+        printf("%sCalibration: camera_config.json\n", cam->tag);
+    } else {
+        fprintf(stderr, "%sNo calibration available\n", cam->tag);
+    }
+}
+
+/* Bulk-IN buffer in usbfs memory (mmap of the device file): the kernel
+ * DMAs transfers straight into it instead of copying each one out of its
+ * own URB buffer. Needs Linux 4.6 and room under usbfs_memory_mb; the
+ * heap buffer stays in use otherwise. */
+void alloc_transfer_buffer(struct camera *cam) {
+    if (!cam->dev || !usb_dma) return;
+#if LIBUSB_API_VERSION >= 0x01000105
+    unsigned char *buf = libusb_dev_mem_alloc(cam->dev, BUFFER_SIZE);
+    if (buf) {
+        cam->xfer = buf;
+        cam->xfer_dma = 1;
+        printf("%sUSB reads: zero-copy (usbfs memory)\n", cam->tag);
+        return;
+    }
+#endif
+    printf("%sUSB reads: copied (no usbfs memory)\n", cam->tag);
+}
+
+void free_transfer_buffer(struct camera *cam) {
+#if LIBUSB_API_VERSION >= 0x01000105
+    if (cam->xfer_dma) libusb_dev_mem_free(cam->dev, cam->xfer, BUFFER_SIZE);
+#endif
+    cam->xfer = cam->xfer_heap;
+    cam->xfer_dma = 0;
+}
+
+/* Read throughput and the camera thread's CPU time per frame, split into
+ * user and system time (where the kernel copy shows up). Called on the
+ * camera thread when its loop ends. */
+void report_usb(struct camera *cam) {
+    struct rusage ru;
+    if (getrusage(RUSAGE_THREAD, &ru) < 0 || cam->m.frames == 0) return;
+    
+    double secs = (now_ms() - cam->m.start_ms) / 1000.0;
+    double user_us = ru.ru_utime.tv_sec * 1e6 + ru.ru_utime.tv_usec;
+    double sys_us = ru.ru_stime.tv_sec * 1e6 + ru.ru_stime.tv_usec;
+    printf("%sUSB reads (%s): %.2f MB/s, CPU per frame %.0f us user + %.0f us system\n",
+           cam->tag, cam->dev ? (cam->xfer_dma ? "zero-copy" : "copied") : "fake",
+           secs > 0 ? cam->m.bytes / secs / 1e6 : 0,
+           user_us / cam->m.frames, sys_us / cam->m.frames);
+}
+
+void *camera_thread(void *arg) {
+    struct camera *cam = arg;
+    
+    devclock_init(&cam->clock, clock_offset, clock_hz);
+    load_calibration(cam);
+    status_start(cam);
+    alloc_transfer_buffer(cam);
+    run_loop(cam);
+    report_usb(cam);
+    free_transfer_buffer(cam);
+    
+    /* A parked handoff may be waiting for this thread */
+    pthread_mutex_lock(&park_lock);
+    cam->thread_running = 0;
+    threads_running--;
+    pthread_cond_broadcast(&park_cond);
+    pthread_mutex_unlock(&park_lock);
+    return NULL;
+}
+
+/* Park every camera thread, hand off, and release them again */
+void serve_handoff(int conn) {
+    pthread_mutex_lock(&park_lock);
+    park_request = 1;
+    while (parked < threads_running) {
+        pthread_cond_wait(&park_cond, &park_lock);
+    }
+    
+    /* Two processes must never have URBs in flight on the same usbfs file */
+    for (int i = 0; i < ncameras; i++) status_stop(cameras[i]);
+    
+    if (hand_off(conn) == 0) {
+        handed_off = 1;
+        running = 0;
+    } else {
+        for (int i = 0; i < ncameras; i++) status_start(cameras[i]);
+    }
+    
+    park_request = 0;
+    pthread_cond_broadcast(&park_cond);
+    pthread_mutex_unlock(&park_lock);
+    close(conn);
+}
+
+void print_metrics(void) {
+    for (int i = 0; i < ncameras; i++) {
+        struct camera *cam = cameras[i];
+        printf("[%s] frames=%lu transfers=%lu bytes=%lu usb_errors=%lu "
+               "thermal=%lu visible=%lu visible_dropped=%lu visible_invalid=%lu flagged=%lu held=%lu%s\n",
+               cam->id, cam->m.frames, cam->m.transfers, cam->m.bytes, cam->m.usb_errors,
+               cam->m.thermal_writes, cam->m.visible_writes, cam->m.visible_dropped, cam->m.visible_invalid,
+               cam->m.frames_flagged, cam->m.frames_held,
+               cam->stream_paused ? " (paused)" : "");
+        if (cam->clock.offset >= 0) {
+            printf("[%s] clock %s jitter=%.0fus drift=%.1fppm outliers=%lu resyncs=%lu\n",
+                   cam->id, cam->clock.locked ? "locked" : "unlocked", cam->clock.jitter_ns / 1000,
+                   devclock_drift_ppm(&cam->clock), cam->clock.outliers, cam->clock.resyncs);
+        }
+    }
+}
+
 /* Cleanup */
 void cleanup(void) {
-    if (dev) {
-        unsigned char data[2] = {0, 0};
-        libusb_control_transfer(dev, 1, 0x0b, 0, 2, data, 0, 100);
-        libusb_control_transfer(dev, 1, 0x0b, 0, 1, data, 0, 100);
+    for (int c = 0; c < ncameras; c++) {
+        struct camera *cam = cameras[c];
         
-        for (int i = 0; i < 3; i++) {
-            libusb_release_interface(dev, i);
+        /* After a handoff the successor owns the stream: leave the camera alone */
+        if (cam->dev) {
+            libusb_device_handle *dev = cam->dev;
+            status_stop(cam);
+            if (!handed_off) {
+                unsigned char data[2] = {0, 0};
+                libusb_control_transfer(dev, 1, 0x0b, 0, 2, data, 0, 100);
+                libusb_control_transfer(dev, 1, 0x0b, 0, 1, data, 0, 100);
+                
+                for (int i = 0; i < 3; i++) {
+                    libusb_release_interface(dev, i);
+                }
+                libusb_reset_device(dev);
+            }
+            libusb_close(dev);
         }
-        libusb_reset_device(dev);
-        libusb_close(dev);
+        
+        if (cam->usb_fd >= 0) close(cam->usb_fd);
+        if (cam->fd_fake >= 0) close(cam->fd_fake);
+        if (cam->fd_capture >= 0) close(cam->fd_capture);
+        if (cam->fd_thermal >= 0) close(cam->fd_thermal);
+        if (cam->fd_visible >= 0) close(cam->fd_visible);
+        pipeline_destroy(cam->pipe);
+        stream_close(cam->streams);
+        rtp_close(cam->rtp);
+        record_close(cam->record);
+        bundle_close(cam->bundle, !handed_off);
+        if (cam->adopt) {
+            handoff_extra_close(cam->adopt);
+            free(cam->adopt);
+        }
+        frame_unref(cam->thermal_good);
+        frame_unref(cam->visible_good);
+        frame_pool_destroy(cam->frames);
+        free(cam);
     }
-    libusb_exit(NULL);
+    ncameras = 0;
+    if (usb_ready) libusb_exit(NULL);
+    
+    /* After a handoff the successor writes to them */
+    if (!handed_off) loopback_remove_all();
     
-    if (fd_thermal >= 0) close(fd_thermal);
-    if (fd_visible >= 0) close(fd_visible);
+    if (fd_handoff >= 0) close(fd_handoff);
     
     printf("Cleanup complete\n");
 }
 
+/* --camera ID=THERMAL,VISIBLE where ID is a USB serial, a bus-port path
+ * such as 1-2.3, or fake:FILE */
+int parse_camera_spec(char *spec) {
+    char *eq = strrchr(spec, '=');
+    if (!eq) return -1;
+    *eq = '\0';
+    
+    char *visible = strchr(eq + 1, ',');
+    if (visible) *visible++ = '\0';
+    
+    struct camera *cam = camera_new(spec);
+    if (!cam) return -1;
+    cam->thermal_path = eq[1] ? eq + 1 : NULL;
+    cam->visible_path = (visible && *visible) ? visible : NULL;
+    return 0;
+}
+
+/* --device-clock 24:1000000 */
+int parse_device_clock(const char *spec) {
+    char *end;
+    long offset = strtol(spec, &end, 0);
+    if (end == spec || offset < 4 || offset > HEADER_SIZE - 4) return -1;
+    if (*end == ':') {
+        clock_hz = strtod(end + 1, &end);
+        if (clock_hz <= 0) return -1;
+    }
+    if (*end) return -1;
+    clock_offset = offset;
+    return 0;
+}
+
+/* --ffc-policy thermal=hold */
+int parse_ffc_policy(const char *spec) {
+    const char *eq = strchr(spec, '=');
+    if (!eq) return -1;
+    int policy = status_parse_policy(eq + 1);
+    if (policy < 0) return -1;
+    
+    if (strncmp(spec, "thermal=", 8) == 0) policy_thermal = policy;
+    else if (strncmp(spec, "visible=", 8) == 0) policy_visible = policy;
+    else return -1;
+    return 0;
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [options] [thermal_device] [visible_device]\n"
+        "  --fake FILE             read camera packets from FILE or a FIFO instead of USB\n"
+        "  --capture FILE          append raw EP 0x85 data to FILE (input for --fake)\n"
+        "  --camera ID=THERM,VIS   run camera ID (USB serial, bus-port like 1-2.3, or\n"
+        "                          fake:FILE) with its own sinks; repeat for up to %d\n"
+        "  --handoff-socket PATH   accept live upgrades on the Unix socket PATH\n"
+        "  --takeover              take over the stream from the driver on --handoff-socket\n"
+        "                          (same output options; not with --record)\n"
+        "  --on-demand             only stream from the camera while a consumer is attached\n"
+        "  --plugin PATH[:ARGS]    run a frame processor plugin (.so); repeatable\n"
+        "  --sink NAME=PATH        open a named output for plugins (\"metadata\" gets\n"
+        "                          per-frame metadata, \"telemetry\" the camera status\n"
+        "                          messages, both as JSON lines)\n"
+        "  --workers N             plugin and pipeline worker threads (default 2)\n"
+        "  --pipeline FILE         run the processing stages declared in FILE\n"
+        "  --ffc-policy OUT=POL    what the thermal or visible output does with frames\n"
+        "                          flagged during FFC: pass (default), drop or hold\n"
+        "  --uniform-range N       flag thermal frames flatter than N raw counts as\n"
+        "                          closed shutter (default %d, 0 = off)\n"
+        "  --calib-dir DIR         per-serial calibration cache (default calibration)\n"
+        "  --fake-files DIR        serve DIR over a scripted FILEIO channel to --fake\n"
+        "                          cameras (for testing the calibration download)\n"
+        "  --device-clock OFF[:HZ] timestamp frames from the LE32 device tick counter at\n"
+        "                          header byte OFF (rate HZ, for drift reporting)\n"
+        "  --snapshot-dir DIR      on SIGUSR1, save the next good frame of each camera\n"
+        "                          to DIR as a radiometric JPEG\n"
+        "  --stream FMT:PATH       write y16, y4m, mjpeg or nut to PATH (\"-\" for\n"
+        "                          stdout, the log then goes to stderr); repeatable\n"
+        "  --rtp STREAM=HOST:PORT  send thermal (RFC 4175) or visible (RFC 2435) over\n"
+        "                          RTP; options ,mtu=N ,rate=KBPS ,sdp=FILE; repeatable\n"
+        "  --record PATH           record thermal (lossless FFV1) and visible (MJPEG)\n"
+        "                          to the Matroska file PATH\n"
+        "  --bundle DEST           one record per packet with metadata, thermal and\n"
+        "                          visible, to a file, FIFO, \"-\" (stdout), unix:PATH\n"
+        "                          (seqpacket socket) or shm:NAME (ring in /dev/shm);\n"
+        "                          repeatable\n"
+        "  --loopback              use the v4l2loopback devices labelled FLIR_Thermal\n"
+        "                          and FLIR_Visible, creating them if missing; any\n"
+        "                          output path may also be label:NAME\n"
+        "  --usb-copy              read into a heap buffer even where usbfs zero-copy\n"
+        "                          buffers are available (for comparison)\n",
+        prog, MAX_CAMERAS, STATUS_UNIFORM_RANGE);
+}
+
 int main(int argc, char **argv) {
     printf("FLIR One Pro LT Driver\n");
     printf("======================\n\n");
     
     char *dev_thermal_path = VIDEO_THERMAL;
     char *dev_visible_path = VIDEO_VISIBLE;
-
-    if (argc >= 2) dev_thermal_path = argv[1];
-    if (argc >= 3) dev_visible_path = argv[2];
-
-    printf("Target Thermal: %s\n", dev_thermal_path);
-    printf("Target Visible: %s\n", dev_visible_path);
+    const char *fake_path = NULL;
+    const char *capture_path = NULL;
+    int takeover = 0;
+    int loopback = 0;
+    int workers = 2;
     
-    signal(SIGINT, signal_handler);
-    signal(SIGTERM, signal_handler);
+    static const struct option long_options[] = {
+        { "fake",           required_argument, NULL, 'f' },
+        { "capture",        required_argument, NULL, 'c' },
+        { "camera",         required_argument, NULL, 'C' },
+        { "handoff-socket", required_argument, NULL, 's' },
+        { "takeover",       no_argument,       NULL, 't' },
+        { "on-demand",      no_argument,       NULL, 'd' },
+        { "plugin",         required_argument, NULL, 'p' },
+        { "sink",           required_argument, NULL, 'S' },
+        { "workers",        required_argument, NULL, 'w' },
+        { "pipeline",       required_argument, NULL, 'P' },
+        { "ffc-policy",     required_argument, NULL, 'F' },
+        { "uniform-range",  required_argument, NULL, 'u' },
+        { "calib-dir",      required_argument, NULL, 'D' },
+        { "fake-files",     required_argument, NULL, 'A' },
+        { "device-clock",   required_argument, NULL, 'T' },
+        { "snapshot-dir",   required_argument, NULL, 'R' },
+        { "stream",         required_argument, NULL, 'o' },
+        { "rtp",            required_argument, NULL, 'r' },
+        { "record",         required_argument, NULL, 'M' },
+        { "bundle",         required_argument, NULL, 'B' },
+        { "loopback",       no_argument,       NULL, 'L' },
+        { "usb-copy",       no_argument,       NULL, 'U' },
+        { "help",           no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'f': fake_path = optarg; break;
+        case 'c': capture_path = optarg; break;
+        case 'C':
+            if (parse_camera_spec(optarg) < 0) {
+                fprintf(stderr, "Invalid --camera spec (ID=THERMAL,VISIBLE)\n");
+                return 1;
+            }
+            break;
+        case 's': handoff_path = optarg; break;
+        case 't': takeover = 1; break;
+        case 'd': on_demand = 1; break;
+        case 'U': usb_dma = 0; break;
+        case 'L':
+            dev_thermal_path = LOOPBACK_PREFIX LOOPBACK_THERMAL;
+            dev_visible_path = LOOPBACK_PREFIX LOOPBACK_VISIBLE;
+            loopback = 1;
+            break;
+        case 'p':
+            if (plugin_load(optarg) < 0) return 1;
+            break;
+        case 'S':
+            if (sink_add(optarg) < 0) return 1;
+            break;
+        case 'F':
+            if (parse_ffc_policy(optarg) < 0) {
+                fprintf(stderr, "Invalid --ffc-policy (thermal|visible=pass|drop|hold)\n");
+                return 1;
+            }
+            break;
+        case 'u': status_uniform_range = atoi(optarg); break;
+        case 'D': calib_dir = optarg; break;
+        case 'A': fake_files = optarg; break;
+        case 'R': snapshot_dir = optarg; break;
+        case 'o':
+            if (stream_add(optarg) < 0) return 1;
+            break;
+        case 'r':
+            if (rtp_add(optarg) < 0) return 1;
+            break;
+        case 'M':
+            if (record_add(optarg) < 0) return 1;
+            break;
+        case 'B':
+            if (bundle_add(optarg) < 0) return 1;
+            break;
+        case 'T':
+            if (parse_device_clock(optarg) < 0) {
+                fprintf(stderr, "Invalid --device-clock (OFFSET[:HZ], offset 4..%d)\n", HEADER_SIZE - 4);
+                return 1;
+            }
+            break;
+        case 'P':
+            if (pipeline_load(optarg) < 0) return 1;
+            break;
+        case 'w':
+            workers = atoi(optarg);
+            if (workers < 1 || workers > WORKQ_MAX_THREADS) {
+                fprintf(stderr, "--workers must be 1..%d\n", WORKQ_MAX_THREADS);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
     
-    if (init_usb() < 0) {
+    if (takeover && !handoff_path) {
+        fprintf(stderr, "--takeover requires --handoff-socket\n");
+        return 1;
+    }
+    if (takeover && ncameras > 0) {
+        fprintf(stderr, "--takeover gets its cameras from the running driver\n");
+        return 1;
+    }
+    if (handoff_path && record_count() > 0) {
+        /* A successor would have to continue the old one's Matroska cluster */
+        fprintf(stderr, "--record cannot be handed off: do not combine it with --handoff-socket\n");
         return 1;
     }
     
-    /* Open V4L2 devices - thermal as 16-bit raw (Y16) */
-    fd_thermal = open_v4l2_output(dev_thermal_path, THERMAL_WIDTH, THERMAL_HEIGHT, V4L2_PIX_FMT_Y16);
-    fd_visible = open_v4l2_output(dev_visible_path, VISIBLE_WIDTH, VISIBLE_HEIGHT, V4L2_PIX_FMT_MJPEG);
+    if (optind < argc) dev_thermal_path = argv[optind];
+    if (optind + 1 < argc) dev_visible_path = argv[optind + 1];
     
-    if (fd_thermal < 0 && fd_visible < 0) {
-        fprintf(stderr, "No output devices available\n");
-        cleanup();
-        return 1;
+    /* With a pipeline, streams, RTP, a recording or bundles the built-in outputs are only opened when named */
+    if ((pipeline_loaded() || stream_count() > 0 || rtp_count() > 0 || record_count() > 0 || bundle_count() > 0) &&
+        optind >= argc && !loopback) {
+        dev_thermal_path = NULL;
+        dev_visible_path = NULL;
+    }
+    
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+    if (snapshot_dir) signal(SIGUSR1, snapshot_handler);
+    
+    if (takeover) {
+        /* Cameras, sinks and partial frames all come from the old process */
+        if (take_over(handoff_path) < 0) {
+            cleanup();
+            return 1;
+        }
+    } else {
+        /* Single camera: --fake or the first device, positional sinks */
+        if (ncameras == 0 && fake_path) {
+            char id[CAMERA_ID_LEN];
+            snprintf(id, sizeof(id), "fake:%s", fake_path);
+            camera_new(id);
+        }
+        if (ncameras <= 1 && cameras[0] && !cameras[0]->thermal_path && !cameras[0]->visible_path) {
+            cameras[0]->thermal_path = dev_thermal_path;
+            cameras[0]->visible_path = dev_visible_path;
+        }
+        
+        int need_usb = 0;
+        for (int i = 0; i < ncameras; i++) {
+            struct camera *cam = cameras[i];
+            if (strncmp(cam->id, "fake:", 5) != 0) {
+                need_usb = 1;
+                continue;
+            }
+            cam->fd_fake = open(cam->id + 5, O_RDONLY | O_CLOEXEC);
+            if (cam->fd_fake < 0) {
+                fprintf(stderr, "Cannot open %s: %s\n", cam->id + 5, strerror(errno));
+                cleanup();
+                return 1;
+            }
+            printf("Fake device: %s\n", cam->id + 5);
+        }
+        if ((ncameras == 0 || need_usb) && init_usb() < 0) {
+            cleanup();
+            return 1;
+        }
+        if (ncameras == 1 && !cameras[0]->thermal_path && !cameras[0]->visible_path) {
+            /* Camera found by auto-detection */
+            cameras[0]->thermal_path = dev_thermal_path;
+            cameras[0]->visible_path = dev_visible_path;
+        }
+        
+        int outputs = 0;
+        for (int i = 0; i < ncameras; i++) {
+            struct camera *cam = cameras[i];
+            if (!cam->dev && cam->fd_fake < 0) continue;
+            
+            if (ncameras > 1) snprintf(cam->tag, sizeof(cam->tag), "[%s] ", cam->id);
+            printf("%sTarget Thermal: %s\n", cam->tag, cam->thermal_path ? cam->thermal_path : "-");
+            printf("%sTarget Visible: %s\n", cam->tag, cam->visible_path ? cam->visible_path : "-");
+            
+            if (capture_path && ncameras == 1) {
+                cam->fd_capture = open(capture_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+                if (cam->fd_capture < 0) {
+                    fprintf(stderr, "Cannot open %s: %s\n", capture_path, strerror(errno));
+                }
+            }
+            
+            /* Open V4L2 devices - thermal as 16-bit raw (Y16) */
+            if (cam->thermal_path) {
+                cam->fd_thermal = open_v4l2_output(cam->thermal_path, THERMAL_WIDTH, THERMAL_HEIGHT, V4L2_PIX_FMT_Y16);
+            }
+            if (cam->visible_path) {
+                cam->fd_visible = open_v4l2_output(cam->visible_path, VISIBLE_WIDTH, VISIBLE_HEIGHT, V4L2_PIX_FMT_MJPEG);
+            }
+            
+            if (cam->fd_thermal < 0 && cam->fd_visible < 0 && plugin_count() == 0 && !pipeline_loaded() &&
+                stream_count() == 0 && rtp_count() == 0 && record_count() == 0 && bundle_count() == 0) {
+                fprintf(stderr, "%sNo output devices available\n", cam->tag);
+                continue;
+            }
+            
+            if (cam->fd_fake < 0 && start_streaming(cam) < 0) {
+                continue;
+            }
+            cam->thread_running = 1;
+            outputs++;
+        }
+        
+        if (outputs == 0) {
+            cleanup();
+            return 1;
+        }
     }
     
-    if (start_streaming() < 0) {
+    if (plugins_start(workers) < 0 || pipeline_start(workers) < 0) {
         cleanup();
         return 1;
     }
     
-    run_loop();
+    if (handoff_path) {
+        fd_handoff = handoff_listen(handoff_path);
+    }
+    
+    /* One independent pipeline thread per camera */
+    for (int i = 0; i < ncameras; i++) {
+        struct camera *cam = cameras[i];
+        if (takeover) {
+            if (ncameras > 1) snprintf(cam->tag, sizeof(cam->tag), "[%s] ", cam->id);
+            cam->thread_running = 1;
+        }
+        if (!cam->thread_running) continue;
+        
+        if (pipeline_loaded()) {
+            cam->pipe = pipeline_create(cam->index, cam->tag, &cam->demand, cam->adopt);
+            if (!cam->pipe) {
+                fprintf(stderr, "%sCannot set up the pipeline outputs\n", cam->tag);
+                cam->thread_running = 0;
+                continue;
+            }
+        }
+        
+        if (stream_count() > 0) cam->streams = stream_open(cam->index, cam->tag, &cam->demand, cam->adopt);
+        if (rtp_count() > 0) cam->rtp = rtp_open(cam->index, cam->tag, &cam->demand, cam->adopt);
+        if (record_count() > 0) cam->record = record_open(cam->index, cam->tag, &cam->demand);
+        if (bundle_count() > 0) cam->bundle = bundle_open(cam->index, cam->tag, &cam->demand, cam->adopt);
+        
+        /* Whatever the old driver had that we were not configured for */
+        if (cam->adopt) {
+            handoff_extra_close(cam->adopt);
+            free(cam->adopt);
+            cam->adopt = NULL;
+        }
+        
+        if (on_demand) {
+            snprintf(cam->thermal_name, sizeof(cam->thermal_name), "%sThermal", cam->tag);
+            snprintf(cam->visible_name, sizeof(cam->visible_name), "%sVisible", cam->tag);
+            if (cam->fd_thermal >= 0) demand_add_v4l2(&cam->demand, cam->fd_thermal, cam->thermal_name);
+            if (cam->fd_visible >= 0) demand_add_v4l2(&cam->demand, cam->fd_visible, cam->visible_name);
+            if (plugin_count() > 0) demand_add(&cam->demand, "Plugins", DEMAND_UNKNOWN);
+        }
+        
+        if (pthread_create(&cam->thread, NULL, camera_thread, cam) != 0) {
+            fprintf(stderr, "%sCannot start camera thread\n", cam->tag);
+            cam->thread_running = 0;
+            continue;
+        }
+        threads_running++;
+    }
+    
+    /* Main thread: live upgrades and metrics */
+    uint64_t next_metrics = now_ms() + METRICS_INTERVAL_MS;
+    while (running && threads_running > 0) {
+        struct pollfd pfd = { fd_handoff, POLLIN, 0 };
+        poll(&pfd, fd_handoff >= 0 ? 1 : 0, 200);
+        
+        if (fd_handoff >= 0 && (pfd.revents & POLLIN)) {
+            int conn = handoff_accept(fd_handoff);
+            if (conn >= 0) serve_handoff(conn);
+        }
+        
+        if (ncameras > 1 && now_ms() >= next_metrics) {
+            print_metrics();
+            next_metrics += METRICS_INTERVAL_MS;
+        }
+    }
+    running = 0;
+    
+    for (int i = 0; i < ncameras; i++) {
+        if (cameras[i]->thread) pthread_join(cameras[i]->thread, NULL);
+    }
+    if (ncameras > 1) print_metrics();
+    
+    /* Plugins may still be reading camera buffers */
+    if (plugin_count() > 0) plugins_stop();
+    pipeline_stop();
+    sink_close_all();
     cleanup();
     
     return 0;
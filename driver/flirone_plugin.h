@@ -0,0 +1,102 @@
+/*
+ * FLIR One Pro LT Linux Driver - frame processor plugin ABI
+ *
+ * Plugins are shared objects loaded with --plugin PATH[:ARGS]. Each one
+ * exports flirone_plugin_entry(), returning a struct flirone_plugin.
+ *
+ * process() gets read-only, zero-copy views of the frame. They stay valid
+ * until process() returns; copy anything you need later. Calls to a plugin
+ * for one camera never overlap, but different cameras run concurrently on the
+ * worker pool, so shared plugin state needs its own locking.
+ *
+ * Compatibility: structs only ever grow at the end. Check struct_size
+ * before touching fields added after FLIRONE_PLUGIN_ABI 1.
+ */
+
+#ifndef FLIRONE_PLUGIN_H
+#define FLIRONE_PLUGIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FLIRONE_PLUGIN_ABI      1
+#define FLIRONE_PLUGIN_ENTRY    "flirone_plugin_entry"
+
+/* Shutter / flat-field calibration state when a frame was captured */
+#define FLIRONE_FFC_UNKNOWN     0
+#define FLIRONE_FFC_IDLE        1
+#define FLIRONE_FFC_RUNNING     2   /* shutter closed: thermal data is not the scene */
+
+/* Frame quality flags; any of them set means the thermal data is not usable */
+#define FLIRONE_QUALITY_FFC         0x01    /* camera reports FFC / closed shutter */
+#define FLIRONE_QUALITY_UNIFORM     0x02    /* flat frame, looks like the shutter */
+#define FLIRONE_QUALITY_SETTLING    0x04    /* first frames after an FFC */
+
+struct flirone_frame {
+    uint32_t struct_size;
+    int32_t  camera_index;
+    const char *camera_id;
+    uint32_t sequence;          /* per-camera frame counter */
+    uint64_t timestamp_ns;      /* host CLOCK_MONOTONIC when the frame completed, or
+                                   derived from the device clock (--device-clock) */
+
+    const uint8_t *header;      /* raw camera packet header */
+    uint32_t header_size;
+
+    const uint16_t *thermal;    /* de-interleaved raw counts, row-major */
+    uint16_t thermal_width;
+    uint16_t thermal_height;
+
+    const uint8_t *jpeg;        /* visible JPEG as sent by the camera */
+    uint32_t jpeg_size;
+
+    const uint8_t *status;      /* status block following the JPEG */
+    uint32_t status_size;
+
+    void *host_private;         /* do not touch */
+
+    int32_t ffc_state;          /* FLIRONE_FFC_*, latest camera status report */
+    uint32_t quality;           /* FLIRONE_QUALITY_* flags, 0 for a good frame */
+
+    uint64_t arrival_ns;        /* host CLOCK_MONOTONIC of the frame's first USB transfer */
+};
+
+struct flirone_host {
+    uint32_t struct_size;
+    uint32_t abi_version;
+
+    /* Attach a key/value to the frame; published with the frame's metadata
+     * record on the "metadata" sink. Returns 0, or -1 if the record is full. */
+    int (*set_metadata)(const struct flirone_frame *frame, const char *key, const char *value);
+
+    /* Write one record to the named sink (--sink NAME=PATH). Returns 0, or
+     * -1 if the sink does not exist or the record was dropped. */
+    int (*emit)(const char *sink, const void *data, size_t size);
+
+    void (*log)(const char *plugin, const char *fmt, ...);
+};
+
+struct flirone_plugin {
+    uint32_t abi_version;       /* FLIRONE_PLUGIN_ABI the plugin was built for */
+    const char *name;
+
+    /* args is the text after ':' in --plugin, or "" */
+    void *(*create)(const struct flirone_host *host, const char *args);
+
+    /* Return < 0 to report an error (counted, the frame still flows) */
+    int (*process)(void *instance, const struct flirone_frame *frame);
+
+    void (*destroy)(void *instance);
+};
+
+typedef const struct flirone_plugin *(*flirone_plugin_entry_fn)(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ * FLIR One Pro LT Linux Driver - shared frame buffers
+ *
+ * The pool is one aligned allocation with a mutex-protected free stack;
+ * references are atomic, so only getting and returning a frame locks.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "frame.h"
+
+struct frame_pool {
+    struct frame *frames;
+    pthread_mutex_t lock;
+    struct frame *free[FRAME_POOL_SIZE];
+    int nfree;
+};
+
+struct frame_pool *frame_pool_create(void) {
+    struct frame_pool *p = calloc(1, sizeof(*p));
+    if (!p) return NULL;
+    if (posix_memalign((void **)&p->frames, FRAME_ALIGN, FRAME_POOL_SIZE * sizeof(struct frame)) != 0) {
+        free(p);
+        return NULL;
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    for (int i = 0; i < FRAME_POOL_SIZE; i++) {
+        struct frame *f = &p->frames[i];
+        memset(f, 0, offsetof(struct frame, thermal));
+        f->pool = p;
+        p->free[p->nfree++] = f;
+    }
+    return p;
+}
+
+void frame_pool_destroy(struct frame_pool *p) {
+    if (!p) return;
+    pthread_mutex_destroy(&p->lock);
+    free(p->frames);
+    free(p);
+}
+
+struct frame *frame_get(struct frame_pool *p) {
+    struct frame *f = NULL;
+
+    pthread_mutex_lock(&p->lock);
+    if (p->nfree > 0) f = p->free[--p->nfree];
+    pthread_mutex_unlock(&p->lock);
+    if (!f) return NULL;
+
+    f->refs = 1;
+    f->thermal_size = 0;
+    f->jpeg_size = 0;
+    f->status_size = 0;
+    f->jpeg = NULL;
+    f->jpeg_status = JPEG_OK;
+    f->status = NULL;
+    f->has_thermal = 0;
+    return f;
+}
+
+struct frame *frame_ref(struct frame *f) {
+    __atomic_fetch_add(&f->refs, 1, __ATOMIC_RELAXED);
+    return f;
+}
+
+void frame_unref(struct frame *f) {
+    if (!f || __atomic_sub_fetch(&f->refs, 1, __ATOMIC_ACQ_REL) != 0) return;
+
+    struct frame_pool *p = f->pool;
+    pthread_mutex_lock(&p->lock);
+    p->free[p->nfree++] = f;
+    pthread_mutex_unlock(&p->lock);
+}
+
+int frame_pool_available(struct frame_pool *p) {
+    pthread_mutex_lock(&p->lock);
+    int n = p->nfree;
+    pthread_mutex_unlock(&p->lock);
+    return n;
+}
+
+void frame_seal(struct frame *f, const struct packet_sizes *s) {
+    /* Sizes the header claims beyond the packet are cut back */
+    uint32_t thermal = s->thermal < s->frame ? s->thermal : s->frame;
+    uint32_t jpeg = s->jpeg < s->frame - thermal ? s->jpeg : s->frame - thermal;
+    unsigned char *jpeg_data = f->packet + HEADER_SIZE + thermal;
+    unsigned char *status = jpeg_data + jpeg + FRAME_JPEG_PAD;
+    size_t valid = 0;
+
+    f->thermal_size = thermal;
+    f->jpeg_status = jpeg > 0 ? jpeg_validate(jpeg_data, jpeg, &valid) : JPEG_OK;
+    f->jpeg_size = f->jpeg_status == JPEG_OK ? valid : 0;
+    f->jpeg = f->jpeg_size > 0 ? jpeg_data : NULL;
+    f->status_size = s->frame - thermal - jpeg;
+    f->status = f->status_size > 0 ? status : NULL;
+    f->has_thermal = 0;
+
+    /* HEADER_SIZE + frame <= BUFFER_SIZE, so both fit in packet[] */
+    memmove(status, jpeg_data + jpeg, f->status_size);
+    memset(jpeg_data + f->jpeg_size, 0, FRAME_JPEG_PAD);
+}
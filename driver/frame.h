@@ -0,0 +1,69 @@
+/*
+ * FLIR One Pro LT Linux Driver - shared frame buffers
+ *
+ * Each camera owns a fixed pool of frames, allocated once. The parser
+ * assembles a packet straight into a free frame and unpacks the thermal
+ * plane once; from then on the frame is read-only. Consumers that outlive
+ * vframe() (plugins, RTP, the --ffc-policy hold state) take a reference
+ * instead of a copy, synchronous sinks just read it, so memory use does
+ * not depend on how many sinks there are.
+ */
+
+#ifndef FLIRONE_FRAME_H
+#define FLIRONE_FRAME_H
+
+#include <stdint.h>
+
+#include "jpeg.h"
+#include "packet.h"
+
+/* Frames in use at once, at most: the one being assembled, the held good
+ * thermal and visible frames, one at the plugins and two at the RTP sender */
+#define FRAME_POOL_SIZE     6
+
+/* Zeros after the JPEG: decoders in OpenCV/FFmpeg read past EOI */
+#define FRAME_JPEG_PAD      8192
+
+#define FRAME_ALIGN         64
+
+struct frame_pool;
+
+struct frame {
+    int refs;
+    struct frame_pool *pool;
+
+    /* Set by frame_seal() once the packet is complete */
+    uint32_t thermal_size;
+    uint32_t jpeg_size;
+    uint32_t status_size;
+    const unsigned char *jpeg;      /* through EOI, then FRAME_JPEG_PAD zeros;
+                                     * NULL unless it validated */
+    enum jpeg_status jpeg_status;
+    const unsigned char *status;    /* moved behind the padding */
+    int has_thermal;                /* thermal[] was unpacked */
+
+    uint16_t thermal[THERMAL_WIDTH * THERMAL_HEIGHT] __attribute__((aligned(FRAME_ALIGN)));
+    unsigned char packet[BUFFER_SIZE + FRAME_JPEG_PAD] __attribute__((aligned(FRAME_ALIGN)));
+};
+
+struct frame_pool *frame_pool_create(void);
+
+void frame_pool_destroy(struct frame_pool *p);
+
+/* A free frame holding one reference, or NULL if all are in use */
+struct frame *frame_get(struct frame_pool *p);
+
+struct frame *frame_ref(struct frame *f);
+
+/* Any thread may drop a reference; the last one returns the frame */
+void frame_unref(struct frame *f);
+
+/* Frames not in use, for the metrics */
+int frame_pool_available(struct frame_pool *p);
+
+/* Record the part sizes of the complete packet in f->packet, validate the
+ * JPEG and trim it to its EOI, move the status block out of the way and
+ * zero-pad the JPEG in place */
+void frame_seal(struct frame *f, const struct packet_sizes *s);
+
+#endif
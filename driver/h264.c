@@ -0,0 +1,304 @@
+/*
+ * FLIR One Pro LT Linux Driver - H.264 encoder for pipeline outputs
+ *
+ * One slot per encoder, like the RTP sender: h264_frame() copies the RGB
+ * frame in under the lock and wakes the thread, which converts it to
+ * I420 (BT.601, limited range), encodes and writes the NAL units of the
+ * frame in one go. A write that fails part-way (a stalled TCP peer hits
+ * the send timeout) leaves a torn NAL unit behind; rather than continue
+ * with P-frames that refer to it, the next frame is forced to be an IDR
+ * frame, whose start code and repeated SPS/PPS let the receiver resync.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "h264.h"
+
+#ifdef HAVE_X264
+
+#include <x264.h>
+
+/* The camera's nominal rate; timestamps are frame counts */
+#define H264_FPS_NUM    87
+#define H264_FPS_DEN    10
+
+struct h264_enc {
+    char tag[80];
+    char name[32];
+    int width, height;
+    int fd;
+    struct sink *sink;
+
+    x264_t *x264;
+    x264_picture_t pic;
+    int64_t pts;
+    int resync;                 /* force an IDR frame next */
+
+    uint8_t *rgb;               /* the slot */
+    int pending;
+    int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+
+    unsigned long frames;
+    unsigned long dropped;
+    unsigned long write_errors;
+    unsigned long resyncs;
+    uint64_t bytes;
+};
+
+int h264_supported(void) {
+    return 1;
+}
+
+static void rgb_to_i420(const uint8_t *rgb, int w, int h, x264_image_t *img) {
+    uint8_t *py = img->plane[0], *pu = img->plane[1], *pv = img->plane[2];
+
+    for (int y = 0; y < h; y++) {
+        const uint8_t *s = rgb + (size_t)y * w * 3;
+        uint8_t *d = py + (size_t)y * img->i_stride[0];
+        for (int x = 0; x < w; x++, s += 3) {
+            d[x] = ((66 * s[0] + 129 * s[1] + 25 * s[2] + 128) >> 8) + 16;
+        }
+    }
+    /* Chroma from the average of each 2x2 block */
+    for (int y = 0; y < h / 2; y++) {
+        const uint8_t *s0 = rgb + (size_t)(2 * y) * w * 3;
+        const uint8_t *s1 = s0 + (size_t)w * 3;
+        uint8_t *du = pu + (size_t)y * img->i_stride[1];
+        uint8_t *dv = pv + (size_t)y * img->i_stride[2];
+        for (int x = 0; x < w / 2; x++, s0 += 6, s1 += 6) {
+            int r = (s0[0] + s0[3] + s1[0] + s1[3] + 2) >> 2;
+            int g = (s0[1] + s0[4] + s1[1] + s1[4] + 2) >> 2;
+            int b = (s0[2] + s0[5] + s1[2] + s1[5] + 2) >> 2;
+            du[x] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+            dv[x] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+        }
+    }
+}
+
+/* The whole buffer, or -1 if any of it was lost (dropped by the sink,
+ * or cut short by an error): the stream must then resync */
+static int write_all(struct h264_enc *e, const uint8_t *data, size_t size) {
+    if (e->sink) {
+        if (sink_write(e->sink, data, size) < 0) {
+            e->write_errors++;
+            return -1;
+        }
+        e->bytes += size;
+        return 0;
+    }
+    while (size > 0) {
+        ssize_t r = write(e->fd, data, size);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) {
+            if (e->write_errors++ == 0) {
+                fprintf(stderr, "%s%s: write failed: %s\n", e->tag, e->name,
+                        r < 0 ? strerror(errno) : "nothing written");
+            }
+            return -1;
+        }
+        data += r;
+        size -= r;
+        e->bytes += r;
+    }
+    return 0;
+}
+
+/* NAL units of one encode call are contiguous in x264's buffer */
+static int write_nals(struct h264_enc *e, x264_nal_t *nal, int n, int size) {
+    if (size > 0 && n > 0) return write_all(e, nal[0].p_payload, size);
+    return 0;
+}
+
+static void *h264_thread(void *arg) {
+    struct h264_enc *e = arg;
+    x264_picture_t out;
+    x264_nal_t *nal;
+    int n;
+
+    pthread_mutex_lock(&e->lock);
+    for (;;) {
+        while (!e->pending && !e->stopping) pthread_cond_wait(&e->cond, &e->lock);
+        if (e->stopping) break;
+        pthread_mutex_unlock(&e->lock);
+
+        rgb_to_i420(e->rgb, e->width, e->height, &e->pic.img);
+        e->pic.i_pts = e->pts++;
+        e->pic.i_type = e->resync ? X264_TYPE_IDR : X264_TYPE_AUTO;
+        int size = x264_encoder_encode(e->x264, &nal, &n, &e->pic, &out);
+        if (size >= 0) {
+            if (write_nals(e, nal, n, size) < 0) {
+                /* Keep forcing IDR frames until one is through whole */
+                if (!e->resync) e->resyncs++;
+                e->resync = 1;
+            } else if (size > 0 && out.b_keyframe) {
+                e->resync = 0;
+            }
+            e->frames++;
+        }
+
+        pthread_mutex_lock(&e->lock);
+        e->pending = 0;
+        /* h264_drain() may be waiting for this frame */
+        pthread_cond_broadcast(&e->cond);
+    }
+    pthread_mutex_unlock(&e->lock);
+
+    /* Nothing is delayed without lookahead or B-frames, but be sure */
+    while (x264_encoder_delayed_frames(e->x264) > 0) {
+        int size = x264_encoder_encode(e->x264, &nal, &n, NULL, &out);
+        if (size < 0) break;
+        write_nals(e, nal, n, size);
+    }
+    return NULL;
+}
+
+struct h264_enc *h264_open(const char *tag, const char *name, const struct h264_params *p,
+                           int fd, struct sink *sink) {
+    x264_param_t param;
+
+    if (x264_param_default_preset(&param, "veryfast", "zerolatency") < 0) return NULL;
+    param.i_csp = X264_CSP_I420;
+    param.i_width = p->width;
+    param.i_height = p->height;
+    param.i_fps_num = H264_FPS_NUM;
+    param.i_fps_den = H264_FPS_DEN;
+    param.i_threads = 1;
+    param.i_log_level = X264_LOG_WARNING;
+
+    /* No B-frames or lookahead (zerolatency), intra refresh instead of
+     * IDR frames, and a VBV of one frame so no frame is much larger */
+    param.i_bframe = 0;
+    param.b_intra_refresh = 1;
+    param.i_keyint_max = p->keyint;
+    param.rc.i_rc_method = X264_RC_ABR;
+    param.rc.i_bitrate = p->bitrate;
+    param.rc.i_vbv_max_bitrate = p->bitrate;
+    param.rc.i_vbv_buffer_size = p->bitrate * H264_FPS_DEN / H264_FPS_NUM + 1;
+
+    /* Self-contained Annex-B stream: headers before every recovery point */
+    param.b_annexb = 1;
+    param.b_repeat_headers = 1;
+    param.vui.i_colorprim = 6;
+    param.vui.i_transfer = 6;
+    param.vui.i_colmatrix = 6;
+    if (x264_param_apply_profile(&param, "main") < 0) return NULL;
+
+    struct h264_enc *e = calloc(1, sizeof(*e));
+    if (!e) return NULL;
+    snprintf(e->tag, sizeof(e->tag), "%s", tag);
+    snprintf(e->name, sizeof(e->name), "%s", name);
+    e->width = p->width;
+    e->height = p->height;
+    e->fd = fd;
+    e->sink = sink;
+
+    e->rgb = malloc((size_t)p->width * p->height * 3);
+    if (!e->rgb || x264_picture_alloc(&e->pic, X264_CSP_I420, p->width, p->height) < 0) {
+        free(e->rgb);
+        free(e);
+        return NULL;
+    }
+    e->x264 = x264_encoder_open(&param);
+    if (!e->x264) {
+        fprintf(stderr, "%s%s: cannot open the H.264 encoder\n", tag, name);
+        x264_picture_clean(&e->pic);
+        free(e->rgb);
+        free(e);
+        return NULL;
+    }
+
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_cond_init(&e->cond, NULL);
+    if (pthread_create(&e->thread, NULL, h264_thread, e) != 0) {
+        x264_encoder_close(e->x264);
+        x264_picture_clean(&e->pic);
+        free(e->rgb);
+        free(e);
+        return NULL;
+    }
+    printf("%s%s: H.264 %dx%d, %d kbit/s, intra refresh every %d frames\n",
+           tag, name, p->width, p->height, p->bitrate, p->keyint);
+    return e;
+}
+
+int h264_frame(struct h264_enc *e, const uint8_t *rgb) {
+    pthread_mutex_lock(&e->lock);
+    if (e->pending) {
+        /* Still encoding the last frame */
+        e->dropped++;
+        pthread_mutex_unlock(&e->lock);
+        return -1;
+    }
+    memcpy(e->rgb, rgb, (size_t)e->width * e->height * 3);
+    e->pending = 1;
+    pthread_cond_signal(&e->cond);
+    pthread_mutex_unlock(&e->lock);
+    return 0;
+}
+
+void h264_drain(struct h264_enc *e) {
+    if (!e) return;
+    pthread_mutex_lock(&e->lock);
+    while (e->pending) pthread_cond_wait(&e->cond, &e->lock);
+    pthread_mutex_unlock(&e->lock);
+}
+
+void h264_close(struct h264_enc *e) {
+    if (!e) return;
+    pthread_mutex_lock(&e->lock);
+    e->stopping = 1;
+    pthread_cond_signal(&e->cond);
+    pthread_mutex_unlock(&e->lock);
+    pthread_join(e->thread, NULL);
+
+    double secs = (double)e->pts * H264_FPS_DEN / H264_FPS_NUM;
+    printf("%s%s: %lu frames encoded, %lu dropped, %lu write errors, %lu resyncs, %.0f kbit/s\n",
+           e->tag, e->name, e->frames, e->dropped, e->write_errors, e->resyncs,
+           secs > 0 ? e->bytes * 8 / secs / 1000 : 0);
+
+    x264_encoder_close(e->x264);
+    x264_picture_clean(&e->pic);
+    free(e->rgb);
+    pthread_mutex_destroy(&e->lock);
+    pthread_cond_destroy(&e->cond);
+    free(e);
+}
+
+#else
+
+int h264_supported(void) {
+    return 0;
+}
+
+struct h264_enc *h264_open(const char *tag, const char *name, const struct h264_params *p,
+                           int fd, struct sink *sink) {
+    (void)p;
+    (void)fd;
+    (void)sink;
+    fprintf(stderr, "%s%s: built without H.264 support (make H264=1)\n", tag, name);
+    return NULL;
+}
+
+int h264_frame(struct h264_enc *e, const uint8_t *rgb) {
+    (void)e;
+    (void)rgb;
+    return -1;
+}
+
+void h264_drain(struct h264_enc *e) {
+    (void)e;
+}
+
+void h264_close(struct h264_enc *e) {
+    (void)e;
+}
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * FLIR One Pro LT Linux Driver - H.264 encoder for pipeline outputs
+ *
+ * An output with codec=h264 hands its RGB24 frames (usually a colourised,
+ * upscaled thermal image) to an encoder thread of its own and returns at
+ * once; a frame arriving while the previous one is still being encoded is
+ * dropped, so the encoder never holds up the camera thread. libx264 is
+ * set up for latency rather than size: no B-frames, no lookahead, one
+ * frame of VBV, and periodic intra refresh instead of IDR frames, so the
+ * bit rate stays flat and a receiver joining late recovers within keyint
+ * frames. After a failed or partial write the next frame is an IDR frame.
+ * The output is an Annex-B elementary stream with SPS/PPS repeated, which
+ * ffmpeg, GStreamer (h264parse) and VLC play directly.
+ *
+ * Built only with `make H264=1` (HAVE_X264); otherwise h264_supported()
+ * is 0 and the pipeline refuses codec=h264.
+ */
+
+#ifndef FLIRONE_H264_H
+#define FLIRONE_H264_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sink.h"
+
+struct h264_params {
+    int width, height;          /* even */
+    int bitrate;                /* kbit/s */
+    int keyint;                 /* frames per intra refresh cycle */
+};
+
+struct h264_enc;
+
+int h264_supported(void);
+
+/* Start an encoder writing to fd (blocking writes, on the encoder thread)
+ * or to sink. name labels the log lines. NULL on error. */
+struct h264_enc *h264_open(const char *tag, const char *name, const struct h264_params *p,
+                           int fd, struct sink *sink);
+
+/* Queue one width x height RGB24 frame. Returns 0, or -1 if the encoder
+ * was busy and the frame was dropped. */
+int h264_frame(struct h264_enc *e, const uint8_t *rgb);
+
+/* Wait until the queued frame is written, so that another process can
+ * take over the fd (live upgrade) */
+void h264_drain(struct h264_enc *e);
+
+/* Flush, stop the thread and report. Does not close the fd. */
+void h264_close(struct h264_enc *e);
+
+#endif
@@ -0,0 +1,308 @@
+/*
+ * FLIR One Pro LT Linux Driver - live upgrade handoff
+ *
+ * Wire format, per camera: one sendmsg() carrying struct handoff_state plus
+ * the fds in an SCM_RIGHTS control message (the slot fds, then those of
+ * the entries), then buf_len bytes of partial frame data and extra_len
+ * bytes of entries. After the last camera the successor answers with a
+ * single ack byte once it has taken over.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "handoff.h"
+
+/* How long the old process waits for the successor to confirm */
+#define HANDOFF_ACK_TIMEOUT_MS  2000
+
+#define HANDOFF_MAX_FDS     (HANDOFF_FD_COUNT + HANDOFF_EXTRA_FDS)
+
+/* Entry state is padded to keep the next header aligned */
+#define ENTRY_PAD(n)        (((n) + 7) & ~(size_t)7)
+
+static int fill_addr(struct sockaddr_un *addr, const char *path) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "Handoff socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+static int write_all(int fd, const unsigned char *p, size_t len) {
+    while (len > 0) {
+        ssize_t r = write(fd, p, len);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += r;
+        len -= r;
+    }
+    return 0;
+}
+
+static int read_all(int fd, unsigned char *p, size_t len) {
+    while (len > 0) {
+        ssize_t r = read(fd, p, len);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (r == 0) return -1;
+        p += r;
+        len -= r;
+    }
+    return 0;
+}
+
+int handoff_listen(const char *path) {
+    struct sockaddr_un addr;
+    if (fill_addr(&addr, path) < 0) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("handoff socket");
+        return -1;
+    }
+
+    /* A predecessor may still hold the old socket; its inode goes with it */
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0) {
+        fprintf(stderr, "Cannot listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    printf("Handoff socket: %s\n", path);
+    return fd;
+}
+
+int handoff_accept(int listen_fd) {
+    int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            perror("handoff accept");
+        }
+        return -1;
+    }
+    return fd;
+}
+
+int handoff_send(int conn, struct handoff_state *st,
+                 const int fds[HANDOFF_FD_COUNT], const unsigned char *buf,
+                 const struct handoff_extra *x) {
+    int sendfds[HANDOFF_MAX_FDS];
+    int nfds = 0;
+    for (int i = 0; i < HANDOFF_FD_COUNT; i++) {
+        if (st->fd_mask & (1u << i)) sendfds[nfds++] = fds[i];
+    }
+    st->extra_len = x ? x->len : 0;
+    st->extra_fds = x ? x->nfds : 0;
+    for (int i = 0; i < (int)st->extra_fds; i++) sendfds[nfds++] = x->fds[i];
+
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+        struct cmsghdr align;
+    } ctrl;
+    memset(&ctrl, 0, sizeof(ctrl));
+
+    struct iovec iov = { (void *)st, sizeof(*st) };
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (nfds > 0) {
+        msg.msg_control = ctrl.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+        memcpy(CMSG_DATA(cmsg), sendfds, sizeof(int) * nfds);
+    }
+
+    if (sendmsg(conn, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof(*st)) {
+        perror("handoff sendmsg");
+        return -1;
+    }
+    if ((st->buf_len > 0 && write_all(conn, buf, st->buf_len) < 0) ||
+        (st->extra_len > 0 && write_all(conn, x->data, st->extra_len) < 0)) {
+        perror("handoff write");
+        return -1;
+    }
+    return 0;
+}
+
+int handoff_wait_ack(int conn) {
+    /* Until the ack arrives the successor may still fail; keep ownership */
+    struct pollfd pfd = { conn, POLLIN, 0 };
+    unsigned char ack = 0;
+    if (poll(&pfd, 1, HANDOFF_ACK_TIMEOUT_MS) <= 0 || read(conn, &ack, 1) != 1 || ack != 1) {
+        fprintf(stderr, "Handoff not acknowledged, continuing\n");
+        return -1;
+    }
+    return 0;
+}
+
+int handoff_connect(const char *path) {
+    struct sockaddr_un addr;
+    if (fill_addr(&addr, path) < 0) return -1;
+
+    int conn = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (conn < 0) {
+        perror("handoff socket");
+        return -1;
+    }
+    if (connect(conn, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "Cannot connect to %s: %s\n", path, strerror(errno));
+        close(conn);
+        return -1;
+    }
+    return conn;
+}
+
+int handoff_receive(int conn, struct handoff_state *st,
+                    int fds[HANDOFF_FD_COUNT], unsigned char *buf, size_t buf_size,
+                    struct handoff_extra *x) {
+    for (int i = 0; i < HANDOFF_FD_COUNT; i++) fds[i] = -1;
+    x->len = 0;
+    x->nfds = 0;
+
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+        struct cmsghdr align;
+    } ctrl;
+    struct iovec iov = { st, sizeof(*st) };
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+
+    ssize_t r;
+    do {
+        r = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+    } while (r < 0 && errno == EINTR);
+    if (r < 0) msg.msg_controllen = 0;
+
+    /* Collect fds first so they are closed on every error path below */
+    int recvfds[HANDOFF_MAX_FDS];
+    int nfds = 0;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            int n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            if (n > HANDOFF_MAX_FDS - nfds) n = HANDOFF_MAX_FDS - nfds;
+            memcpy(recvfds + nfds, CMSG_DATA(cmsg), sizeof(int) * n);
+            nfds += n;
+        }
+    }
+    int k = 0;
+    for (int i = 0; i < HANDOFF_FD_COUNT && r == (ssize_t)sizeof(*st); i++) {
+        if ((st->fd_mask & (1u << i)) && k < nfds) fds[i] = recvfds[k++];
+    }
+
+    if (r != (ssize_t)sizeof(*st) || st->magic != HANDOFF_MAGIC || st->version != HANDOFF_VERSION
+        || (msg.msg_flags & MSG_CTRUNC) || k + st->extra_fds != (uint32_t)nfds || st->buf_len > buf_size
+        || st->extra_len > sizeof(x->data)) {
+        fprintf(stderr, "Invalid handoff message\n");
+        goto fail;
+    }
+    st->id[HANDOFF_ID_LEN - 1] = '\0';
+    if (st->buf_len > 0 && read_all(conn, buf, st->buf_len) < 0) {
+        fprintf(stderr, "Truncated handoff buffer\n");
+        goto fail;
+    }
+    if (st->extra_len > 0 && read_all(conn, x->data, st->extra_len) < 0) {
+        fprintf(stderr, "Truncated handoff entries\n");
+        goto fail;
+    }
+    x->len = st->extra_len;
+    x->nfds = nfds - k;
+    memcpy(x->fds, recvfds + k, sizeof(int) * x->nfds);
+
+    return 0;
+
+fail:
+    for (int i = 0; i < nfds; i++) close(recvfds[i]);
+    for (int i = 0; i < HANDOFF_FD_COUNT; i++) fds[i] = -1;
+    return -1;
+}
+
+int handoff_ack(int conn) {
+    unsigned char ack = 1;
+    int r = write_all(conn, &ack, 1);
+    close(conn);
+    return r;
+}
+
+int handoff_put(struct handoff_extra *x, const char *name, const void *state, size_t size,
+                const int *fds, int nfds) {
+    struct handoff_entry e = {0};
+    size_t need = sizeof(e) + ENTRY_PAD(size);
+
+    if (x->len + need > sizeof(x->data) || x->nfds + nfds > HANDOFF_EXTRA_FDS) {
+        fprintf(stderr, "Too many outputs to hand off (%s)\n", name);
+        return -1;
+    }
+    snprintf(e.name, sizeof(e.name), "%s", name);
+    e.size = size;
+    e.nfds = nfds;
+    memcpy(x->data + x->len, &e, sizeof(e));
+    if (size > 0) memcpy(x->data + x->len + sizeof(e), state, size);
+    x->len += need;
+    memcpy(x->fds + x->nfds, fds, sizeof(int) * nfds);
+    x->nfds += nfds;
+    return 0;
+}
+
+int handoff_take(struct handoff_extra *x, const char *name, void *state, size_t size,
+                 int *fds, int max_fds) {
+    char key[HANDOFF_NAME_LEN];
+    size_t pos = 0;
+    int first = 0;
+
+    /* Names were cut to the same length when they were put */
+    snprintf(key, sizeof(key), "%s", name);
+    while (pos + sizeof(struct handoff_entry) <= x->len) {
+        struct handoff_entry e;
+        memcpy(&e, x->data + pos, sizeof(e));
+        e.name[HANDOFF_NAME_LEN - 1] = '\0';
+        size_t next = pos + sizeof(e) + ENTRY_PAD(e.size);
+        if (e.size > x->len || next > x->len || e.nfds > (uint32_t)(x->nfds - first)) break;
+
+        if (e.name[0] && strcmp(e.name, key) == 0 && e.size == size) {
+            int n = 0;
+            if (size > 0) memcpy(state, x->data + pos + sizeof(e), size);
+            for (uint32_t i = 0; i < e.nfds; i++) {
+                int fd = x->fds[first + i];
+                if (n < max_fds) fds[n++] = fd;
+                else if (fd >= 0) close(fd);
+                x->fds[first + i] = -1;
+            }
+            x->data[pos] = '\0';    /* the name: taken */
+            return n;
+        }
+        pos = next;
+        first += e.nfds;
+    }
+    return -1;
+}
+
+void handoff_extra_close(struct handoff_extra *x) {
+    for (int i = 0; i < x->nfds; i++) {
+        if (x->fds[i] >= 0) close(x->fds[i]);
+    }
+    x->nfds = 0;
+    x->len = 0;
+}
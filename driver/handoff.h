@@ -0,0 +1,113 @@
+/*
+ * FLIR One Pro LT Linux Driver - live upgrade handoff
+ *
+ * A running driver listens on a Unix socket. A newly started driver
+ * (flirone --takeover) connects to it and receives the USB device fd,
+ * the sink fds and the partial frame buffer over SCM_RIGHTS, so the
+ * stream continues without re-enumerating the camera. With several
+ * cameras one message per camera is sent on the same connection.
+ *
+ * The other outputs (pipeline, --stream, --rtp, --bundle) travel as named
+ * entries of a struct handoff_extra: each module puts its open fds and
+ * the state needed to carry on under a name such as "stream:PATH", and
+ * the successor, started with the same options, takes them back by name
+ * instead of opening the output afresh.
+ */
+
+#ifndef FLIRONE_HANDOFF_H
+#define FLIRONE_HANDOFF_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define HANDOFF_MAGIC       0x464C4831  /* "FLH1" */
+#define HANDOFF_VERSION     3
+
+/* Slots in the fd table passed with the state */
+#define HANDOFF_FD_USB      0   /* usbfs fd, or fake source fd */
+#define HANDOFF_FD_THERMAL  1
+#define HANDOFF_FD_VISIBLE  2
+#define HANDOFF_FD_CAPTURE  3
+#define HANDOFF_FD_COUNT    4
+
+/* Flags */
+#define HANDOFF_FLAG_FAKE   0x01    /* HANDOFF_FD_USB is a fake-device stream */
+#define HANDOFF_FLAG_PAUSED 0x02    /* EP 0x85 stopped for lack of consumers */
+
+#define HANDOFF_ID_LEN      64
+
+struct handoff_state {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t camera_index;
+    uint32_t camera_count;  /* messages in this handoff */
+    char     id[HANDOFF_ID_LEN];
+    uint32_t flags;
+    uint32_t fd_mask;       /* bit n set: slot n carries an fd */
+    int32_t  frame_count;
+    uint32_t buf_len;       /* bytes of partial frame following the header */
+    uint32_t extra_len;     /* bytes of entries following the frame */
+    uint32_t extra_fds;     /* fds of the entries, after the slot fds */
+};
+
+#define HANDOFF_EXTRA_SIZE  32768
+#define HANDOFF_EXTRA_FDS   128
+#define HANDOFF_NAME_LEN    320
+
+/* One camera's entries: a struct handoff_entry and its state, padded to
+ * 8 bytes, per entry in data[]; the fds of all entries in order in fds[] */
+struct handoff_extra {
+    unsigned char data[HANDOFF_EXTRA_SIZE];
+    uint32_t len;
+    int fds[HANDOFF_EXTRA_FDS];
+    int nfds;
+};
+
+struct handoff_entry {
+    char     name[HANDOFF_NAME_LEN];    /* "" once taken */
+    uint32_t size;
+    uint32_t nfds;
+};
+
+/* Running side: add an entry; state may be NULL if size is 0. Returns 0,
+ * or -1 if x is full. */
+int handoff_put(struct handoff_extra *x, const char *name, const void *state, size_t size,
+                const int *fds, int nfds);
+
+/* Successor side: take the entry called name, whose state must be size
+ * bytes, and up to max_fds fds (the rest are closed). Returns the number
+ * of fds, or -1 if there is no such entry. */
+int handoff_take(struct handoff_extra *x, const char *name, void *state, size_t size,
+                 int *fds, int max_fds);
+
+/* Successor side: close the fds of entries nobody took */
+void handoff_extra_close(struct handoff_extra *x);
+
+/* Running side: listen for successors (non-blocking). Returns fd or -1. */
+int handoff_listen(const char *path);
+
+/* Running side: accept a waiting successor. Returns fd, or -1 if none. */
+int handoff_accept(int listen_fd);
+
+/* Running side: send one camera's state, fds, buffer and entries. The
+ * extra_ fields of st are filled in from x, which may be NULL. */
+int handoff_send(int conn, struct handoff_state *st,
+                 const int fds[HANDOFF_FD_COUNT], const unsigned char *buf,
+                 const struct handoff_extra *x);
+
+/* Running side: wait for the successor's ack after the last camera.
+ * Returns 0 once the successor owns the streams, -1 if we must keep running. */
+int handoff_wait_ack(int conn);
+
+/* Successor side: connect to the running driver. Returns fd or -1. */
+int handoff_connect(const char *path);
+
+/* Successor side: receive one camera. fds[] gets -1 for empty slots. */
+int handoff_receive(int conn, struct handoff_state *st,
+                    int fds[HANDOFF_FD_COUNT], unsigned char *buf, size_t buf_size,
+                    struct handoff_extra *x);
+
+/* Successor side: tell the old process it may exit. */
+int handoff_ack(int conn);
+
+#endif
@@ -0,0 +1,71 @@
+/*
+ * FLIR One Pro LT Linux Driver - JPEG validation
+ *
+ * Marker segments carry their length, so they are stepped over. In the
+ * entropy-coded data after SOS a 0xFF is either stuffed (FF 00), a restart
+ * marker (FF D0..D7) or the next marker; memchr() finds the candidates a
+ * word at a time, and the camera's images have few of them.
+ */
+
+#include <string.h>
+
+#include "jpeg.h"
+
+/* SOFn: every code in C0..CF except DHT, JPG and DAC */
+static int is_sof(int m) {
+    return m >= 0xC0 && m <= 0xCF && m != 0xC4 && m != 0xC8 && m != 0xCC;
+}
+
+enum jpeg_status jpeg_validate(const unsigned char *p, size_t size, size_t *length) {
+    int have_sof = 0;
+
+    if (size < 2 || p[0] != 0xFF || p[1] != 0xD8) return JPEG_CORRUPT;
+    size_t pos = 2;
+
+    for (;;) {
+        /* A marker, possibly after fill bytes */
+        if (pos >= size) return JPEG_TRUNCATED;
+        if (p[pos] != 0xFF) return JPEG_CORRUPT;
+        while (pos < size && p[pos] == 0xFF) pos++;
+        if (pos >= size) return JPEG_TRUNCATED;
+        int m = p[pos++];
+
+        if (m == 0xD9) {
+            if (!have_sof) return JPEG_CORRUPT;
+            *length = pos;
+            return JPEG_OK;
+        }
+        if (m == 0x01 || (m >= 0xD0 && m <= 0xD7)) continue;   /* no length */
+        if (m == 0x00 || m == 0xD8) return JPEG_CORRUPT;
+
+        if (pos + 2 > size) return JPEG_TRUNCATED;
+        size_t len = (p[pos] << 8) | p[pos + 1];
+        if (len < 2) return JPEG_CORRUPT;
+        if (pos + len > size) return JPEG_TRUNCATED;
+        pos += len;
+
+        if (is_sof(m)) have_sof = 1;
+        if (m != 0xDA) continue;
+        if (!have_sof) return JPEG_CORRUPT;
+
+        /* Entropy-coded data up to the next real marker */
+        for (;;) {
+            const unsigned char *ff = memchr(p + pos, 0xFF, size - pos);
+            if (!ff || ff + 1 >= p + size) return JPEG_TRUNCATED;
+            pos = ff - p;
+            int c = p[pos + 1];
+            if (c == 0x00 || (c >= 0xD0 && c <= 0xD7)) pos += 2;
+            else if (c == 0xFF) pos++;
+            else break;
+        }
+    }
+}
+
+const char *jpeg_status_name(enum jpeg_status s) {
+    switch (s) {
+    case JPEG_OK: return "ok";
+    case JPEG_TRUNCATED: return "truncated";
+    case JPEG_CORRUPT: return "corrupt";
+    }
+    return "?";
+}
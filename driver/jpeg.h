@@ -0,0 +1,28 @@
+/*
+ * FLIR One Pro LT Linux Driver - JPEG validation
+ *
+ * The header's JpgSize covers the image plus whatever the camera padded
+ * it with, and a packet cut short by a USB error still claims the full
+ * size. jpeg_validate() walks the marker segments and skips the
+ * entropy-coded data with memchr() to find the real EOI, so only complete
+ * images, without the padding, reach decoders and the network.
+ */
+
+#ifndef FLIRONE_JPEG_H
+#define FLIRONE_JPEG_H
+
+#include <stddef.h>
+
+enum jpeg_status {
+    JPEG_OK = 0,
+    JPEG_TRUNCATED,         /* data ends before EOI */
+    JPEG_CORRUPT,           /* no SOI, a bad marker or segment length, no frame header */
+};
+
+/* Check the image at p (size bytes at most) and set *length to the bytes
+ * up to and including its EOI. *length is only valid for JPEG_OK. */
+enum jpeg_status jpeg_validate(const unsigned char *p, size_t size, size_t *length);
+
+const char *jpeg_status_name(enum jpeg_status s);
+
+#endif
@@ -0,0 +1,183 @@
+/*
+ * FLIR One Pro LT Linux Driver - reduced visible JPEGs
+ *
+ * Built on the plain libjpeg API (libjpeg-turbo provides it): the crop is
+ * what jpegtran -crop does for MCU-aligned regions, the scale is a scaled
+ * decode feeding the encoder scanline by scanline. libjpeg reports errors
+ * through error_exit, which jumps back to the call in progress.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+
+#include "jpegdct.h"
+
+struct jpegdct {
+    struct jpeg_decompress_struct d;
+    struct jpeg_compress_struct c;
+    struct jpeg_error_mgr err;
+    struct jpeg_destination_mgr dest;
+    jmp_buf fail;
+};
+
+static void error_exit(j_common_ptr cinfo) {
+    struct jpegdct *j = cinfo->client_data;
+    longjmp(j->fail, 1);
+}
+
+/* Warnings about damaged frames: the frame is dropped or still usable,
+ * nothing to log per frame */
+static void output_message(j_common_ptr cinfo) {
+    (void)cinfo;
+}
+
+/* The output goes straight into the caller's buffer; running out of it
+ * fails the frame */
+static void dest_init(j_compress_ptr cinfo) {
+    (void)cinfo;
+}
+
+static boolean dest_full(j_compress_ptr cinfo) {
+    struct jpegdct *j = cinfo->client_data;
+    longjmp(j->fail, 1);
+}
+
+static void dest_term(j_compress_ptr cinfo) {
+    (void)cinfo;
+}
+
+struct jpegdct *jpegdct_create(void) {
+    struct jpegdct *j = calloc(1, sizeof(*j));
+    if (!j) return NULL;
+
+    j->d.err = jpeg_std_error(&j->err);
+    j->c.err = &j->err;
+    j->err.error_exit = error_exit;
+    j->err.output_message = output_message;
+    j->d.client_data = j;
+    j->c.client_data = j;
+    if (setjmp(j->fail)) {
+        free(j);
+        return NULL;
+    }
+    jpeg_create_decompress(&j->d);
+    jpeg_create_compress(&j->c);
+
+    j->dest.init_destination = dest_init;
+    j->dest.empty_output_buffer = dest_full;
+    j->dest.term_destination = dest_term;
+    j->c.dest = &j->dest;
+    return j;
+}
+
+void jpegdct_destroy(struct jpegdct *j) {
+    if (!j) return;
+    jpeg_destroy_compress(&j->c);
+    jpeg_destroy_decompress(&j->d);
+    free(j);
+}
+
+size_t jpegdct_crop(struct jpegdct *j, const uint8_t *src, size_t size,
+                    int x, int y, int w, int h, uint8_t *dst, size_t cap) {
+    struct jpeg_decompress_struct *d = &j->d;
+    struct jpeg_compress_struct *c = &j->c;
+    jvirt_barray_ptr out[MAX_COMPONENTS];
+
+    if (setjmp(j->fail)) {
+        jpeg_abort_compress(c);
+        jpeg_abort_decompress(d);
+        return 0;
+    }
+    jpeg_mem_src(d, (unsigned char *)src, size);
+    jpeg_read_header(d, TRUE);
+
+    /* Whole MCUs only, so every block is copied as it is */
+    int mcu_w = d->max_h_samp_factor * DCTSIZE;
+    int mcu_h = d->max_v_samp_factor * DCTSIZE;
+    if (x % mcu_w || y % mcu_h || x + w > (int)d->image_width || y + h > (int)d->image_height) {
+        jpeg_abort_decompress(d);
+        return 0;
+    }
+
+    /* Room for the region's blocks, allocated with the source's */
+    for (int ci = 0; ci < d->num_components; ci++) {
+        const jpeg_component_info *comp = &d->comp_info[ci];
+        out[ci] = d->mem->request_virt_barray((j_common_ptr)d, JPOOL_IMAGE, FALSE,
+                                              (w + mcu_w - 1) / mcu_w * comp->h_samp_factor,
+                                              (h + mcu_h - 1) / mcu_h * comp->v_samp_factor,
+                                              comp->v_samp_factor);
+    }
+    jvirt_barray_ptr *in = jpeg_read_coefficients(d);
+
+    jpeg_copy_critical_parameters(d, c);
+    c->image_width = w;
+    c->image_height = h;
+    j->dest.next_output_byte = dst;
+    j->dest.free_in_buffer = cap;
+    jpeg_write_coefficients(c, out);
+
+    for (int ci = 0; ci < d->num_components; ci++) {
+        const jpeg_component_info *comp = &d->comp_info[ci];
+        int hs = comp->h_samp_factor, vs = comp->v_samp_factor;
+        JDIMENSION bw = (w + mcu_w - 1) / mcu_w * hs;
+        JDIMENSION bh = (h + mcu_h - 1) / mcu_h * vs;
+        JDIMENSION bx = x / mcu_w * hs, by = y / mcu_h * vs;
+
+        for (JDIMENSION row = 0; row < bh; row += vs) {
+            JBLOCKARRAY o = d->mem->access_virt_barray((j_common_ptr)d, out[ci], row, vs, TRUE);
+            JBLOCKARRAY s = d->mem->access_virt_barray((j_common_ptr)d, in[ci], by + row, vs, FALSE);
+            for (int r = 0; r < vs; r++) memcpy(o[r], s[r] + bx, bw * sizeof(JBLOCK));
+        }
+    }
+
+    jpeg_finish_compress(c);
+    jpeg_finish_decompress(d);
+    return cap - j->dest.free_in_buffer;
+}
+
+size_t jpegdct_scale(struct jpegdct *j, const uint8_t *src, size_t size,
+                     int denom, int quality, uint8_t *dst, size_t cap) {
+    struct jpeg_decompress_struct *d = &j->d;
+    struct jpeg_compress_struct *c = &j->c;
+
+    if (setjmp(j->fail)) {
+        jpeg_abort_compress(c);
+        jpeg_abort_decompress(d);
+        return 0;
+    }
+    jpeg_mem_src(d, (unsigned char *)src, size);
+    jpeg_read_header(d, TRUE);
+
+    /* Reduced IDCT, and no colour conversion on either side */
+    d->scale_num = 1;
+    d->scale_denom = denom;
+    d->out_color_space = JCS_YCbCr;
+    d->dct_method = JDCT_IFAST;
+    d->do_fancy_upsampling = FALSE;
+    jpeg_start_decompress(d);
+
+    c->image_width = d->output_width;
+    c->image_height = d->output_height;
+    c->input_components = 3;
+    c->in_color_space = JCS_YCbCr;
+    jpeg_set_defaults(c);
+    jpeg_set_quality(c, quality, TRUE);
+    c->dct_method = JDCT_IFAST;
+    j->dest.next_output_byte = dst;
+    j->dest.free_in_buffer = cap;
+    jpeg_start_compress(c, TRUE);
+
+    JSAMPARRAY rows = d->mem->alloc_sarray((j_common_ptr)d, JPOOL_IMAGE,
+                                           d->output_width * 3, d->rec_outbuf_height);
+    while (d->output_scanline < d->output_height) {
+        JDIMENSION n = jpeg_read_scanlines(d, rows, d->rec_outbuf_height);
+        jpeg_write_scanlines(c, rows, n);
+    }
+
+    jpeg_finish_compress(c);
+    jpeg_finish_decompress(d);
+    return cap - j->dest.free_in_buffer;
+}
@@ -0,0 +1,41 @@
+/*
+ * FLIR One Pro LT Linux Driver - reduced visible JPEGs
+ *
+ * Two ways to make a smaller JPEG from the camera's without a full decode,
+ * resize and encode:
+ *
+ *   crop   copies the quantised DCT blocks of a region into a new image.
+ *          Nothing is decoded to pixels, so the result is lossless.
+ *   scale  decodes with libjpeg's reduced-size IDCT (1/2, 1/4 or 1/8 of
+ *          each 8x8 block), in YCbCr, and re-encodes with the fast DCT.
+ *
+ * A context keeps its libjpeg objects between frames; one per pipeline
+ * stage and camera, used by one thread at a time.
+ */
+
+#ifndef FLIRONE_JPEGDCT_H
+#define FLIRONE_JPEGDCT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Crop offsets and sizes are multiples of this, the largest MCU */
+#define JPEGDCT_CROP_ALIGN  16
+
+struct jpegdct;
+
+struct jpegdct *jpegdct_create(void);
+
+void jpegdct_destroy(struct jpegdct *j);
+
+/* The w x h region at (x, y) of src into dst (cap bytes). Returns the
+ * size of the new JPEG, or 0 if src cannot be read or the region does
+ * not fit. */
+size_t jpegdct_crop(struct jpegdct *j, const uint8_t *src, size_t size,
+                    int x, int y, int w, int h, uint8_t *dst, size_t cap);
+
+/* src at 1/denom (2, 4 or 8) of its size, re-encoded at quality */
+size_t jpegdct_scale(struct jpegdct *j, const uint8_t *src, size_t size,
+                     int denom, int quality, uint8_t *dst, size_t cap);
+
+#endif
@@ -0,0 +1,48 @@
+/*
+ * FLIR One Pro LT Linux Driver - minimal JSON field lookup
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+
+int json_get(const char *msg, const char *key, char *out, size_t size) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+
+    const char *p = strstr(msg, pattern);
+    if (!p) return 0;
+    p += strlen(pattern);
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p++ != ':') return 0;
+    while (*p == ' ' || *p == '\t') p++;
+
+    size_t n = 0;
+    if (*p == '"') {
+        for (p++; *p && *p != '"' && n + 1 < size; p++) {
+            if (*p == '\\' && p[1]) p++;
+            out[n++] = *p;
+        }
+    } else {
+        for (; *p && !strchr(",}] \t", *p) && n + 1 < size; p++) out[n++] = *p;
+    }
+    out[n] = '\0';
+    return n > 0;
+}
+
+int json_get_any(const char *msg, const char *const *keys, char *out, size_t size) {
+    for (; *keys; keys++) {
+        if (json_get(msg, *keys, out, size)) return 1;
+    }
+    return 0;
+}
+
+double json_get_number(const char *msg, const char *key, double def) {
+    char v[64];
+    if (!json_get(msg, key, v, sizeof(v))) return def;
+    char *end;
+    double d = strtod(v, &end);
+    return end == v ? def : d;
+}
@@ -0,0 +1,23 @@
+/*
+ * FLIR One Pro LT Linux Driver - minimal JSON field lookup
+ *
+ * The camera's status and FILEIO messages are small flat-ish JSON objects.
+ * We only ever need a few scalar fields out of them, so there is no tree:
+ * a field is found by its quoted key anywhere in the text.
+ */
+
+#ifndef FLIRONE_JSON_H
+#define FLIRONE_JSON_H
+
+#include <stddef.h>
+
+/* Value of the first "key" in msg, unquoted. Returns 1 if found. */
+int json_get(const char *msg, const char *key, char *out, size_t size);
+
+/* Same, for the first of several alternative keys (NULL-terminated) */
+int json_get_any(const char *msg, const char *const *keys, char *out, size_t size);
+
+/* Numeric value of "key", or def */
+double json_get_number(const char *msg, const char *key, double def);
+
+#endif
@@ -0,0 +1,211 @@
+/*
+ * FLIR One Pro LT Linux Driver - v4l2loopback device management
+ *
+ * The control ioctls are not size-encoded, and v4l2loopback 0.13 inserted
+ * min_width and min_height into struct v4l2_loopback_config, so the
+ * layout is picked by the version of the loaded module.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/ioctl.h>
+
+#include "loopback.h"
+#include "handoff.h"
+
+/* From v4l2loopback.h, which is rarely installed */
+#define V4L2LOOPBACK_CTL_ADD        0x4C80
+#define V4L2LOOPBACK_CTL_REMOVE     0x4C81
+
+struct loopback_config_012 {
+    int32_t output_nr;
+    int32_t capture_nr;
+    char card_label[32];
+    int32_t max_width;
+    int32_t max_height;
+    int32_t max_buffers;
+    int32_t max_openers;
+    int32_t debug;
+    int32_t announce_all_caps;
+};
+
+struct loopback_config_013 {
+    int32_t output_nr;
+    int32_t unused;
+    char card_label[32];
+    uint32_t min_width;
+    uint32_t max_width;
+    uint32_t min_height;
+    uint32_t max_height;
+    int32_t max_buffers;
+    int32_t max_openers;
+    int32_t debug;
+    int32_t announce_all_caps;
+};
+
+#define LOOPBACK_CONTROL    "/dev/v4l2loopback"
+#define LOOPBACK_VERSION    "/sys/module/v4l2loopback/version"
+#define LOOPBACK_BUFFERS    2
+
+/* udev may still be creating the node after CTL_ADD returns */
+#define LOOPBACK_NODE_MS    1000
+
+/* Two per camera and then some for pipeline outputs */
+#define LOOPBACK_MAX        32
+
+static int created[LOOPBACK_MAX];
+static int ncreated = 0;
+
+/* Handoff entry: the devices to remove on exit */
+struct loopback_handoff {
+    int32_t count;
+    int32_t nr[LOOPBACK_MAX];
+};
+
+/* Device number of the video4linux device named label, or -1 */
+static int find_by_label(const char *label) {
+    DIR *d = opendir("/sys/class/video4linux");
+    struct dirent *e;
+    int nr = -1;
+
+    if (!d) return -1;
+    while (nr < 0 && (e = readdir(d))) {
+        char path[300], name[64];
+        if (strncmp(e->d_name, "video", 5) != 0) continue;
+        snprintf(path, sizeof(path), "/sys/class/video4linux/%s/name", e->d_name);
+        FILE *f = fopen(path, "r");
+        if (!f) continue;
+        if (fgets(name, sizeof(name), f)) {
+            name[strcspn(name, "\n")] = '\0';
+            if (strcmp(name, label) == 0) nr = atoi(e->d_name + 5);
+        }
+        fclose(f);
+    }
+    closedir(d);
+    return nr;
+}
+
+/* 1 for 0.13 and later, 0 before, -1 if the module is not loaded */
+static int module_is_013(void) {
+    FILE *f = fopen(LOOPBACK_VERSION, "r");
+    int major = 0, minor = 0;
+
+    if (!f) return -1;
+    int n = fscanf(f, "%d.%d", &major, &minor);
+    fclose(f);
+    if (n != 2) return -1;
+    return major > 0 || minor >= 13;
+}
+
+static int create(const char *label) {
+    int v013 = module_is_013();
+    if (v013 < 0) {
+        fprintf(stderr, "No v4l2loopback module (sudo modprobe v4l2loopback devices=0)\n");
+        return -1;
+    }
+    int fd = open(LOOPBACK_CONTROL, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open %s: %s (v4l2loopback 0.12.5 or later needed)\n", LOOPBACK_CONTROL,
+                strerror(errno));
+        return -1;
+    }
+
+    /* Every field is set: a zero is taken literally (max_openers 0 makes
+     * the device impossible to open), a negative number means the module
+     * parameter's default, as v4l2loopback-ctl passes them. The sizes are
+     * left to the module too (unsigned in 0.13, where 0 is unset).
+     * Exclusive caps: browsers only list capture devices that are not
+     * also outputs. */
+    int nr;
+    if (v013) {
+        struct loopback_config_013 c = { 0 };
+        c.output_nr = c.unused = -1;
+        snprintf(c.card_label, sizeof(c.card_label), "%s", label);
+        c.max_buffers = LOOPBACK_BUFFERS;
+        c.max_openers = -1;
+        c.debug = -1;
+        c.announce_all_caps = 0;
+        nr = ioctl(fd, V4L2LOOPBACK_CTL_ADD, &c);
+    } else {
+        struct loopback_config_012 c = { 0 };
+        c.output_nr = c.capture_nr = -1;
+        snprintf(c.card_label, sizeof(c.card_label), "%s", label);
+        c.max_width = c.max_height = -1;
+        c.max_buffers = LOOPBACK_BUFFERS;
+        c.max_openers = -1;
+        c.debug = -1;
+        c.announce_all_caps = 0;
+        nr = ioctl(fd, V4L2LOOPBACK_CTL_ADD, &c);
+    }
+    if (nr < 0) fprintf(stderr, "Cannot create loopback device %s: %s\n", label, strerror(errno));
+    close(fd);
+    if (nr < 0) return -1;
+
+    if (ncreated < LOOPBACK_MAX) created[ncreated++] = nr;
+    printf("Created /dev/video%d (%s)\n", nr, label);
+    return nr;
+}
+
+int loopback_resolve(const char *label, char *dev, size_t size) {
+    if (!*label || strlen(label) >= 32) {
+        fprintf(stderr, "Invalid loopback label \"%s\" (1 to 31 characters)\n", label);
+        return -1;
+    }
+
+    int nr = find_by_label(label);
+    if (nr < 0) nr = create(label);
+    if (nr < 0) return -1;
+    snprintf(dev, size, "/dev/video%d", nr);
+
+    struct timespec step = { 0, 10 * 1000000 };
+    for (int waited = 0; access(dev, F_OK) < 0 && waited < LOOPBACK_NODE_MS; waited += 10) {
+        nanosleep(&step, NULL);
+    }
+    return 0;
+}
+
+void loopback_remove_all(void) {
+    if (ncreated == 0) return;
+    int fd = open(LOOPBACK_CONTROL, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open %s: %s\n", LOOPBACK_CONTROL, strerror(errno));
+        return;
+    }
+    for (int i = 0; i < ncreated; i++) {
+        /* EBUSY: a consumer still has it open; it stays */
+        if (ioctl(fd, V4L2LOOPBACK_CTL_REMOVE, created[i]) < 0) {
+            fprintf(stderr, "Cannot remove /dev/video%d: %s\n", created[i], strerror(errno));
+        } else {
+            printf("Removed /dev/video%d\n", created[i]);
+        }
+    }
+    close(fd);
+    ncreated = 0;
+}
+
+int loopback_hand_off(struct handoff_extra *x) {
+    struct loopback_handoff h = { 0 };
+
+    if (ncreated == 0) return 0;
+    h.count = ncreated;
+    for (int i = 0; i < ncreated; i++) h.nr[i] = created[i];
+    return handoff_put(x, "loopback", &h, sizeof(h), NULL, 0);
+}
+
+void loopback_adopt(struct handoff_extra *x) {
+    struct loopback_handoff h;
+
+    if (handoff_take(x, "loopback", &h, sizeof(h), NULL, 0) < 0) return;
+    for (int i = 0; i < h.count && i < LOOPBACK_MAX && ncreated < LOOPBACK_MAX; i++) {
+        int known = 0;
+        for (int j = 0; j < ncreated; j++) known |= created[j] == h.nr[i];
+        if (!known) created[ncreated++] = h.nr[i];
+    }
+}
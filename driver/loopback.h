@@ -0,0 +1,40 @@
+/*
+ * FLIR One Pro LT Linux Driver - v4l2loopback device management
+ *
+ * An output path "label:NAME" names a v4l2loopback device by its card
+ * label instead of its number. The device is looked up in sysfs and, if
+ * there is none, created through the /dev/v4l2loopback control device
+ * (v4l2loopback 0.12.5+) with that label, exclusive caps and two buffers,
+ * as start.sh used to ask modprobe for. Devices the driver created are
+ * removed again when it exits, leaving every other loopback device alone;
+ * after a live upgrade the list goes to the successor, which removes them
+ * instead.
+ */
+
+#ifndef FLIRONE_LOOPBACK_H
+#define FLIRONE_LOOPBACK_H
+
+#include <stddef.h>
+
+#define LOOPBACK_PREFIX     "label:"
+
+/* Card labels of the default outputs with --loopback */
+#define LOOPBACK_THERMAL    "FLIR_Thermal"
+#define LOOPBACK_VISIBLE    "FLIR_Visible"
+
+struct handoff_extra;
+
+/* /dev/videoN of the loopback device labelled label, created if needed.
+ * Returns 0 or -1. */
+int loopback_resolve(const char *label, char *dev, size_t size);
+
+/* Remove the devices loopback_resolve() created */
+void loopback_remove_all(void);
+
+/* Running side: put the created devices into x. Returns 0 or -1. */
+int loopback_hand_off(struct handoff_extra *x);
+
+/* Successor side: take over the old driver's devices from x, if any */
+void loopback_adopt(struct handoff_extra *x);
+
+#endif
@@ -0,0 +1,35 @@
+/*
+ * FLIR One Pro LT Linux Driver - EP 0x85 packet layout
+ *
+ * Thermal lines are 82 little-endian words apart, 80 of them pixels, so on
+ * a little-endian host a line is one memcpy.
+ */
+
+#include <string.h>
+
+#include "packet.h"
+
+static uint32_t le32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+int packet_is_start(const unsigned char *buf) {
+    return buf[0] == MAGIC_0 && buf[1] == MAGIC_1 && buf[2] == 0 && buf[3] == 0;
+}
+
+void packet_sizes(const unsigned char *buf, struct packet_sizes *s) {
+    s->frame = le32(buf + 8);
+    s->thermal = le32(buf + 12);
+    s->jpeg = le32(buf + 16);
+}
+
+void packet_thermal(const unsigned char *buf, uint16_t *pix) {
+    for (int y = 0; y < THERMAL_HEIGHT; y++) {
+        const unsigned char *line = buf + LINE_OFFSET + 2 * y * LINE_STRIDE;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        memcpy(pix + y * THERMAL_WIDTH, line, 2 * THERMAL_WIDTH);
+#else
+        for (int x = 0; x < THERMAL_WIDTH; x++) pix[y * THERMAL_WIDTH + x] = line[2 * x] | (line[2 * x + 1] << 8);
+#endif
+    }
+}
@@ -0,0 +1,45 @@
+/*
+ * FLIR One Pro LT Linux Driver - EP 0x85 packet layout
+ *
+ * A camera packet is a 28-byte header (magic EF BE 00 00, little-endian
+ * sizes at 8, 12 and 16), the thermal block, the visible JPEG and a status
+ * block.
+ */
+
+#ifndef FLIRONE_PACKET_H
+#define FLIRONE_PACKET_H
+
+#include <stdint.h>
+
+/* Frame format */
+#define HEADER_SIZE     28
+#define MAGIC_0         0xEF
+#define MAGIC_1         0xBE
+#define LINE_STRIDE     82  /* 80 * 164 / 160 */
+#define LINE_OFFSET     32
+
+/* Frame dimensions (Pro LT = Gen3 = 80x60) */
+#define THERMAL_WIDTH   80
+#define THERMAL_HEIGHT  60
+#define VISIBLE_WIDTH   640
+#define VISIBLE_HEIGHT  480
+
+/* Buffer size - must be 1MB per original driver */
+#define BUFFER_SIZE     1048576
+
+struct packet_sizes {
+    uint32_t frame;         /* everything after the header */
+    uint32_t thermal;
+    uint32_t jpeg;
+};
+
+/* 1 if buf (at least 4 bytes) starts a packet */
+int packet_is_start(const unsigned char *buf);
+
+/* Sizes from the header of a packet */
+void packet_sizes(const unsigned char *buf, struct packet_sizes *s);
+
+/* Unpack the thermal block of a packet into 80x60 raw values */
+void packet_thermal(const unsigned char *buf, uint16_t *pix);
+
+#endif
@@ -0,0 +1,830 @@
+/*
+ * FLIR One Pro LT Linux Driver - configurable processing pipeline
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <linux/videodev2.h>
+
+#include "pipeline.h"
+#include "camera.h"
+#include "h264.h"
+#include "handoff.h"
+#include "jpegdct.h"
+#include "sink.h"
+#include "status.h"
+#include "workq.h"
+
+/* Same padding as the built-in visible output */
+#define PIPE_JPEG_PAD   8192
+#define PIPE_PNM_HDR    32
+
+enum pipe_format { FMT_Y16, FMT_GRAY, FMT_RGB, FMT_JPEG, FMT_PNM };
+
+enum pipe_stage {
+    ST_THERMAL, ST_VISIBLE,
+    ST_MEDIAN, ST_SMOOTH, ST_AGC, ST_COLORIZE, ST_UPSCALE, ST_PNM, ST_JPEGCROP, ST_JPEGSCALE, ST_OUTPUT
+};
+
+static const char *stage_names[] = {
+    "thermal", "visible",
+    "median", "smooth", "agc", "colorize", "upscale", "pnm", "jpegcrop", "jpegscale", "output"
+};
+
+struct pipe_node {
+    char name[PIPE_NAME_LEN];
+    int stage;
+    int input;              /* node index, -1 for the camera streams */
+    int format;             /* of this node's output */
+    int width;
+    int height;
+    size_t size;            /* largest output in bytes */
+
+    /* Parameters */
+    int low, high;          /* agc: percentiles */
+    unsigned char palette[768];
+    int factor;             /* upscale; jpegscale: 1/factor */
+    int bilinear;
+    int crop_x, crop_y;     /* jpegcrop */
+    int crop_w, crop_h;
+    int quality;            /* jpegscale */
+    char path[256];         /* output */
+    char sink[SINK_NAME_LEN];
+    int ffc_policy;         /* FFC_POLICY_* for flagged frames */
+    int h264;               /* output codec=h264 */
+    int bitrate;            /* kbit/s */
+    int keyint;
+};
+
+struct pipe_out {
+    int fd;
+    struct sink *sink;
+    int demand_id;
+    unsigned long writes;
+    unsigned long dropped;
+};
+
+struct pipe_task {
+    struct pipe_instance *pi;
+    int node;
+};
+
+struct pipe_instance {
+    char tag[CAMERA_ID_LEN + 4];
+    int camera;
+    struct demand *demand;
+
+    const unsigned char *data[PIPE_MAX_NODES];
+    size_t len[PIPE_MAX_NODES];             /* 0: nothing this frame */
+    unsigned char *own[PIPE_MAX_NODES];     /* stage output buffers */
+    uint16_t *scratch[PIPE_MAX_NODES];      /* agc: sorted copy */
+    struct jpegdct *jdct[PIPE_MAX_NODES];   /* jpegcrop, jpegscale */
+    struct h264_enc *enc[PIPE_MAX_NODES];   /* codec=h264 outputs */
+    struct pipe_out out[PIPE_MAX_NODES];
+    unsigned char *held[PIPE_MAX_NODES];    /* ffc=hold: last good input */
+    size_t held_len[PIPE_MAX_NODES];
+    unsigned char needed[PIPE_MAX_NODES];
+    struct pipe_task tasks[PIPE_MAX_NODES];
+
+    const uint16_t *thermal;
+    const uint8_t *jpeg;
+    size_t jpeg_size;
+
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    int remaining;
+};
+
+static struct pipe_node nodes[PIPE_MAX_NODES];
+static int nnodes = 0;
+static struct workq *pool = NULL;
+
+static size_t format_size(int format, int w, int h) {
+    switch (format) {
+    case FMT_Y16:  return (size_t)w * h * 2;
+    case FMT_GRAY: return (size_t)w * h;
+    case FMT_RGB:  return (size_t)w * h * 3;
+    case FMT_PNM:  return PIPE_PNM_HDR + (size_t)w * h * 3;
+    default:       return BUFFER_SIZE;
+    }
+}
+
+static int find_node(const char *name) {
+    for (int i = 0; i < nnodes; i++) {
+        if (strcmp(nodes[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+static int add_source(const char *name, int stage, int format, int w, int h) {
+    struct pipe_node *n = &nodes[nnodes];
+    memset(n, 0, sizeof(*n));
+    snprintf(n->name, sizeof(n->name), "%s", name);
+    n->stage = stage;
+    n->input = -1;
+    n->format = format;
+    n->width = w;
+    n->height = h;
+    n->size = format_size(format, w, h);
+    return nnodes++;
+}
+
+static int load_palette(struct pipe_node *n, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Cannot open palette %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    size_t r = fread(n->palette, 1, sizeof(n->palette), f);
+    fclose(f);
+    if (r != sizeof(n->palette)) {
+        fprintf(stderr, "Palette %s: expected 768 bytes\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/* Apply key=value to a stage. Returns 0, or -1 if it does not apply. */
+static int set_param(struct pipe_node *n, const char *key, const char *value) {
+    if (n->stage == ST_AGC && strcmp(key, "low") == 0) {
+        n->low = atoi(value);
+    } else if (n->stage == ST_AGC && strcmp(key, "high") == 0) {
+        n->high = atoi(value);
+    } else if (n->stage == ST_COLORIZE && strcmp(key, "palette") == 0) {
+        return load_palette(n, value);
+    } else if (n->stage == ST_UPSCALE && strcmp(key, "factor") == 0) {
+        n->factor = atoi(value);
+    } else if (n->stage == ST_UPSCALE && strcmp(key, "mode") == 0) {
+        if (strcmp(value, "bilinear") == 0) n->bilinear = 1;
+        else if (strcmp(value, "nearest") == 0) n->bilinear = 0;
+        else return -1;
+    } else if (n->stage == ST_JPEGSCALE && strcmp(key, "factor") == 0) {
+        n->factor = atoi(value);
+    } else if (n->stage == ST_JPEGSCALE && strcmp(key, "quality") == 0) {
+        n->quality = atoi(value);
+    } else if (n->stage == ST_JPEGCROP && strcmp(key, "crop") == 0) {
+        if (sscanf(value, "%dx%d+%d+%d", &n->crop_w, &n->crop_h, &n->crop_x, &n->crop_y) != 4) return -1;
+    } else if (n->stage == ST_OUTPUT && strcmp(key, "path") == 0) {
+        snprintf(n->path, sizeof(n->path), "%s", value);
+    } else if (n->stage == ST_OUTPUT && strcmp(key, "sink") == 0) {
+        snprintf(n->sink, sizeof(n->sink), "%s", value);
+    } else if (n->stage == ST_OUTPUT && strcmp(key, "codec") == 0) {
+        if (strcmp(value, "h264") != 0) return -1;
+        if (!h264_supported()) {
+            fprintf(stderr, "codec=h264 needs a driver built with make H264=1\n");
+            return -1;
+        }
+        n->h264 = 1;
+    } else if (n->stage == ST_OUTPUT && strcmp(key, "bitrate") == 0) {
+        n->bitrate = atoi(value);
+    } else if (n->stage == ST_OUTPUT && strcmp(key, "keyint") == 0) {
+        n->keyint = atoi(value);
+    } else if (n->stage == ST_OUTPUT && strcmp(key, "ffc") == 0) {
+        n->ffc_policy = status_parse_policy(value);
+        if (n->ffc_policy < 0) return -1;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/* Check the input format and derive the output format and size */
+static int resolve_node(struct pipe_node *n) {
+    const struct pipe_node *in = &nodes[n->input];
+    n->width = in->width;
+    n->height = in->height;
+
+    switch (n->stage) {
+    case ST_MEDIAN:
+    case ST_SMOOTH:
+        if (in->format != FMT_Y16) return -1;
+        n->format = FMT_Y16;
+        break;
+    case ST_AGC:
+        if (in->format != FMT_Y16) return -1;
+        if (n->low < 0 || n->high > 100 || n->low >= n->high) return -1;
+        n->format = FMT_GRAY;
+        break;
+    case ST_COLORIZE:
+        if (in->format != FMT_GRAY) return -1;
+        n->format = FMT_RGB;
+        break;
+    case ST_UPSCALE:
+        if (in->format != FMT_Y16 && in->format != FMT_GRAY && in->format != FMT_RGB) return -1;
+        if (n->factor < 1 || n->factor > 8) return -1;
+        n->format = in->format;
+        n->width *= n->factor;
+        n->height *= n->factor;
+        break;
+    case ST_PNM:
+        if (in->format != FMT_Y16 && in->format != FMT_GRAY && in->format != FMT_RGB) return -1;
+        n->format = FMT_PNM;
+        break;
+    case ST_JPEGCROP:
+        /* MCU-aligned, so whole blocks are copied */
+        if (in->format != FMT_JPEG || n->crop_w <= 0 || n->crop_h <= 0 || n->crop_x < 0 || n->crop_y < 0) return -1;
+        if ((n->crop_x | n->crop_y | n->crop_w | n->crop_h) % JPEGDCT_CROP_ALIGN) return -1;
+        if (n->crop_x + n->crop_w > in->width || n->crop_y + n->crop_h > in->height) return -1;
+        n->format = FMT_JPEG;
+        n->width = n->crop_w;
+        n->height = n->crop_h;
+        break;
+    case ST_JPEGSCALE:
+        if (in->format != FMT_JPEG || (n->factor != 2 && n->factor != 4 && n->factor != 8)) return -1;
+        if (n->quality < 1 || n->quality > 100) return -1;
+        n->format = FMT_JPEG;
+        n->width = (in->width + n->factor - 1) / n->factor;
+        n->height = (in->height + n->factor - 1) / n->factor;
+        break;
+    case ST_OUTPUT:
+        if (!n->path[0] == !n->sink[0]) return -1;
+        /* 4:2:0 needs even sizes */
+        if (n->h264 && (in->format != FMT_RGB || in->width % 2 || in->height % 2)) return -1;
+        if (n->h264 && (n->bitrate <= 0 || n->keyint <= 0)) return -1;
+        n->format = in->format;
+        break;
+    }
+    n->size = format_size(n->format, n->width, n->height);
+    return 0;
+}
+
+int pipeline_load(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Cannot open pipeline %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    nnodes = 0;
+    add_source("thermal", ST_THERMAL, FMT_Y16, THERMAL_WIDTH, THERMAL_HEIGHT);
+    add_source("visible", ST_VISIBLE, FMT_JPEG, VISIBLE_WIDTH, VISIBLE_HEIGHT);
+
+    char line[512];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+
+        char *save;
+        char *name = strtok_r(line, " \t\r\n", &save);
+        if (!name) continue;
+        char *type = strtok_r(NULL, " \t\r\n", &save);
+        char *input = strtok_r(NULL, " \t\r\n", &save);
+        if (!type || !input) {
+            fprintf(stderr, "%s:%d: expected NAME TYPE INPUT\n", path, lineno);
+            goto fail;
+        }
+        if (nnodes >= PIPE_MAX_NODES) {
+            fprintf(stderr, "%s:%d: too many stages (max %d)\n", path, lineno, PIPE_MAX_NODES);
+            goto fail;
+        }
+        if (strlen(name) >= PIPE_NAME_LEN || find_node(name) >= 0) {
+            fprintf(stderr, "%s:%d: bad or duplicate stage name %s\n", path, lineno, name);
+            goto fail;
+        }
+
+        struct pipe_node *n = &nodes[nnodes];
+        memset(n, 0, sizeof(*n));
+        snprintf(n->name, sizeof(n->name), "%s", name);
+        n->stage = -1;
+        for (int s = ST_MEDIAN; s <= ST_OUTPUT; s++) {
+            if (strcmp(type, stage_names[s]) == 0) n->stage = s;
+        }
+        if (n->stage < 0) {
+            fprintf(stderr, "%s:%d: unknown stage type %s\n", path, lineno, type);
+            goto fail;
+        }
+        n->input = find_node(input);
+        if (n->input < 0 || nodes[n->input].stage == ST_OUTPUT) {
+            fprintf(stderr, "%s:%d: input %s is not a stage declared above\n", path, lineno, input);
+            goto fail;
+        }
+
+        /* Defaults */
+        n->high = 100;
+        n->factor = 2;
+        n->bilinear = 1;
+        n->quality = 75;
+        n->bitrate = 200;
+        n->keyint = 26;
+        for (int i = 0; i < 256; i++) {
+            n->palette[i * 3] = n->palette[i * 3 + 1] = n->palette[i * 3 + 2] = i;
+        }
+
+        char *kv;
+        while ((kv = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+            char *eq = strchr(kv, '=');
+            if (eq) *eq = '\0';
+            if (!eq || set_param(n, kv, eq + 1) < 0) {
+                fprintf(stderr, "%s:%d: bad parameter %s for %s\n", path, lineno, kv, type);
+                goto fail;
+            }
+        }
+        if (resolve_node(n) < 0) {
+            fprintf(stderr, "%s:%d: %s cannot take %s as input, or bad parameters\n",
+                    path, lineno, type, input);
+            goto fail;
+        }
+        nnodes++;
+    }
+    fclose(f);
+
+    printf("Pipeline %s: %d stage(s)\n", path, nnodes - 2);
+    return 0;
+
+fail:
+    fclose(f);
+    nnodes = 0;
+    return -1;
+}
+
+int pipeline_loaded(void) {
+    return nnodes > 0;
+}
+
+int pipeline_start(int workers) {
+    if (nnodes == 0) return 0;
+    pool = workq_create(workers);
+    return pool ? 0 : -1;
+}
+
+static int v4l2_format(int format) {
+    switch (format) {
+    case FMT_Y16:  return V4L2_PIX_FMT_Y16;
+    case FMT_GRAY: return V4L2_PIX_FMT_GREY;
+    case FMT_RGB:  return V4L2_PIX_FMT_RGB24;
+    default:       return V4L2_PIX_FMT_MJPEG;
+    }
+}
+
+/* tcp:HOST:PORT for encoded outputs: a blocking stream socket, written
+ * from the encoder thread, that gives up on a stalled peer after 1 s */
+static int connect_tcp(const char *spec) {
+    char host[256];
+    const char *colon = strrchr(spec, ':');
+    if (!colon || colon == spec || (size_t)(colon - spec) >= sizeof(host)) {
+        fprintf(stderr, "Bad address tcp:%s (HOST:PORT)\n", spec);
+        return -1;
+    }
+    snprintf(host, sizeof(host), "%.*s", (int)(colon - spec), spec);
+
+    struct addrinfo hints = { 0 }, *ai;
+    hints.ai_socktype = SOCK_STREAM;
+    int e = getaddrinfo(host, colon + 1, &hints, &ai);
+    if (e != 0) {
+        fprintf(stderr, "Cannot resolve %s: %s\n", host, gai_strerror(e));
+        return -1;
+    }
+    /* Every address in turn, e.g. IPv6 then IPv4 for a name that has both */
+    int fd = -1, err = 0;
+    for (struct addrinfo *a = ai; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) < 0) {
+            err = errno;
+            close(fd);
+            fd = -1;
+        } else if (fd < 0) {
+            err = errno;
+        }
+    }
+    freeaddrinfo(ai);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot connect to tcp:%s: %s\n", spec, strerror(err));
+        return -1;
+    }
+
+    struct timeval tv = { 1, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    /* A peer going away is reported as EPIPE, not a signal */
+    signal(SIGPIPE, SIG_IGN);
+    printf("Connected to tcp:%s\n", spec);
+    return fd;
+}
+
+/* {camera} expands to the camera index */
+static void output_path(const struct pipe_node *n, int camera_index, char *path, size_t size) {
+    const char *p = strstr(n->path, "{camera}");
+    if (p) {
+        snprintf(path, size, "%.*s%d%s", (int)(p - n->path), n->path, camera_index, p + 8);
+    } else {
+        snprintf(path, size, "%s", n->path);
+    }
+}
+
+/* Outputs are handed off by node and path; the format must match too */
+struct pipe_handoff {
+    int32_t format;
+    int32_t h264;
+    int32_t width, height;
+};
+
+static void handoff_name(const struct pipe_node *n, int camera_index, char name[HANDOFF_NAME_LEN]) {
+    char path[sizeof(n->path) + 16];
+    output_path(n, camera_index, path, sizeof(path));
+    snprintf(name, HANDOFF_NAME_LEN, "pipe:%.*s:%s", PIPE_NAME_LEN, n->name, path);
+}
+
+static int open_output(struct pipe_instance *pi, int i, struct handoff_extra *adopt) {
+    const struct pipe_node *n = &nodes[i];
+    struct pipe_out *o = &pi->out[i];
+    char path[sizeof(n->path) + 16], name[HANDOFF_NAME_LEN];
+    struct pipe_handoff h;
+
+    if (n->sink[0]) {
+        o->sink = sink_find(n->sink);
+        if (!o->sink) {
+            fprintf(stderr, "Pipeline output %s: no --sink %s\n", n->name, n->sink);
+            return -1;
+        }
+        return 0;
+    }
+    output_path(n, pi->camera, path, sizeof(path));
+    handoff_name(n, pi->camera, name);
+
+    int adopted = adopt && handoff_take(adopt, name, &h, sizeof(h), &o->fd, 1) == 1;
+    if (adopted && (h.format != n->format || h.h264 != n->h264 || h.width != n->width || h.height != n->height)) {
+        /* The old driver wrote something else there: start over */
+        close(o->fd);
+        adopted = 0;
+    }
+
+    if (adopted) {
+        /* Already set up by the old driver, and a file keeps its contents */
+    } else if (n->h264 && strncmp(path, "tcp:", 4) == 0) {
+        o->fd = connect_tcp(path + 4);
+    } else if (n->format == FMT_PNM || n->h264) {
+        /* A stream of PNM images, e.g. for ffmpeg -f image2pipe, or H.264 */
+        o->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (o->fd < 0) fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+    } else {
+        o->fd = open_v4l2_output(path, n->width, n->height, v4l2_format(n->format));
+    }
+    if (o->fd < 0) return -1;
+
+    o->demand_id = demand_add_v4l2(pi->demand, o->fd, n->name);
+    return 0;
+}
+
+struct pipe_instance *pipeline_create(int camera_index, const char *tag, struct demand *d,
+                                      struct handoff_extra *adopt) {
+    struct pipe_instance *pi = calloc(1, sizeof(*pi));
+    if (!pi) return NULL;
+    snprintf(pi->tag, sizeof(pi->tag), "%s", tag);
+    pi->camera = camera_index;
+    pi->demand = d;
+    pthread_mutex_init(&pi->lock, NULL);
+    pthread_cond_init(&pi->done, NULL);
+
+    for (int i = 0; i < nnodes; i++) {
+        const struct pipe_node *n = &nodes[i];
+        pi->out[i].fd = -1;
+        pi->out[i].demand_id = -1;
+        pi->tasks[i].pi = pi;
+        pi->tasks[i].node = i;
+
+        if (n->stage == ST_THERMAL || n->stage == ST_VISIBLE) continue;
+        if (n->stage == ST_OUTPUT) {
+            if (n->format == FMT_JPEG) pi->own[i] = malloc(BUFFER_SIZE + PIPE_JPEG_PAD);
+            if (open_output(pi, i, adopt) < 0) goto fail;
+            if (n->h264) {
+                struct h264_params hp = { n->width, n->height, n->bitrate, n->keyint };
+                pi->enc[i] = h264_open(pi->tag, n->name, &hp, pi->out[i].fd, pi->out[i].sink);
+                if (!pi->enc[i]) goto fail;
+            }
+            if (n->ffc_policy == FFC_POLICY_HOLD && !(pi->held[i] = malloc(nodes[n->input].size))) goto fail;
+        } else {
+            pi->own[i] = malloc(n->size);
+            if (n->stage == ST_AGC && !(pi->scratch[i] = malloc(n->width * n->height * sizeof(uint16_t)))) goto fail;
+            if ((n->stage == ST_JPEGCROP || n->stage == ST_JPEGSCALE) && !(pi->jdct[i] = jpegdct_create())) goto fail;
+        }
+        if ((n->stage != ST_OUTPUT || n->format == FMT_JPEG) && !pi->own[i]) goto fail;
+    }
+    return pi;
+
+fail:
+    pipeline_destroy(pi);
+    return NULL;
+}
+
+/* Stages */
+
+static void filter_3x3(const uint16_t *in, uint16_t *out, int w, int h, int median) {
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            uint16_t v[9];
+            int k = 0;
+            for (int dy = -1; dy <= 1; dy++) {
+                int yy = y + dy < 0 ? 0 : (y + dy >= h ? h - 1 : y + dy);
+                for (int dx = -1; dx <= 1; dx++) {
+                    int xx = x + dx < 0 ? 0 : (x + dx >= w ? w - 1 : x + dx);
+                    v[k++] = in[yy * w + xx];
+                }
+            }
+            if (median) {
+                for (int i = 1; i < 9; i++) {
+                    uint16_t t = v[i];
+                    int j = i - 1;
+                    while (j >= 0 && v[j] > t) { v[j + 1] = v[j]; j--; }
+                    v[j + 1] = t;
+                }
+                out[y * w + x] = v[4];
+            } else {
+                unsigned sum = 0;
+                for (int i = 0; i < 9; i++) sum += v[i];
+                out[y * w + x] = (sum + 4) / 9;
+            }
+        }
+    }
+}
+
+static int cmp_u16(const void *a, const void *b) {
+    return *(const uint16_t *)a - *(const uint16_t *)b;
+}
+
+static void agc(const struct pipe_node *n, const uint16_t *in, uint8_t *out, uint16_t *sorted) {
+    int count = n->width * n->height;
+    int lo = 65535, hi = 0;
+
+    if (n->low == 0 && n->high == 100) {
+        for (int i = 0; i < count; i++) {
+            if (in[i] < lo) lo = in[i];
+            if (in[i] > hi) hi = in[i];
+        }
+    } else {
+        memcpy(sorted, in, count * sizeof(uint16_t));
+        qsort(sorted, count, sizeof(uint16_t), cmp_u16);
+        lo = sorted[(count - 1) * n->low / 100];
+        hi = sorted[(count - 1) * n->high / 100];
+    }
+
+    int range = hi > lo ? hi - lo : 1;
+    for (int i = 0; i < count; i++) {
+        int v = ((int)in[i] - lo) * 255 / range;
+        out[i] = v < 0 ? 0 : (v > 255 ? 255 : v);
+    }
+}
+
+static void upscale(const struct pipe_node *n, const struct pipe_node *in,
+                    const unsigned char *src, unsigned char *dst) {
+    int ch = in->format == FMT_RGB ? 3 : 1;
+    int wide = in->format == FMT_Y16;
+    int sw = in->width, sh = in->height;
+    int f = n->factor;
+
+    for (int y = 0; y < n->height; y++) {
+        /* Sample centres, in 1/256 source pixels */
+        int fy = ((2 * y + 1) * 256 / f - 256) / 2;
+        if (!n->bilinear) fy = (y / f) * 256;
+        if (fy < 0) fy = 0;
+        int y0 = fy >> 8, wy = fy & 255;
+        int y1 = y0 + 1 < sh ? y0 + 1 : y0;
+
+        for (int x = 0; x < n->width; x++) {
+            int fx = ((2 * x + 1) * 256 / f - 256) / 2;
+            if (!n->bilinear) fx = (x / f) * 256;
+            if (fx < 0) fx = 0;
+            int x0 = fx >> 8, wx = fx & 255;
+            int x1 = x0 + 1 < sw ? x0 + 1 : x0;
+
+            for (int c = 0; c < ch; c++) {
+                int i00 = (y0 * sw + x0) * ch + c, i01 = (y0 * sw + x1) * ch + c;
+                int i10 = (y1 * sw + x0) * ch + c, i11 = (y1 * sw + x1) * ch + c;
+                int o = (y * n->width + x) * ch + c;
+                if (wide) {
+                    const uint16_t *s = (const uint16_t *)src;
+                    int top = s[i00] * (256 - wx) + s[i01] * wx;
+                    int bot = s[i10] * (256 - wx) + s[i11] * wx;
+                    ((uint16_t *)dst)[o] = ((long long)top * (256 - wy) + (long long)bot * wy) >> 16;
+                } else {
+                    int top = src[i00] * (256 - wx) + src[i01] * wx;
+                    int bot = src[i10] * (256 - wx) + src[i11] * wx;
+                    dst[o] = (top * (256 - wy) + bot * wy) >> 16;
+                }
+            }
+        }
+    }
+}
+
+static size_t encode_pnm(const struct pipe_node *in, const unsigned char *src, unsigned char *dst) {
+    int pixels = in->width * in->height;
+    int h = snprintf((char *)dst, PIPE_PNM_HDR, "%s\n%d %d\n%d\n",
+                     in->format == FMT_RGB ? "P6" : "P5", in->width, in->height,
+                     in->format == FMT_Y16 ? 65535 : 255);
+
+    if (in->format == FMT_Y16) {
+        /* PNM samples wider than a byte are big-endian */
+        const uint16_t *s = (const uint16_t *)src;
+        for (int i = 0; i < pixels; i++) {
+            dst[h + 2 * i] = s[i] >> 8;
+            dst[h + 2 * i + 1] = s[i] & 0xFF;
+        }
+        return h + 2 * pixels;
+    }
+    size_t size = (size_t)pixels * (in->format == FMT_RGB ? 3 : 1);
+    memcpy(dst + h, src, size);
+    return h + size;
+}
+
+static void write_output(struct pipe_instance *pi, int i, const unsigned char *data, size_t size) {
+    const struct pipe_node *n = &nodes[i];
+    struct pipe_out *o = &pi->out[i];
+
+    /* JPEG gets the same zero padding as the built-in visible output */
+    if (n->format == FMT_JPEG && pi->own[i] && size <= BUFFER_SIZE) {
+        memcpy(pi->own[i], data, size);
+        memset(pi->own[i] + size, 0, PIPE_JPEG_PAD);
+        data = pi->own[i];
+        size += PIPE_JPEG_PAD;
+    }
+
+    int ok;
+    if (pi->enc[i]) {
+        ok = h264_frame(pi->enc[i], data) == 0;
+    } else if (o->sink) {
+        ok = sink_write(o->sink, data, size) == 0;
+    } else {
+        ssize_t r = write(o->fd, data, size);
+        if (r < 0 && errno != EAGAIN && errno != EINTR) {
+            fprintf(stderr, "%s%s: write failed: %s\n", pi->tag, n->name, strerror(errno));
+        }
+        ok = r == (ssize_t)size;
+    }
+    if (ok) o->writes++;
+    else o->dropped++;
+}
+
+static void run_node(struct pipe_instance *pi, int i) {
+    const struct pipe_node *n = &nodes[i];
+
+    if (n->stage == ST_THERMAL) {
+        pi->data[i] = (const unsigned char *)pi->thermal;
+        pi->len[i] = pi->thermal ? n->size : 0;
+        return;
+    }
+    if (n->stage == ST_VISIBLE) {
+        pi->data[i] = pi->jpeg;
+        pi->len[i] = pi->jpeg ? pi->jpeg_size : 0;
+        return;
+    }
+
+    const unsigned char *src = pi->data[n->input];
+    size_t src_len = pi->len[n->input];
+    pi->len[i] = 0;
+    if (src_len == 0) return;
+
+    unsigned char *dst = pi->own[i];
+    pi->data[i] = dst;
+    pi->len[i] = n->size;
+
+    switch (n->stage) {
+    case ST_MEDIAN:
+    case ST_SMOOTH:
+        filter_3x3((const uint16_t *)src, (uint16_t *)dst, n->width, n->height, n->stage == ST_MEDIAN);
+        break;
+    case ST_AGC:
+        agc(n, (const uint16_t *)src, dst, pi->scratch[i]);
+        break;
+    case ST_COLORIZE:
+        for (int p = 0; p < n->width * n->height; p++) {
+            memcpy(dst + 3 * p, n->palette + 3 * src[p], 3);
+        }
+        break;
+    case ST_UPSCALE:
+        upscale(n, &nodes[n->input], src, dst);
+        break;
+    case ST_PNM:
+        pi->len[i] = encode_pnm(&nodes[n->input], src, dst);
+        break;
+    case ST_JPEGCROP:
+        pi->len[i] = jpegdct_crop(pi->jdct[i], src, src_len, n->crop_x, n->crop_y, n->crop_w, n->crop_h,
+                                  dst, n->size);
+        break;
+    case ST_JPEGSCALE:
+        pi->len[i] = jpegdct_scale(pi->jdct[i], src, src_len, n->factor, n->quality, dst, n->size);
+        break;
+    case ST_OUTPUT:
+        if (pi->held[i] && src_len <= nodes[n->input].size) {
+            memcpy(pi->held[i], src, src_len);
+            pi->held_len[i] = src_len;
+        }
+        write_output(pi, i, src, src_len);
+        pi->data[i] = NULL;
+        pi->len[i] = 0;
+        break;
+    }
+}
+
+/* Run a stage, then fan out to the stages consuming it */
+static void run_task(void *arg) {
+    struct pipe_task *t = arg;
+    struct pipe_instance *pi = t->pi;
+
+    run_node(pi, t->node);
+
+    int first = -1;
+    for (int j = t->node + 1; j < nnodes; j++) {
+        if (nodes[j].input != t->node || !pi->needed[j]) continue;
+        /* Keep one child on this thread, hand the others to the pool */
+        if (first < 0) first = j;
+        else if (!pool || workq_submit(pool, run_task, &pi->tasks[j]) < 0) run_task(&pi->tasks[j]);
+    }
+
+    pthread_mutex_lock(&pi->lock);
+    if (--pi->remaining == 0) pthread_cond_signal(&pi->done);
+    pthread_mutex_unlock(&pi->lock);
+
+    if (first >= 0) run_task(&pi->tasks[first]);
+}
+
+void pipeline_run(struct pipe_instance *pi, const uint16_t *thermal,
+                  const uint8_t *jpeg, size_t jpeg_size, unsigned int quality) {
+    /* Only what feeds an output with consumers; file order is topological */
+    demand_update(pi->demand);
+    int count = 0;
+    for (int i = nnodes - 1; i >= 0; i--) {
+        if (nodes[i].stage == ST_OUTPUT) {
+            int id = pi->out[i].demand_id;
+            pi->needed[i] = id < 0 || demand_count(pi->demand, id) != 0;
+
+            /* Flagged frame: repeat the held one without computing anything */
+            if (quality && pi->needed[i] && nodes[i].ffc_policy != FFC_POLICY_PASS) {
+                if (pi->held_len[i] > 0) write_output(pi, i, pi->held[i], pi->held_len[i]);
+                else pi->out[i].dropped++;
+                pi->needed[i] = 0;
+            }
+        } else {
+            pi->needed[i] = 0;
+            for (int j = i + 1; j < nnodes && !pi->needed[i]; j++) {
+                if (nodes[j].input == i && pi->needed[j]) pi->needed[i] = 1;
+            }
+        }
+        count += pi->needed[i];
+    }
+    if (count == 0) return;
+
+    pi->thermal = thermal;
+    pi->jpeg = jpeg;
+    pi->jpeg_size = jpeg_size;
+
+    pthread_mutex_lock(&pi->lock);
+    pi->remaining = count;
+    pthread_mutex_unlock(&pi->lock);
+
+    if (pi->needed[1] && pool) {
+        if (workq_submit(pool, run_task, &pi->tasks[1]) < 0) run_task(&pi->tasks[1]);
+    } else if (pi->needed[1]) {
+        run_task(&pi->tasks[1]);
+    }
+    if (pi->needed[0]) run_task(&pi->tasks[0]);
+
+    pthread_mutex_lock(&pi->lock);
+    while (pi->remaining > 0) pthread_cond_wait(&pi->done, &pi->lock);
+    pthread_mutex_unlock(&pi->lock);
+}
+
+int pipeline_hand_off(struct pipe_instance *pi, struct handoff_extra *x) {
+    for (int i = 0; pi && i < nnodes; i++) {
+        char name[HANDOFF_NAME_LEN];
+        if (pi->out[i].fd < 0) continue;
+
+        /* Two processes must not write one frame each into the same stream */
+        h264_drain(pi->enc[i]);
+        struct pipe_handoff h = { nodes[i].format, nodes[i].h264, nodes[i].width, nodes[i].height };
+        handoff_name(&nodes[i], pi->camera, name);
+        if (handoff_put(x, name, &h, sizeof(h), &pi->out[i].fd, 1) < 0) return -1;
+    }
+    return 0;
+}
+
+void pipeline_destroy(struct pipe_instance *pi) {
+    if (!pi) return;
+    for (int i = 0; i < nnodes; i++) {
+        if (nodes[i].stage == ST_OUTPUT && (pi->out[i].writes || pi->out[i].dropped)) {
+            printf("%s%s: %lu written, %lu dropped\n", pi->tag, nodes[i].name,
+                   pi->out[i].writes, pi->out[i].dropped);
+        }
+        h264_close(pi->enc[i]);
+        if (pi->out[i].fd >= 0) close(pi->out[i].fd);
+        free(pi->own[i]);
+        free(pi->scratch[i]);
+        jpegdct_destroy(pi->jdct[i]);
+        free(pi->held[i]);
+    }
+    pthread_mutex_destroy(&pi->lock);
+    pthread_cond_destroy(&pi->done);
+    free(pi);
+}
+
+void pipeline_stop(void) {
+    workq_destroy(pool);
+    pool = NULL;
+}
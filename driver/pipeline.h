@@ -0,0 +1,66 @@
+/*
+ * FLIR One Pro LT Linux Driver - configurable processing pipeline
+ *
+ * A pipeline file declares processing stages as a DAG rooted at the two
+ * camera streams, "thermal" (Y16) and "visible" (JPEG):
+ *
+ *   # NAME   TYPE      INPUT    [key=value ...]
+ *   clean    median    thermal
+ *   gray     agc       clean    low=1 high=99
+ *   iron     colorize  gray     palette=../palettes/Iron2.raw
+ *   big      upscale   iron     factor=4
+ *   out      output    big      path=/dev/video12
+ *   small    jpegscale visible  factor=4
+ *   remote   output    small    sink=preview
+ *
+ * Every stage has one input declared above it, so file order is a
+ * topological order. Per frame only stages feeding an output with
+ * consumers run, each exactly once, and independent branches run in
+ * parallel on the pipeline thread pool.
+ */
+
+#ifndef FLIRONE_PIPELINE_H
+#define FLIRONE_PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "demand.h"
+
+#define PIPE_MAX_NODES      32
+#define PIPE_NAME_LEN       32
+
+struct pipe_instance;
+struct handoff_extra;
+
+/* Parse the pipeline file. Returns 0 or -1. */
+int pipeline_load(const char *path);
+
+int pipeline_loaded(void);
+
+/* Start the shared pool running the stages of all cameras */
+int pipeline_start(int workers);
+
+/* Per camera: allocate buffers and open the outputs. "{camera}" in an
+ * output path becomes the camera index. Outputs are registered with d.
+ * An output found in adopt (after a takeover, else NULL) keeps the old
+ * driver's fd instead of being opened again. */
+struct pipe_instance *pipeline_create(int camera_index, const char *tag, struct demand *d,
+                                      struct handoff_extra *adopt);
+
+/* Run one frame through the graph; returns when all stages are done.
+ * thermal or jpeg may be NULL if the frame lacks that part. Outputs with
+ * ffc=drop or ffc=hold skip frames with non-zero quality flags, and so
+ * does everything feeding only them. */
+void pipeline_run(struct pipe_instance *pi, const uint16_t *thermal,
+                  const uint8_t *jpeg, size_t jpeg_size, unsigned int quality);
+
+/* Live upgrade: wait for the encoders, then add the output fds to x.
+ * Returns 0 or -1. */
+int pipeline_hand_off(struct pipe_instance *pi, struct handoff_extra *x);
+
+void pipeline_destroy(struct pipe_instance *pi);
+
+void pipeline_stop(void);
+
+#endif
@@ -0,0 +1,258 @@
+/*
+ * FLIR One Pro LT Linux Driver - plugin host
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <dlfcn.h>
+
+#include "plugin.h"
+#include "sink.h"
+#include "status.h"
+#include "workq.h"
+
+struct plugin {
+    char path[256];
+    void *handle;
+    const struct flirone_plugin *api;
+    void *instance;
+
+    /* Timing, updated atomically from the workers */
+    unsigned long calls;
+    unsigned long errors;
+    unsigned long long total_ns;
+    unsigned long long max_ns;
+};
+
+static struct plugin plugins[PLUGIN_MAX];
+static int nplugins = 0;
+static struct workq *pool = NULL;
+static struct sink *meta_sink = NULL;
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int host_set_metadata(const struct flirone_frame *frame, const char *key, const char *value) {
+    struct plugin_frame *pf = frame->host_private;
+    char buf[512];
+    size_t n = 0;
+
+    /* ,"key":"value" with quotes, backslashes and control characters made safe */
+    const char *parts[2] = { key, value };
+    for (int p = 0; p < 2; p++) {
+        buf[n++] = p == 0 ? ',' : ':';
+        buf[n++] = '"';
+        for (const char *c = parts[p]; *c && n < sizeof(buf) - 4; c++) {
+            if (*c == '"' || *c == '\\') buf[n++] = '\\';
+            buf[n++] = ((unsigned char)*c < 0x20) ? ' ' : *c;
+        }
+        buf[n++] = '"';
+    }
+
+    pthread_mutex_lock(&pf->lock);
+    int r = -1;
+    if (pf->meta_len + n < sizeof(pf->meta)) {
+        memcpy(pf->meta + pf->meta_len, buf, n);
+        pf->meta_len += n;
+        r = 0;
+    }
+    pthread_mutex_unlock(&pf->lock);
+    return r;
+}
+
+static int host_emit(const char *name, const void *data, size_t size) {
+    struct sink *s = sink_find(name);
+    if (!s) return -1;
+    return sink_write(s, data, size);
+}
+
+static void host_log(const char *plugin, const char *fmt, ...) {
+    char msg[512];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+    printf("[plugin %s] %s\n", plugin, msg);
+}
+
+static const struct flirone_host host = {
+    sizeof(struct flirone_host),
+    FLIRONE_PLUGIN_ABI,
+    host_set_metadata,
+    host_emit,
+    host_log,
+};
+
+int plugin_load(const char *spec) {
+    if (nplugins >= PLUGIN_MAX) {
+        fprintf(stderr, "Too many plugins (max %d)\n", PLUGIN_MAX);
+        return -1;
+    }
+
+    struct plugin *p = &plugins[nplugins];
+    const char *colon = strchr(spec, ':');
+    const char *args = colon ? colon + 1 : "";
+    size_t len = colon ? (size_t)(colon - spec) : strlen(spec);
+    if (len >= sizeof(p->path)) return -1;
+    memcpy(p->path, spec, len);
+    p->path[len] = '\0';
+
+    p->handle = dlopen(p->path, RTLD_NOW | RTLD_LOCAL);
+    if (!p->handle) {
+        fprintf(stderr, "Cannot load plugin: %s\n", dlerror());
+        return -1;
+    }
+
+    flirone_plugin_entry_fn entry = (flirone_plugin_entry_fn)dlsym(p->handle, FLIRONE_PLUGIN_ENTRY);
+    p->api = entry ? entry() : NULL;
+    if (!p->api || p->api->abi_version < 1 || p->api->abi_version > FLIRONE_PLUGIN_ABI || !p->api->process) {
+        fprintf(stderr, "%s: not a compatible flirone plugin\n", p->path);
+        dlclose(p->handle);
+        return -1;
+    }
+
+    p->instance = p->api->create ? p->api->create(&host, args) : NULL;
+    if (p->api->create && !p->instance) {
+        fprintf(stderr, "%s: plugin create failed\n", p->path);
+        dlclose(p->handle);
+        return -1;
+    }
+
+    printf("Loaded plugin %s (%s)\n", p->api->name ? p->api->name : "?", p->path);
+    nplugins++;
+    return 0;
+}
+
+int plugin_count(void) {
+    return nplugins;
+}
+
+int plugins_start(int workers) {
+    if (nplugins == 0) return 0;
+    pool = workq_create(workers);
+    if (!pool) return -1;
+    meta_sink = sink_find("metadata");
+    printf("Plugin worker pool: %d thread(s)\n", workers);
+    return 0;
+}
+
+void plugin_frame_init(struct plugin_frame *pf) {
+    pthread_mutex_init(&pf->lock, NULL);
+    pf->busy = 0;
+    pf->pending = 0;
+    pf->view.struct_size = sizeof(pf->view);
+    pf->view.host_private = pf;
+}
+
+int plugin_frame_busy(struct plugin_frame *pf) {
+    return __atomic_load_n(&pf->busy, __ATOMIC_ACQUIRE);
+}
+
+/* Last job of a frame: publish its metadata record */
+static void finish_frame(struct plugin_frame *pf) {
+    if (meta_sink && pf->meta_len > 0) {
+        char rec[PLUGIN_META_LEN + 256];
+        int n = snprintf(rec, sizeof(rec), "{\"camera\":\"%s\",\"frame\":%u,\"timestamp_ns\":%llu,\"arrival_ns\":%llu,\"ffc\":\"%s\",\"quality\":%u%.*s}\n",
+                         pf->view.camera_id, pf->view.sequence, (unsigned long long)pf->view.timestamp_ns,
+                         (unsigned long long)pf->view.arrival_ns,
+                         status_ffc_name(pf->view.ffc_state), pf->view.quality, (int)pf->meta_len, pf->meta);
+        if (n > 0 && n < (int)sizeof(rec)) sink_write(meta_sink, rec, n);
+    }
+}
+
+/* Releases the frame back to the camera thread */
+static void release_frame(struct plugin_frame *pf) {
+    struct frame *f = pf->frame;
+    pf->frame = NULL;
+    __atomic_store_n(&pf->busy, 0, __ATOMIC_RELEASE);
+    frame_unref(f);
+}
+
+static void run_job(void *arg) {
+    struct plugin_job *job = arg;
+    struct plugin_frame *pf = job->frame;
+    struct plugin *p = &plugins[job->plugin];
+
+    uint64_t t0 = mono_ns();
+    int r = p->api->process(p->instance, &pf->view);
+    uint64_t dt = mono_ns() - t0;
+
+    __atomic_fetch_add(&p->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&p->total_ns, dt, __ATOMIC_RELAXED);
+    if (r < 0) __atomic_fetch_add(&p->errors, 1, __ATOMIC_RELAXED);
+    unsigned long long max = __atomic_load_n(&p->max_ns, __ATOMIC_RELAXED);
+    while (dt > max && !__atomic_compare_exchange_n(&p->max_ns, &max, dt, 0,
+                                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+
+    pthread_mutex_lock(&pf->lock);
+    int last = (--pf->pending == 0);
+    pthread_mutex_unlock(&pf->lock);
+    if (last) {
+        finish_frame(pf);
+        release_frame(pf);
+    }
+}
+
+int plugins_submit(struct plugin_frame *pf) {
+    if (!pool || plugin_frame_busy(pf)) {
+        frame_unref(pf->frame);
+        pf->frame = NULL;
+        return -1;
+    }
+
+    pf->meta_len = 0;
+    pf->pending = nplugins + 1;     /* +1 holds the frame until all are queued */
+    __atomic_store_n(&pf->busy, 1, __ATOMIC_RELEASE);
+
+    int queued = 0;
+    for (int i = 0; i < nplugins; i++) {
+        pf->jobs[i].frame = pf;
+        pf->jobs[i].plugin = i;
+        if (workq_submit(pool, run_job, &pf->jobs[i]) < 0) break;
+        queued++;
+    }
+
+    /* Drop our hold plus any jobs the full queue refused */
+    pthread_mutex_lock(&pf->lock);
+    pf->pending -= 1 + (nplugins - queued);
+    int last = (pf->pending == 0);
+    pthread_mutex_unlock(&pf->lock);
+    if (last) {
+        finish_frame(pf);
+        release_frame(pf);
+    }
+    return queued > 0 ? 0 : -1;
+}
+
+void plugins_print_stats(void) {
+    for (int i = 0; i < nplugins; i++) {
+        struct plugin *p = &plugins[i];
+        unsigned long calls = __atomic_load_n(&p->calls, __ATOMIC_RELAXED);
+        unsigned long long total = __atomic_load_n(&p->total_ns, __ATOMIC_RELAXED);
+        printf("[plugin %s] calls=%lu errors=%lu avg=%.1fus max=%.1fus\n",
+               p->api->name ? p->api->name : p->path, calls,
+               __atomic_load_n(&p->errors, __ATOMIC_RELAXED),
+               calls ? total / 1000.0 / calls : 0.0,
+               __atomic_load_n(&p->max_ns, __ATOMIC_RELAXED) / 1000.0);
+    }
+}
+
+void plugins_stop(void) {
+    workq_destroy(pool);
+    pool = NULL;
+
+    plugins_print_stats();
+    for (int i = 0; i < nplugins; i++) {
+        struct plugin *p = &plugins[i];
+        if (p->api->destroy) p->api->destroy(p->instance);
+        dlclose(p->handle);
+    }
+    nplugins = 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * FLIR One Pro LT Linux Driver - plugin host
+ *
+ * Loads frame processor plugins (see flirone_plugin.h) and runs them on a
+ * worker pool. Each camera owns one struct plugin_frame; while its jobs are
+ * busy the frame buffers it points into must not be reused.
+ */
+
+#ifndef FLIRONE_PLUGIN_HOST_H
+#define FLIRONE_PLUGIN_HOST_H
+
+#include <pthread.h>
+
+#include "flirone_plugin.h"
+#include "frame.h"
+
+#define PLUGIN_MAX          16
+#define PLUGIN_META_LEN     4096
+
+struct plugin_frame;
+
+struct plugin_job {
+    struct plugin_frame *frame;
+    int plugin;
+};
+
+struct plugin_frame {
+    struct flirone_frame view;
+    struct frame *frame;        /* reference the view points into */
+    pthread_mutex_t lock;
+    int busy;                   /* set until the last job finishes */
+    int pending;                /* jobs not yet finished, under lock */
+    char meta[PLUGIN_META_LEN]; /* ,"key":"value" pairs */
+    size_t meta_len;
+    struct plugin_job jobs[PLUGIN_MAX];
+};
+
+/* Load PATH[:ARGS]. Returns 0 or -1. */
+int plugin_load(const char *spec);
+
+int plugin_count(void);
+
+/* Start the worker pool once all plugins are loaded */
+int plugins_start(int workers);
+
+void plugin_frame_init(struct plugin_frame *pf);
+
+/* 1 while the frame is still being processed */
+int plugin_frame_busy(struct plugin_frame *pf);
+
+/* Run every plugin on pf->view. Takes over the reference in pf->frame and
+ * drops it when the last plugin is done. Returns 0 if dispatched, -1 if
+ * dropped. */
+int plugins_submit(struct plugin_frame *pf);
+
+/* Drain the pool, destroy plugin instances and print per-plugin timing */
+void plugins_stop(void);
+
+void plugins_print_stats(void);
+
+#endif
@@ -0,0 +1,70 @@
+/*
+ * Example flirone plugin: hottest pixel per frame
+ *
+ * Attaches the raw maximum and its position to the frame metadata. With
+ * "every=N" as argument it also logs every Nth frame.
+ *
+ * Build: make plugins
+ * Run:   ./flirone --plugin plugins/hotspot.so:every=50 --sink metadata=/tmp/meta.jsonl
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../flirone_plugin.h"
+
+struct hotspot {
+    const struct flirone_host *host;
+    unsigned int every;
+};
+
+static void *hotspot_create(const struct flirone_host *host, const char *args) {
+    struct hotspot *h = calloc(1, sizeof(*h));
+    if (!h) return NULL;
+    h->host = host;
+    if (strncmp(args, "every=", 6) == 0) h->every = strtoul(args + 6, NULL, 10);
+    return h;
+}
+
+static int hotspot_process(void *instance, const struct flirone_frame *frame) {
+    struct hotspot *h = instance;
+    if (!frame->thermal) return 0;
+
+    int w = frame->thermal_width;
+    int n = w * frame->thermal_height;
+    int best = 0;
+    for (int i = 1; i < n; i++) {
+        if (frame->thermal[i] > frame->thermal[best]) best = i;
+    }
+
+    char value[16];
+    snprintf(value, sizeof(value), "%u", frame->thermal[best]);
+    h->host->set_metadata(frame, "hotspot_raw", value);
+    snprintf(value, sizeof(value), "%d", best % w);
+    h->host->set_metadata(frame, "hotspot_x", value);
+    snprintf(value, sizeof(value), "%d", best / w);
+    h->host->set_metadata(frame, "hotspot_y", value);
+
+    if (h->every && frame->sequence % h->every == 0) {
+        h->host->log("hotspot", "%s frame %u: max %u at (%d,%d)", frame->camera_id,
+                     frame->sequence, frame->thermal[best], best % w, best / w);
+    }
+    return 0;
+}
+
+static void hotspot_destroy(void *instance) {
+    free(instance);
+}
+
+static const struct flirone_plugin hotspot_plugin = {
+    FLIRONE_PLUGIN_ABI,
+    "hotspot",
+    hotspot_create,
+    hotspot_process,
+    hotspot_destroy,
+};
+
+const struct flirone_plugin *flirone_plugin_entry(void) {
+    return &hotspot_plugin;
+}
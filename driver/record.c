@@ -0,0 +1,482 @@
+/*
+ * FLIR One Pro LT Linux Driver - Matroska recording
+ *
+ * The file is written front to back: EBML header, a Segment holding Info
+ * and Tracks, then one Cluster per second of SimpleBlocks. Segment and
+ * Cluster sizes start out as "unknown", which Matroska allows for live
+ * streams; on a regular file they are patched in as each cluster and, at
+ * the end, the segment closes, along with the Duration. A recording cut
+ * short by a crash stays playable up to its last whole block.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "record.h"
+#include "camera.h"
+#include "ffv1.h"
+
+/* Frames queued for the writer, about 3.5 s */
+#define RECORD_QUEUE        32
+
+/* Block timestamps in milliseconds */
+#define RECORD_TIMESCALE    1000000
+#define RECORD_CLUSTER_MS   1000
+
+#define THERMAL_PIXELS      (THERMAL_WIDTH * THERMAL_HEIGHT)
+
+/* Element IDs */
+#define EBML_HEADER         0x1A45DFA3
+#define EBML_VERSION        0x4286
+#define EBML_READ_VERSION   0x42F7
+#define EBML_MAX_ID_LENGTH  0x42F2
+#define EBML_MAX_SIZE_LENGTH 0x42F3
+#define EBML_DOCTYPE        0x4282
+#define EBML_DOCTYPE_VERSION 0x4287
+#define EBML_DOCTYPE_READ_VERSION 0x4285
+#define MKV_SEGMENT         0x18538067
+#define MKV_INFO            0x1549A966
+#define MKV_TIMESTAMP_SCALE 0x2AD7B1
+#define MKV_DURATION        0x4489
+#define MKV_MUXING_APP      0x4D80
+#define MKV_WRITING_APP     0x5741
+#define MKV_TRACKS          0x1654AE6B
+#define MKV_TRACK_ENTRY     0xAE
+#define MKV_TRACK_NUMBER    0xD7
+#define MKV_TRACK_UID       0x73C5
+#define MKV_TRACK_TYPE      0x83
+#define MKV_FLAG_LACING     0x9C
+#define MKV_NAME            0x536E
+#define MKV_CODEC_ID        0x86
+#define MKV_VIDEO           0xE0
+#define MKV_PIXEL_WIDTH     0xB0
+#define MKV_PIXEL_HEIGHT    0xBA
+#define MKV_CLUSTER         0x1F43B675
+#define MKV_CLUSTER_TIMESTAMP 0xE7
+#define MKV_SIMPLE_BLOCK    0xA3
+
+#define MKV_TRACK_THERMAL   1
+#define MKV_TRACK_VISIBLE   2
+
+/* An 8-byte size field with all value bits set: size unknown */
+#define MKV_UNKNOWN_SIZE    0x01FFFFFFFFFFFFFFULL
+
+struct record_slot {
+    uint64_t time_ns;
+    int has_thermal;
+    uint16_t thermal[THERMAL_PIXELS];
+    uint8_t *jpeg;
+    size_t jpeg_size;
+    size_t jpeg_cap;
+};
+
+struct record_set {
+    char tag[32];
+    char path[272];
+    int fd;
+    int seekable;           /* regular file: sizes are patched in */
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int head, count;        /* queued slots, under lock */
+    int stopping;
+    int failed;             /* a write failed, the rest is dropped */
+    struct record_slot slots[RECORD_QUEUE];
+
+    /* Writer thread only */
+    struct ffv1 *ffv1;
+    uint8_t *coded;
+    int started;
+    uint64_t t0_ns;
+    uint64_t pos;           /* bytes written */
+    uint64_t segment_data;  /* where the segment's payload starts */
+    uint64_t duration_pos;  /* the Duration value, 0 if not patched */
+    uint64_t cluster_size;  /* the open cluster's size field, 0 if none */
+    int64_t cluster_ts;
+    int64_t last_ts;
+
+    unsigned long frames;
+    unsigned long dropped;
+    uint64_t thermal_raw;
+    uint64_t thermal_coded;
+};
+
+static char record_path[256];
+
+int record_add(const char *spec) {
+    if (record_path[0]) {
+        fprintf(stderr, "Only one --record (use {camera} for several cameras)\n");
+        return -1;
+    }
+    if (!spec[0]) {
+        fprintf(stderr, "Invalid --record (PATH)\n");
+        return -1;
+    }
+    snprintf(record_path, sizeof(record_path), "%s", spec);
+    return 0;
+}
+
+int record_count(void) {
+    return record_path[0] ? 1 : 0;
+}
+
+/* -- EBML ------------------------------------------------------------------ */
+
+static size_t put_id(uint8_t *p, uint32_t id) {
+    int n = id > 0xFFFFFF ? 4 : id > 0xFFFF ? 3 : id > 0xFF ? 2 : 1;
+    for (int i = 0; i < n; i++) p[i] = id >> (8 * (n - 1 - i));
+    return n;
+}
+
+/* Shortest vint; all ones is reserved for unknown sizes */
+static size_t put_size(uint8_t *p, uint64_t v) {
+    int n = 1;
+    while (n < 8 && v >= (1ULL << (7 * n)) - 1) n++;
+    v |= 1ULL << (7 * n);
+    for (int i = 0; i < n; i++) p[i] = v >> (8 * (n - 1 - i));
+    return n;
+}
+
+static size_t put_size8(uint8_t *p, uint64_t v) {
+    v |= 1ULL << 56;
+    for (int i = 0; i < 8; i++) p[i] = v >> (8 * (7 - i));
+    return 8;
+}
+
+static size_t put_uint(uint8_t *p, uint32_t id, uint64_t v) {
+    size_t n = put_id(p, id);
+    int len = 1;
+    while (len < 8 && v >> (8 * len)) len++;
+    p[n++] = 0x80 | len;
+    for (int i = 0; i < len; i++) p[n++] = v >> (8 * (len - 1 - i));
+    return n;
+}
+
+static size_t put_float(uint8_t *p, uint32_t id, double v) {
+    size_t n = put_id(p, id);
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    p[n++] = 0x88;
+    for (int i = 0; i < 8; i++) p[n++] = bits >> (8 * (7 - i));
+    return n;
+}
+
+static size_t put_string(uint8_t *p, uint32_t id, const char *s) {
+    size_t n = put_id(p, id), len = strlen(s);
+    n += put_size(p + n, len);
+    memcpy(p + n, s, len);
+    return n + len;
+}
+
+static size_t put_master(uint8_t *p, uint32_t id, const uint8_t *data, size_t len) {
+    size_t n = put_id(p, id);
+    n += put_size(p + n, len);
+    memcpy(p + n, data, len);
+    return n + len;
+}
+
+static size_t put_track(uint8_t *p, int number, const char *name, const char *codec, int width, int height) {
+    uint8_t d[128], v[16];
+    size_t n = 0, vn = 0;
+
+    n += put_uint(d + n, MKV_TRACK_NUMBER, number);
+    n += put_uint(d + n, MKV_TRACK_UID, number);
+    n += put_uint(d + n, MKV_TRACK_TYPE, 1);        /* video */
+    n += put_uint(d + n, MKV_FLAG_LACING, 0);
+    n += put_string(d + n, MKV_NAME, name);
+    n += put_string(d + n, MKV_CODEC_ID, codec);
+    vn += put_uint(v + vn, MKV_PIXEL_WIDTH, width);
+    vn += put_uint(v + vn, MKV_PIXEL_HEIGHT, height);
+    n += put_master(d + n, MKV_VIDEO, v, vn);
+    return put_master(p, MKV_TRACK_ENTRY, d, n);
+}
+
+/* EBML header, Segment start, Info and Tracks. *segment is set to the
+ * offset of the Segment's payload, *duration to that of the Duration
+ * value, 0 without one. */
+static size_t put_headers(uint8_t *out, int with_duration, size_t *segment, size_t *duration) {
+    uint8_t d[256];
+    size_t n = 0, o = 0;
+
+    n += put_uint(d + n, EBML_VERSION, 1);
+    n += put_uint(d + n, EBML_READ_VERSION, 1);
+    n += put_uint(d + n, EBML_MAX_ID_LENGTH, 4);
+    n += put_uint(d + n, EBML_MAX_SIZE_LENGTH, 8);
+    n += put_string(d + n, EBML_DOCTYPE, "matroska");
+    n += put_uint(d + n, EBML_DOCTYPE_VERSION, 4);
+    n += put_uint(d + n, EBML_DOCTYPE_READ_VERSION, 2);
+    o += put_master(out + o, EBML_HEADER, d, n);
+
+    o += put_id(out + o, MKV_SEGMENT);
+    o += put_size8(out + o, MKV_UNKNOWN_SIZE);
+    *segment = o;
+
+    n = 0;
+    n += put_uint(d + n, MKV_TIMESTAMP_SCALE, RECORD_TIMESCALE);
+    n += put_string(d + n, MKV_MUXING_APP, "flirone");
+    n += put_string(d + n, MKV_WRITING_APP, "flirone");
+    *duration = 0;
+    if (with_duration) {
+        n += put_float(d + n, MKV_DURATION, 0);
+        /* The value is the last 8 bytes; Info's ID and size come first */
+        *duration = o + 4 + 1 + n - 8;
+    }
+    o += put_master(out + o, MKV_INFO, d, n);
+
+    n = 0;
+    n += put_track(d + n, MKV_TRACK_THERMAL, "thermal", "V_FFV1", THERMAL_WIDTH, THERMAL_HEIGHT);
+    n += put_track(d + n, MKV_TRACK_VISIBLE, "visible", "V_MJPEG", VISIBLE_WIDTH, VISIBLE_HEIGHT);
+    o += put_master(out + o, MKV_TRACKS, d, n);
+    return o;
+}
+
+/* SimpleBlock header for a keyframe of size bytes, rel ms into the cluster */
+static size_t put_block(uint8_t *p, int track, int rel, size_t size) {
+    size_t n = put_id(p, MKV_SIMPLE_BLOCK);
+    n += put_size(p + n, 4 + size);
+    p[n++] = 0x80 | track;
+    p[n++] = rel >> 8;
+    p[n++] = rel;
+    p[n++] = 0x80;
+    return n;
+}
+
+/* -- Writer ---------------------------------------------------------------- */
+
+static int write_all(struct record_set *r, struct iovec *iov, int n) {
+    while (n > 0) {
+        ssize_t w = writev(r->fd, iov, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0) {
+            fprintf(stderr, "%sRecording %s: %s\n", r->tag, r->path, strerror(errno));
+            return -1;
+        }
+        r->pos += w;
+        while (n > 0 && (size_t)w >= iov[0].iov_len) {
+            w -= iov[0].iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov[0].iov_base = (char *)iov[0].iov_base + w;
+            iov[0].iov_len -= w;
+        }
+    }
+    return 0;
+}
+
+/* Fill in a size field left unknown, on files that can take it */
+static void patch_size(struct record_set *r, uint64_t at, uint64_t size) {
+    uint8_t p[8];
+    if (!r->seekable) return;
+    put_size8(p, size);
+    if (pwrite(r->fd, p, 8, at) != 8) r->seekable = 0;
+}
+
+static void close_cluster(struct record_set *r) {
+    if (!r->cluster_size) return;
+    patch_size(r, r->cluster_size, r->pos - r->cluster_size - 8);
+    r->cluster_size = 0;
+}
+
+static int write_frame(struct record_set *r, struct record_slot *s) {
+    uint8_t head[512], cluster[32], th[16], vh[16];
+    struct iovec iov[6];
+    int n = 0;
+
+    if (!r->started) {
+        size_t segment, duration;
+        r->t0_ns = s->time_ns;
+        iov[n].iov_base = head;
+        iov[n++].iov_len = put_headers(head, r->seekable, &segment, &duration);
+        r->segment_data = segment;
+        r->duration_pos = duration;
+    }
+
+    /* Capture times; the camera clock does not go back, but stay monotonic */
+    int64_t ts = (int64_t)(s->time_ns - r->t0_ns) / RECORD_TIMESCALE;
+    if (ts < r->last_ts) ts = r->last_ts;
+    r->last_ts = ts;
+
+    /* Before the headers are out, the segment starts where they end */
+    uint64_t at = r->pos + (n ? iov[0].iov_len : 0);
+    if (!r->cluster_size || ts - r->cluster_ts >= RECORD_CLUSTER_MS) {
+        close_cluster(r);
+        size_t c = put_id(cluster, MKV_CLUSTER);
+        r->cluster_size = at + c;
+        c += put_size8(cluster + c, MKV_UNKNOWN_SIZE);
+        c += put_uint(cluster + c, MKV_CLUSTER_TIMESTAMP, ts);
+        r->cluster_ts = ts;
+        iov[n].iov_base = cluster;
+        iov[n++].iov_len = c;
+    }
+    int rel = ts - r->cluster_ts;
+
+    if (s->has_thermal) {
+        size_t size = ffv1_encode(r->ffv1, s->thermal, r->coded);
+        r->thermal_raw += sizeof(s->thermal);
+        r->thermal_coded += size;
+        iov[n].iov_base = th;
+        iov[n++].iov_len = put_block(th, MKV_TRACK_THERMAL, rel, size);
+        iov[n].iov_base = r->coded;
+        iov[n++].iov_len = size;
+    }
+    if (s->jpeg_size) {
+        iov[n].iov_base = vh;
+        iov[n++].iov_len = put_block(vh, MKV_TRACK_VISIBLE, rel, s->jpeg_size);
+        iov[n].iov_base = s->jpeg;
+        iov[n++].iov_len = s->jpeg_size;
+    }
+
+    if (write_all(r, iov, n) < 0) return -1;
+    r->started = 1;
+    r->frames++;
+    return 0;
+}
+
+static void finish(struct record_set *r) {
+    if (!r->started) return;
+    close_cluster(r);
+    patch_size(r, r->segment_data - 8, r->pos - r->segment_data);
+    if (r->seekable && r->duration_pos) {
+        uint8_t p[16];
+        put_float(p, MKV_DURATION, r->last_ts);
+        if (pwrite(r->fd, p + 3, 8, r->duration_pos) != 8) r->seekable = 0;
+    }
+}
+
+static void *record_thread(void *arg) {
+    struct record_set *r = arg;
+
+    pthread_mutex_lock(&r->lock);
+    for (;;) {
+        while (!r->count && !r->stopping) pthread_cond_wait(&r->cond, &r->lock);
+        /* Stopping, but write out what is queued first */
+        if (!r->count) break;
+        struct record_slot *s = &r->slots[r->head];
+        pthread_mutex_unlock(&r->lock);
+
+        int ok = !r->failed && write_frame(r, s) == 0;
+
+        pthread_mutex_lock(&r->lock);
+        if (!ok) {
+            r->failed = 1;
+            r->dropped++;
+        }
+        r->head = (r->head + 1) % RECORD_QUEUE;
+        r->count--;
+    }
+    pthread_mutex_unlock(&r->lock);
+
+    if (!r->failed) finish(r);
+    return NULL;
+}
+
+/* -- Setup ----------------------------------------------------------------- */
+
+struct record_set *record_open(int camera_index, const char *tag, struct demand *d) {
+    const char *p = strstr(record_path, "{camera}");
+    if (!p && camera_index != 0) return NULL;
+
+    struct record_set *r = calloc(1, sizeof(*r));
+    if (!r) return NULL;
+    snprintf(r->tag, sizeof(r->tag), "%s", tag);
+    if (p) {
+        snprintf(r->path, sizeof(r->path), "%.*s%d%s", (int)(p - record_path), record_path, camera_index, p + 8);
+    } else {
+        snprintf(r->path, sizeof(r->path), "%s", record_path);
+    }
+
+    r->fd = open(r->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (r->fd < 0) {
+        fprintf(stderr, "%sCannot open recording %s: %s\n", tag, r->path, strerror(errno));
+        free(r);
+        return NULL;
+    }
+    struct stat st;
+    r->seekable = fstat(r->fd, &st) == 0 && S_ISREG(st.st_mode);
+
+    r->ffv1 = ffv1_create(THERMAL_WIDTH, THERMAL_HEIGHT);
+    r->coded = malloc(FFV1_MAX_SIZE(THERMAL_WIDTH, THERMAL_HEIGHT));
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    if (!r->ffv1 || !r->coded || pthread_create(&r->thread, NULL, record_thread, r) != 0) {
+        fprintf(stderr, "%sCannot start recording %s\n", tag, r->path);
+        ffv1_destroy(r->ffv1);
+        free(r->coded);
+        close(r->fd);
+        free(r);
+        return NULL;
+    }
+    /* A recording always wants frames */
+    if (d) demand_add(d, r->path, DEMAND_UNKNOWN);
+
+    printf("%sRecording %s (Matroska, FFV1 thermal + MJPEG visible)\n", tag, r->path);
+    return r;
+}
+
+void record_frame(struct record_set *r, const uint16_t *thermal, const uint8_t *jpeg, size_t jpeg_size,
+                  uint64_t time_ns) {
+    if (!thermal && !jpeg) return;
+
+    pthread_mutex_lock(&r->lock);
+    if (r->count == RECORD_QUEUE || r->failed) {
+        r->dropped++;
+        pthread_mutex_unlock(&r->lock);
+        return;
+    }
+    /* The free slot after the queue is ours until it is counted in */
+    struct record_slot *s = &r->slots[(r->head + r->count) % RECORD_QUEUE];
+    pthread_mutex_unlock(&r->lock);
+
+    s->time_ns = time_ns;
+    s->has_thermal = thermal != NULL;
+    if (thermal) memcpy(s->thermal, thermal, sizeof(s->thermal));
+    s->jpeg_size = 0;
+    if (jpeg && jpeg_size > s->jpeg_cap) {
+        uint8_t *p = realloc(s->jpeg, jpeg_size);
+        if (p) {
+            s->jpeg = p;
+            s->jpeg_cap = jpeg_size;
+        }
+    }
+    if (jpeg && jpeg_size <= s->jpeg_cap) {
+        memcpy(s->jpeg, jpeg, jpeg_size);
+        s->jpeg_size = jpeg_size;
+    }
+
+    pthread_mutex_lock(&r->lock);
+    r->count++;
+    pthread_cond_signal(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+}
+
+void record_close(struct record_set *r) {
+    if (!r) return;
+    pthread_mutex_lock(&r->lock);
+    r->stopping = 1;
+    pthread_cond_signal(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    pthread_join(r->thread, NULL);
+
+    printf("%sRecording %s: %lu frames, %lu dropped, %.1f MB, thermal %.1f:1\n", r->tag, r->path,
+           r->frames, r->dropped, r->pos / 1e6,
+           r->thermal_coded ? (double)r->thermal_raw / r->thermal_coded : 0);
+
+    close(r->fd);
+    for (int i = 0; i < RECORD_QUEUE; i++) free(r->slots[i].jpeg);
+    ffv1_destroy(r->ffv1);
+    free(r->coded);
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->cond);
+    free(r);
+}
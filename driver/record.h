@@ -0,0 +1,44 @@
+/*
+ * FLIR One Pro LT Linux Driver - Matroska recording
+ *
+ * --record PATH writes both camera streams into one Matroska file that
+ * FFmpeg, VLC and mkvtoolnix open directly:
+ *
+ *   track 1   thermal, 80x60 16-bit grey, lossless FFV1 (see ffv1.h)
+ *   track 2   visible, the camera JPEGs as they came (V_MJPEG)
+ *
+ * Blocks carry each frame's capture time in milliseconds from the first
+ * frame. The camera thread only copies the frame into a queue; FFV1
+ * coding and writing happen on a thread per recording, so a slow disk
+ * costs queued frames, and dropped ones once the queue is full, but never
+ * a USB read. "{camera}" in PATH becomes the camera index; a PATH without
+ * it belongs to camera 0.
+ */
+
+#ifndef FLIRONE_RECORD_H
+#define FLIRONE_RECORD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "demand.h"
+
+struct record_set;
+
+/* Parse --record PATH. Returns 0 or -1. */
+int record_add(const char *spec);
+
+int record_count(void);
+
+/* Per camera: create the file and start the writer. NULL if the camera
+ * records nothing or on error. */
+struct record_set *record_open(int camera_index, const char *tag, struct demand *d);
+
+/* Queue a copy of the frame; thermal or jpeg may be NULL */
+void record_frame(struct record_set *r, const uint16_t *thermal, const uint8_t *jpeg, size_t jpeg_size,
+                  uint64_t time_ns);
+
+/* Write out the queue, finish the file and report */
+void record_close(struct record_set *r);
+
+#endif
@@ -0,0 +1,192 @@
+/*
+ * FLIR One Pro LT Linux Driver - radiometric JPEG
+ *
+ * FFF header and directory are big-endian (format version 100). Record
+ * contents are little-endian, flagged by a leading 16-bit 2. Only the
+ * CameraInfo fields we know are filled; the rest stays zero.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include <sys/uio.h>
+
+#include "rjpeg.h"
+
+#define FFF_HEADER_SIZE     0x40
+#define FFF_ENTRY_SIZE      0x20
+#define FFF_VERSION         100
+
+#define FFF_REC_RAWDATA     0x01
+#define FFF_REC_CAMERAINFO  0x20
+
+#define RAW_DATA_OFFSET     0x20
+#define CAMERAINFO_SIZE     0x400
+
+/* APP1 payload: "FLIR\0", 0x01, segment index, last segment index, data */
+#define APP1_FLIR_HEADER    8
+#define APP1_MAX_DATA       (65533 - APP1_FLIR_HEADER)
+
+static void be16(uint8_t *p, uint16_t v) { p[0] = v >> 8; p[1] = v; }
+static void be32(uint8_t *p, uint32_t v) { p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v; }
+static void le16(uint8_t *p, uint16_t v) { p[0] = v; p[1] = v >> 8; }
+static void le32(uint8_t *p, uint32_t v) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24; }
+
+static void lef(uint8_t *p, double d) {
+    float f = (float)d;
+    uint32_t v;
+    memcpy(&v, &f, 4);
+    le32(p, v);
+}
+
+static void dir_entry(uint8_t *e, uint16_t type, uint16_t subtype, uint32_t id,
+                      uint32_t offset, uint32_t length) {
+    be16(e, type);
+    be16(e + 2, subtype);
+    be32(e + 4, FFF_VERSION);
+    be32(e + 8, id);
+    be32(e + 12, offset);
+    be32(e + 16, length);
+}
+
+size_t rjpeg_fff(uint8_t **out, const uint16_t *thermal, int width, int height,
+                 const struct calib *calib, const char *serial, time_t when) {
+    size_t raw_size = RAW_DATA_OFFSET + (size_t)width * height * 2;
+    size_t dir = FFF_HEADER_SIZE;
+    size_t raw_off = dir + 2 * FFF_ENTRY_SIZE;
+    size_t info_off = raw_off + raw_size;
+    size_t total = info_off + CAMERAINFO_SIZE;
+
+    uint8_t *p = calloc(1, total);
+    if (!p) return 0;
+
+    memcpy(p, "FFF", 4);
+    memcpy(p + 4, "flirone", 8);            /* creator, 16 bytes */
+    be32(p + 0x14, FFF_VERSION);
+    be32(p + 0x18, dir);
+    be32(p + 0x1c, 2);                      /* directory entries */
+    be32(p + 0x20, 3);                      /* next free id */
+
+    dir_entry(p + dir, FFF_REC_RAWDATA, 2, 1, raw_off, raw_size);
+    dir_entry(p + dir + FFF_ENTRY_SIZE, FFF_REC_CAMERAINFO, 1, 2, info_off, CAMERAINFO_SIZE);
+
+    /* RawData: byte-order mark, size, then the counts row by row */
+    uint8_t *r = p + raw_off;
+    le16(r, 2);
+    le16(r + 2, width);
+    le16(r + 4, height);
+    for (int i = 0; i < width * height; i++) le16(r + RAW_DATA_OFFSET + 2 * i, thermal[i]);
+
+    /* CameraInfo: temperatures in Kelvin */
+    uint8_t *c = p + info_off;
+    double refl = calib && calib->valid ? calib->refl_temp : 20.0;
+    le16(c, 2);
+    lef(c + 0x20, calib && calib->valid ? calib->emissivity : 0.95);
+    lef(c + 0x24, 1.0);                     /* object distance, m */
+    lef(c + 0x28, refl + 273.15);           /* reflected apparent temperature */
+    lef(c + 0x2c, refl + 273.15);           /* atmospheric temperature */
+    lef(c + 0x30, refl + 273.15);           /* IR window temperature */
+    lef(c + 0x34, 1.0);                     /* IR window transmission */
+    lef(c + 0x3c, 0.5);                     /* relative humidity */
+    if (calib && calib->valid) {
+        lef(c + 0x58, calib->r1);
+        lef(c + 0x5c, calib->b);
+        lef(c + 0x60, calib->f);
+        le32(c + 0x308, (uint32_t)(int32_t)lround(calib->o));
+        lef(c + 0x30c, calib->r2);
+    }
+    /* Atmospheric transmission defaults used by FLIR cameras */
+    lef(c + 0x70, 0.006569);
+    lef(c + 0x74, 0.01262);
+    lef(c + 0x78, -0.002276);
+    lef(c + 0x7c, -0.00667);
+    lef(c + 0x80, 1.9);
+    snprintf((char *)c + 0xd4, 32, "FLIR ONE Pro LT");
+    snprintf((char *)c + 0x104, 16, "%s", serial ? serial : "");
+
+    uint16_t lo = 0xFFFF, hi = 0;
+    for (int i = 0; i < width * height; i++) {
+        if (thermal[i] < lo) lo = thermal[i];
+        if (thermal[i] > hi) hi = thermal[i];
+    }
+    le16(c + 0x310, lo);                    /* raw value range min/max */
+    le16(c + 0x312, hi);
+    le32(c + 0x384, (uint32_t)when);        /* DateTimeOriginal: seconds, ms, tz */
+
+    *out = p;
+    return total;
+}
+
+/* Length of SOI plus any APP0 segments right after it */
+static size_t insert_point(const uint8_t *jpeg, size_t size) {
+    if (size < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8) return 0;
+    size_t pos = 2;
+    while (pos + 4 <= size && jpeg[pos] == 0xFF && jpeg[pos + 1] == 0xE0) {
+        size_t len = (jpeg[pos + 2] << 8) | jpeg[pos + 3];
+        if (pos + 2 + len > size) break;
+        pos += 2 + len;
+    }
+    return pos;
+}
+
+static int write_all(int fd, const uint8_t *p, size_t len) {
+    while (len > 0) {
+        ssize_t r = write(fd, p, len);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += r;
+        len -= r;
+    }
+    return 0;
+}
+
+int rjpeg_write(const char *path, const uint8_t *jpeg, size_t jpeg_size,
+                const uint16_t *thermal, int width, int height,
+                const struct calib *calib, const char *serial) {
+    size_t head = insert_point(jpeg, jpeg_size);
+    if (head == 0) {
+        fprintf(stderr, "Snapshot: visible frame is not a JPEG\n");
+        return -1;
+    }
+
+    uint8_t *fff;
+    size_t fff_size = rjpeg_fff(&fff, thermal, width, height, calib, serial, time(NULL));
+    if (fff_size == 0) return -1;
+
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot create %s: %s\n", tmp, strerror(errno));
+        free(fff);
+        return -1;
+    }
+
+    int r = write_all(fd, jpeg, head);
+    int segments = (fff_size + APP1_MAX_DATA - 1) / APP1_MAX_DATA;
+    for (int i = 0; i < segments && r == 0; i++) {
+        size_t off = (size_t)i * APP1_MAX_DATA;
+        size_t n = fff_size - off < APP1_MAX_DATA ? fff_size - off : APP1_MAX_DATA;
+        uint8_t hdr[4 + APP1_FLIR_HEADER] = { 0xFF, 0xE1, 0, 0, 'F', 'L', 'I', 'R', 0, 0x01, 0, 0 };
+        be16(hdr + 2, 2 + APP1_FLIR_HEADER + n);
+        hdr[10] = i;
+        hdr[11] = segments - 1;
+        r = write_all(fd, hdr, sizeof(hdr));
+        if (r == 0) r = write_all(fd, fff + off, n);
+    }
+    if (r == 0) r = write_all(fd, jpeg + head, jpeg_size - head);
+    free(fff);
+
+    if (close(fd) < 0 || r < 0 || rename(tmp, path) < 0) {
+        fprintf(stderr, "Cannot write %s: %s\n", path, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
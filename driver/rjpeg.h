@@ -0,0 +1,30 @@
+/*
+ * FLIR One Pro LT Linux Driver - radiometric JPEG
+ *
+ * Writes the visible JPEG unchanged, with FLIR APP1 segments inserted after
+ * SOI/APP0 holding an FFF container: a RawData record (raw thermal counts)
+ * and a CameraInfo record (Planck constants, emissivity, serial), laid out
+ * as FLIR Tools and ExifTool (-RawThermalImage, -Planck*) read them.
+ */
+
+#ifndef FLIRONE_RJPEG_H
+#define FLIRONE_RJPEG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "calib.h"
+
+/* The FFF container: header + record directory + records, malloc'd.
+ * Returns its size, or 0 on allocation failure. */
+size_t rjpeg_fff(uint8_t **out, const uint16_t *thermal, int width, int height,
+                 const struct calib *calib, const char *serial, time_t when);
+
+/* Write jpeg + thermal as a radiometric JPEG to path (via a temporary file
+ * and rename). Returns 0 or -1. */
+int rjpeg_write(const char *path, const uint8_t *jpeg, size_t jpeg_size,
+                const uint16_t *thermal, int width, int height,
+                const struct calib *calib, const char *serial);
+
+#endif
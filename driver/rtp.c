@@ -0,0 +1,623 @@
+/*
+ * FLIR One Pro LT Linux Driver - RTP sender
+ *
+ * RFC 4175 packets carry whole or partial lines, each described by a
+ * 6-byte line header; with the default MTU a thermal frame is 8 packets.
+ * RFC 2435 assumes the standard Huffman tables of JPEG Annex K: frames
+ * with other tables cannot be rebuilt by a receiver and are not sent.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "rtp.h"
+#include "camera.h"
+#include "handoff.h"
+
+#define RTP_DEFAULT_MTU     1400
+#define RTP_MIN_MTU         256
+#define RTP_HEADER          12
+#define RTP_BATCH           16          /* packets per sendmmsg */
+
+#define RTP_PT_RAW          96
+#define RTP_PT_JPEG         26
+#define RTP_CLOCK           90000
+
+enum rtp_stream { RTP_THERMAL, RTP_VISIBLE };
+
+struct rtp_spec {
+    int stream;
+    char host[128];
+    int port;
+    int mtu;
+    int rate_kbps;          /* 0: as fast as possible */
+    char sdp[256];
+};
+
+struct rtp_sender {
+    const struct rtp_spec *spec;
+    int fd;
+    int payload;            /* RTP payload bytes per packet */
+    uint32_t ssrc;
+    uint32_t seq;           /* RFC 4175 sends the upper 16 bits too */
+    unsigned long frames;
+    unsigned long dropped;
+    unsigned long packets;
+    unsigned long errors;
+    int warned;
+};
+
+struct rtp_set {
+    char tag[32];
+    int camera;
+    struct rtp_sender snd[RTP_MAX_SPECS];
+    int nsnd;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int pending;            /* a frame is queued or being sent */
+    int stopping;
+
+    /* The frames being sent, referenced until done */
+    struct frame *thermal;
+    struct frame *visible;
+    uint64_t time_ns;
+
+    /* Packets of the current frame, back to back */
+    uint8_t *buf;
+    size_t buf_cap;
+    struct mmsghdr *msgs;
+    struct iovec *iov;
+    int msg_cap;
+};
+
+/* A receiver sees one session across a live upgrade */
+struct rtp_handoff {
+    uint32_t ssrc;
+    uint32_t seq;
+};
+
+static struct rtp_spec specs[RTP_MAX_SPECS];
+static int nspecs = 0;
+
+int rtp_add(const char *spec) {
+    char copy[512];
+    snprintf(copy, sizeof(copy), "%s", spec);
+
+    if (nspecs >= RTP_MAX_SPECS) {
+        fprintf(stderr, "Too many RTP streams (max %d)\n", RTP_MAX_SPECS);
+        return -1;
+    }
+    struct rtp_spec *s = &specs[nspecs];
+    memset(s, 0, sizeof(*s));
+    s->mtu = RTP_DEFAULT_MTU;
+
+    char *eq = strchr(copy, '=');
+    if (!eq) goto invalid;
+    *eq = '\0';
+    if (strcmp(copy, "thermal") == 0) s->stream = RTP_THERMAL;
+    else if (strcmp(copy, "visible") == 0) s->stream = RTP_VISIBLE;
+    else goto invalid;
+
+    /* HOST:PORT, with [v6]:PORT for IPv6 literals */
+    char *addr = strtok(eq + 1, ",");
+    char *colon = addr ? strrchr(addr, ':') : NULL;
+    if (!colon || colon == addr) goto invalid;
+    *colon = '\0';
+    if (addr[0] == '[' && colon[-1] == ']') {
+        addr++;
+        colon[-1] = '\0';
+    }
+    snprintf(s->host, sizeof(s->host), "%s", addr);
+    s->port = atoi(colon + 1);
+    if (s->port <= 0 || s->port > 65535) goto invalid;
+
+    char *opt;
+    while ((opt = strtok(NULL, ","))) {
+        if (strncmp(opt, "mtu=", 4) == 0) s->mtu = atoi(opt + 4);
+        else if (strncmp(opt, "rate=", 5) == 0) s->rate_kbps = atoi(opt + 5);
+        else if (strncmp(opt, "sdp=", 4) == 0) snprintf(s->sdp, sizeof(s->sdp), "%s", opt + 4);
+        else goto invalid;
+    }
+    if (s->mtu < RTP_MIN_MTU || s->mtu > 65535 || s->rate_kbps < 0) goto invalid;
+
+    nspecs++;
+    return 0;
+
+invalid:
+    fprintf(stderr, "Invalid --rtp %s (thermal|visible=HOST:PORT[,mtu=N][,rate=KBPS][,sdp=FILE])\n", spec);
+    return -1;
+}
+
+int rtp_count(void) {
+    return nspecs;
+}
+
+static void put16(uint8_t *p, uint16_t v) { p[0] = v >> 8; p[1] = v; }
+static void put32(uint8_t *p, uint32_t v) { p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v; }
+
+/* -- JPEG parsing for RFC 2435 --------------------------------------------- */
+
+/* Annex K.3 tables: 16 code counts, then the symbols */
+static const uint8_t std_dht[4][16 + 162] = {
+    { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0,
+      0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 },
+    { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d,
+      0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+      0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+      0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+      0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+      0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+      0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+      0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+      0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+      0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+      0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+      0xf9, 0xfa },
+    { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0,
+      0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 },
+    { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77,
+      0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+      0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+      0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+      0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+      0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+      0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+      0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+      0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+      0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+      0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+      0xf9, 0xfa },
+};
+
+struct jpeg_info {
+    int type;                   /* RFC 2435 type: 0 4:2:2, 1 4:2:0, +64 with restart markers */
+    int width, height;
+    int restart;
+    const uint8_t *qt[2];       /* 64-byte tables for luma and chroma */
+    const uint8_t *scan;
+    size_t scan_size;
+};
+
+static const char *jpeg_parse(const uint8_t *p, size_t size, struct jpeg_info *j) {
+    const uint8_t *dqt[4] = { 0 };
+    int qsel[3] = { -1, -1, -1 }, hv[3] = { 0 };
+
+    memset(j, 0, sizeof(*j));
+    if (size < 4 || p[0] != 0xFF || p[1] != 0xD8) return "no SOI";
+    size_t pos = 2;
+    while (pos + 4 <= size) {
+        if (p[pos] != 0xFF) return "bad marker";
+        int m = p[pos + 1];
+        size_t len = (p[pos + 2] << 8) | p[pos + 3];
+        const uint8_t *d = p + pos + 4;
+        if (len < 2 || pos + 2 + len > size) return "truncated segment";
+        len -= 2;
+
+        if (m == 0xDB) {
+            for (size_t k = 0; k + 65 <= len; k += 65) {
+                if (d[k] >> 4) return "16-bit quantisation table";
+                dqt[d[k] & 3] = d + k + 1;
+            }
+        } else if (m == 0xC0) {
+            if (len < 15 || d[5] != 3) return "not a 3-component baseline JPEG";
+            j->height = (d[1] << 8) | d[2];
+            j->width = (d[3] << 8) | d[4];
+            for (int c = 0; c < 3; c++) {
+                hv[c] = d[7 + 3 * c];
+                qsel[c] = d[8 + 3 * c] & 3;
+            }
+        } else if (m >= 0xC1 && m <= 0xCF && m != 0xC4 && m != 0xC8 && m != 0xCC) {
+            return "not baseline";
+        } else if (m == 0xC4) {
+            for (size_t k = 0; k < len;) {
+                int tc = d[k] >> 4, th = d[k] & 15;
+                size_t n = 0;
+                for (int b = 0; b < 16 && k + 1 + b < len; b++) n += d[k + 1 + b];
+                if (tc > 1 || th > 1 || k + 17 + n > len) return "bad Huffman table";
+                const uint8_t *ref = std_dht[th * 2 + tc];
+                size_t ref_n = 0;
+                for (int b = 0; b < 16; b++) ref_n += ref[b];
+                if (n != ref_n || memcmp(d + k + 1, ref, 16 + n) != 0) return "non-standard Huffman tables";
+                k += 17 + n;
+            }
+        } else if (m == 0xDD) {
+            if (len >= 2) j->restart = (d[0] << 8) | d[1];
+        } else if (m == 0xDA) {
+            j->scan = d + len;
+            break;
+        }
+        pos += 2 + len + 2;
+    }
+    if (!j->scan) return "no scan";
+
+    /* Frames are validated and trimmed, so the scan data ends at the EOI
+     * in the last two bytes */
+    const uint8_t *end = p + size - 2;
+    if (end <= j->scan || end[0] != 0xFF || end[1] != 0xD9) return "no EOI";
+    j->scan_size = end - j->scan;
+
+    if (hv[1] != 0x11 || hv[2] != 0x11) return "unsupported chroma sampling";
+    if (hv[0] == 0x21) j->type = 0;
+    else if (hv[0] == 0x22) j->type = 1;
+    else return "unsupported luma sampling";
+    if (j->restart) j->type += 64;
+    if (j->width > 2040 || j->height > 2040) return "too large for RTP/JPEG";
+    if (qsel[1] != qsel[2] || !dqt[qsel[0]] || !dqt[qsel[1]]) return "missing quantisation table";
+    j->qt[0] = dqt[qsel[0]];
+    j->qt[1] = dqt[qsel[1]];
+    return NULL;
+}
+
+/* -- Packetising ----------------------------------------------------------- */
+
+static int reserve(struct rtp_set *r, int packets, size_t bytes) {
+    if (bytes > r->buf_cap) {
+        uint8_t *b = realloc(r->buf, bytes);
+        if (!b) return -1;
+        r->buf = b;
+        r->buf_cap = bytes;
+    }
+    if (packets > r->msg_cap) {
+        struct mmsghdr *m = realloc(r->msgs, packets * sizeof(*m));
+        if (m) r->msgs = m;
+        struct iovec *v = realloc(r->iov, packets * sizeof(*v));
+        if (v) r->iov = v;
+        if (!m || !v) return -1;
+        r->msg_cap = packets;
+    }
+    return 0;
+}
+
+static size_t rtp_header(struct rtp_sender *s, uint8_t *p, int pt, int marker, uint32_t ts) {
+    p[0] = 0x80;
+    p[1] = (marker ? 0x80 : 0) | pt;
+    put16(p + 2, s->seq);
+    put32(p + 4, ts);
+    put32(p + 8, s->ssrc);
+    s->seq++;
+    return RTP_HEADER;
+}
+
+/* RFC 4175: line headers first, then the samples they describe */
+static int packetise_raw(struct rtp_set *r, struct rtp_sender *s, uint32_t ts) {
+    const int total = THERMAL_WIDTH * THERMAL_HEIGHT;
+    int per_packet = (s->payload - 2 - 6) / 2;
+    int max_packets = total / per_packet + THERMAL_HEIGHT + 1;
+    if (reserve(r, max_packets, (size_t)max_packets * (RTP_HEADER + s->payload)) < 0) return -1;
+
+    int n = 0, pos = 0;
+    uint8_t *p = r->buf;
+    while (pos < total) {
+        uint8_t *start = p;
+        uint32_t seq = s->seq;
+        p += rtp_header(s, p, RTP_PT_RAW, 0, ts);
+        put16(p, seq >> 16);
+        p += 2;
+
+        /* Segments that fit: 6 header bytes plus at least one sample */
+        int room = s->payload - 2, nseg = 0, seg_pos[THERMAL_HEIGHT + 1], seg_len[THERMAL_HEIGHT + 1];
+        while (pos < total && room >= 6 + 2) {
+            int off = pos % THERMAL_WIDTH;
+            int len = THERMAL_WIDTH - off;
+            if (len > (room - 6) / 2) len = (room - 6) / 2;
+            seg_pos[nseg] = pos;
+            seg_len[nseg++] = len;
+            room -= 6 + 2 * len;
+            pos += len;
+        }
+        for (int k = 0; k < nseg; k++) {
+            put16(p, seg_len[k] * 2);
+            put16(p + 2, seg_pos[k] / THERMAL_WIDTH);       /* F = 0: progressive */
+            put16(p + 4, (k < nseg - 1 ? 0x8000 : 0) | (seg_pos[k] % THERMAL_WIDTH));
+            p += 6;
+        }
+        for (int k = 0; k < nseg; k++) {
+            const uint16_t *src = &r->thermal->thermal[seg_pos[k]];
+            for (int i = 0; i < seg_len[k]; i++, p += 2) put16(p, src[i]);
+        }
+        if (pos >= total) start[1] |= 0x80;                 /* last packet of the frame */
+
+        r->iov[n].iov_base = start;
+        r->iov[n].iov_len = p - start;
+        n++;
+    }
+    return n;
+}
+
+/* RFC 2435: main header, quantisation tables in the first packet, scan data */
+static int packetise_jpeg(struct rtp_set *r, struct rtp_sender *s, uint32_t ts) {
+    struct jpeg_info j;
+    const char *err = jpeg_parse(r->visible->jpeg, r->visible->jpeg_size, &j);
+    if (err) {
+        if (!s->warned++) fprintf(stderr, "%sRTP visible: %s, frames not sent\n", r->tag, err);
+        return 0;
+    }
+
+    int hdr = 8 + (j.restart ? 4 : 0);
+    int max_packets = j.scan_size / (s->payload - hdr - 132) + 2;
+    if (reserve(r, max_packets, (size_t)max_packets * (RTP_HEADER + s->payload)) < 0) return -1;
+
+    int n = 0;
+    size_t off = 0;
+    uint8_t *p = r->buf;
+    while (off < j.scan_size) {
+        uint8_t *start = p;
+        p += rtp_header(s, p, RTP_PT_JPEG, 0, ts);
+        p[0] = 0;
+        p[1] = off >> 16;
+        p[2] = off >> 8;
+        p[3] = off;
+        p[4] = j.type;
+        p[5] = 255;                             /* Q >= 128: tables in-band */
+        p[6] = j.width / 8;
+        p[7] = j.height / 8;
+        p += 8;
+        if (j.restart) {
+            put16(p, j.restart);
+            put16(p + 2, 0xFFFF);               /* F = L = 1: whole scan, restart count 0x3FFF */
+            p += 4;
+        }
+        if (off == 0) {
+            p[0] = 0;                           /* MBZ */
+            p[1] = 0;                           /* 8-bit tables */
+            put16(p + 2, 128);
+            memcpy(p + 4, j.qt[0], 64);
+            memcpy(p + 68, j.qt[1], 64);
+            p += 132;
+        }
+        size_t len = s->payload - (p - start - RTP_HEADER);
+        if (len > j.scan_size - off) len = j.scan_size - off;
+        memcpy(p, j.scan + off, len);
+        p += len;
+        off += len;
+        if (off >= j.scan_size) start[1] |= 0x80;
+
+        r->iov[n].iov_base = start;
+        r->iov[n].iov_len = p - start;
+        n++;
+    }
+    return n;
+}
+
+static void send_packets(struct rtp_set *r, struct rtp_sender *s, int n) {
+    struct timespec t0;
+    size_t bytes = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    for (int i = 0; i < n; i++) {
+        memset(&r->msgs[i], 0, sizeof(r->msgs[i]));
+        r->msgs[i].msg_hdr.msg_iov = &r->iov[i];
+        r->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    for (int i = 0; i < n;) {
+        int batch = n - i < RTP_BATCH ? n - i : RTP_BATCH;
+        int sent = sendmmsg(s->fd, &r->msgs[i], batch, 0);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            /* ECONNREFUSED: nobody listening yet (ICMP from a previous send) */
+            if (!s->errors++ && errno != ECONNREFUSED) {
+                fprintf(stderr, "%sRTP %s:%d: %s\n", r->tag, s->spec->host, s->spec->port, strerror(errno));
+            }
+            s->dropped++;
+            return;
+        }
+        for (int k = 0; k < sent; k++) bytes += r->iov[i + k].iov_len;
+        s->packets += sent;
+        i += sent;
+
+        if (s->spec->rate_kbps > 0 && i < n) {
+            /* Pace the batches: kbit/s is bits per millisecond */
+            uint64_t ns = (uint64_t)bytes * 8 * 1000000 / s->spec->rate_kbps;
+            struct timespec until = t0;
+            until.tv_sec += ns / 1000000000;
+            until.tv_nsec += ns % 1000000000;
+            if (until.tv_nsec >= 1000000000) {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000;
+            }
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR);
+        }
+    }
+    s->frames++;
+}
+
+static void *rtp_thread(void *arg) {
+    struct rtp_set *r = arg;
+
+    pthread_mutex_lock(&r->lock);
+    for (;;) {
+        while (!r->pending && !r->stopping) pthread_cond_wait(&r->cond, &r->lock);
+        if (r->stopping) break;
+        pthread_mutex_unlock(&r->lock);
+
+        uint32_t ts = (uint32_t)(r->time_ns / 1000 * RTP_CLOCK / 1000000);
+        for (int i = 0; i < r->nsnd; i++) {
+            struct rtp_sender *s = &r->snd[i];
+            int n = 0;
+            if (s->spec->stream == RTP_THERMAL && r->thermal) n = packetise_raw(r, s, ts);
+            else if (s->spec->stream == RTP_VISIBLE && r->visible) n = packetise_jpeg(r, s, ts);
+            if (n > 0) send_packets(r, s, n);
+            else if (n < 0) s->dropped++;
+        }
+
+        pthread_mutex_lock(&r->lock);
+        frame_unref(r->thermal);
+        frame_unref(r->visible);
+        r->thermal = NULL;
+        r->visible = NULL;
+        r->pending = 0;
+        /* rtp_hand_off() may be waiting for this frame */
+        pthread_cond_broadcast(&r->cond);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
+
+/* -- Setup ----------------------------------------------------------------- */
+
+static void write_sdp(struct rtp_set *r, struct rtp_sender *s, const char *host, int port) {
+    const char *path = s->spec->sdp;
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "%sCannot write %s: %s\n", r->tag, path, strerror(errno));
+        return;
+    }
+    const char *ip = strchr(host, ':') ? "IP6" : "IP4";
+    fprintf(f, "v=0\r\no=- %u 0 IN %s %s\r\ns=FLIR One %s\r\nc=IN %s %s\r\nt=0 0\r\n",
+            s->ssrc, ip, host, s->spec->stream == RTP_THERMAL ? "thermal" : "visible", ip, host);
+    if (s->spec->stream == RTP_THERMAL) {
+        fprintf(f, "m=video %d RTP/AVP %d\r\na=rtpmap:%d raw/%d\r\n"
+                   "a=fmtp:%d sampling=GRAYSCALE; width=%d; height=%d; depth=16; exactframerate=87/10\r\n",
+                port, RTP_PT_RAW, RTP_PT_RAW, RTP_CLOCK, RTP_PT_RAW, THERMAL_WIDTH, THERMAL_HEIGHT);
+    } else {
+        fprintf(f, "m=video %d RTP/AVP %d\r\na=rtpmap:%d JPEG/%d\r\n", port, RTP_PT_JPEG, RTP_PT_JPEG, RTP_CLOCK);
+    }
+    fclose(f);
+    printf("%sRTP session description: %s\n", r->tag, path);
+}
+
+static void handoff_name(char *name, size_t size, const struct rtp_sender *s, int port) {
+    snprintf(name, size, "rtp:%s:%s:%d", s->spec->stream == RTP_THERMAL ? "thermal" : "visible",
+             s->spec->host, port);
+}
+
+static int open_sender(struct rtp_set *r, struct rtp_sender *s, int camera_index, struct handoff_extra *adopt) {
+    char port[16], host[128], name[HANDOFF_NAME_LEN];
+    struct addrinfo hints = { 0 }, *ai;
+    struct rtp_handoff h;
+    int port_n = s->spec->port + 2 * camera_index;
+
+    snprintf(port, sizeof(port), "%d", port_n);
+    hints.ai_socktype = SOCK_DGRAM;
+    int e = getaddrinfo(s->spec->host, port, &hints, &ai);
+    if (e != 0) {
+        fprintf(stderr, "%sRTP %s: %s\n", r->tag, s->spec->host, gai_strerror(e));
+        return -1;
+    }
+    handoff_name(name, sizeof(name), s, port_n);
+    int adopted = adopt && handoff_take(adopt, name, &h, sizeof(h), &s->fd, 1) == 1;
+    if (!adopted) s->fd = socket(ai->ai_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (s->fd < 0 || (!adopted && connect(s->fd, ai->ai_addr, ai->ai_addrlen) < 0)) {
+        fprintf(stderr, "%sRTP %s:%s: %s\n", r->tag, s->spec->host, port, strerror(errno));
+        if (s->fd >= 0) close(s->fd);
+        s->fd = -1;
+        freeaddrinfo(ai);
+        return -1;
+    }
+    if (getnameinfo(ai->ai_addr, ai->ai_addrlen, host, sizeof(host), NULL, 0, NI_NUMERICHOST) != 0) {
+        snprintf(host, sizeof(host), "%s", s->spec->host);
+    }
+
+    /* UDP payload: MTU less IP and UDP headers */
+    s->payload = s->spec->mtu - (ai->ai_family == AF_INET6 ? 48 : 28) - RTP_HEADER;
+    freeaddrinfo(ai);
+
+    if (adopted) {
+        s->ssrc = h.ssrc;
+        s->seq = h.seq;
+    } else {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        s->ssrc = (uint32_t)(ts.tv_nsec ^ (ts.tv_sec << 12) ^ ((uint32_t)getpid() << 8)) + camera_index * 2 +
+                  s->spec->stream;
+        s->seq = s->ssrc >> 16;
+    }
+
+    printf("%sRTP %s: %s port %d (mtu %d%s)\n", r->tag, s->spec->stream == RTP_THERMAL ? "thermal" : "visible",
+           host, port_n, s->spec->mtu, s->spec->rate_kbps ? ", paced" : "");
+    if (s->spec->sdp[0]) write_sdp(r, s, host, port_n);
+    return 0;
+}
+
+struct rtp_set *rtp_open(int camera_index, const char *tag, struct demand *d,
+                         struct handoff_extra *adopt) {
+    struct rtp_set *r = calloc(1, sizeof(*r));
+    if (!r) return NULL;
+    snprintf(r->tag, sizeof(r->tag), "%s", tag);
+
+    for (int i = 0; i < nspecs; i++) {
+        struct rtp_sender *s = &r->snd[r->nsnd];
+        s->spec = &specs[i];
+        if (open_sender(r, s, camera_index, adopt) < 0) continue;
+        if (d) demand_add(d, s->spec->host, DEMAND_UNKNOWN);
+        r->nsnd++;
+    }
+    r->camera = camera_index;
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    if (r->nsnd == 0 || pthread_create(&r->thread, NULL, rtp_thread, r) != 0) {
+        for (int i = 0; i < r->nsnd; i++) close(r->snd[i].fd);
+        free(r);
+        return NULL;
+    }
+    return r;
+}
+
+void rtp_frame(struct rtp_set *r, struct frame *thermal, struct frame *visible, uint64_t time_ns) {
+    pthread_mutex_lock(&r->lock);
+    if (r->pending) {
+        /* Still sending the last frame */
+        for (int i = 0; i < r->nsnd; i++) r->snd[i].dropped++;
+        pthread_mutex_unlock(&r->lock);
+        return;
+    }
+    r->thermal = thermal ? frame_ref(thermal) : NULL;
+    r->visible = visible && visible->jpeg ? frame_ref(visible) : NULL;
+    r->time_ns = time_ns;
+    r->pending = 1;
+    pthread_cond_signal(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+}
+
+int rtp_hand_off(struct rtp_set *r, struct handoff_extra *x) {
+    int ret = 0;
+    if (!r) return 0;
+
+    pthread_mutex_lock(&r->lock);
+    while (r->pending) pthread_cond_wait(&r->cond, &r->lock);
+    for (int i = 0; i < r->nsnd && ret == 0; i++) {
+        struct rtp_sender *s = &r->snd[i];
+        struct rtp_handoff h = { s->ssrc, s->seq };
+        char name[HANDOFF_NAME_LEN];
+
+        handoff_name(name, sizeof(name), s, s->spec->port + 2 * r->camera);
+        ret = handoff_put(x, name, &h, sizeof(h), &s->fd, 1);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return ret;
+}
+
+void rtp_close(struct rtp_set *r) {
+    if (!r) return;
+    pthread_mutex_lock(&r->lock);
+    r->stopping = 1;
+    pthread_cond_signal(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    pthread_join(r->thread, NULL);
+
+    for (int i = 0; i < r->nsnd; i++) {
+        struct rtp_sender *s = &r->snd[i];
+        printf("%sRTP %s: %lu frames, %lu packets, %lu dropped\n", r->tag,
+               s->spec->stream == RTP_THERMAL ? "thermal" : "visible", s->frames, s->packets, s->dropped);
+        close(s->fd);
+    }
+    free(r->buf);
+    free(r->msgs);
+    free(r->iov);
+    frame_unref(r->thermal);
+    frame_unref(r->visible);
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->cond);
+    free(r);
+}
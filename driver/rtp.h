@@ -0,0 +1,53 @@
+/*
+ * FLIR One Pro LT Linux Driver - RTP sender
+ *
+ * --rtp STREAM=HOST:PORT[,mtu=N][,rate=KBPS][,sdp=FILE] sends
+ *
+ *   thermal   Y16 as RFC 4175 raw video (payload type 96, big-endian
+ *             16-bit samples, 80x60)
+ *   visible   the camera JPEG as RFC 2435 RTP/JPEG (payload type 26),
+ *             scan data as received with the quantisation tables in-band
+ *
+ * Packets of a frame go out in sendmmsg batches from a sender thread per
+ * camera, optionally paced to a bit rate. A frame arriving while the
+ * previous one is still being sent is dropped. Camera N sends to
+ * PORT + 2 * N.
+ */
+
+#ifndef FLIRONE_RTP_H
+#define FLIRONE_RTP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "demand.h"
+#include "frame.h"
+
+#define RTP_MAX_SPECS   4
+
+struct rtp_set;
+struct handoff_extra;
+
+/* Parse a --rtp spec. Returns 0 or -1. */
+int rtp_add(const char *spec);
+
+int rtp_count(void);
+
+/* Per camera: open the sockets and start the sender thread. UDP cannot
+ * tell whether anyone listens, so each sender keeps the camera wanted.
+ * A sender found in adopt (after a takeover, else NULL) keeps its socket,
+ * SSRC and sequence numbers. NULL on error. */
+struct rtp_set *rtp_open(int camera_index, const char *tag, struct demand *d,
+                         struct handoff_extra *adopt);
+
+/* The frames to send the thermal plane and the JPEG of, either may be NULL.
+ * Both are referenced, not copied, until sent. */
+void rtp_frame(struct rtp_set *r, struct frame *thermal, struct frame *visible, uint64_t time_ns);
+
+/* Live upgrade: wait for the frame being sent, then add the senders to x.
+ * Returns 0 or -1. */
+int rtp_hand_off(struct rtp_set *r, struct handoff_extra *x);
+
+void rtp_close(struct rtp_set *r);
+
+#endif
@@ -0,0 +1,172 @@
+/*
+ * FLIR One Pro LT Linux Driver - named sinks
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#include "sink.h"
+
+struct sink {
+    char name[SINK_NAME_LEN];
+    int fd;
+    unsigned long written;
+    unsigned long dropped;
+    pthread_mutex_t lock;
+};
+
+static struct sink sinks[SINK_MAX];
+static int nsinks = 0;
+static int stdout_fd = -1;
+
+int sink_add(const char *spec) {
+    const char *eq = strchr(spec, '=');
+    if (!eq || eq == spec || (size_t)(eq - spec) >= SINK_NAME_LEN || !eq[1]) {
+        fprintf(stderr, "Invalid sink spec %s (NAME=PATH)\n", spec);
+        return -1;
+    }
+    if (nsinks >= SINK_MAX) {
+        fprintf(stderr, "Too many sinks (max %d)\n", SINK_MAX);
+        return -1;
+    }
+
+    struct sink *s = &sinks[nsinks];
+    memcpy(s->name, spec, eq - spec);
+    s->name[eq - spec] = '\0';
+
+    /* O_RDWR keeps FIFOs from blocking until a reader shows up */
+    s->fd = open(eq + 1, O_RDWR | O_CREAT | O_APPEND | O_NONBLOCK | O_CLOEXEC, 0644);
+    if (s->fd < 0) {
+        fprintf(stderr, "Cannot open sink %s: %s\n", eq + 1, strerror(errno));
+        return -1;
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    nsinks++;
+
+    printf("Sink %s: %s\n", s->name, eq + 1);
+    return 0;
+}
+
+struct sink *sink_find(const char *name) {
+    for (int i = 0; i < nsinks; i++) {
+        if (strcmp(sinks[i].name, name) == 0) return &sinks[i];
+    }
+    return NULL;
+}
+
+int sink_write(struct sink *s, const void *data, size_t size) {
+    pthread_mutex_lock(&s->lock);
+    ssize_t r = write(s->fd, data, size);
+    if (r == (ssize_t)size) {
+        s->written++;
+    } else {
+        /* Short writes count as drops too: the record is incomplete */
+        s->dropped++;
+        r = -1;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return r < 0 ? -1 : 0;
+}
+
+void sink_close_all(void) {
+    for (int i = 0; i < nsinks; i++) {
+        printf("Sink %s: %lu written, %lu dropped\n", sinks[i].name, sinks[i].written, sinks[i].dropped);
+        close(sinks[i].fd);
+        pthread_mutex_destroy(&sinks[i].lock);
+    }
+    nsinks = 0;
+}
+
+int sink_claim_stdout(void) {
+    if (stdout_fd >= 0) {
+        fprintf(stderr, "Only one output can go to stdout\n");
+        return -1;
+    }
+    /* Keep the real stdout for the output; printf goes to stderr from
+     * here on, including anything still buffered */
+    stdout_fd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 3);
+    if (stdout_fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        fprintf(stderr, "Cannot redirect stdout: %s\n", strerror(errno));
+        return -1;
+    }
+    fflush(stdout);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    return 0;
+}
+
+int sink_open_path(const char *path, int pipe_size, int *pipe) {
+    struct stat st;
+    int fd;
+
+    *pipe = 0;
+    if (strcmp(path, "-") == 0) {
+        fd = stdout_fd;
+    } else if (stat(path, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        /* O_RDWR keeps the FIFO from blocking until a reader shows up */
+        fd = open(path, O_RDWR | O_CLOEXEC);
+    } else {
+        fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    if (fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        /* The pipe buffer is the only queue between us and the reader.
+         * Above /proc/sys/fs/pipe-max-size this fails and the default stays. */
+        fcntl(fd, F_SETPIPE_SZ, pipe_size);
+        *pipe = fcntl(fd, F_GETPIPE_SZ);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        /* A reader going away is reported as EPIPE, not a signal */
+        signal(SIGPIPE, SIG_IGN);
+    }
+    return fd;
+}
+
+void sink_close_path(int fd) {
+    if (fd >= 0 && fd != stdout_fd) close(fd);
+}
+
+int sink_writev(int fd, struct iovec *iov, int n, size_t total, size_t room, int finish_ms) {
+    if (room > 0) {
+        int queued = 0;
+        if (ioctl(fd, FIONREAD, &queued) == 0 && (size_t)queued + total > room) return 1;
+    }
+
+    size_t done = 0;
+    while (done < total) {
+        ssize_t r = writev(fd, iov, n);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN && done > 0) {
+                struct pollfd pfd = { fd, POLLOUT, 0 };
+                if (poll(&pfd, 1, finish_ms) > 0) continue;
+                errno = EAGAIN;
+            }
+            if (errno == EAGAIN && done == 0) return 1;
+            return -1;
+        }
+        done += r;
+        /* Skip what went out, for the retry after a short write */
+        while (n > 0 && (size_t)r >= iov[0].iov_len) {
+            r -= iov[0].iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov[0].iov_base = (char *)iov[0].iov_base + r;
+            iov[0].iov_len -= r;
+        }
+    }
+    return 0;
+}
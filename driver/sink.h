@@ -0,0 +1,50 @@
+/*
+ * FLIR One Pro LT Linux Driver - named sinks
+ *
+ * Extra outputs declared with --sink NAME=PATH (file, FIFO or device).
+ * Any thread may write; each write is one record, sent whole or dropped.
+ */
+
+#ifndef FLIRONE_SINK_H
+#define FLIRONE_SINK_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#define SINK_MAX        16
+#define SINK_NAME_LEN   32
+
+struct sink;
+
+/* Parse NAME=PATH and open it. Returns 0 or -1. */
+int sink_add(const char *spec);
+
+struct sink *sink_find(const char *name);
+
+/* Returns 0 if the record was written whole, -1 if it was dropped */
+int sink_write(struct sink *s, const void *data, size_t size);
+
+void sink_close_all(void);
+
+/* Record outputs on files and FIFOs (--stream, --bundle) */
+
+/* Reserve the real stdout for the one output named "-"; printf goes to
+ * stderr from then on. Returns 0 or -1 (taken, or no redirect). */
+int sink_claim_stdout(void);
+
+/* Open path ("-" after sink_claim_stdout()) for records. A FIFO is opened
+ * without waiting for a reader, made nonblocking and asked for a pipe of
+ * pipe_size bytes; anything else is created or truncated. *pipe gets the
+ * pipe buffer size, or 0. Returns the fd or -1. */
+int sink_open_path(const char *path, int pipe_size, int *pipe);
+
+/* Close what sink_open_path() returned; stdout stays */
+void sink_close_path(int fd);
+
+/* Write one record whole or not at all: with room > 0 it is only started
+ * if the bytes queued in the pipe plus total stay within room, and one cut
+ * short by a full pipe gets finish_ms to go out. iov is consumed. Returns
+ * 0 written, 1 dropped, -1 with errno set (EAGAIN: stalled mid-record). */
+int sink_writev(int fd, struct iovec *iov, int n, size_t total, size_t room, int finish_ms);
+
+#endif
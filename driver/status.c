@@ -0,0 +1,170 @@
+/*
+ * FLIR One Pro LT Linux Driver - camera status telemetry
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "status.h"
+#include "json.h"
+#include "sink.h"
+
+int status_uniform_range = STATUS_UNIFORM_RANGE;
+
+void status_init(struct status *st, const char *camera_id) {
+    memset(st, 0, sizeof(*st));
+    st->camera_id = camera_id;
+    pthread_mutex_init(&st->lock, NULL);
+    st->ffc = FLIRONE_FFC_UNKNOWN;
+    st->shutter_temp = NAN;
+    st->battery_voltage = NAN;
+    st->battery_percent = -1;
+}
+
+const char *status_ffc_name(int ffc) {
+    switch (ffc) {
+    case FLIRONE_FFC_IDLE:    return "idle";
+    case FLIRONE_FFC_RUNNING: return "running";
+    default:                  return "unknown";
+    }
+}
+
+int status_ffc(struct status *st) {
+    return __atomic_load_n(&st->ffc, __ATOMIC_RELAXED);
+}
+
+unsigned int status_quality(struct status *st, int ffc, const uint16_t *thermal, int count) {
+    unsigned int q = 0;
+
+    if (ffc == FLIRONE_FFC_RUNNING) q |= FLIRONE_QUALITY_FFC;
+
+    /* Fast fallback when the status channel says nothing: real scenes are
+     * never this flat, the closed shutter always is */
+    if (thermal && count > 0 && status_uniform_range > 0) {
+        uint16_t lo = thermal[0], hi = thermal[0];
+        for (int i = 1; i < count; i++) {
+            if (thermal[i] < lo) lo = thermal[i];
+            if (thermal[i] > hi) hi = thermal[i];
+        }
+        if (hi - lo < status_uniform_range) q |= FLIRONE_QUALITY_UNIFORM;
+    }
+
+    /* Sensor and NUC table settle for a few frames after the shutter opens */
+    if (q) {
+        st->was_bad = 1;
+    } else if (st->was_bad) {
+        st->was_bad = 0;
+        st->settle_left = STATUS_SETTLE_FRAMES;
+    }
+    if (!q && st->settle_left > 0) {
+        st->settle_left--;
+        q |= FLIRONE_QUALITY_SETTLING;
+    }
+    return q;
+}
+
+int status_parse_policy(const char *name) {
+    if (strcmp(name, "pass") == 0) return FFC_POLICY_PASS;
+    if (strcmp(name, "drop") == 0) return FFC_POLICY_DROP;
+    if (strcmp(name, "hold") == 0) return FFC_POLICY_HOLD;
+    return -1;
+}
+
+/* Shutter closed or calibration in progress */
+static int ffc_running(const char *state) {
+    return strcmp(state, "FFC") == 0 || strcmp(state, "CLOSED") == 0 || strstr(state, "PROGRESS") != NULL;
+}
+
+static void handle_message(struct status *st, const char *msg, const char *source) {
+    static const char *const voltage_keys[] = { "batteryVoltage", "voltage", NULL };
+    static const char *const percent_keys[] = { "batteryPercentage", "percentage", NULL };
+    static const char *const charging_keys[] = { "batteryChargingState", "chargingState", NULL };
+    char v[STATUS_STATE_LEN];
+
+    pthread_mutex_lock(&st->lock);
+    st->messages++;
+
+    json_get(msg, "shutterState", st->shutter_state, sizeof(st->shutter_state));
+    json_get(msg, "ffcState", st->ffc_state, sizeof(st->ffc_state));
+    if (json_get(msg, "shutterTemperature", v, sizeof(v))) st->shutter_temp = atof(v);
+    if (json_get_any(msg, voltage_keys, v, sizeof(v))) st->battery_voltage = atof(v);
+    if (json_get_any(msg, percent_keys, v, sizeof(v))) st->battery_percent = atoi(v);
+    json_get_any(msg, charging_keys, st->charging_state, sizeof(st->charging_state));
+
+    int ffc = FLIRONE_FFC_UNKNOWN;
+    if (ffc_running(st->shutter_state) || ffc_running(st->ffc_state)) {
+        ffc = FLIRONE_FFC_RUNNING;
+    } else if (st->shutter_state[0] || st->ffc_state[0]) {
+        ffc = FLIRONE_FFC_IDLE;
+    }
+    __atomic_store_n(&st->ffc, ffc, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&st->lock);
+
+    struct sink *s = sink_find("telemetry");
+    if (s) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        char rec[STATUS_MSG_MAX + 256];
+        int n = snprintf(rec, sizeof(rec), "{\"camera\":\"%s\",\"t_ms\":%lld,\"source\":\"%s\",\"ffc\":\"%s\",\"msg\":%s}\n",
+                         st->camera_id, (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000,
+                         source, status_ffc_name(ffc), msg);
+        if (n > 0 && n < (int)sizeof(rec)) sink_write(s, rec, n);
+    }
+}
+
+/* Returns 1 when p->buf holds a complete object */
+static int parser_push(struct status *st, struct status_parser *p, char c) {
+    if (p->depth == 0 && c != '{') return 0;     /* NUL padding, noise */
+
+    if (p->len + 1 >= sizeof(p->buf)) {
+        /* Oversized message: resync at the next top-level object */
+        st->overflows++;
+        p->len = 0;
+        p->depth = 0;
+        p->in_string = 0;
+        return 0;
+    }
+    /* Keep one message per telemetry line */
+    p->buf[p->len++] = (c == '\n' || c == '\r') ? ' ' : c;
+
+    if (p->in_string) {
+        if (p->escape) p->escape = 0;
+        else if (c == '\\') p->escape = 1;
+        else if (c == '"') p->in_string = 0;
+        return 0;
+    }
+    if (c == '"') p->in_string = 1;
+    else if (c == '{') p->depth++;
+    else if (c == '}' && --p->depth == 0) {
+        p->buf[p->len] = '\0';
+        return 1;
+    }
+    return 0;
+}
+
+static void parse(struct status *st, struct status_parser *p, const unsigned char *data, size_t len,
+                  const char *source) {
+    for (size_t i = 0; i < len; i++) {
+        if (parser_push(st, p, data[i])) {
+            handle_message(st, p->buf, source);
+            p->len = 0;
+        }
+    }
+}
+
+void status_feed(struct status *st, const unsigned char *data, size_t len) {
+    parse(st, &st->ep81, data, len, "ep81");
+}
+
+void status_frame(struct status *st, const unsigned char *data, size_t len) {
+    /* Whole messages only: a fresh parser per block */
+    struct status_parser p;
+    p.len = 0;
+    p.depth = 0;
+    p.in_string = 0;
+    p.escape = 0;
+    parse(st, &p, data, len, "frame");
+}
@@ -0,0 +1,86 @@
+/*
+ * FLIR One Pro LT Linux Driver - camera status telemetry
+ *
+ * The camera reports battery, shutter/FFC state and temperatures as JSON
+ * objects, both on EP 0x81 and in the status block at the end of every
+ * frame. Messages are split out of the byte stream incrementally (they may
+ * span transfers) and published one per line on the "telemetry" sink.
+ */
+
+#ifndef FLIRONE_STATUS_H
+#define FLIRONE_STATUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "flirone_plugin.h"
+
+#define STATUS_MSG_MAX      4096
+#define STATUS_STATE_LEN    32
+
+/* A thermal frame whose max - min raw range is below this looks like the
+ * closed shutter; frames after an FFC still settling are flagged too */
+#define STATUS_UNIFORM_RANGE    16
+#define STATUS_SETTLE_FRAMES    2
+
+/* What a sink does with a frame flagged bad */
+#define FFC_POLICY_PASS     0
+#define FFC_POLICY_DROP     1
+#define FFC_POLICY_HOLD     2   /* repeat the last good frame */
+
+/* Splits a byte stream into top-level {...} objects */
+struct status_parser {
+    char buf[STATUS_MSG_MAX];
+    size_t len;
+    int depth;
+    int in_string;
+    int escape;
+};
+
+struct status {
+    const char *camera_id;
+    pthread_mutex_t lock;
+    struct status_parser ep81;
+
+    /* Latest known values; NaN / -1 / "" until reported */
+    int ffc;                    /* FLIRONE_FFC_*, read lock-free by the camera thread */
+    char shutter_state[STATUS_STATE_LEN];
+    char ffc_state[STATUS_STATE_LEN];
+    double shutter_temp;
+    double battery_voltage;
+    int battery_percent;
+    char charging_state[STATUS_STATE_LEN];
+
+    unsigned long messages;
+    unsigned long overflows;
+
+    /* Frame quality, camera thread only */
+    int settle_left;
+    int was_bad;
+};
+
+/* Uniformity threshold for all cameras; 0 disables the check */
+extern int status_uniform_range;
+
+void status_init(struct status *st, const char *camera_id);
+
+/* EP 0x81 data; messages may be split across calls */
+void status_feed(struct status *st, const unsigned char *data, size_t len);
+
+/* The self-contained status block of one frame */
+void status_frame(struct status *st, const unsigned char *data, size_t len);
+
+/* Most recent FLIRONE_FFC_* state */
+int status_ffc(struct status *st);
+
+const char *status_ffc_name(int ffc);
+
+/* FLIRONE_QUALITY_* flags for a frame, from the FFC state it was tagged
+ * with and its thermal data (NULL if not extracted) */
+unsigned int status_quality(struct status *st, int ffc, const uint16_t *thermal, int count);
+
+/* "pass", "drop" or "hold"; -1 if unknown */
+int status_parse_policy(const char *name);
+
+#endif
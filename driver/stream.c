@@ -0,0 +1,430 @@
+/*
+ * FLIR One Pro LT Linux Driver - stream outputs
+ *
+ * NUT is written with a fixed frame code table: code 1 is a keyframe
+ * with explicit stream id, pts and size, code 2 the same with a header
+ * checksum for frames too large to go without one. Each camera frame
+ * starts with a syncpoint, so a reader can join at any frame.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/uio.h>
+
+#include "stream.h"
+#include "camera.h"
+#include "handoff.h"
+#include "sink.h"
+
+/* Pipe buffer to ask for: a few seconds of both streams */
+#define STREAM_PIPE_SIZE    (1 << 20)
+
+/* A frame that was partly written must be finished to keep the framing */
+#define STREAM_FINISH_MS    1000
+
+enum stream_format { SF_Y16, SF_Y4M, SF_MJPEG, SF_NUT };
+
+static const char *format_names[] = { "y16", "y4m", "mjpeg", "nut" };
+
+struct stream_spec {
+    int format;
+    char path[256];
+};
+
+struct stream_out {
+    const struct stream_spec *spec;
+    char path[272];
+    int fd;
+    int pipe_size;          /* > 0 for pipes: frames that do not fit are dropped */
+    int started;            /* stream header written */
+    int demand_id;
+    uint64_t pos;           /* bytes written */
+    uint64_t last_sync;     /* NUT: position of the last syncpoint */
+    uint64_t t0_ns;         /* NUT: time of the first frame */
+    unsigned long frames;
+    unsigned long dropped;
+};
+
+struct stream_set {
+    char tag[32];
+    struct demand *demand;
+    struct stream_out out[STREAM_MAX];
+    int nout;
+};
+
+/* What the successor needs to carry on a stream after a live upgrade */
+struct stream_handoff {
+    int32_t pipe_size;
+    int32_t started;
+    uint64_t pos;
+    uint64_t last_sync;
+    uint64_t t0_ns;
+};
+
+static struct stream_spec specs[STREAM_MAX];
+static int nspecs = 0;
+
+int stream_add(const char *spec) {
+    const char *colon = strchr(spec, ':');
+    int format = -1;
+
+    for (int i = 0; colon && i < (int)(sizeof(format_names) / sizeof(format_names[0])); i++) {
+        if (strlen(format_names[i]) == (size_t)(colon - spec) && strncmp(spec, format_names[i], colon - spec) == 0) {
+            format = i;
+        }
+    }
+    if (format < 0 || !colon[1]) {
+        fprintf(stderr, "Invalid stream %s (y16|y4m|mjpeg|nut:PATH)\n", spec);
+        return -1;
+    }
+    if (nspecs >= STREAM_MAX) {
+        fprintf(stderr, "Too many streams (max %d)\n", STREAM_MAX);
+        return -1;
+    }
+
+    struct stream_spec *s = &specs[nspecs];
+    s->format = format;
+    snprintf(s->path, sizeof(s->path), "%s", colon + 1);
+
+    if (strcmp(s->path, "-") == 0 && sink_claim_stdout() < 0) return -1;
+    nspecs++;
+    return 0;
+}
+
+int stream_count(void) {
+    return nspecs;
+}
+
+static void handoff_name(char *name, size_t size, const struct stream_out *o) {
+    snprintf(name, size, "stream:%s:%s", format_names[o->spec->format], o->path);
+}
+
+/* The fd and position the old driver had; the headers are not repeated */
+static int adopt_out(struct stream_out *o, struct handoff_extra *x) {
+    struct stream_handoff h;
+    char name[HANDOFF_NAME_LEN];
+
+    handoff_name(name, sizeof(name), o);
+    if (!x || handoff_take(x, name, &h, sizeof(h), &o->fd, 1) != 1) return -1;
+    o->pipe_size = h.pipe_size;
+    o->started = h.started;
+    o->pos = h.pos;
+    o->last_sync = h.last_sync;
+    o->t0_ns = h.t0_ns;
+    return 0;
+}
+
+struct stream_set *stream_open(int camera_index, const char *tag, struct demand *d,
+                               struct handoff_extra *adopt) {
+    struct stream_set *s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    snprintf(s->tag, sizeof(s->tag), "%s", tag);
+    s->demand = d;
+
+    for (int i = 0; i < nspecs; i++) {
+        const struct stream_spec *sp = &specs[i];
+        struct stream_out *o = &s->out[s->nout];
+        const char *p = strstr(sp->path, "{camera}");
+        memset(o, 0, sizeof(*o));
+        if (p) {
+            snprintf(o->path, sizeof(o->path), "%.*s%d%s", (int)(p - sp->path), sp->path, camera_index, p + 8);
+        } else if (camera_index == 0) {
+            snprintf(o->path, sizeof(o->path), "%s", strcmp(sp->path, "-") ? sp->path : "stdout");
+        } else {
+            continue;
+        }
+
+        o->spec = sp;
+        if (adopt_out(o, adopt) < 0) {
+            o->fd = sink_open_path(sp->path[0] == '-' && !sp->path[1] ? "-" : o->path, STREAM_PIPE_SIZE,
+                                   &o->pipe_size);
+        }
+        if (o->fd < 0) continue;
+        /* The name stays valid: it is stored with the stream */
+        o->demand_id = d ? demand_add(d, o->path, DEMAND_UNKNOWN) : -1;
+        s->nout++;
+        printf("%sStream %s: %s%s\n", tag, format_names[sp->format], o->path, o->pipe_size > 0 ? " (pipe)" : "");
+    }
+    if (s->nout == 0) {
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+static void out_close(struct stream_set *s, struct stream_out *o) {
+    if (o->fd < 0) return;
+    sink_close_path(o->fd);
+    o->fd = -1;
+    if (s->demand && o->demand_id >= 0) demand_set(s->demand, o->demand_id, 0);
+}
+
+/* One record, whole or not at all. Returns 0 written, 1 dropped, -1 the
+ * stream is broken (reader gone, or stuck mid-frame). */
+static int out_writev(struct stream_set *s, struct stream_out *o, struct iovec *iov, int n) {
+    size_t total = 0;
+    for (int i = 0; i < n; i++) total += iov[i].iov_len;
+
+    int r = sink_writev(o->fd, iov, n, total, o->pipe_size, STREAM_FINISH_MS);
+    if (r == 0) {
+        o->pos += total;
+    } else if (r == 1) {
+        o->dropped++;
+    } else {
+        fprintf(stderr, "%sStream %s: %s\n", s->tag, o->path,
+                errno == EPIPE ? "reader closed" : errno == EAGAIN ? "reader stalled mid-frame" : strerror(errno));
+        out_close(s, o);
+    }
+    return r;
+}
+
+/* -- NUT ------------------------------------------------------------------ */
+
+#define NUT_MAIN_STARTCODE      (0x7A561F5F04ADULL + (((uint64_t)('N' << 8) + 'M') << 48))
+#define NUT_STREAM_STARTCODE    (0x11405BF2F9DBULL + (((uint64_t)('N' << 8) + 'S') << 48))
+#define NUT_SYNCPOINT_STARTCODE (0xE4ADEECA4569ULL + (((uint64_t)('N' << 8) + 'K') << 48))
+
+#define NUT_FLAG_KEY        1
+#define NUT_FLAG_CODED_PTS  8
+#define NUT_FLAG_STREAM_ID  16
+#define NUT_FLAG_SIZE_MSB   32
+#define NUT_FLAG_CHECKSUM   64
+#define NUT_FLAG_INVALID    8192
+
+#define NUT_MAX_DISTANCE    65536
+#define NUT_MSB_PTS_SHIFT   7
+#define NUT_TIME_BASE       1000        /* pts in milliseconds */
+
+static uint32_t crc_table[256];
+
+/* CRC-32, polynomial 0x04C11DB7, MSB first, initial value 0 */
+static uint32_t nut_crc(const uint8_t *p, size_t n) {
+    if (!crc_table[1]) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i << 24;
+            for (int j = 0; j < 8; j++) c = (c << 1) ^ (c & 0x80000000 ? 0x04C11DB7 : 0);
+            crc_table[i] = c;
+        }
+    }
+    uint32_t crc = 0;
+    while (n--) crc = (crc << 8) ^ crc_table[(crc >> 24) ^ *p++];
+    return crc;
+}
+
+static size_t put_v(uint8_t *p, uint64_t v) {
+    int n = 1;
+    while (n < 10 && (v >> (7 * n))) n++;
+    for (int i = 0; i < n; i++) p[i] = ((v >> (7 * (n - 1 - i))) & 0x7F) | (i < n - 1 ? 0x80 : 0);
+    return n;
+}
+
+static size_t put_be32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+    return 4;
+}
+
+/* startcode, forward_ptr, data, checksum; data must stay under 4 KiB */
+static size_t nut_packet(uint8_t *out, uint64_t startcode, const uint8_t *data, size_t len) {
+    size_t n = 0;
+    for (int i = 7; i >= 0; i--) out[n++] = startcode >> (8 * i);
+    n += put_v(out + n, len + 4);
+    memcpy(out + n, data, len);
+    n += len;
+    n += put_be32(out + n, nut_crc(data, len));
+    return n;
+}
+
+static size_t nut_stream_header(uint8_t *out, int id, const char fourcc[4], int width, int height) {
+    uint8_t d[64];
+    size_t n = 0;
+    n += put_v(d + n, id);
+    n += put_v(d + n, 0);                   /* video */
+    n += put_v(d + n, 4);
+    memcpy(d + n, fourcc, 4);
+    n += 4;
+    n += put_v(d + n, 0);                   /* time base id */
+    n += put_v(d + n, NUT_MSB_PTS_SHIFT);
+    n += put_v(d + n, 60 * NUT_TIME_BASE);  /* max pts distance */
+    n += put_v(d + n, 0);                   /* decode delay */
+    n += put_v(d + n, 0);                   /* stream flags */
+    n += put_v(d + n, 0);                   /* codec specific data */
+    n += put_v(d + n, width);
+    n += put_v(d + n, height);
+    n += put_v(d + n, 0);                   /* sample aspect ratio unknown */
+    n += put_v(d + n, 0);
+    n += put_v(d + n, 0);                   /* colorspace */
+    return nut_packet(out, NUT_STREAM_STARTCODE, d, n);
+}
+
+static size_t nut_headers(uint8_t *out) {
+    static const char id[] = "nut/multimedia container";
+    uint8_t d[64];
+    size_t n = 0, o = 0;
+
+    memcpy(out, id, sizeof(id));
+    o += sizeof(id);
+
+    n += put_v(d + n, 3);                   /* version */
+    n += put_v(d + n, 2);                   /* streams */
+    n += put_v(d + n, NUT_MAX_DISTANCE);
+    n += put_v(d + n, 1);                   /* time bases */
+    n += put_v(d + n, 1);
+    n += put_v(d + n, NUT_TIME_BASE);
+    /* frame codes: 0 invalid, 1 explicit keyframe, 2 the same with a
+     * checksum, the rest invalid */
+    n += put_v(d + n, NUT_FLAG_INVALID);
+    n += put_v(d + n, 0);
+    for (int c = 1; c <= 2; c++) {
+        n += put_v(d + n, NUT_FLAG_KEY | NUT_FLAG_CODED_PTS | NUT_FLAG_STREAM_ID | NUT_FLAG_SIZE_MSB |
+                          (c == 2 ? NUT_FLAG_CHECKSUM : 0));
+        n += put_v(d + n, 6);
+        n += put_v(d + n, 0);               /* pts delta */
+        n += put_v(d + n, 1);               /* size multiplier */
+        n += put_v(d + n, 0);               /* stream */
+        n += put_v(d + n, 0);               /* size lsb */
+        n += put_v(d + n, 0);               /* reserved */
+        n += put_v(d + n, 1);               /* count */
+    }
+    n += put_v(d + n, NUT_FLAG_INVALID);
+    n += put_v(d + n, 6);
+    n += put_v(d + n, 0);
+    n += put_v(d + n, 1);
+    n += put_v(d + n, 0);
+    n += put_v(d + n, 0);
+    n += put_v(d + n, 0);
+    n += put_v(d + n, 256 - 3 - 1);         /* codes 3..255 except 'N' */
+    n += put_v(d + n, 0);                   /* no elision headers */
+    o += nut_packet(out + o, NUT_MAIN_STARTCODE, d, n);
+
+    o += nut_stream_header(out + o, 0, "Y1\0\x10", THERMAL_WIDTH, THERMAL_HEIGHT);
+    o += nut_stream_header(out + o, 1, "MJPG", VISIBLE_WIDTH, VISIBLE_HEIGHT);
+    return o;
+}
+
+static size_t nut_frame_header(uint8_t *out, int stream, uint64_t pts, size_t size) {
+    int code = size > 2 * NUT_MAX_DISTANCE ? 2 : 1;
+    size_t n = 0;
+    out[n++] = code;
+    n += put_v(out + n, stream);
+    n += put_v(out + n, pts + (1 << NUT_MSB_PTS_SHIFT));
+    n += put_v(out + n, size);
+    if (code == 2) n += put_be32(out + n, nut_crc(out, n));
+    return n;
+}
+
+static int write_nut(struct stream_set *s, struct stream_out *o, const uint16_t *thermal,
+                     const uint8_t *jpeg, size_t jpeg_size, uint64_t time_ns) {
+    uint8_t head[512], sync[64], fh[2][32];
+    struct iovec iov[6];
+    int n = 0;
+
+    if (!o->started) {
+        o->t0_ns = time_ns;
+        iov[n].iov_base = head;
+        iov[n++].iov_len = nut_headers(head);
+    }
+    uint64_t pts = (time_ns - o->t0_ns) / (1000000000ULL / NUT_TIME_BASE);
+
+    /* The syncpoint starts after the headers, if they go out with it */
+    size_t before = n ? iov[0].iov_len : 0;
+    uint64_t sync_pos = o->pos + before;
+    uint8_t d[32];
+    size_t dn = put_v(d, pts);                              /* global key pts, time base 0 */
+    dn += put_v(d + dn, o->started ? (sync_pos - o->last_sync) / 16 : 0);
+    iov[n].iov_base = sync;
+    iov[n++].iov_len = nut_packet(sync, NUT_SYNCPOINT_STARTCODE, d, dn);
+
+    if (thermal) {
+        iov[n].iov_base = fh[0];
+        iov[n++].iov_len = nut_frame_header(fh[0], 0, pts, THERMAL_WIDTH * THERMAL_HEIGHT * 2);
+        iov[n].iov_base = (void *)thermal;
+        iov[n++].iov_len = THERMAL_WIDTH * THERMAL_HEIGHT * 2;
+    }
+    if (jpeg) {
+        iov[n].iov_base = fh[1];
+        iov[n++].iov_len = nut_frame_header(fh[1], 1, pts, jpeg_size);
+        iov[n].iov_base = (void *)jpeg;
+        iov[n++].iov_len = jpeg_size;
+    }
+
+    int r = out_writev(s, o, iov, n);
+    if (r == 0) {
+        o->started = 1;
+        o->last_sync = sync_pos;
+    }
+    return r;
+}
+
+/* -------------------------------------------------------------------------- */
+
+void stream_frame(struct stream_set *s, const uint16_t *thermal, const uint8_t *jpeg, size_t jpeg_size,
+                  uint64_t time_ns) {
+    static const char y4m_header[] = "YUV4MPEG2 W80 H60 F87:10 Ip A1:1 Cmono16\n";
+    static const char y4m_frame[] = "FRAME\n";
+
+    for (int i = 0; i < s->nout; i++) {
+        struct stream_out *o = &s->out[i];
+        struct iovec iov[3];
+        int n = 0, r = 1;
+        if (o->fd < 0) continue;
+
+        switch (o->spec->format) {
+        case SF_Y16:
+            if (!thermal) continue;
+            iov[n].iov_base = (void *)thermal;
+            iov[n++].iov_len = THERMAL_WIDTH * THERMAL_HEIGHT * 2;
+            r = out_writev(s, o, iov, n);
+            break;
+        case SF_Y4M:
+            if (!thermal) continue;
+            if (!o->started) {
+                iov[n].iov_base = (void *)y4m_header;
+                iov[n++].iov_len = sizeof(y4m_header) - 1;
+            }
+            iov[n].iov_base = (void *)y4m_frame;
+            iov[n++].iov_len = sizeof(y4m_frame) - 1;
+            iov[n].iov_base = (void *)thermal;
+            iov[n++].iov_len = THERMAL_WIDTH * THERMAL_HEIGHT * 2;
+            r = out_writev(s, o, iov, n);
+            if (r == 0) o->started = 1;
+            break;
+        case SF_MJPEG:
+            if (!jpeg) continue;
+            iov[n].iov_base = (void *)jpeg;
+            iov[n++].iov_len = jpeg_size;
+            r = out_writev(s, o, iov, n);
+            break;
+        case SF_NUT:
+            if (!thermal && !jpeg) continue;
+            r = write_nut(s, o, thermal, jpeg, jpeg_size, time_ns);
+            break;
+        }
+        if (r == 0) o->frames++;
+    }
+}
+
+int stream_hand_off(struct stream_set *s, struct handoff_extra *x) {
+    for (int i = 0; s && i < s->nout; i++) {
+        struct stream_out *o = &s->out[i];
+        struct stream_handoff h = { o->pipe_size, o->started, o->pos, o->last_sync, o->t0_ns };
+        char name[HANDOFF_NAME_LEN];
+        if (o->fd < 0) continue;
+
+        handoff_name(name, sizeof(name), o);
+        if (handoff_put(x, name, &h, sizeof(h), &o->fd, 1) < 0) return -1;
+    }
+    return 0;
+}
+
+void stream_close(struct stream_set *s) {
+    if (!s) return;
+    for (int i = 0; i < s->nout; i++) {
+        struct stream_out *o = &s->out[i];
+        printf("%sStream %s: %lu frames, %lu dropped\n", s->tag, o->path, o->frames, o->dropped);
+        sink_close_path(o->fd);
+    }
+    free(s);
+}
@@ -0,0 +1,51 @@
+/*
+ * FLIR One Pro LT Linux Driver - stream outputs
+ *
+ * --stream FORMAT:PATH writes the camera streams to stdout ("-"), a FIFO or
+ * a file, for pipelines that cannot use v4l2loopback:
+ *
+ *   y16     raw 80x60 gray16le frames   ffmpeg -f rawvideo -pix_fmt gray16le -s 80x60
+ *   y4m     the same, self-describing   ffmpeg -f yuv4mpegpipe
+ *   mjpeg   visible JPEGs back to back  ffmpeg -f mjpeg
+ *   nut     both, timestamped           ffmpeg -f nut
+ *
+ * Every frame is one writev. A pipe that cannot take a whole frame drops
+ * it, so a slow reader never stalls the camera thread or tears a frame.
+ */
+
+#ifndef FLIRONE_STREAM_H
+#define FLIRONE_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "demand.h"
+
+#define STREAM_MAX      8
+
+struct stream_set;
+struct handoff_extra;
+
+/* Parse FORMAT:PATH. A stream on stdout moves the log to stderr.
+ * Returns 0 or -1. */
+int stream_add(const char *spec);
+
+int stream_count(void);
+
+/* Per camera: open the streams. "{camera}" in a path becomes the camera
+ * index; other paths belong to camera 0. A stream found in adopt (after
+ * a takeover, else NULL) carries on where the old driver left it. NULL if
+ * the camera has none. */
+struct stream_set *stream_open(int camera_index, const char *tag, struct demand *d,
+                               struct handoff_extra *adopt);
+
+/* thermal or jpeg may be NULL; time_ns is the frame timestamp */
+void stream_frame(struct stream_set *s, const uint16_t *thermal, const uint8_t *jpeg, size_t jpeg_size,
+                  uint64_t time_ns);
+
+/* Live upgrade: add the open streams to x. Returns 0 or -1. */
+int stream_hand_off(struct stream_set *s, struct handoff_extra *x);
+
+void stream_close(struct stream_set *s);
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ * FLIR One Pro LT Linux Driver - worker pool
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "workq.h"
+
+struct job {
+    workq_fn fn;
+    void *arg;
+};
+
+struct workq {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct job queue[WORKQ_QUEUE_LEN];
+    int head;
+    int count;
+    int stopping;
+    int nthreads;
+    pthread_t threads[WORKQ_MAX_THREADS];
+};
+
+static void *worker(void *arg) {
+    struct workq *wq = arg;
+
+    pthread_mutex_lock(&wq->lock);
+    for (;;) {
+        while (wq->count == 0 && !wq->stopping) {
+            pthread_cond_wait(&wq->cond, &wq->lock);
+        }
+        if (wq->count == 0) break;
+
+        struct job job = wq->queue[wq->head];
+        wq->head = (wq->head + 1) % WORKQ_QUEUE_LEN;
+        wq->count--;
+
+        pthread_mutex_unlock(&wq->lock);
+        job.fn(job.arg);
+        pthread_mutex_lock(&wq->lock);
+    }
+    pthread_mutex_unlock(&wq->lock);
+    return NULL;
+}
+
+struct workq *workq_create(int nthreads) {
+    if (nthreads < 1) nthreads = 1;
+    if (nthreads > WORKQ_MAX_THREADS) nthreads = WORKQ_MAX_THREADS;
+
+    struct workq *wq = calloc(1, sizeof(*wq));
+    if (!wq) return NULL;
+    pthread_mutex_init(&wq->lock, NULL);
+    pthread_cond_init(&wq->cond, NULL);
+
+    for (int i = 0; i < nthreads; i++) {
+        if (pthread_create(&wq->threads[i], NULL, worker, wq) != 0) {
+            fprintf(stderr, "Cannot start worker thread %d\n", i);
+            break;
+        }
+        wq->nthreads++;
+    }
+    if (wq->nthreads == 0) {
+        free(wq);
+        return NULL;
+    }
+    return wq;
+}
+
+int workq_submit(struct workq *wq, workq_fn fn, void *arg) {
+    pthread_mutex_lock(&wq->lock);
+    if (wq->count == WORKQ_QUEUE_LEN || wq->stopping) {
+        pthread_mutex_unlock(&wq->lock);
+        return -1;
+    }
+    int tail = (wq->head + wq->count) % WORKQ_QUEUE_LEN;
+    wq->queue[tail].fn = fn;
+    wq->queue[tail].arg = arg;
+    wq->count++;
+    pthread_cond_signal(&wq->cond);
+    pthread_mutex_unlock(&wq->lock);
+    return 0;
+}
+
+void workq_destroy(struct workq *wq) {
+    if (!wq) return;
+
+    pthread_mutex_lock(&wq->lock);
+    wq->stopping = 1;
+    pthread_cond_broadcast(&wq->cond);
+    pthread_mutex_unlock(&wq->lock);
+
+    for (int i = 0; i < wq->nthreads; i++) {
+        pthread_join(wq->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&wq->lock);
+    pthread_cond_destroy(&wq->cond);
+    free(wq);
+}
@@ -0,0 +1,26 @@
+/*
+ * FLIR One Pro LT Linux Driver - worker pool
+ *
+ * A fixed set of threads pulling jobs from a bounded FIFO. Submitting never
+ * blocks: when the queue is full the caller gets -1 and decides what to drop.
+ */
+
+#ifndef FLIRONE_WORKQ_H
+#define FLIRONE_WORKQ_H
+
+#define WORKQ_MAX_THREADS   16
+#define WORKQ_QUEUE_LEN     256
+
+typedef void (*workq_fn)(void *arg);
+
+struct workq;
+
+struct workq *workq_create(int nthreads);
+
+/* Returns 0 if queued, -1 if the queue is full */
+int workq_submit(struct workq *wq, workq_fn fn, void *arg);
+
+/* Runs all queued jobs, then stops and frees the pool */
+void workq_destroy(struct workq *wq);
+
+#endif
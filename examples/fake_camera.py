@@ -0,0 +1,262 @@
+#!/usr/bin/env python3
+"""
+Fake FLIR One Pro LT packet stream.
+
+Writes synthetic EP 0x85 camera packets (header, interleaved thermal,
+visible JPEG, status) in the exact layout the C driver parses, so the
+driver can be exercised without hardware:
+
+    python3 examples/fake_camera.py /tmp/flir.raw --frames 200
+    ./driver/flirone --fake /tmp/flir.raw /tmp/thermal.y16 /tmp/visible.mjpg
+
+The output may also be a FIFO, in which case frames are generated until
+the reader goes away.
+
+--camera-files DIR also writes a CameraFiles.zip with calibration constants
+for the driver's scripted FILEIO channel (--fake-files DIR). With
+--streamed-zip its members leave their sizes to trailing data descriptors,
+as zips written on the fly do.
+"""
+
+import argparse
+import io
+import json
+import math
+import os
+import stat
+import struct
+import sys
+import zipfile
+
+import numpy as np
+
+MAGIC_BYTES = bytes([0xEF, 0xBE, 0x00, 0x00])
+HEADER_SIZE = 28
+THERMAL_WIDTH, THERMAL_HEIGHT = 80, 60
+LINE_STRIDE = 82
+LINE_OFFSET = 32
+VISIBLE_WIDTH, VISIBLE_HEIGHT = 640, 480
+
+# Frames the shutter stays closed during a simulated FFC
+FFC_FRAMES = 6
+
+# Frame period the driver paces --fake input to, and where the simulated
+# device tick counter goes (the last header word, unused by the driver)
+FRAME_PERIOD_S = 0.115
+CLOCK_OFFSET = 24
+
+# Thermal block as sent by the camera: 4 bytes lead-in + 60 lines of 82 pixels
+THERMAL_SIZE = (LINE_OFFSET - HEADER_SIZE) + LINE_STRIDE * THERMAL_HEIGHT * 2
+
+# Calibration served by the fake camera's FILEIO channel
+FAKE_SERIAL = "FAKE0001"
+FAKE_CALIBRATION = {
+    "PlanckR1": 17096.453,
+    "PlanckB": 1428.0,
+    "PlanckF": 1.0,
+    "PlanckO": -512,
+    "PlanckR2": 0.012866305,
+}
+
+# Standard luminance DC Huffman table (ITU T.81 Annex K)
+DC_BITS = [0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0]
+DC_VALS = list(range(12))
+# DC-only images never need an AC symbol other than EOB
+AC_BITS = [1] + [0] * 15
+AC_VALS = [0x00]
+QUANT = 16
+
+
+def _huffman_codes(bits, vals):
+    """Build the canonical code table {symbol: (code, length)}."""
+    codes = {}
+    code = 0
+    k = 0
+    for length in range(1, 17):
+        for _ in range(bits[length - 1]):
+            codes[vals[k]] = (code, length)
+            code += 1
+            k += 1
+        code <<= 1
+    return codes
+
+
+def _segment(marker, payload):
+    return bytes([0xFF, marker]) + struct.pack('>H', len(payload) + 2) + payload
+
+
+def encode_dc_jpeg(levels: np.ndarray) -> bytes:
+    """Encode a grayscale image made of flat 8x8 blocks as a baseline JPEG.
+
+    Only used when OpenCV is not installed; the result is blocky but it is
+    a valid JPEG that every decoder accepts.
+
+    Args:
+        levels: (rows, cols) array of block brightness values (0-255)
+    """
+    rows, cols = levels.shape
+    dc_codes = _huffman_codes(DC_BITS, DC_VALS)
+    eob_code, eob_len = _huffman_codes(AC_BITS, AC_VALS)[0x00]
+
+    acc = 0
+    nbits = 0
+    out = bytearray()
+
+    def put(value, length):
+        nonlocal acc, nbits
+        acc = (acc << length) | (value & ((1 << length) - 1))
+        nbits += length
+        while nbits >= 8:
+            nbits -= 8
+            byte = (acc >> nbits) & 0xFF
+            out.append(byte)
+            if byte == 0xFF:
+                out.append(0x00)  # byte stuffing
+
+    prev = 0
+    for by in range(rows):
+        for bx in range(cols):
+            dc = int(round((int(levels[by, bx]) - 128) * 8 / QUANT))
+            diff = dc - prev
+            prev = dc
+            cat = abs(diff).bit_length()
+            code, length = dc_codes[cat]
+            put(code, length)
+            if cat:
+                put(diff if diff > 0 else diff + (1 << cat) - 1, cat)
+            put(eob_code, eob_len)
+    if nbits:
+        put(0x7F, 8 - nbits)  # pad with 1-bits
+
+    header = bytearray(b'\xFF\xD8')
+    header += _segment(0xDB, bytes([0x00]) + bytes([QUANT] * 64))
+    header += _segment(0xC0, struct.pack('>BHHB', 8, rows * 8, cols * 8, 1) + bytes([1, 0x11, 0]))
+    header += _segment(0xC4, bytes([0x00] + DC_BITS + DC_VALS))
+    header += _segment(0xC4, bytes([0x10] + AC_BITS + AC_VALS))
+    header += _segment(0xDA, bytes([1, 1, 0x00, 0, 63, 0]))
+    return bytes(header) + bytes(out) + b'\xFF\xD9'
+
+
+def make_visible(index: int) -> bytes:
+    """Visible frame: a moving diagonal gradient."""
+    cols, rows = VISIBLE_WIDTH // 8, VISIBLE_HEIGHT // 8
+    yy, xx = np.mgrid[0:rows, 0:cols]
+    levels = ((xx + yy + index) * 4) % 256
+    try:
+        import cv2
+        img = cv2.resize(levels.astype(np.uint8), (VISIBLE_WIDTH, VISIBLE_HEIGHT),
+                         interpolation=cv2.INTER_LINEAR)
+        ok, buf = cv2.imencode('.jpg', cv2.cvtColor(img, cv2.COLOR_GRAY2BGR))
+        if ok:
+            return buf.tobytes()
+    except ImportError:
+        pass
+    return encode_dc_jpeg(levels)
+
+
+def make_thermal(index: int) -> np.ndarray:
+    """Thermal frame: ~3500 count background with an orbiting hotspot."""
+    yy, xx = np.mgrid[0:THERMAL_HEIGHT, 0:THERMAL_WIDTH]
+    cx = THERMAL_WIDTH / 2 + 25 * math.cos(index / 10)
+    cy = THERMAL_HEIGHT / 2 + 18 * math.sin(index / 10)
+    spot = 600 * np.exp(-((xx - cx) ** 2 + (yy - cy) ** 2) / 40.0)
+    return (3400 + yy * 2 + spot).astype(np.uint16)
+
+
+def in_ffc(index: int, ffc_every: int) -> bool:
+    """True for the frames of a simulated flat-field calibration."""
+    return ffc_every > 0 and index % ffc_every >= ffc_every - FFC_FRAMES
+
+
+def make_packet(index: int, ffc_every: int = 0, clock_hz: float = 0, clock_ppm: float = 0) -> bytes:
+    """Build one complete camera packet."""
+    ffc = in_ffc(index, ffc_every)
+    if ffc:
+        # Closed shutter: flat, slightly noisy, no scene
+        thermal = (3600 + np.random.randint(0, 4, (THERMAL_HEIGHT, THERMAL_WIDTH))).astype(np.uint16)
+    else:
+        thermal = make_thermal(index)
+    block = np.zeros((THERMAL_HEIGHT, LINE_STRIDE), dtype='<u2')
+    block[:, :THERMAL_WIDTH] = thermal
+    thermal_bytes = bytes(LINE_OFFSET - HEADER_SIZE) + block.tobytes()
+
+    jpeg = make_visible(index)
+    status = json.dumps({
+        "frame": index,
+        "shutterState": "FFC" if ffc else "ON",
+        "shutterTemperature": 301.5,
+        "ffcState": "FFC_PROGRESS" if ffc else "FFC_VALID_RAD",
+    }).encode() + b'\x00'
+
+    # Device clock, optionally off its nominal rate, wrapping at 32 bits
+    ticks = int(index * FRAME_PERIOD_S * clock_hz * (1 + clock_ppm * 1e-6)) & 0xFFFFFFFF
+
+    frame_size = len(thermal_bytes) + len(jpeg) + len(status)
+    header = MAGIC_BYTES + struct.pack('<IIIIII', index, frame_size, len(thermal_bytes),
+                                       len(jpeg), len(status), ticks)
+    return header + thermal_bytes + jpeg + status
+
+
+class _Unseekable(io.RawIOBase):
+    """Makes zipfile write data descriptors, as it does on a pipe"""
+
+    def __init__(self, f):
+        self._f = f
+
+    def writable(self):
+        return True
+
+    def write(self, b):
+        return self._f.write(b)
+
+
+def write_camera_files(directory: str, streamed: bool = False) -> str:
+    """CameraFiles.zip with an identification and a calibration member"""
+    os.makedirs(directory, exist_ok=True)
+    path = os.path.join(directory, "CameraFiles.zip")
+    info = {"CameraSerialNumber": FAKE_SERIAL, "CameraModel": "FLIR ONE Pro LT (fake)"}
+    calib = "".join(f"<{k}>{v}</{k}>\n" for k, v in FAKE_CALIBRATION.items())
+    with open(path, 'wb') as f:
+        with zipfile.ZipFile(_Unseekable(f) if streamed else f, 'w', zipfile.ZIP_DEFLATED) as z:
+            z.writestr("CameraInfo.json", json.dumps(info, indent=2))
+            z.writestr("calib/Calibration.xml", f"<Calibration>\n{calib}</Calibration>\n")
+    return path
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate a fake FLIR One packet stream")
+    parser.add_argument('output', help="output file or FIFO")
+    parser.add_argument('--frames', type=int, default=100,
+                        help="number of frames for regular files (default: 100)")
+    parser.add_argument('--ffc-every', type=int, default=0,
+                        help="simulate a flat-field calibration every N frames (default: off)")
+    parser.add_argument('--clock-hz', type=float, default=0,
+                        help=f"write a device tick counter at header offset {CLOCK_OFFSET} "
+                             "(driver: --device-clock %d:HZ)" % CLOCK_OFFSET)
+    parser.add_argument('--clock-ppm', type=float, default=0,
+                        help="make the simulated device clock run this many ppm fast")
+    parser.add_argument('--camera-files', metavar='DIR',
+                        help="also write DIR/CameraFiles.zip for the driver's --fake-files")
+    parser.add_argument('--streamed-zip', action='store_true',
+                        help="write CameraFiles.zip with trailing data descriptors")
+    args = parser.parse_args()
+
+    if args.camera_files:
+        print(f"Wrote {write_camera_files(args.camera_files, args.streamed_zip)}", file=sys.stderr)
+
+    is_fifo = os.path.exists(args.output) and stat.S_ISFIFO(os.stat(args.output).st_mode)
+
+    with open(args.output, 'wb', buffering=0) as f:
+        index = 0
+        try:
+            while is_fifo or index < args.frames:
+                f.write(make_packet(index, args.ffc_every, args.clock_hz, args.clock_ppm))
+                index += 1
+        except BrokenPipeError:
+            pass
+
+    print(f"Wrote {index} frames to {args.output}", file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,245 @@
+#!/usr/bin/env python3
+"""
+Receive the driver's --rtp streams and check them.
+
+Reassembles RFC 4175 thermal frames and RFC 2435 RTP/JPEG visible frames,
+counts lost packets and incomplete frames, and optionally writes what it
+received in the formats --stream produces:
+
+    ./driver/flirone --rtp thermal=127.0.0.1:5004 --rtp visible=127.0.0.1:5006
+    python3 examples/rtp_receiver.py --thermal 5004 --visible 5006 \\
+        --y16 /tmp/thermal.y16 --mjpeg /tmp/visible.mjpg
+
+A JPEG rebuilt from RFC 2435 uses the standard Huffman tables, so it is not
+byte-identical to the camera's but decodes to the same pixels.
+"""
+
+import argparse
+import select
+import socket
+import struct
+import sys
+import time
+
+import numpy as np
+
+THERMAL_WIDTH, THERMAL_HEIGHT = 80, 60
+PT_RAW, PT_JPEG = 96, 26
+
+# JPEG Annex K.3: (class, id, 16 code counts, symbols)
+STD_DHT = [
+    (0, 0, bytes([0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0]), bytes(range(12))),
+    (1, 0, bytes([0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d]), bytes.fromhex(
+        "01020300041105122131410613516107227114328191a1082342b1c11552d1f0"
+        "2433627282090a161718191a25262728292a3435363738393a43444546474849"
+        "4a535455565758595a636465666768696a737475767778797a83848586878889"
+        "8a92939495969798999aa2a3a4a5a6a7a8a9aab2b3b4b5b6b7b8b9bac2c3c4c5"
+        "c6c7c8c9cad2d3d4d5d6d7d8d9dae1e2e3e4e5e6e7e8e9eaf1f2f3f4f5f6f7f8"
+        "f9fa")),
+    (0, 1, bytes([0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0]), bytes(range(12))),
+    (1, 1, bytes([0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77]), bytes.fromhex(
+        "000102031104052131061241510761711322328108144291a1b1c109233352f0"
+        "156272d10a162434e125f11718191a262728292a35363738393a434445464748"
+        "494a535455565758595a636465666768696a737475767778797a828384858687"
+        "88898a92939495969798999aa2a3a4a5a6a7a8a9aab2b3b4b5b6b7b8b9bac2c3"
+        "c4c5c6c7c8c9cad2d3d4d5d6d7d8d9dae2e3e4e5e6e7e8e9eaf2f3f4f5f6f7f8"
+        "f9fa")),
+]
+
+
+def segment(marker, payload):
+    return struct.pack(">BBH", 0xFF, marker, len(payload) + 2) + payload
+
+
+def jpeg_headers(jtype, width, height, luma_q, chroma_q, restart):
+    """RFC 2435 appendix A: the headers a type 0/1 frame implies"""
+    out = b"\xff\xd8"
+    out += segment(0xDB, b"\x00" + luma_q + b"\x01" + chroma_q)
+    sampling = 0x21 if (jtype & 63) == 0 else 0x22
+    out += segment(0xC0, struct.pack(">BHHB", 8, height, width, 3)
+                   + bytes([1, sampling, 0, 2, 0x11, 1, 3, 0x11, 1]))
+    for tc, th, bits, vals in STD_DHT:
+        out += segment(0xC4, bytes([tc << 4 | th]) + bits + vals)
+    if restart:
+        out += segment(0xDD, struct.pack(">H", restart))
+    out += segment(0xDA, bytes([3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0]))
+    return out
+
+
+class Stream:
+    def __init__(self, name):
+        self.name = name
+        self.frames = 0
+        self.incomplete = 0
+        self.packets = 0
+        self.lost = 0
+        self.last_seq = None
+        self.timestamp = None
+        self.gap = False
+
+    def sequence(self, seq):
+        """Track 16-bit sequence numbers; True if packets went missing"""
+        self.packets += 1
+        missing = 0
+        if self.last_seq is not None:
+            missing = (seq - self.last_seq - 1) & 0xFFFF
+            if missing > 0x8000:          # reordered or duplicate
+                missing = 0
+        self.last_seq = seq
+        self.lost += missing
+        return missing > 0
+
+    def start(self, timestamp):
+        if timestamp != self.timestamp:
+            if self.timestamp is not None and self.pending():
+                self.incomplete += 1
+            self.timestamp = timestamp
+            self.gap = False
+            self.reset()
+
+
+class ThermalStream(Stream):
+    def __init__(self, out):
+        super().__init__("thermal")
+        self.out = out
+        self.reset()
+
+    def reset(self):
+        self.frame = np.zeros(THERMAL_WIDTH * THERMAL_HEIGHT, dtype=np.uint16)
+        self.covered = 0
+
+    def pending(self):
+        return self.covered > 0
+
+    def packet(self, payload, marker):
+        # Extended sequence number, then line headers until C = 0
+        pos, headers = 2, []
+        while True:
+            length, line, offset = struct.unpack_from(">HHH", payload, pos)
+            pos += 6
+            headers.append((length, line & 0x7FFF, offset & 0x7FFF))
+            if not offset & 0x8000:
+                break
+        for length, line, offset in headers:
+            n = length // 2
+            start = line * THERMAL_WIDTH + offset
+            self.frame[start:start + n] = np.frombuffer(payload, ">u2", n, pos)
+            self.covered += n
+            pos += length
+        if marker:
+            if self.covered == self.frame.size and not self.gap:
+                self.frames += 1
+                if self.out:
+                    self.out.write(self.frame.astype("<u2").tobytes())
+            else:
+                self.incomplete += 1
+            self.timestamp = None
+            self.reset()
+
+
+class JpegStream(Stream):
+    def __init__(self, out):
+        super().__init__("visible")
+        self.out = out
+        self.reset()
+
+    def reset(self):
+        self.fragments = {}
+        self.headers = None
+
+    def pending(self):
+        return bool(self.fragments)
+
+    def packet(self, payload, marker):
+        off = int.from_bytes(payload[1:4], "big")
+        jtype, q, w8, h8 = payload[4:8]
+        pos, restart = 8, 0
+        if jtype >= 64:
+            restart = struct.unpack_from(">H", payload, pos)[0]
+            pos += 4
+        if off == 0:
+            if q < 128:
+                raise ValueError("only in-band quantisation tables (Q >= 128) are supported")
+            length = struct.unpack_from(">H", payload, pos + 2)[0]
+            tables = payload[pos + 4:pos + 4 + length]
+            pos += 4 + length
+            self.headers = jpeg_headers(jtype, w8 * 8, h8 * 8, tables[:64], tables[64:128], restart)
+        self.fragments[off] = payload[pos:]
+        if marker:
+            scan, expect = b"", 0
+            for o in sorted(self.fragments):
+                if o != expect:
+                    break
+                scan += self.fragments[o]
+                expect += len(self.fragments[o])
+            complete = self.headers and expect == sum(len(f) for f in self.fragments.values())
+            if complete and not self.gap:
+                self.frames += 1
+                if self.out:
+                    self.out.write(self.headers + scan + b"\xff\xd9")
+            else:
+                self.incomplete += 1
+            self.timestamp = None
+            self.reset()
+
+
+def open_socket(port, host):
+    s = socket.socket(socket.AF_INET6 if ":" in host else socket.AF_INET, socket.SOCK_DGRAM)
+    s.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4 << 20)
+    s.bind((host, port))
+    return s
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--thermal", type=int, metavar="PORT", help="receive RFC 4175 Y16 on PORT")
+    ap.add_argument("--visible", type=int, metavar="PORT", help="receive RFC 2435 JPEG on PORT")
+    ap.add_argument("--bind", default="0.0.0.0", help="local address (default: all IPv4)")
+    ap.add_argument("--y16", metavar="FILE", help="write thermal frames as raw gray16le")
+    ap.add_argument("--mjpeg", metavar="FILE", help="write rebuilt JPEGs back to back")
+    ap.add_argument("--frames", type=int, default=0, help="stop after N complete frames per stream")
+    ap.add_argument("--timeout", type=float, default=5.0, help="stop after this many idle seconds")
+    args = ap.parse_args()
+    if args.thermal is None and args.visible is None:
+        ap.error("give --thermal and/or --visible")
+
+    streams = {}
+    if args.thermal is not None:
+        streams[open_socket(args.thermal, args.bind)] = (PT_RAW, ThermalStream(open(args.y16, "wb") if args.y16 else None))
+    if args.visible is not None:
+        streams[open_socket(args.visible, args.bind)] = (PT_JPEG, JpegStream(open(args.mjpeg, "wb") if args.mjpeg else None))
+
+    started = None
+    try:
+        while True:
+            ready, _, _ = select.select(list(streams), [], [], args.timeout)
+            if not ready:
+                break
+            for sock in ready:
+                data = sock.recv(65536)
+                pt, stream = streams[sock]
+                if len(data) < 12 or data[0] >> 6 != 2 or data[1] & 0x7F != pt:
+                    continue
+                started = started or time.monotonic()
+                seq, timestamp = struct.unpack_from(">HI", data, 2)
+                stream.start(timestamp)
+                if stream.sequence(seq):
+                    stream.gap = True
+                stream.packet(data[12:], data[1] & 0x80)
+            if args.frames and all(s.frames >= args.frames for _, s in streams.values()):
+                break
+    except KeyboardInterrupt:
+        pass
+
+    elapsed = time.monotonic() - started if started else 0
+    for _, s in streams.values():
+        rate = s.frames / elapsed if elapsed > 0 else 0
+        print(f"{s.name}: {s.frames} frames ({rate:.1f} fps), {s.incomplete} incomplete, "
+              f"{s.packets} packets, {s.lost} lost")
+        if s.out:
+            s.out.close()
+    return 0 if all(s.frames > 0 for _, s in streams.values()) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
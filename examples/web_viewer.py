@@ -5,6 +5,8 @@ import time
 import os
 from flir.thermal import ThermalContext
 from flir.colormap import load_palette, PALETTE_DIR
+from flir.jpegenc import ThermalJpegEncoder, draw_circle, draw_marker, draw_text
+from flir.recording import Recording, Player
 
 app = Flask(__name__)
 
@@ -13,6 +15,12 @@ THERMAL_DEVICE = os.environ.get('FLIR_THERMAL_DEVICE', '/dev/video10')
 VISIBLE_DEVICE = os.environ.get('FLIR_VISIBLE_DEVICE', '/dev/video11')
 THERMAL_WIDTH, THERMAL_HEIGHT = 80, 60
 
+# Playback: serve a recorded session (driver --capture file or Y16 file)
+# instead of the live devices
+PLAYBACK_FILE = os.environ.get('FLIR_PLAYBACK')
+player = None
+preview_ctx = None
+
 # Global State
 CURRENT_PALETTE_NAME = "Iron2"
 CURRENT_PALETTE = load_palette(CURRENT_PALETTE_NAME)
@@ -30,8 +38,9 @@ def get_available_palettes():
                 palettes.append(f[:-4])
     return sorted(palettes)
 
-def apply_colormap_16bit(frame_16, ctx):
-    """Normalize 16-bit frame and apply colormap with radiometry"""
+def apply_colormap_16bit(frame_16, ctx, enc):
+    """Normalize 16-bit frame and apply colormap with radiometry, as the
+    encoder's planes"""
     # Create copy of context to apply current system params
     # We tweak the context object directly here for simplicity
     ctx.config["Emissivity"] = EMISSIVITY
@@ -51,18 +60,13 @@ def apply_colormap_16bit(frame_16, ctx):
     else:
         norm = np.zeros_like(frame_16, dtype=np.uint8)
     
-    # Apply palette (RGB)
-    colored = CURRENT_PALETTE[norm]
-    bgr = colored[:, :, ::-1].copy()
-    
-    # Upscale
-    bgr = cv2.resize(bgr, (640, 480), interpolation=cv2.INTER_NEAREST)
+    # Apply palette (as YCbCr) and upscale
+    enc.set_palette(CURRENT_PALETTE)
+    planes = enc.planes(norm)
     
     # Draw Info
-    cv2.putText(bgr, f"Range: {min_temp:.1f}C - {max_temp:.1f}C", (10, 30), 
-                cv2.FONT_HERSHEY_SIMPLEX, 0.7, (255, 255, 255), 2)
-    cv2.putText(bgr, f"E:{EMISSIVITY:.2f}", (540, 30), 
-                cv2.FONT_HERSHEY_SIMPLEX, 0.6, (200, 200, 200), 1)
+    draw_text(planes, f"Range: {min_temp:.1f}C - {max_temp:.1f}C", (10, 30), 0.7, (255, 255, 255), 2)
+    draw_text(planes, f"E:{EMISSIVITY:.2f}", (540, 30), 0.6, (200, 200, 200), 1)
     
     # Scale locations
     scale_x = 640 / THERMAL_WIDTH
@@ -82,26 +86,23 @@ def apply_colormap_16bit(frame_16, ctx):
         raw_val = frame_16[ty, tx]
         temp = ctx.raw2temp(raw_val)
         
-        cv2.drawMarker(bgr, (mx, my), (0, 255, 255), cv2.MARKER_CROSS, 20, 2)
-        cv2.putText(bgr, f"{temp:.1f}C", (mx + 10, my - 10), 
-                   cv2.FONT_HERSHEY_SIMPLEX, 0.7, (0, 255, 255), 2)
+        draw_marker(planes, (mx, my), (0, 255, 255), cv2.MARKER_CROSS, 20, 2)
+        draw_text(planes, f"{temp:.1f}C", (mx + 10, my - 10), 0.7, (0, 255, 255), 2)
 
     # Hot/Cold Spots
     if SHOW_HOTSPOT:
         hx = int(max_loc[0] * scale_x)
         hy = int(max_loc[1] * scale_y)
-        cv2.circle(bgr, (hx, hy), 5, (0, 0, 255), 2)
-        cv2.putText(bgr, f"{max_temp:.1f}C", (hx + 10, hy), 
-                   cv2.FONT_HERSHEY_SIMPLEX, 0.6, (0, 0, 255), 2)
+        draw_circle(planes, (hx, hy), 5, (0, 0, 255), 2)
+        draw_text(planes, f"{max_temp:.1f}C", (hx + 10, hy), 0.6, (0, 0, 255), 2)
 
     if SHOW_COLDSPOT:
         lx = int(min_loc[0] * scale_x)
         ly = int(min_loc[1] * scale_y)
-        cv2.circle(bgr, (lx, ly), 5, (255, 0, 0), 2)
-        cv2.putText(bgr, f"{min_temp:.1f}C", (lx + 10, ly), 
-                   cv2.FONT_HERSHEY_SIMPLEX, 0.6, (255, 200, 100), 2)
+        draw_circle(planes, (lx, ly), 5, (255, 0, 0), 2)
+        draw_text(planes, f"{min_temp:.1f}C", (lx + 10, ly), 0.6, (255, 200, 100), 2)
     
-    return bgr
+    return planes
 
 # ... [Generator functions remain same] ...
 
@@ -113,7 +114,8 @@ def index():
                           current_palette=CURRENT_PALETTE_NAME, 
                           show_hot=SHOW_HOTSPOT, 
                           show_cold=SHOW_COLDSPOT,
-                          emissivity=EMISSIVITY)
+                          emissivity=EMISSIVITY,
+                          playback=player.state() if player else None)
 
 # ... [Video routes remain same] ...
 
@@ -148,14 +150,39 @@ def clear_spots():
     return jsonify({"status": "ok"})
 
 
+def render_thermal_jpeg(gray, ctx, enc):
+    return enc.encode(apply_colormap_16bit(gray, ctx, enc))
+
+def generate_thermal_playback():
+    ctx = ThermalContext()
+    enc = ThermalJpegEncoder()
+    last_index = None
+    last_render = 0
+    frame_bytes = None
+    while True:
+        index = player.position()
+        # Re-render a paused frame now and then so palette/spot changes show
+        if index != last_index or time.monotonic() - last_render > 0.2:
+            frame_bytes = render_thermal_jpeg(player.rec.thermal(index), ctx, enc)
+            last_index = index
+            last_render = time.monotonic()
+        yield (b'--frame\r\n'
+               b'Content-Type: image/jpeg\r\n\r\n' + frame_bytes + b'\r\n')
+        time.sleep(player.frame_interval())
+
 def generate_thermal():
+    if player:
+        yield from generate_thermal_playback()
+        return
+
     cap = cv2.VideoCapture(THERMAL_DEVICE)
     cap.set(cv2.CAP_PROP_CONVERT_RGB, 0)
     # Try to set format, but it depends on the driver if this is needed or respected
     cap.set(cv2.CAP_PROP_FOURCC, cv2.VideoWriter_fourcc('Y','1','6',' '))
     
-    # Initialize Radiometry
+    # Initialize Radiometry, and one encoder per stream
     ctx = ThermalContext()
+    enc = ThermalJpegEncoder()
     
     if not cap.isOpened():
         print("Could not open thermal device")
@@ -184,9 +211,7 @@ def generate_thermal():
              except:
                  pass
 
-        final = apply_colormap_16bit(gray, ctx)
-        ret, buffer = cv2.imencode('.jpg', final)
-        frame_bytes = buffer.tobytes()
+        frame_bytes = render_thermal_jpeg(gray, ctx, enc)
         
         yield (b'--frame\r\n'
                b'Content-Type: image/jpeg\r\n\r\n' + frame_bytes + b'\r\n')
@@ -242,8 +267,25 @@ class VideoReader:
         with self.lock:
             return self.frame_data
 
+class PlaybackReader:
+    """VideoReader stand-in serving the recorded JPEG at the playback position"""
+    def __init__(self, player):
+        self.player = player
+        self.running = True
+
+    def start(self):
+        pass
+
+    def get_frame(self):
+        return self.player.rec.jpeg(self.player.position())
+
 # Initialize Global Reader
-visible_reader = VideoReader(VISIBLE_DEVICE)
+if PLAYBACK_FILE:
+    player = Player(Recording(PLAYBACK_FILE))
+    visible_reader = PlaybackReader(player)
+    print(f"Playback: {PLAYBACK_FILE} ({player.rec.frame_count} frames)")
+else:
+    visible_reader = VideoReader(VISIBLE_DEVICE)
 # Start strictly once? Or on first request? 
 # Better on startup to ensure device is claimed correctly.
 # But Flask reloader causes restart. We'll start in main block or lazy load.
@@ -347,5 +389,83 @@ def toggle_spot():
         
     return jsonify({"status": "ok", "type": spot_type, "state": state})
 
+# Playback control (only with FLIR_PLAYBACK)
+
+def playback_required():
+    if not player:
+        return jsonify({"status": "error", "message": "Not in playback mode"}), 404
+    return None
+
+@app.route('/api/playback')
+def playback_state():
+    return playback_required() or jsonify({"status": "ok", **player.state()})
+
+@app.route('/api/seek')
+def playback_seek():
+    err = playback_required()
+    if err:
+        return err
+    try:
+        if 'frame' in request.args:
+            player.seek(float(request.args['frame']))
+        else:
+            player.seek_time(float(request.args.get('t', 0)))
+    except ValueError:
+        return jsonify({"status": "error"}), 400
+    return jsonify({"status": "ok", **player.state()})
+
+@app.route('/api/play')
+def playback_play():
+    err = playback_required()
+    if err:
+        return err
+    try:
+        speed = request.args.get('speed')
+        player.play(float(speed) if speed is not None else None)
+    except ValueError:
+        return jsonify({"status": "error"}), 400
+    return jsonify({"status": "ok", **player.state()})
+
+@app.route('/api/pause')
+def playback_pause():
+    err = playback_required()
+    if err:
+        return err
+    player.pause()
+    return jsonify({"status": "ok", **player.state()})
+
+@app.route('/api/step')
+def playback_step():
+    err = playback_required()
+    if err:
+        return err
+    try:
+        player.step(int(request.args.get('n', 1)))
+    except ValueError:
+        return jsonify({"status": "error"}), 400
+    return jsonify({"status": "ok", **player.state()})
+
+@app.route('/api/playback_frame')
+def playback_frame():
+    """Single rendered frame, e.g. for scrub previews"""
+    err = playback_required()
+    if err:
+        return err
+    try:
+        index = int(request.args.get('frame', player.position()))
+    except ValueError:
+        return jsonify({"status": "error"}), 400
+    if request.args.get('stream') == 'visible':
+        data = player.rec.jpeg(index)
+        if data is None:
+            return jsonify({"status": "error", "message": "No visible frame"}), 404
+    else:
+        global preview_ctx
+        if preview_ctx is None:
+            preview_ctx = ThermalContext()
+        # Requests run on several threads: a short-lived encoder each
+        data = render_thermal_jpeg(player.rec.thermal(index), preview_ctx, ThermalJpegEncoder())
+    return Response(data, mimetype='image/jpeg')
+
 if __name__ == '__main__':
     app.run(host='0.0.0.0', port=5000, threaded=True)
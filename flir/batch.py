@@ -0,0 +1,405 @@
+"""
+Parallel offline processing of recorded sessions.
+
+Recordings are cut into chunks of frames. Each chunk is converted to
+temperatures with a lookup table and reduced to per-ROI statistics with
+whole-array numpy operations on worker threads; there is no per-frame
+Python code in the workers. Chunks are spread over the workers as
+contiguous runs (sequential reads per worker) and idle workers steal from
+the far end of the busiest queue. Results are formatted and written by a
+writer thread strictly in recording and frame order, whatever order the
+chunks finish in.
+
+Frames can also be exported as radiometric JPEGs (``--rjpeg DIR``): the
+recorded visible JPEG is copied as is, with the raw thermal and calibration
+added in FLIR APP1 segments, by the same workers.
+
+    python3 -m flir.batch session1.raw session2.raw --roi door=10,5,20,30 \\
+        --alarm door>45 --csv stats.csv --alarms alarms.jsonl
+    python3 -m flir.batch session1.raw --rjpeg export/ --rjpeg-every 9
+"""
+
+import argparse
+import csv
+import io
+import json
+import os
+import sys
+import threading
+import time
+from collections import deque
+from dataclasses import dataclass
+from typing import Callable, Dict, List, Optional, Tuple
+
+import numpy as np
+
+from .frame_parser import THERMAL_WIDTH, THERMAL_HEIGHT
+from .recording import Recording
+from .rjpeg import write_radiometric_jpeg
+from .thermal import ThermalContext
+
+DEFAULT_CHUNK = 256
+
+
+@dataclass
+class ROI:
+    name: str
+    x: int
+    y: int
+    w: int
+    h: int
+
+    @staticmethod
+    def parse(spec: str) -> 'ROI':
+        """NAME=X,Y,W,H in thermal pixels"""
+        name, _, box = spec.partition('=')
+        x, y, w, h = (int(v) for v in box.split(','))
+        if name == "frame":
+            raise ValueError("ROI name 'frame' is reserved for the whole frame")
+        if not name or w <= 0 or h <= 0 or x < 0 or y < 0 or x + w > THERMAL_WIDTH or y + h > THERMAL_HEIGHT:
+            raise ValueError(f"bad ROI {spec!r}")
+        return ROI(name, x, y, w, h)
+
+
+@dataclass
+class Alarm:
+    roi: str
+    above: bool
+    threshold: float
+
+    @staticmethod
+    def parse(spec: str) -> 'Alarm':
+        """ROI>CELSIUS or ROI<CELSIUS"""
+        for op in ('>', '<'):
+            if op in spec:
+                roi, _, value = spec.partition(op)
+                return Alarm(roi, op == '>', float(value))
+        raise ValueError(f"bad alarm {spec!r}")
+
+
+@dataclass
+class Export:
+    """--rjpeg: every n-th frame of each recording to directory"""
+    directory: str
+    every: int
+    config: dict
+    serial: str
+
+
+@dataclass
+class Chunk:
+    seq: int            # global position in the output order
+    recording: int
+    start: int
+    stop: int
+
+
+class StealingPool:
+    """Threads with one deque of tasks each; an idle thread steals from the
+    back of the longest other deque."""
+
+    def __init__(self, workers: int):
+        self.workers = workers
+        self.queues = [deque() for _ in range(workers)]
+        self.steals = 0
+
+    def run(self, tasks: List, fn: Callable):
+        # Contiguous runs per worker keep reads sequential
+        per = (len(tasks) + self.workers - 1) // max(1, self.workers)
+        for w in range(self.workers):
+            self.queues[w].extend(tasks[w * per:(w + 1) * per])
+        errors = []
+        threads = [threading.Thread(target=self._worker, args=(w, fn, errors), daemon=True)
+                   for w in range(self.workers)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        if errors:
+            raise errors[0]
+
+    def _take(self, w: int):
+        try:
+            return self.queues[w].popleft()
+        except IndexError:
+            pass
+        # deque.pop/popleft are atomic, so a lost race just means retrying
+        while True:
+            victim = max(range(self.workers), key=lambda v: len(self.queues[v]))
+            if not self.queues[victim]:
+                return None
+            try:
+                task = self.queues[victim].pop()
+                self.steals += 1
+                return task
+            except IndexError:
+                continue
+
+    def _worker(self, w: int, fn: Callable, errors: List):
+        while not errors:
+            task = self._take(w)
+            if task is None:
+                return
+            try:
+                fn(task)
+            except Exception as e:
+                errors.append(e)
+                return
+
+
+class OrderedWriter:
+    """Hands chunk results to a sink in sequence order, on a thread of its
+    own: formatting output holds the GIL, and workers never wait for it."""
+
+    def __init__(self, sink: Callable):
+        self.sink = sink
+        self.pending: Dict[int, object] = {}
+        self.next = 0
+        self.cond = threading.Condition()
+        self.closed = False
+        self.error: Optional[Exception] = None
+        self.thread = threading.Thread(target=self._run, daemon=True)
+        self.thread.start()
+
+    def put(self, seq: int, result):
+        with self.cond:
+            self.pending[seq] = result
+            self.cond.notify()
+
+    def _run(self):
+        while True:
+            with self.cond:
+                while self.next not in self.pending and not self.closed:
+                    self.cond.wait()
+                if self.next not in self.pending:
+                    return
+                result = self.pending.pop(self.next)
+                self.next += 1
+            try:
+                self.sink(result)
+            except Exception as e:
+                self.error = e
+                return
+
+    def close(self):
+        """Wait until everything put so far is written"""
+        with self.cond:
+            self.closed = True
+            self.cond.notify()
+        self.thread.join()
+        if self.error:
+            raise self.error
+
+
+def export_chunk(rec: Recording, chunk: Chunk, raw: np.ndarray, export: Export) -> int:
+    """Radiometric JPEGs of the chunk's selected frames; frames without a
+    visible JPEG (Y16 recordings) are skipped. Returns the number written."""
+    name = os.path.splitext(os.path.basename(rec.path))[0]
+    written = 0
+    first = -(-chunk.start // export.every) * export.every
+    for i in range(first, chunk.stop, export.every):
+        jpeg = rec.jpeg(i)
+        if jpeg is None:
+            continue
+        path = os.path.join(export.directory, f"{name}-{i:06d}.jpg")
+        write_radiometric_jpeg(path, jpeg, raw[i - chunk.start], export.config, export.serial)
+        written += 1
+    return written
+
+
+def process_chunk(rec: Recording, chunk: Chunk, lut: np.ndarray, rois: List[ROI], want_csv: bool,
+                  export: Optional[Export] = None) -> dict:
+    """Temperatures and ROI min/max/mean for every frame of the chunk, and
+    the chunk's CSV table (formatted by the writer)."""
+    raw = rec.thermal_block(chunk.start, chunk.stop)
+    exported = export_chunk(rec, chunk, raw, export) if export else 0
+    temps = lut[raw]
+    stats = {}
+    for roi in rois:
+        sub = temps[:, roi.y:roi.y + roi.h, roi.x:roi.x + roi.w]
+        stats[roi.name] = (sub.min(axis=(1, 2)), sub.max(axis=(1, 2)), sub.mean(axis=(1, 2)))
+
+    table = None
+    if want_csv:
+        frames = np.arange(chunk.start, chunk.stop)
+        table = np.column_stack([frames, frames / rec.fps] + [a for roi in rois for a in stats[roi.name]])
+    return {"chunk": chunk, "stats": stats, "csv": table, "exported": exported}
+
+
+def csv_rows(path: str, table: np.ndarray) -> str:
+    """CSV rows of a process_chunk table: recording, frame, time, statistics.
+    The numbers are formatted by numpy; the path is quoted by csv.writer,
+    as in the header, and rows end like the header's."""
+    field = io.StringIO()
+    csv.writer(field, lineterminator=',').writerow([path])
+    numbers = io.StringIO()
+    np.savetxt(numbers, table, fmt=",".join(["%d", "%.3f"] + ["%.2f"] * (table.shape[1] - 2)), newline='\r\n')
+    prefix = field.getvalue()
+    return "".join(prefix + line for line in numbers.getvalue().splitlines(keepends=True))
+
+
+class AlarmTracker:
+    """Turns per-frame ROI values into alarm events (start/end/peak).
+    Events of a recording are written when it is done, sorted by start frame
+    and alarm, so the output does not depend on the chunk size."""
+
+    def __init__(self, alarms: List[Alarm], out):
+        self.alarms = alarms
+        self.out = out
+        self.active: Dict[Tuple[int, int], dict] = {}
+        self.done: List[Tuple[int, int, dict]] = []
+        self.events = 0
+
+    def feed(self, path: str, rec_index: int, start: int, stats: dict):
+        for k, alarm in enumerate(self.alarms):
+            mins, maxs, _ = stats[alarm.roi]
+            values = maxs if alarm.above else mins
+            hit = values > alarm.threshold if alarm.above else values < alarm.threshold
+            key = (rec_index, k)
+            # Only the frames where the state flips need Python-level work
+            edges = np.flatnonzero(np.diff(np.concatenate(([key in self.active], hit)).astype(np.int8)))
+            ev = self.active.get(key)
+            pos = 0
+            for e in edges:
+                if ev is None:
+                    ev = {"alarm": k, "recording": path, "roi": alarm.roi,
+                          "condition": f"{'>' if alarm.above else '<'}{alarm.threshold:g}",
+                          "start_frame": start + int(e), "peak": None}
+                else:
+                    self._extend(ev, values[pos:e], alarm.above)
+                    ev["end_frame"] = start + int(e) - 1
+                    self._emit(ev)
+                    ev = None
+                pos = e
+            if ev is not None:
+                self._extend(ev, values[pos:], alarm.above)
+                self.active[key] = ev
+            else:
+                self.active.pop(key, None)
+
+    @staticmethod
+    def _extend(ev: dict, values: np.ndarray, above: bool):
+        if len(values) == 0:
+            return
+        v = float(values.max() if above else values.min())
+        if ev["peak"] is None or (v > ev["peak"] if above else v < ev["peak"]):
+            ev["peak"] = round(v, 2)
+
+    def close_recording(self, rec_index: int, frames: int):
+        for key in [k for k in self.active if k[0] == rec_index]:
+            ev = self.active.pop(key)
+            ev["end_frame"] = frames - 1
+            self._emit(ev)
+        self.done.sort(key=lambda d: (d[0], d[1]))
+        for _, _, ev in self.done:
+            self.events += 1
+            if self.out:
+                self.out.write(json.dumps(ev) + "\n")
+        self.done = []
+
+    def _emit(self, ev: dict):
+        self.done.append((ev["start_frame"], ev.pop("alarm"), ev))
+
+
+def run(paths: List[str], rois: List[ROI], alarms: List[Alarm], csv_out, alarms_out,
+        workers: int, chunk_frames: int, ctx: ThermalContext, export: Optional[Export] = None) -> dict:
+    recordings = [Recording(p, cache_frames=0) for p in paths]
+    full = ROI("frame", 0, 0, THERMAL_WIDTH, THERMAL_HEIGHT)
+    rois = [full] + rois
+    lut = ctx.lookup_table()
+
+    chunks = []
+    for r, rec in enumerate(recordings):
+        for start in range(0, rec.frame_count, chunk_frames):
+            chunks.append(Chunk(len(chunks), r, start, min(rec.frame_count, start + chunk_frames)))
+
+    if csv_out:
+        csv.writer(csv_out).writerow(["recording", "frame", "time_s"] +
+                                     [f"{roi.name}_{s}" for roi in rois for s in ("min", "max", "mean")])
+    tracker = AlarmTracker(alarms, alarms_out)
+    exported = 0
+    last_chunk = {r: max((c.seq for c in chunks if c.recording == r), default=-1)
+                  for r in range(len(recordings))}
+
+    def sink(result):
+        nonlocal exported
+        c = result["chunk"]
+        rec = recordings[c.recording]
+        stats = result["stats"]
+        if csv_out:
+            csv_out.write(csv_rows(rec.path, result["csv"]))
+        exported += result["exported"]
+        tracker.feed(rec.path, c.recording, c.start, stats)
+        if c.seq == last_chunk[c.recording]:
+            tracker.close_recording(c.recording, rec.frame_count)
+
+    ordered = OrderedWriter(sink)
+    pool = StealingPool(workers)
+    t0 = time.monotonic()
+    try:
+        pool.run(chunks, lambda c: ordered.put(c.seq, process_chunk(recordings[c.recording], c, lut, rois,
+                                                                       csv_out is not None, export)))
+    finally:
+        ordered.close()
+    elapsed = time.monotonic() - t0
+
+    frames = sum(r.frame_count for r in recordings)
+    for rec in recordings:
+        rec.close()
+    return {"recordings": len(recordings), "frames": frames, "chunks": len(chunks),
+            "workers": workers, "steals": pool.steals, "alarm_events": tracker.events,
+            "exported": exported,
+            "seconds": round(elapsed, 3), "fps": round(frames / elapsed, 1) if elapsed > 0 else None}
+
+
+def main(argv: Optional[List[str]] = None):
+    parser = argparse.ArgumentParser(description="Process recorded FLIR sessions in parallel")
+    parser.add_argument('recordings', nargs='+', help="--capture files or Y16 files")
+    parser.add_argument('--roi', action='append', default=[], metavar='NAME=X,Y,W,H',
+                        help="region of interest in thermal pixels (repeatable); 'frame' is always added")
+    parser.add_argument('--alarm', action='append', default=[], metavar='ROI>C',
+                        help="alarm when the ROI maximum exceeds C (or ROI<C: minimum below C)")
+    parser.add_argument('--csv', metavar='FILE', help="per-frame statistics ('-' for stdout)")
+    parser.add_argument('--alarms', metavar='FILE', help="alarm events as JSON lines")
+    parser.add_argument('--rjpeg', metavar='DIR', help="export frames as radiometric JPEGs to DIR")
+    parser.add_argument('--rjpeg-every', type=int, default=1, metavar='N', help="export every N-th frame")
+    parser.add_argument('--workers', type=int, default=os.cpu_count() or 1)
+    parser.add_argument('--chunk', type=int, default=DEFAULT_CHUNK, help="frames per work item")
+    parser.add_argument('--emissivity', type=float)
+    parser.add_argument('--serial', help="use the driver's cached calibration for this camera")
+    args = parser.parse_args(argv)
+
+    try:
+        rois = [ROI.parse(s) for s in args.roi]
+        alarms = [Alarm.parse(s) for s in args.alarm]
+    except ValueError as e:
+        parser.error(str(e))
+    names = {"frame"} | {r.name for r in rois}
+    for a in alarms:
+        if a.roi not in names:
+            parser.error(f"alarm on unknown ROI {a.roi!r}")
+    if args.workers < 1 or args.chunk < 1 or args.rjpeg_every < 1:
+        parser.error("--workers, --chunk and --rjpeg-every must be positive")
+
+    ctx = ThermalContext(serial=args.serial)
+    if args.emissivity is not None:
+        ctx.config["Emissivity"] = args.emissivity
+    export = None
+    if args.rjpeg:
+        os.makedirs(args.rjpeg, exist_ok=True)
+        export = Export(args.rjpeg, args.rjpeg_every, dict(ctx.config), args.serial or "")
+
+    csv_out = sys.stdout if args.csv == '-' else (open(args.csv, 'w', newline='') if args.csv else None)
+    alarms_out = open(args.alarms, 'w') if args.alarms else None
+    try:
+        summary = run(args.recordings, rois, alarms, csv_out, alarms_out, args.workers, args.chunk, ctx, export)
+    finally:
+        if csv_out and csv_out is not sys.stdout:
+            csv_out.close()
+        if alarms_out:
+            alarms_out.close()
+    sys.stderr.write(json.dumps(summary) + "\n")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,186 @@
+"""
+Readers for the driver's thermal + visible bundles (``flirone --bundle``).
+
+Every record holds one camera packet: metadata, the raw thermal plane and
+the visible JPEG, so the two always belong together. The same records
+come from three places:
+
+    BundleReader.open('frames.bundle')   # a file or FIFO
+    BundleReader.open('unix:/run/flir.sock')
+    BundleReader.open('shm:flir')        # the ring in /dev/shm/flir
+
+Files, FIFOs and sockets deliver every record the driver could send;
+the shared memory ring always hands out the newest one and skips what
+the reader was too slow for (``Bundle.sequence`` tells). The layout is
+documented in ``driver/bundle.h``.
+"""
+
+import mmap
+import os
+import socket
+import struct
+import time
+from dataclasses import dataclass
+from typing import Iterator, Optional
+
+import numpy as np
+
+MAGIC = b'FLB1'
+RING_MAGIC = b'FLBR'
+
+THERMAL = 1
+JPEG = 2
+STATUS = 3
+
+# struct bundle_header and struct bundle_section
+_HEADER = struct.Struct('<4sIHHIQQIi')
+_SECTION = struct.Struct('<IIIHH')
+# struct bundle_ring
+_RING = struct.Struct('<4sIIIQ')
+RING_HEADER = 64
+SLOT_HEADER = 16
+
+MAX_RECORD = 2 << 20
+
+
+@dataclass
+class Bundle:
+    camera: int
+    sequence: int
+    time_ns: int            # CLOCK_MONOTONIC
+    quality: int            # FLIRONE_QUALITY_* flags, 0 for a good frame
+    ffc_state: int
+    thermal: Optional[np.ndarray]   # (height, width) uint16, or None
+    jpeg: Optional[bytes]
+    status: Optional[bytes]
+
+
+def parse(record: bytes) -> Bundle:
+    """One record, as read whole from any of the sources"""
+    magic, size, header_size, nsections, camera, sequence, time_ns, quality, ffc = \
+        _HEADER.unpack_from(record)
+    if magic != MAGIC or size > len(record):
+        raise ValueError("not a bundle record")
+    parts = {}
+    for i in range(nsections):
+        kind, offset, length, width, height = _SECTION.unpack_from(record, _HEADER.size + i * _SECTION.size)
+        if length:
+            parts[kind] = (offset, length, width, height)
+
+    thermal = jpeg = status = None
+    if THERMAL in parts:
+        offset, length, width, height = parts[THERMAL]
+        thermal = np.frombuffer(record, '<u2', width * height, offset).reshape(height, width)
+    if JPEG in parts:
+        offset, length, _, _ = parts[JPEG]
+        jpeg = bytes(record[offset:offset + length])
+    if STATUS in parts:
+        offset, length, _, _ = parts[STATUS]
+        status = bytes(record[offset:offset + length])
+    return Bundle(camera, sequence, time_ns, quality, ffc, thermal, jpeg, status)
+
+
+class BundleReader:
+    """Iterates over the bundles of one source"""
+
+    @staticmethod
+    def open(dest: str) -> 'BundleReader':
+        if dest.startswith('unix:'):
+            return _SocketReader(dest[5:])
+        if dest.startswith('shm:'):
+            return _RingReader(dest[4:])
+        return _FileReader(dest)
+
+    def read(self) -> Optional[Bundle]:
+        raise NotImplementedError
+
+    def __iter__(self) -> Iterator[Bundle]:
+        while True:
+            b = self.read()
+            if b is None:
+                return
+            yield b
+
+    def close(self):
+        pass
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+
+class _FileReader(BundleReader):
+    def __init__(self, path: str):
+        self._file = open(path, 'rb')
+
+    def _read_exactly(self, n: int) -> Optional[bytes]:
+        buf = self._file.read(n)
+        return buf if len(buf) == n else None
+
+    def read(self) -> Optional[Bundle]:
+        head = self._read_exactly(_HEADER.size)
+        if head is None:
+            return None
+        size = _HEADER.unpack_from(head)[1]
+        if head[:4] != MAGIC or size < _HEADER.size:
+            raise ValueError("lost bundle framing")
+        rest = self._read_exactly(size - _HEADER.size)
+        return parse(head + rest) if rest is not None else None
+
+    def close(self):
+        self._file.close()
+
+
+class _SocketReader(BundleReader):
+    def __init__(self, path: str):
+        self._sock = socket.socket(socket.AF_UNIX, socket.SOCK_SEQPACKET)
+        self._sock.connect(path)
+        self._buf = bytearray(MAX_RECORD)
+
+    def read(self) -> Optional[Bundle]:
+        n = self._sock.recv_into(self._buf)
+        return parse(memoryview(self._buf)[:n].tobytes()) if n else None
+
+    def close(self):
+        self._sock.close()
+
+
+class _RingReader(BundleReader):
+    """Newest record of the ring, waiting for the next one if already read"""
+
+    def __init__(self, name: str, poll_interval: float = 0.005):
+        self._file = open(os.path.join('/dev/shm', name), 'rb')
+        self._map = mmap.mmap(self._file.fileno(), 0, access=mmap.ACCESS_READ)
+        magic, self.slots, self.slot_size, _, _ = _RING.unpack_from(self._map)
+        if magic != RING_MAGIC:
+            raise ValueError("not a bundle ring")
+        self._poll = poll_interval
+        self._next = 0
+
+    def _head(self) -> int:
+        return struct.unpack_from('<Q', self._map, 16)[0]
+
+    def read(self) -> Optional[Bundle]:
+        while True:
+            head = self._head()
+            if head <= self._next:
+                time.sleep(self._poll)
+                continue
+            n = head - 1
+            slot = RING_HEADER + (n % self.slots) * self.slot_size
+            word = struct.unpack_from('<Q', self._map, slot)[0]
+            if word != 2 * n + 2:
+                continue
+            size = _HEADER.unpack_from(self._map, slot + SLOT_HEADER)[1]
+            record = self._map[slot + SLOT_HEADER:slot + SLOT_HEADER + min(size, self.slot_size - SLOT_HEADER)]
+            # Overwritten while copying: try the newer record
+            if struct.unpack_from('<Q', self._map, slot)[0] != word:
+                continue
+            self._next = head
+            return parse(record)
+
+    def close(self):
+        self._map.close()
+        self._file.close()
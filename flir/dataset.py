@@ -0,0 +1,401 @@
+"""
+Chunked array datasets for analysis.
+
+Recordings are exported as a Zarr v2 directory store, written without
+needing zarr itself: a group with the arrays
+
+    thermal        (frames, 60, 80) uint16   raw counts
+    time_estimate  (frames,) float64         seconds since the epoch, estimated
+    sequence       (frames,) uint32          packet number, from 1 as the driver counts
+    source         (frames,) uint16          index into the "sources" attribute
+
+and the calibration constants as group attributes.
+
+Neither a --capture file nor a Y16 file records when its frames were
+taken, so time_estimate is reconstructed: the last frame of a file is put
+at the file's modification time (its last write) and the others before
+it, spaced by the camera's device tick counter with --device-clock, or
+evenly at the nominal frame rate without. Treat it as an estimate, good
+for ordering and rough alignment, not as a capture time. Likewise the
+packets carry no sequence number of their own; the driver numbers them
+from 1 as they complete (frame_count), and so does the export, in file
+order. A capture appended to by several sessions is numbered straight
+through. Each array is cut into
+chunks of frames, stored one file per chunk, either raw or zlib compressed
+(Zarr's "zlib" codec). ``zarr.open(path)`` reads it as is; without zarr,
+``Dataset(path)`` opens it lazily: opening reads only the metadata, and
+indexing touches only the chunks it needs, memory-mapping raw chunks.
+
+    python3 -m flir.dataset export day1.raw day2.raw -o site.zarr --compress zlib
+    python3 -m flir.dataset export day3.raw -o site.zarr --append --device-clock 24:1000000
+
+    ds = Dataset('site.zarr')
+    ds.thermal[1000:1100].mean(axis=0)
+"""
+
+import argparse
+import json
+import os
+import sys
+import threading
+import time
+import zlib
+from collections import OrderedDict
+from typing import Dict, List, Optional
+
+import numpy as np
+
+from .batch import StealingPool
+from .frame_parser import THERMAL_WIDTH, THERMAL_HEIGHT
+from .recording import Recording
+from .thermal import ThermalContext
+
+DEFAULT_CHUNK = 1024
+
+# Decompressed chunks kept per array
+CHUNK_CACHE = 16
+
+_FRAME_SHAPE = (THERMAL_HEIGHT, THERMAL_WIDTH)
+_ARRAYS = {
+    "thermal": ("<u2", _FRAME_SHAPE),
+    "time_estimate": ("<f8", ()),
+    "sequence": ("<u4", ()),
+    "source": ("<u2", ()),
+}
+
+
+def _write_json(path: str, obj: dict):
+    tmp = path + '.tmp'
+    with open(tmp, 'w') as f:
+        json.dump(obj, f, indent=4)
+    os.replace(tmp, path)
+
+
+def _chunk_key(i: int, ndim: int) -> str:
+    return ".".join([str(i)] + ["0"] * (ndim - 1))
+
+
+class ChunkedArray:
+    """One array of the store, read lazily along the first axis."""
+
+    def __init__(self, path: str):
+        self.path = path
+        with open(os.path.join(path, '.zarray')) as f:
+            meta = json.load(f)
+        self.shape = tuple(meta["shape"])
+        self.dtype = np.dtype(meta["dtype"])
+        self.chunk = meta["chunks"][0]
+        self.compressor = (meta.get("compressor") or {}).get("id")
+        if self.compressor not in (None, "zlib"):
+            raise ValueError(f"{path}: unsupported compressor {self.compressor}")
+        self._cache = OrderedDict()
+        self._lock = threading.Lock()
+
+    def __len__(self):
+        return self.shape[0]
+
+    @property
+    def ndim(self):
+        return len(self.shape)
+
+    def _read_chunk(self, c: int) -> np.ndarray:
+        with self._lock:
+            arr = self._cache.get(c)
+            if arr is not None:
+                self._cache.move_to_end(c)
+                return arr
+        rows = min(self.chunk, self.shape[0] - c * self.chunk)
+        shape = (rows,) + self.shape[1:]
+        path = os.path.join(self.path, _chunk_key(c, self.ndim))
+        if not os.path.exists(path):
+            arr = np.zeros(shape, dtype=self.dtype)
+        elif self.compressor is None:
+            # Zarr writes edge chunks full size; only the valid rows are mapped
+            arr = np.memmap(path, dtype=self.dtype, mode='r', shape=shape)
+        else:
+            with open(path, 'rb') as f:
+                data = zlib.decompress(f.read())
+            arr = np.frombuffer(data, dtype=self.dtype)[:int(np.prod(shape))].reshape(shape)
+        with self._lock:
+            self._cache[c] = arr
+            while len(self._cache) > CHUNK_CACHE:
+                self._cache.popitem(last=False)
+        return arr
+
+    def _rows(self, start: int, stop: int) -> np.ndarray:
+        out = np.empty((stop - start,) + self.shape[1:], dtype=self.dtype)
+        pos = start
+        while pos < stop:
+            c = pos // self.chunk
+            end = min(stop, (c + 1) * self.chunk)
+            out[pos - start:end - start] = self._read_chunk(c)[pos - c * self.chunk:end - c * self.chunk]
+            pos = end
+        return out
+
+    def __getitem__(self, key):
+        rest = ()
+        if isinstance(key, tuple):
+            key, rest = key[0], key[1:]
+        n = self.shape[0]
+        if isinstance(key, (int, np.integer)):
+            i = int(key) + n if key < 0 else int(key)
+            if not 0 <= i < n:
+                raise IndexError(key)
+            c = i // self.chunk
+            return np.array(self._read_chunk(c)[(i - c * self.chunk,) + rest])
+        if isinstance(key, slice):
+            start, stop, step = key.indices(n)
+            if step == 1:
+                out = self._rows(start, max(start, stop))
+                return out[(slice(None),) + rest] if rest else out
+            key = np.arange(start, stop, step)
+        idx = np.asarray(key)
+        if idx.dtype == bool:
+            idx = np.flatnonzero(idx)
+        idx = np.where(idx < 0, idx + n, idx)
+        if idx.size and (idx.min() < 0 or idx.max() >= n):
+            raise IndexError("index out of range")
+        out = np.empty((idx.size,) + self.shape[1:], dtype=self.dtype)
+        chunks = idx // self.chunk
+        for c in np.unique(chunks):
+            sel = np.flatnonzero(chunks == c)
+            out[sel] = self._read_chunk(int(c))[idx[sel] - c * self.chunk]
+        return out[(slice(None),) + rest] if rest else out
+
+    def __array__(self, dtype=None):
+        arr = self[:]
+        return arr.astype(dtype) if dtype is not None else arr
+
+    def __repr__(self):
+        return f"ChunkedArray(shape={self.shape}, dtype={self.dtype}, chunk={self.chunk}, compressor={self.compressor})"
+
+
+class Dataset:
+    """An exported store opened lazily."""
+
+    def __init__(self, path: str):
+        self.path = path
+        with open(os.path.join(path, '.zattrs')) as f:
+            self.attrs = json.load(f)
+        self.thermal = ChunkedArray(os.path.join(path, 'thermal'))
+        self.time_estimate = ChunkedArray(os.path.join(path, 'time_estimate'))
+        self.sequence = ChunkedArray(os.path.join(path, 'sequence'))
+        self.source = ChunkedArray(os.path.join(path, 'source'))
+
+    def __len__(self):
+        return len(self.thermal)
+
+    @property
+    def sources(self) -> List[str]:
+        return self.attrs.get("sources", [])
+
+    def frames_between(self, t0: float, t1: float) -> slice:
+        """Frame range with t0 <= time_estimate < t1, for recordings exported
+        in chronological order. The binary search touches only log(n) chunks."""
+        def first_at_or_after(t, lo):
+            hi = len(self)
+            while lo < hi:
+                m = (lo + hi) // 2
+                if self.time_estimate[m] < t:
+                    lo = m + 1
+                else:
+                    hi = m
+            return lo
+        start = first_at_or_after(t0, 0)
+        return slice(start, first_at_or_after(t1, start))
+
+    def celsius(self, key) -> np.ndarray:
+        """Temperatures of the selected frames with the stored calibration."""
+        ctx = ThermalContext.__new__(ThermalContext)
+        ctx.config = dict(self.attrs["calibration"])
+        return ctx.lookup_table()[self.thermal[key]]
+
+
+# -- Export ------------------------------------------------------------------
+
+def _device_offsets(rec: Recording, offset: int, hz: float) -> np.ndarray:
+    """Seconds from the first packet by the LE32 tick counter at header byte
+    offset, as the driver's --device-clock reads it. A step that goes back
+    or jumps by more than a minute (the counter restarted, e.g. a capture
+    appended to by a new session) counts as one nominal frame period."""
+    data = np.frombuffer(rec._map, dtype=np.uint8)
+    pos = rec.index[:, 0].astype(np.int64)[:, None] + offset + np.arange(4)
+    ticks = data[pos].copy().view('<u4').ravel().astype(np.int64)
+    steps = np.diff(ticks) % (1 << 32) / hz
+    steps[(steps <= 0) | (steps > 60)] = 1 / rec.fps
+    return np.concatenate(([0.0], np.cumsum(steps)))
+
+
+class _Source:
+    """Frames of one recording with the side arrays the export needs."""
+
+    def __init__(self, rec: Recording, index: int, device_clock: Optional[tuple] = None):
+        self.rec = rec
+        self.index = index
+        self.frame_count = rec.frame_count
+        # Seconds from the first frame; the last one is at the end of the
+        # file's last write
+        self.offsets = None
+        if device_clock and not rec.is_y16 and rec.frame_count:
+            self.offsets = _device_offsets(rec, *device_clock)
+        span = self.offsets[-1] if self.offsets is not None else max(rec.frame_count - 1, 0) / rec.fps
+        self.start_time = os.stat(rec.path).st_mtime - span
+
+    def block(self, start: int, stop: int) -> Dict[str, np.ndarray]:
+        n = stop - start
+        if self.offsets is not None:
+            offsets = self.offsets[start:stop]
+        else:
+            offsets = np.arange(start, stop) / self.rec.fps
+        return {
+            "thermal": self.rec.thermal_block(start, stop),
+            "time_estimate": self.start_time + offsets,
+            "sequence": np.arange(start + 1, stop + 1, dtype=np.uint32),
+            "source": np.full(n, self.index, dtype=np.uint16),
+        }
+
+
+class _Tail:
+    """The partial last chunk of an existing store, rewritten on --append."""
+
+    def __init__(self, ds: Dataset, start: int):
+        self.ds = ds
+        self.start = start
+        self.frame_count = len(ds) - start
+
+    def block(self, start: int, stop: int) -> Dict[str, np.ndarray]:
+        s = slice(self.start + start, self.start + stop)
+        return {name: getattr(self.ds, name)[s] for name in _ARRAYS}
+
+
+def _write_meta(out: str, name: str, frames: int, chunk: int, compress: Optional[int]):
+    dtype, shape = _ARRAYS[name]
+    os.makedirs(os.path.join(out, name), exist_ok=True)
+    _write_json(os.path.join(out, name, '.zarray'), {
+        "zarr_format": 2,
+        "shape": [frames] + list(shape),
+        "chunks": [chunk] + list(shape),
+        "dtype": dtype,
+        "compressor": {"id": "zlib", "level": compress} if compress is not None else None,
+        "fill_value": 0,
+        "order": "C",
+        "filters": None,
+        "dimension_separator": ".",
+    })
+
+
+def export(paths: List[str], out: str, chunk: int = DEFAULT_CHUNK, compress: Optional[int] = None,
+           append: bool = False, workers: int = 1, ctx: Optional[ThermalContext] = None,
+           device_clock: Optional[tuple] = None) -> dict:
+    """Write (or extend, with append) a store from recordings. Chunks are
+    independent files, so they are read, compressed and written in parallel.
+    device_clock is (header offset, Hz) of the camera's tick counter."""
+    base = 0
+    attrs = {"fps": None, "sources": [], "calibration": (ctx or ThermalContext()).config}
+    sources = []
+    if append and os.path.exists(os.path.join(out, '.zattrs')):
+        # The store's own chunking and compression win over the arguments
+        ds = Dataset(out)
+        with open(os.path.join(out, 'thermal', '.zarray')) as f:
+            compress = (json.load(f).get("compressor") or {}).get("level")
+        chunk = ds.thermal.chunk
+        attrs = ds.attrs
+        base = len(ds) - len(ds) % chunk
+        if base < len(ds):
+            sources.append(_Tail(ds, base))
+    else:
+        os.makedirs(out, exist_ok=True)
+        _write_json(os.path.join(out, '.zgroup'), {"zarr_format": 2})
+
+    recordings = [Recording(p, cache_frames=0) for p in paths]
+    for rec in recordings:
+        sources.append(_Source(rec, len(attrs["sources"]), device_clock))
+        attrs["sources"].append(os.path.abspath(rec.path))
+        attrs["fps"] = rec.fps
+
+    # Global frame ranges of every source, then chunk-aligned work items
+    bounds = np.cumsum([0] + [s.frame_count for s in sources])
+    total = base + int(bounds[-1])
+    tasks = list(range(base // chunk, (total + chunk - 1) // chunk))
+
+    def write_chunk(c: int):
+        lo, hi = c * chunk - base, min(total, (c + 1) * chunk) - base
+        parts = []
+        for k, src in enumerate(sources):
+            a, b = max(lo, int(bounds[k])), min(hi, int(bounds[k + 1]))
+            if a < b:
+                parts.append(src.block(a - int(bounds[k]), b - int(bounds[k])))
+        for name, (dtype, _) in _ARRAYS.items():
+            data = np.ascontiguousarray(np.concatenate([p[name] for p in parts]), dtype=dtype)
+            if len(data) < chunk:
+                # Full-size edge chunks, as Zarr expects
+                pad = np.zeros((chunk,) + data.shape[1:], dtype=dtype)
+                pad[:len(data)] = data
+                data = pad
+            raw = data.tobytes()
+            path = os.path.join(out, name, _chunk_key(c, data.ndim))
+            with open(path + '.tmp', 'wb') as f:
+                f.write(zlib.compress(raw, compress) if compress is not None else raw)
+            os.replace(path + '.tmp', path)
+
+    for name in _ARRAYS:
+        os.makedirs(os.path.join(out, name), exist_ok=True)
+    t0 = time.monotonic()
+    StealingPool(workers).run(tasks, write_chunk)
+    elapsed = time.monotonic() - t0
+
+    # Metadata last: a reader never sees a shape beyond the written chunks
+    for name in _ARRAYS:
+        _write_meta(out, name, total, chunk, compress)
+    _write_json(os.path.join(out, '.zattrs'), attrs)
+    for rec in recordings:
+        rec.close()
+    added = sum(s.frame_count for s in sources if isinstance(s, _Source))
+    return {"frames": total, "added": added, "chunks": len(tasks), "seconds": round(elapsed, 3)}
+
+def main(argv: Optional[List[str]] = None):
+    parser = argparse.ArgumentParser(description="Export recordings as chunked arrays")
+    sub = parser.add_subparsers(dest='command', required=True)
+    ex = sub.add_parser('export', help="write or extend a store")
+    ex.add_argument('recordings', nargs='+', help="--capture files or Y16 files")
+    ex.add_argument('-o', '--output', required=True, metavar='DIR')
+    ex.add_argument('--chunk', type=int, default=DEFAULT_CHUNK, help="frames per chunk")
+    ex.add_argument('--compress', nargs='?', const='zlib', choices=['zlib'],
+                    help="compress chunks (not memory-mappable)")
+    ex.add_argument('--level', type=int, default=1, help="zlib level")
+    ex.add_argument('--append', action='store_true', help="add to an existing store")
+    ex.add_argument('--workers', type=int, default=os.cpu_count() or 1)
+    ex.add_argument('--serial', help="use the driver's cached calibration for this camera")
+    ex.add_argument('--device-clock', metavar='OFF:HZ',
+                    help="space frames by the LE32 tick counter at header byte OFF (rate HZ)")
+    info = sub.add_parser('info', help="describe a store")
+    info.add_argument('store')
+    args = parser.parse_args(argv)
+
+    if args.command == 'info':
+        ds = Dataset(args.store)
+        ts = ds.time_estimate
+        print(json.dumps({"frames": len(ds), "chunk": ds.thermal.chunk, "compressor": ds.thermal.compressor,
+                          "sources": ds.sources,
+                          "first": float(ts[0]) if len(ds) else None,
+                          "last": float(ts[-1]) if len(ds) else None}, indent=4))
+        return
+
+    if args.chunk < 1 or args.workers < 1:
+        parser.error("--chunk and --workers must be positive")
+    device_clock = None
+    if args.device_clock:
+        try:
+            off, hz = args.device_clock.split(':')
+            device_clock = (int(off), float(hz))
+        except ValueError:
+            parser.error("--device-clock takes OFF:HZ")
+        if not 4 <= device_clock[0] <= 24 or device_clock[1] <= 0:
+            parser.error("--device-clock: OFF must be 4..24 and HZ positive")
+    summary = export(args.recordings, args.output, args.chunk, args.level if args.compress else None,
+                     args.append, args.workers, ThermalContext(serial=args.serial), device_clock)
+    sys.stderr.write(json.dumps(summary) + "\n")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,186 @@
+"""
+Colourised thermal frames encoded straight from palette YCbCr.
+
+``cv2.imencode`` on a BGR image converts every pixel to YCbCr and sets up
+a libjpeg compressor for every frame. Here the palette is converted once:
+the 8-bit normalised frame indexes Y, Cb and Cr tables directly, whose
+entries are already repeated across a uint64 (uint32 for the half-size
+chroma), so the lookup also does the horizontal part of the nearest
+neighbour upscale; rows are then repeated. Every thermal pixel becomes an
+8x8 block, so 4:2:0 subsampling loses nothing but the edges of drawn
+overlays. The planes go to libjpeg-turbo's TurboJPEG API
+(``tjCompressFromYUVPlanes``) through one compressor handle and one output
+buffer kept for the life of the encoder.
+
+Without libturbojpeg (package libturbojpeg0 on Debian and Raspberry Pi OS)
+the same lookup makes full-size B, G and R planes for ``cv2.imencode``.
+"""
+
+import ctypes
+import ctypes.util
+from typing import Callable, Sequence, Tuple
+
+import cv2
+import numpy as np
+
+TJSAMP_420 = 2
+TJFLAG_NOREALLOC = 1024
+TJFLAG_FASTDCT = 2048
+
+Planes = Tuple[np.ndarray, np.ndarray, np.ndarray]
+
+# Integer types as wide as a run of 2, 4 or 8 samples, and their 0x01 bytes
+_WIDE = {1: np.uint8, 2: np.uint16, 4: np.uint32, 8: np.uint64}
+_ONES = {1: 0x01, 2: 0x0101, 4: 0x01010101, 8: 0x0101010101010101}
+
+
+def _load_turbojpeg():
+    for name in (ctypes.util.find_library('turbojpeg'), 'libturbojpeg.so.0'):
+        if not name:
+            continue
+        try:
+            lib = ctypes.CDLL(name)
+        except OSError:
+            continue
+        lib.tjInitCompress.restype = ctypes.c_void_p
+        lib.tjDestroy.argtypes = [ctypes.c_void_p]
+        lib.tjBufSize.restype = ctypes.c_ulong
+        lib.tjBufSize.argtypes = [ctypes.c_int, ctypes.c_int, ctypes.c_int]
+        lib.tjCompressFromYUVPlanes.argtypes = [
+            ctypes.c_void_p, ctypes.POINTER(ctypes.c_void_p), ctypes.c_int, ctypes.POINTER(ctypes.c_int),
+            ctypes.c_int, ctypes.c_int, ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_ulong),
+            ctypes.c_int, ctypes.c_int]
+        lib.tjGetErrorStr2.restype = ctypes.c_char_p
+        lib.tjGetErrorStr2.argtypes = [ctypes.c_void_p]
+        return lib
+    return None
+
+
+_tj = _load_turbojpeg()
+
+
+def rgb_to_ycbcr(rgb: np.ndarray) -> np.ndarray:
+    """JFIF (full range BT.601) YCbCr of RGB values, rounded, as uint8."""
+    rgb = np.asarray(rgb, dtype=np.float32)
+    r, g, b = rgb[..., 0], rgb[..., 1], rgb[..., 2]
+    y = 0.299 * r + 0.587 * g + 0.114 * b
+    cb = 128 - 0.168736 * r - 0.331264 * g + 0.5 * b
+    cr = 128 + 0.5 * r - 0.418688 * g - 0.081312 * b
+    return np.clip(np.rint(np.stack([y, cb, cr], axis=-1)), 0, 255).astype(np.uint8)
+
+
+class ThermalJpegEncoder:
+    """Palette lookup, upscale and JPEG encode of 8-bit thermal frames.
+
+    The frame is enlarged by scale (2, 4 or 8; 8 makes 640x480 from 80x60).
+    Not thread-safe: give each stream its own encoder.
+    """
+
+    def __init__(self, scale: int = 8, quality: int = 95):
+        if scale not in _WIDE:
+            raise ValueError("scale must be 2, 4 or 8")
+        self.scale = scale
+        self.quality = quality
+        self._palette = None
+        self._lut = None
+        self._handle = _tj.tjInitCompress() if _tj else None
+        self._buf = None
+        self._size = ctypes.c_ulong(0)
+        self._planes = (ctypes.c_void_p * 3)()
+        self._shape = None
+        self._out = None
+
+    @property
+    def turbojpeg(self) -> bool:
+        return self._handle is not None
+
+    def set_palette(self, palette: np.ndarray):
+        """Use an RGB palette of shape (256, 3). Cheap if it is unchanged."""
+        if self._palette is palette:
+            return
+        self._palette = palette
+        # Each entry repeated across a wider integer: one lookup writes a
+        # whole run of identical samples
+        s = self.scale
+        if self._handle:
+            ycc = rgb_to_ycbcr(palette)
+            self._lut = [(ycc[:, 0], s), (ycc[:, 1], s // 2), (ycc[:, 2], s // 2)]
+        else:
+            rgb = np.asarray(palette, dtype=np.uint8)
+            self._lut = [(rgb[:, 2], s), (rgb[:, 1], s), (rgb[:, 0], s)]
+        self._lut = [(lut.astype(_WIDE[n]) * _WIDE[n](_ONES[n]), n) for lut, n in self._lut]
+        self._out = None
+
+    def planes(self, norm: np.ndarray) -> Planes:
+        """Y at scale, Cb and Cr at half of it, from an 8-bit frame; B, G
+        and R all at scale without libturbojpeg. The planes are reused by
+        the next call."""
+        if self._out is None or self._out[0].shape[0] != norm.shape[0]:
+            # Fresh arrays of this size would fault in new pages every frame
+            self._out = [np.empty((norm.shape[0], n, norm.shape[1]), lut.dtype) for lut, n in self._lut]
+        for (lut, n), out in zip(self._lut, self._out):
+            out[...] = lut[norm][:, None, :]
+        return tuple(out.reshape(out.shape[0] * out.shape[1], -1).view(np.uint8) for out in self._out)
+
+    def encode(self, planes: Planes) -> bytes:
+        """JPEG of the planes returned by planes(), overlays drawn or not."""
+        height, width = planes[0].shape
+        if not self._handle:
+            ok, buf = cv2.imencode('.jpg', cv2.merge(planes), [cv2.IMWRITE_JPEG_QUALITY, self.quality])
+            return buf.tobytes()
+
+        if self._shape != (height, width):
+            self._shape = (height, width)
+            self._buf = ctypes.create_string_buffer(_tj.tjBufSize(width, height, TJSAMP_420))
+            self._strides = (ctypes.c_int * 3)(width, width // 2, width // 2)
+        buf_ptr = ctypes.c_void_p(ctypes.addressof(self._buf))
+        for i, p in enumerate(planes):
+            self._planes[i] = p.ctypes.data
+        if _tj.tjCompressFromYUVPlanes(self._handle, self._planes, width, self._strides, height, TJSAMP_420,
+                                       ctypes.byref(buf_ptr), ctypes.byref(self._size), self.quality,
+                                       TJFLAG_NOREALLOC | TJFLAG_FASTDCT) != 0:
+            raise RuntimeError(_tj.tjGetErrorStr2(self._handle).decode(errors='replace'))
+        return ctypes.string_at(self._buf, self._size.value)
+
+    def close(self):
+        if self._handle:
+            _tj.tjDestroy(self._handle)
+            self._handle = None
+
+    def __del__(self):
+        self.close()
+
+
+def draw(planes: Planes, bgr: Sequence[int], fn: Callable[[np.ndarray, int, float], None]):
+    """Draw an overlay in a BGR colour on the planes of an encoder.
+
+    fn(image, value, scale) draws on one plane in one channel value; it is
+    called for Y at scale 1 and for Cb and Cr at scale 0.5, where
+    coordinates, sizes and thicknesses must be halved. Planes of equal size
+    are B, G and R, all drawn at scale 1.
+    """
+    if planes[1].shape == planes[0].shape:
+        for plane, value in zip(planes, bgr):
+            fn(plane, int(value), 1.0)
+        return
+    y, cb, cr = rgb_to_ycbcr(np.array(bgr[::-1]))
+    fn(planes[0], int(y), 1.0)
+    fn(planes[1], int(cb), 0.5)
+    fn(planes[2], int(cr), 0.5)
+
+
+def draw_text(planes: Planes, text: str, org: Tuple[int, int], scale: float, bgr: Sequence[int],
+              thickness: int, font: int = cv2.FONT_HERSHEY_SIMPLEX):
+    draw(planes, bgr, lambda img, v, s: cv2.putText(
+        img, text, (int(org[0] * s), int(org[1] * s)), font, scale * s, v, max(1, round(thickness * s))))
+
+
+def draw_circle(planes: Planes, center: Tuple[int, int], radius: int, bgr: Sequence[int], thickness: int):
+    draw(planes, bgr, lambda img, v, s: cv2.circle(
+        img, (int(center[0] * s), int(center[1] * s)), max(1, round(radius * s)), v, max(1, round(thickness * s))))
+
+
+def draw_marker(planes: Planes, pos: Tuple[int, int], bgr: Sequence[int], marker: int, size: int,
+                thickness: int):
+    draw(planes, bgr, lambda img, v, s: cv2.drawMarker(
+        img, (int(pos[0] * s), int(pos[1] * s)), v, marker, max(1, round(size * s)), max(1, round(thickness * s))))
@@ -0,0 +1,358 @@
+"""
+Recorded sessions: random access and playback.
+
+A recording is either a raw EP 0x85 capture (``flirone --capture FILE``,
+or ``examples/fake_camera.py``), holding complete camera packets with
+thermal, visible JPEG and status, or a plain Y16 file as written by the
+driver's thermal output (80x60 little-endian frames back to back). A
+capture need not start on a packet header (``--capture`` appends raw
+transfers, e.g. after a takeover), so the kind is decided by looking for
+packets rather than by the first bytes; ``format=`` overrides it.
+
+Opening a capture builds a frame index once by hopping from header to
+header; it is saved next to the file (``FILE.idx.npy``) so reopening even
+hours of data is immediate. Frames are read through mmap, decoded frames
+are kept in an LRU cache, and a readahead thread decodes the frames a
+Player is about to show.
+"""
+
+import json
+import mmap
+import os
+import struct
+import threading
+import time
+from collections import OrderedDict
+from typing import Optional
+
+import numpy as np
+
+from .frame_parser import MAGIC_BYTES, HEADER_SIZE, THERMAL_WIDTH, THERMAL_HEIGHT
+
+# Thermal block layout inside a packet (same as the C driver)
+LINE_STRIDE = 82
+LINE_OFFSET = 32
+
+# Bytes the thermal lines span: the last line ends after its 80 pixels, so a
+# camera may send a block without the last line's padding
+THERMAL_BYTES = (LINE_STRIDE * (THERMAL_HEIGHT - 1) + THERMAL_WIDTH) * 2
+
+# Frame rate of the camera, used when a recording has no timestamps
+DEFAULT_FPS = 8.7
+
+Y16_FRAME_BYTES = THERMAL_WIDTH * THERMAL_HEIGHT * 2
+
+# Index columns: packet offset, thermal size, JPEG size, frame size
+_INDEX_COLUMNS = 4
+
+# A capture has a packet header within this many bytes of its start
+_PROBE_BYTES = 1 << 20
+
+
+class Recording:
+    """Random access to the frames of a recorded session."""
+
+    def __init__(self, path: str, cache_frames: int = 512, fps: float = DEFAULT_FPS,
+                 format: Optional[str] = None):
+        """format is 'capture', 'y16' or None to tell them apart."""
+        if format not in (None, 'capture', 'y16'):
+            raise ValueError(f"unknown recording format {format!r}")
+        self.path = path
+        self.fps = fps
+        self._file = open(path, 'rb')
+        size = os.fstat(self._file.fileno()).st_size
+        self._map = mmap.mmap(self._file.fileno(), 0, access=mmap.ACCESS_READ) if size else b''
+
+        self.index = None
+        if format == 'capture' or (format is None and (size == 0 or self._map.find(MAGIC_BYTES, 0, _PROBE_BYTES) >= 0)):
+            index = self._load_index(size)
+            # The magic alone may turn up in thermal data: only packets count
+            if len(index) or format == 'capture' or size == 0:
+                self.index = index
+        if self.index is None and format is None and size % Y16_FRAME_BYTES:
+            self.close()
+            raise ValueError(f"{path}: no camera packets, and not whole Y16 frames either")
+
+        self.is_y16 = self.index is None
+        self.frame_count = size // Y16_FRAME_BYTES if self.is_y16 else len(self.index)
+
+        self._cache = OrderedDict()
+        self._cache_frames = cache_frames
+        self._lock = threading.Lock()
+        self.hits = 0
+        self.misses = 0
+
+    # -- Index ---------------------------------------------------------------
+
+    def _index_path(self) -> str:
+        return self.path + '.idx.npy'
+
+    def _load_index(self, size: int) -> np.ndarray:
+        """Cached index if it matches the file, else a fresh scan."""
+        st = os.stat(self.path)
+        try:
+            cached = np.load(self._index_path())
+            # First row: file size and mtime the index was built for
+            if cached[0, 0] == st.st_size and cached[0, 1] == int(st.st_mtime):
+                return cached[1:]
+        except (OSError, ValueError, IndexError):
+            pass
+
+        index = self._scan(size)
+        header = np.array([[st.st_size, int(st.st_mtime), 0, 0]], dtype=np.int64)
+        try:
+            np.save(self._index_path(), np.vstack([header, index]))
+        except OSError:
+            pass  # read-only location: rescan next time
+        return index
+
+    def _scan(self, size: int) -> np.ndarray:
+        """Hop header to header, resyncing on the magic after garbage."""
+        rows = []
+        m = self._map
+        pos = 0
+        while pos + HEADER_SIZE <= size:
+            if m[pos:pos + 4] != MAGIC_BYTES:
+                pos = m.find(MAGIC_BYTES, pos + 1)
+                if pos < 0:
+                    break
+                continue
+            frame_size, thermal_size, jpeg_size = struct.unpack_from('<III', m, pos + 8)
+            end = pos + HEADER_SIZE + frame_size
+            if end > size or thermal_size + jpeg_size > frame_size:
+                pos = m.find(MAGIC_BYTES, pos + 1)
+                if pos < 0:
+                    break
+                continue
+            rows.append((pos, thermal_size, jpeg_size, frame_size))
+            pos = end
+        return np.array(rows, dtype=np.int64).reshape(-1, _INDEX_COLUMNS)
+
+    # -- Frame access --------------------------------------------------------
+
+    def _clamp(self, i: int) -> int:
+        return max(0, min(self.frame_count - 1, int(i)))
+
+    def _decode_thermal(self, i: int) -> np.ndarray:
+        if self.is_y16:
+            off = i * Y16_FRAME_BYTES
+            return np.frombuffer(self._map, dtype='<u2', count=THERMAL_WIDTH * THERMAL_HEIGHT,
+                                 offset=off).reshape(THERMAL_HEIGHT, THERMAL_WIDTH).copy()
+        pos, thermal_size = int(self.index[i, 0]), int(self.index[i, 1])
+        if thermal_size < LINE_OFFSET - HEADER_SIZE + THERMAL_BYTES:
+            return np.zeros((THERMAL_HEIGHT, THERMAL_WIDTH), dtype=np.uint16)
+        words = np.frombuffer(self._map, dtype='<u2', count=THERMAL_BYTES // 2, offset=pos + LINE_OFFSET)
+        return np.lib.stride_tricks.as_strided(words, (THERMAL_HEIGHT, THERMAL_WIDTH),
+                                               (LINE_STRIDE * 2, 2), writeable=False).copy()
+
+    def thermal(self, i: int) -> np.ndarray:
+        """Raw 16-bit counts of frame i (80x60), decoded once and cached."""
+        i = self._clamp(i)
+        with self._lock:
+            frame = self._cache.get(i)
+            if frame is not None:
+                self._cache.move_to_end(i)
+                self.hits += 1
+                return frame
+            self.misses += 1
+        frame = self._decode_thermal(i)
+        frame.flags.writeable = False
+        with self._lock:
+            self._cache[i] = frame
+            while len(self._cache) > self._cache_frames:
+                self._cache.popitem(last=False)
+        return frame
+
+    def thermal_block(self, start: int, stop: int) -> np.ndarray:
+        """Frames start..stop-1 as one (n, 60, 80) array, bypassing the cache
+        (for batch processing)."""
+        start, stop = max(0, start), min(self.frame_count, stop)
+        if stop <= start:
+            return np.zeros((0, THERMAL_HEIGHT, THERMAL_WIDTH), dtype=np.uint16)
+        if self.is_y16:
+            return np.frombuffer(self._map, dtype='<u2', count=(stop - start) * THERMAL_WIDTH * THERMAL_HEIGHT,
+                                 offset=start * Y16_FRAME_BYTES).reshape(-1, THERMAL_HEIGHT, THERMAL_WIDTH).copy()
+        rows = self.index[start:stop]
+        block = THERMAL_BYTES
+        whole = rows[:, 1] >= LINE_OFFSET - HEADER_SIZE + block
+        data = np.frombuffer(self._map, dtype=np.uint8)
+        # Every block start as a row of a (len, block) byte view: one fancy
+        # index copies all blocks of the range, whatever their alignment
+        windows = np.lib.stride_tricks.as_strided(data, (max(0, len(data) - block + 1), block), (1, 1),
+                                                  writeable=False)
+        raw = np.zeros((stop - start, block), dtype=np.uint8)
+        raw[whole] = windows[rows[whole, 0] + LINE_OFFSET]
+        return np.lib.stride_tricks.as_strided(raw.view('<u2'), (stop - start, THERMAL_HEIGHT, THERMAL_WIDTH),
+                                               (block, LINE_STRIDE * 2, 2), writeable=False).copy()
+
+    def cached(self, i: int) -> bool:
+        with self._lock:
+            return i in self._cache
+
+    def jpeg(self, i: int) -> Optional[bytes]:
+        """Visible JPEG of frame i as recorded (no re-encoding), or None."""
+        if self.is_y16:
+            return None
+        i = self._clamp(i)
+        pos, thermal_size, jpeg_size = (int(v) for v in self.index[i, :3])
+        if jpeg_size == 0:
+            return None
+        start = pos + HEADER_SIZE + thermal_size
+        return bytes(self._map[start:start + jpeg_size])
+
+    def status(self, i: int) -> Optional[dict]:
+        """Parsed status block of frame i, or None."""
+        if self.is_y16:
+            return None
+        i = self._clamp(i)
+        pos, thermal_size, jpeg_size, frame_size = (int(v) for v in self.index[i])
+        start = pos + HEADER_SIZE + thermal_size + jpeg_size
+        block = bytes(self._map[start:pos + HEADER_SIZE + frame_size]).split(b'\x00', 1)[0]
+        try:
+            return json.loads(block) if block else None
+        except ValueError:
+            return None
+
+    def header(self, i: int) -> Optional[bytes]:
+        if self.is_y16:
+            return None
+        pos = int(self.index[self._clamp(i), 0])
+        return bytes(self._map[pos:pos + HEADER_SIZE])
+
+    @property
+    def duration(self) -> float:
+        return self.frame_count / self.fps
+
+    def close(self):
+        if isinstance(self._map, mmap.mmap):
+            self._map.close()
+        self._file.close()
+
+    def __len__(self):
+        return self.frame_count
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_val, exc_tb):
+        self.close()
+
+
+class Player:
+    """Playback position over a Recording: seek, scrub and variable speed.
+
+    The position follows the wall clock (position = anchor + elapsed * fps *
+    speed), so any number of viewers see the same frame. A readahead thread
+    keeps the next frames in the playing direction decoded.
+    """
+
+    def __init__(self, recording: Recording, readahead: int = 64, loop: bool = True):
+        self.rec = recording
+        self.readahead = readahead
+        self.loop = loop
+        self.speed = 1.0
+        self.paused = False
+        self._anchor_pos = 0.0
+        self._anchor_time = time.monotonic()
+        self._lock = threading.Lock()
+        self._wake = threading.Event()
+        self._running = True
+        self._thread = threading.Thread(target=self._readahead, daemon=True)
+        self._thread.start()
+
+    def _position_locked(self) -> float:
+        pos = self._anchor_pos
+        if not self.paused:
+            pos += (time.monotonic() - self._anchor_time) * self.rec.fps * self.speed
+        n = self.rec.frame_count
+        if n == 0:
+            return 0.0
+        if self.loop:
+            return pos % n
+        return max(0.0, min(n - 1.0, pos))
+
+    def _reanchor(self):
+        self._anchor_pos = self._position_locked()
+        self._anchor_time = time.monotonic()
+
+    def position(self) -> int:
+        with self._lock:
+            return int(self._position_locked())
+
+    def seek(self, frame: float):
+        with self._lock:
+            self._anchor_pos = max(0.0, min(self.rec.frame_count - 1.0, float(frame)))
+            self._anchor_time = time.monotonic()
+        self._wake.set()
+
+    def seek_time(self, seconds: float):
+        self.seek(seconds * self.rec.fps)
+
+    def step(self, frames: int):
+        """Pause and move by whole frames (frame-by-frame scrubbing)."""
+        with self._lock:
+            self._reanchor()
+            self.paused = True
+            self._anchor_pos = float(max(0, min(self.rec.frame_count - 1, int(self._anchor_pos) + frames)))
+        self._wake.set()
+
+    def play(self, speed: Optional[float] = None):
+        with self._lock:
+            self._reanchor()
+            if speed is not None:
+                self.speed = float(speed)
+            self.paused = False
+        self._wake.set()
+
+    def pause(self):
+        with self._lock:
+            self._reanchor()
+            self.paused = True
+
+    def frame_interval(self) -> float:
+        """Seconds until the displayed frame changes"""
+        with self._lock:
+            if self.paused or self.speed == 0:
+                return 0.05
+            return max(0.01, min(0.5, 1.0 / (self.rec.fps * abs(self.speed))))
+
+    def state(self) -> dict:
+        with self._lock:
+            pos = self._position_locked()
+            return {
+                "path": self.rec.path,
+                "frame": int(pos),
+                "frames": self.rec.frame_count,
+                "time": pos / self.rec.fps,
+                "duration": self.rec.duration,
+                "fps": self.rec.fps,
+                "speed": self.speed,
+                "paused": self.paused,
+                "visible": not self.rec.is_y16,
+                "cache_hits": self.rec.hits,
+                "cache_misses": self.rec.misses,
+            }
+
+    def _readahead(self):
+        while self._running:
+            with self._lock:
+                pos = int(self._position_locked())
+                direction = -1 if self.speed < 0 else 1
+            n = self.rec.frame_count
+            for k in range(self.readahead):
+                i = pos + direction * k
+                if self.loop and n:
+                    i %= n
+                if not 0 <= i < n:
+                    break
+                if not self.rec.cached(i):
+                    self.rec.thermal(i)
+                if self._wake.is_set():
+                    break
+            self._wake.wait(0.1)
+            self._wake.clear()
+
+    def stop(self):
+        self._running = False
+        self._wake.set()
+        self._thread.join()
@@ -0,0 +1,182 @@
+"""
+Radiometric JPEGs in the FLIR layout.
+
+The visible JPEG is kept byte for byte; FLIR APP1 segments holding an FFF
+container are inserted after SOI/APP0. The container has a RawData record
+(raw 16-bit counts) and a CameraInfo record (Planck constants, emissivity,
+reflected temperature, serial), which is what FLIR Tools and ExifTool
+(``-RawThermalImage``, ``-PlanckR1`` ...) read. Same layout as the driver's
+``--snapshot-dir`` output (driver/rjpeg.c).
+"""
+
+import os
+import struct
+import time
+from typing import Optional
+
+import numpy as np
+
+FFF_HEADER_SIZE = 0x40
+FFF_ENTRY_SIZE = 0x20
+FFF_VERSION = 100
+
+REC_RAWDATA = 0x01
+REC_CAMERAINFO = 0x20
+
+RAW_DATA_OFFSET = 0x20
+CAMERAINFO_SIZE = 0x400
+
+# APP1 payload: "FLIR\0", 0x01, segment index, last segment index, data
+APP1_FLIR_HEADER = 8
+APP1_MAX_DATA = 65533 - APP1_FLIR_HEADER
+
+CAMERA_MODEL = "FLIR ONE Pro LT"
+
+# CameraInfo fields: offset, struct format, config key (temperatures in K)
+_CAMERAINFO = [
+    (0x20, '<f', 'Emissivity'),
+    (0x24, '<f', 'ObjectDistance'),
+    (0x28, '<f', 'ReflectedApparentTemperature'),
+    (0x2c, '<f', 'AtmosphericTemperature'),
+    (0x30, '<f', 'IRWindowTemperature'),
+    (0x34, '<f', 'IRWindowTransmission'),
+    (0x3c, '<f', 'RelativeHumidity'),
+    (0x58, '<f', 'PlanckR1'),
+    (0x5c, '<f', 'PlanckB'),
+    (0x60, '<f', 'PlanckF'),
+    (0x70, '<f', 'AtmosphericTransAlpha1'),
+    (0x74, '<f', 'AtmosphericTransAlpha2'),
+    (0x78, '<f', 'AtmosphericTransBeta1'),
+    (0x7c, '<f', 'AtmosphericTransBeta2'),
+    (0x80, '<f', 'AtmosphericTransX'),
+    (0x308, '<i', 'PlanckO'),
+    (0x30c, '<f', 'PlanckR2'),
+    (0x310, '<H', 'RawValueRangeMin'),
+    (0x312, '<H', 'RawValueRangeMax'),
+]
+_KELVIN = {'ReflectedApparentTemperature', 'AtmosphericTemperature', 'IRWindowTemperature'}
+
+
+def build_fff(raw: np.ndarray, config: dict, serial: str = "", when: Optional[float] = None) -> bytes:
+    """FFF container for one frame of raw counts and a camera_config.json
+    style dict (temperatures in Celsius)."""
+    raw = np.asarray(raw, dtype='<u2')
+    height, width = raw.shape
+    raw_size = RAW_DATA_OFFSET + raw.nbytes
+    directory = FFF_HEADER_SIZE
+    raw_off = directory + 2 * FFF_ENTRY_SIZE
+    info_off = raw_off + raw_size
+
+    out = bytearray(info_off + CAMERAINFO_SIZE)
+    out[0:4] = b'FFF\0'
+    out[4:12] = b'flirone\0'
+    struct.pack_into('>IIII', out, 0x14, FFF_VERSION, directory, 2, 3)
+    struct.pack_into('>HHIIII', out, directory, REC_RAWDATA, 2, FFF_VERSION, 1, raw_off, raw_size)
+    struct.pack_into('>HHIIII', out, directory + FFF_ENTRY_SIZE, REC_CAMERAINFO, 1, FFF_VERSION, 2,
+                     info_off, CAMERAINFO_SIZE)
+
+    struct.pack_into('<HHH', out, raw_off, 2, width, height)
+    out[raw_off + RAW_DATA_OFFSET:info_off] = raw.tobytes()
+
+    refl = float(config.get("ReflectedApparentTemperature", 20.0))
+    values = {
+        'Emissivity': config.get("Emissivity", 0.95),
+        'ObjectDistance': config.get("ObjectDistance", 1.0),
+        'ReflectedApparentTemperature': refl,
+        'AtmosphericTemperature': config.get("AtmosphericTemperature", refl),
+        'IRWindowTemperature': config.get("IRWindowTemperature", refl),
+        'IRWindowTransmission': config.get("IRWindowTransmission", 1.0),
+        'RelativeHumidity': config.get("RelativeHumidity", 0.5),
+        'PlanckR1': config.get("PlanckR1", 0),
+        'PlanckB': config.get("PlanckB", 0),
+        'PlanckF': config.get("PlanckF", 1.0),
+        # Atmospheric transmission defaults used by FLIR cameras
+        'AtmosphericTransAlpha1': 0.006569,
+        'AtmosphericTransAlpha2': 0.01262,
+        'AtmosphericTransBeta1': -0.002276,
+        'AtmosphericTransBeta2': -0.00667,
+        'AtmosphericTransX': 1.9,
+        'PlanckO': int(round(config.get("PlanckO", 0))),
+        'PlanckR2': config.get("PlanckR2", 1.0),
+        'RawValueRangeMin': int(raw.min()) if raw.size else 0,
+        'RawValueRangeMax': int(raw.max()) if raw.size else 0,
+    }
+    struct.pack_into('<H', out, info_off, 2)
+    for off, fmt, key in _CAMERAINFO:
+        v = values[key] + 273.15 if key in _KELVIN else values[key]
+        struct.pack_into(fmt, out, info_off + off, v)
+    out[info_off + 0xd4:info_off + 0xd4 + len(CAMERA_MODEL)] = CAMERA_MODEL.encode()
+    out[info_off + 0x104:info_off + 0x104 + 15] = serial.encode()[:15].ljust(15, b'\0')
+    struct.pack_into('<I', out, info_off + 0x384, int(time.time() if when is None else when))
+    return bytes(out)
+
+
+def _insert_point(jpeg: bytes) -> int:
+    """Length of SOI plus any APP0 segments right after it"""
+    if jpeg[:2] != b'\xff\xd8':
+        raise ValueError("not a JPEG")
+    pos = 2
+    while jpeg[pos:pos + 2] == b'\xff\xe0' and pos + 4 <= len(jpeg):
+        pos += 2 + struct.unpack_from('>H', jpeg, pos + 2)[0]
+    return pos
+
+
+def radiometric_jpeg(jpeg: bytes, raw: np.ndarray, config: dict, serial: str = "",
+                     when: Optional[float] = None) -> bytes:
+    """The visible JPEG with the FLIR APP1 segments spliced in (no re-encoding)."""
+    head = _insert_point(jpeg)
+    fff = build_fff(raw, config, serial, when)
+    n = (len(fff) + APP1_MAX_DATA - 1) // APP1_MAX_DATA
+    parts = [jpeg[:head]]
+    for i in range(n):
+        chunk = fff[i * APP1_MAX_DATA:(i + 1) * APP1_MAX_DATA]
+        parts.append(struct.pack('>HH', 0xFFE1, 2 + APP1_FLIR_HEADER + len(chunk)))
+        parts.append(b'FLIR\0\x01' + bytes((i, n - 1)))
+        parts.append(chunk)
+    parts.append(jpeg[head:])
+    return b''.join(parts)
+
+
+def write_radiometric_jpeg(path: str, jpeg: bytes, raw: np.ndarray, config: dict, serial: str = "",
+                           when: Optional[float] = None):
+    """Write atomically (temporary file and rename)."""
+    data = radiometric_jpeg(jpeg, raw, config, serial, when)
+    tmp = path + '.tmp'
+    with open(tmp, 'wb') as f:
+        f.write(data)
+    os.replace(tmp, path)
+
+
+def read_radiometric_jpeg(data: bytes) -> dict:
+    """Raw counts and CameraInfo fields of a FLIR radiometric JPEG.
+    Returns {"raw": array, "serial": str, "model": str, <CameraInfo keys>}
+    with temperatures converted back to Celsius."""
+    fff = bytearray()
+    pos = 2
+    while pos + 4 <= len(data) and data[pos] == 0xFF:
+        marker = data[pos + 1]
+        if marker == 0xDA:      # start of scan: no more metadata
+            break
+        length = struct.unpack_from('>H', data, pos + 2)[0]
+        payload = data[pos + 4:pos + 2 + length]
+        if marker == 0xE1 and payload[:5] == b'FLIR\0':
+            fff += payload[APP1_FLIR_HEADER:]
+        pos += 2 + length
+    if fff[:4] != b'FFF\0':
+        raise ValueError("no FLIR FFF data")
+
+    directory, entries = struct.unpack_from('>II', fff, 0x18)
+    result = {}
+    for k in range(entries):
+        rtype, _, _, _, off, length = struct.unpack_from('>HHIIII', fff, directory + k * FFF_ENTRY_SIZE)
+        if rtype == REC_RAWDATA:
+            width, height = struct.unpack_from('<HH', fff, off + 2)
+            result["raw"] = np.frombuffer(bytes(fff[off + RAW_DATA_OFFSET:off + RAW_DATA_OFFSET + width * height * 2]),
+                                          dtype='<u2').reshape(height, width)
+        elif rtype == REC_CAMERAINFO:
+            for field_off, fmt, key in _CAMERAINFO:
+                v = struct.unpack_from(fmt, fff, off + field_off)[0]
+                result[key] = v - 273.15 if key in _KELVIN else v
+            result["model"] = bytes(fff[off + 0xd4:off + 0xd4 + 32]).split(b'\0', 1)[0].decode(errors='replace')
+            result["serial"] = bytes(fff[off + 0x104:off + 0x104 + 16]).split(b'\0', 1)[0].decode(errors='replace')
+    return result
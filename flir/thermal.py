@@ -4,7 +4,7 @@ import os
 import sys
 
 class ThermalContext:
-    def __init__(self, config_path='camera_config.json'):
+    def __init__(self, config_path='camera_config.json', serial=None):
         self.config = {
             "PlanckR1": 21106.77,
             "PlanckB": 1506.8,
@@ -15,8 +15,9 @@ class ThermalContext:
         }
         
         # Try to load custom config
-        # Look in CWD and project root
-        paths = [
+        # Factory constants cached by the driver come first (calibration/<serial>.json),
+        # then camera_config.json in CWD and project root
+        paths = self._calibration_cache(serial or os.environ.get('FLIR_SERIAL')) + [
             os.path.abspath(config_path), 
             os.path.abspath(os.path.join(os.path.dirname(__file__), '..', 'camera_config.json'))
         ]
@@ -41,6 +42,22 @@ class ThermalContext:
             
         sys.stderr.write(f"Active PlanckO: {self.config['PlanckO']}\n")
 
+    @staticmethod
+    def _calibration_cache(serial):
+        """Driver cache files to try. Without a serial, a lone cached camera is used."""
+        dirs = [os.path.abspath('calibration'),
+                os.path.abspath(os.path.join(os.path.dirname(__file__), '..', 'driver', 'calibration'))]
+        for d in dirs:
+            if serial:
+                path = os.path.join(d, f"{serial}.json")
+                if os.path.exists(path):
+                    return [path]
+            elif os.path.isdir(d):
+                cached = [f for f in os.listdir(d) if f.endswith('.json')]
+                if len(cached) == 1:
+                    return [os.path.join(d, cached[0])]
+        return []
+
     def raw2temp(self, raw_counts):
         """
         Convert raw 16-bit sensor values to temperature in Celsius.
@@ -115,3 +132,16 @@ class ThermalContext:
         temp_c = temp_k - 273.15
         
         return temp_c
+
+    def lookup_table(self):
+        """Celsius for every possible raw value (65536 float32 entries).
+
+        Converting a frame is then a single gather, temps = lut[raw], which
+        numpy runs without the GIL; the table follows the current config.
+        """
+        key = tuple(self.config.get(k) for k in ("PlanckR1", "PlanckB", "PlanckF", "PlanckO",
+                                                  "Emissivity", "ReflectedApparentTemperature"))
+        if getattr(self, "_lut_key", None) != key:
+            self._lut = self.raw2temp(np.arange(65536, dtype=np.float32)).astype(np.float32)
+            self._lut_key = key
+        return self._lut
@@ -39,28 +39,20 @@ if [ "$EUID" -ne 0 ]; then
   ( while true; do sudo -n true; sleep 60; kill -0 "$$" || exit; done 2>/dev/null & )
 fi
 
-# 1. Ensure v4l2loopback is loaded properly
-# We ask for specific labels so we can find them later
+# 1. Ensure v4l2loopback is loaded. The driver finds its devices by label
+# and creates missing ones itself (--loopback), so a loaded module is never
+# reloaded and other loopback users keep their devices.
 REQUIRED_LABELS="FLIR_Thermal,FLIR_Visible"
 
 if ! lsmod | grep -q v4l2loopback; then
     echo "Loading v4l2loopback module..."
-    # If IDs are set, use them. Otherwise let module pick.
-    VIDEO_NR_ARG=""
     if [ ! -z "$LOOPBACK_THERMAL_NR" ] && [ ! -z "$LOOPBACK_VISIBLE_NR" ]; then
-        VIDEO_NR_ARG="video_nr=$LOOPBACK_THERMAL_NR,$LOOPBACK_VISIBLE_NR"
-    fi
-    sudo modprobe v4l2loopback $VIDEO_NR_ARG card_label="$REQUIRED_LABELS" exclusive_caps=1,1 max_buffers=2
-else
-    # Check if labels exist in current module
-    if ! grep -q "FLIR_Thermal" /sys/class/video4linux/*/name 2>/dev/null; then
-        echo "Reloading v4l2loopback (missing correct labels)..."
-        sudo rmmod v4l2loopback 2>/dev/null || true
-        sudo modprobe v4l2loopback card_label="$REQUIRED_LABELS" exclusive_caps=1,1 max_buffers=2
+        sudo modprobe v4l2loopback video_nr="$LOOPBACK_THERMAL_NR,$LOOPBACK_VISIBLE_NR" card_label="$REQUIRED_LABELS" exclusive_caps=1,1 max_buffers=2
+    else
+        sudo modprobe v4l2loopback devices=0
     fi
 fi
 
-# 1.5 Auto-Discover Devices by Label
 find_device_by_label() {
     local label=$1
     for dev in /sys/class/video4linux/*; do
@@ -76,21 +68,6 @@ find_device_by_label() {
     return 1
 }
 
-DEV_THERMAL=$(find_device_by_label "FLIR_Thermal")
-DEV_VISIBLE=$(find_device_by_label "FLIR_Visible")
-
-if [ -z "$DEV_THERMAL" ] || [ -z "$DEV_VISIBLE" ]; then
-    echo "Error: Could not find FLIR loopback devices. Driver load failed?"
-    exit 1
-fi
-
-echo "Found Devices:"
-echo "  [Thermal] -> $DEV_THERMAL"
-echo "  [Visible] -> $DEV_VISIBLE"
-
-# Allow user access to video devices
-sudo chmod 666 $DEV_THERMAL $DEV_VISIBLE || true
-
 # 2. Build Driver if needed
 echo "Checking driver build..."
 cd "$DIR/driver"
@@ -112,17 +89,42 @@ trap cleanup EXIT
 
 # 4. Start C Driver
 echo "Starting C Driver..."
-# Pass device paths as arguments
-sudo "$DIR/driver/flirone" $DEV_THERMAL $DEV_VISIBLE &
+sudo "$DIR/driver/flirone" --loopback &
 DRIVER_PID=$!
 
-# Wait for driver to initialize
-sleep 2
+# Wait for the driver to have its devices. It opens them once the camera
+# is found, which it waits up to 5 s for, so give up after 10 s.
+DEVICE_TIMEOUT=10
+for i in $(seq $((DEVICE_TIMEOUT * 10))); do
+    DEV_THERMAL=$(find_device_by_label "FLIR_Thermal") || true
+    DEV_VISIBLE=$(find_device_by_label "FLIR_Visible") || true
+    if [ -n "$DEV_THERMAL" ] && [ -n "$DEV_VISIBLE" ]; then
+        break
+    fi
+    if ! kill -0 $DRIVER_PID 2>/dev/null; then
+        break
+    fi
+    if [ "$i" == 20 ]; then
+        echo "Waiting for the camera..."
+    fi
+    sleep 0.1
+done
 
 if ! kill -0 $DRIVER_PID 2>/dev/null; then
     echo "Error: Driver failed to start"
     exit 1
 fi
+if [ -z "$DEV_THERMAL" ] || [ -z "$DEV_VISIBLE" ]; then
+    echo "Error: No FLIR loopback devices after ${DEVICE_TIMEOUT} s (v4l2loopback 0.12.5 or later needed)"
+    exit 1
+fi
+
+echo "Found Devices:"
+echo "  [Thermal] -> $DEV_THERMAL"
+echo "  [Visible] -> $DEV_VISIBLE"
+
+# Allow user access to video devices
+sudo chmod 666 $DEV_THERMAL $DEV_VISIBLE || true
 
 # 5. Start Viewer (Optional)
 if [ "$1" == "web" ]; then